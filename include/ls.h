@@ -210,6 +210,11 @@ extern "C" {
  * @brief Timer specific definitions/functions
  */
 
+/**
+ * @defgroup offload Offload
+ * @brief Running blocking jobs in the offload thread pool
+ */
+
 /**
  * @enum LSI_CFG_LEVEL
  * @brief Conditions when a particular configuration entry is relevant in user
@@ -1307,6 +1312,7 @@ enum LSI_COMPRESS_METHOD
     LSI_NO_COMPRESS = 0,
     LSI_GZIP_COMPRESS,
     LSI_BR_COMPRESS,
+    LSI_ZSTD_COMPRESS,
 };
 
 
@@ -1603,6 +1609,24 @@ typedef int (*lsi_datarelease_pf)(void *);
  */
 typedef void (*lsi_timercb_pf)(const void *);
 
+/**
+ * @typedef lsi_offload_pf
+ * @brief The job function run in an offload thread, its return value is
+ * passed to the #lsi_offload_done_pf callback.
+ * @ingroup offload
+ * @since 1.2
+ */
+typedef int (*lsi_offload_pf)(void *param);
+
+/**
+ * @typedef lsi_offload_done_pf
+ * @brief The completion callback of an offloaded job, called from the
+ * event loop thread.
+ * @ingroup offload
+ * @since 1.2
+ */
+typedef void (*lsi_offload_done_pf)(void *param, int result);
+
 
 
 /**************************************************************************************************
@@ -3044,7 +3068,7 @@ struct lsi_api_s
      * @since 1.0
      *
      * @param[in] pSession - a pointer to the session.
-     * @return 0 no compress, 1 gzip, 2, br.
+     * @return 0 no compress, 1 gzip, 2, br, 3 zstd.
      */
     int (*get_resp_buffer_compress_method)(const lsi_session_t *pSession);
 
@@ -3057,7 +3081,7 @@ struct lsi_api_s
      * @param[in] pSession - a pointer to the session.
      * @param[in] compress_method - compress method;
      *               set 1 if gzip compressed, 2 if br compressed,
-     *               0 to clear the flag.
+     *               3 if zstd compressed, 0 to clear the flag.
      * @return 0 if success, -1 if failure.
      */
     int (*set_resp_buffer_compress_method)(const lsi_session_t *pSession, int method);
@@ -3977,6 +4001,39 @@ struct lsi_api_s
     void (*register_thread_cleanup)(const lsi_module_t *module,
                                     void (*routine)(void *), void * arg);
 
+    /**
+     * @brief offload_task runs a blocking or CPU heavy job, like compressing
+     * a large buffer or reading a file, in the server's offload thread pool
+     * instead of the event loop.
+     * @details perform is called in an offload thread and must not call
+     * any other LSIAPI function; on_done is called from the event loop with
+     * the value returned by perform. If no offload thread is configured or
+     * the job cannot be queued, both are called before this function returns.
+     * @ingroup offload
+     * @since 1.2
+     *
+     * @param[in] perform - the job function.
+     * @param[in] on_done - optional completion callback.
+     * @param[in] param - passed to both perform and on_done.
+     * @return a handle for cancel_offload_task, valid until on_done has
+     * been called; NULL if the job has been run inline.
+     */
+    void *(*offload_task)(lsi_offload_pf perform, lsi_offload_done_pf on_done,
+                          void *param);
+
+    /**
+     * @brief cancel_offload_task prevents on_done from being called for a
+     * job returned by offload_task, usually because the session is going
+     * away. perform may already be running, the data it uses must stay
+     * valid until it returns.
+     * @ingroup offload
+     * @since 1.2
+     *
+     * @param[in] handle - the handle returned by offload_task.
+     * @return -1 on error; 0 on success.
+     */
+    int (*cancel_offload_task)(void *handle);
+
 };
 
 /**
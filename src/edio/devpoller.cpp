@@ -100,6 +100,7 @@ int DevPoller::waitAndProcessEvents(int iTimeoutMilliSec)
     dvp.dp_nfds    = MAX_EVENTS;
     dvp.dp_timeout = iTimeoutMilliSec;
     int ret = ioctl(m_fdDP, DP_POLL, &dvp);
+    setReadyEvents(ret > 0 ? ret : 0);
     if (ret > 0)
     {
         struct pollfd *pBegin = m_events;
@@ -215,6 +215,7 @@ int epoll::waitAndProcessEvents(int iTimeoutMilliSec)
     applyEvents();
     int ret = epoll_wait(m_epfd, m_pResults, EPOLL_RESULT_MAX,
                          iTimeoutMilliSec);
+    setReadyEvents(ret > 0 ? ret : 0);
     if (ret <= 0)
         return ret;
     if (ret == 1)
@@ -27,6 +27,9 @@
 #define ERF_UPDATE  1
 #define ERF_ADD     2
 #define ERF_REMOVE  4
+#define ERF_RECV_COMPLETION 8
+//timeouts driven by the multiplexer timing wheel, skipped by the fd scan
+#define ERF_TIMER_WHEEL     16
 
 class Multiplexer;
 
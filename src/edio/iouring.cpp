@@ -0,0 +1,975 @@
+/*****************************************************************************
+*    Open LiteSpeed is an open source HTTP server.                           *
+*    Copyright (C) 2013 - 2020  LiteSpeed Technologies, Inc.                 *
+*                                                                            *
+*    This program is free software: you can redistribute it and/or modify    *
+*    it under the terms of the GNU General Public License as published by    *
+*    the Free Software Foundation, either version 3 of the License, or       *
+*    (at your option) any later version.                                     *
+*                                                                            *
+*    This program is distributed in the hope that it will be useful,         *
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            *
+*    GNU General Public License for more details.                            *
+*                                                                            *
+*    You should have received a copy of the GNU General Public License       *
+*    along with this program. If not, see http://www.gnu.org/licenses/.      *
+*****************************************************************************/
+
+#include "iouring.h"
+
+#ifdef LS_HAS_IO_URING
+
+#include <util/objarray.h>
+
+#include <assert.h>
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+
+#define IOURING_MAX_ENTRIES     1024
+#define IOURING_MIN_ENTRIES     64
+#define IOURING_RESULT_MAX      64
+#define IOURING_UD_IGNORE       0xffffffffULL
+#define IOURING_UD_RECV         (1ULL << 63)
+#define IOURING_BGID            0
+#define IOURING_MAX_RECV_BUFS   32768
+#define IOURING_MAX_RECV_BUF_SIZE   65535
+
+//provided buffer rings arrived together with IORING_RECVSEND_POLL_FIRST.
+#ifdef IORING_RECVSEND_POLL_FIRST
+#define LS_IOURING_PBUF
+#endif
+
+enum
+{
+    FDS_RECV_ARMED  = 1,
+    FDS_RECV_DATA   = 2,
+    FDS_NO_RECV     = 4,
+    FDS_LISTED      = 8,
+    FDS_IN_BATCH    = 16,
+};
+
+
+int IoUring::s_iRecvBufCount = 256;
+int IoUring::s_iRecvBufSize = 16384;
+
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+
+static int sys_io_uring_enter(int fd, unsigned to_submit,
+                              unsigned min_complete, unsigned flags,
+                              const void *arg, size_t argsz)
+{
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                   arg, argsz);
+}
+
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg,
+                                 unsigned nr_args)
+{
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+
+static inline uint64_t makeUserData(int fd, uint32_t seq)
+{   return ((uint64_t)(seq & 0x7fffffff) << 32) | (uint32_t)fd;    }
+
+
+static inline uint32_t getSeq(uint64_t user_data)
+{   return (uint32_t)(user_data >> 32) & 0x7fffffff;   }
+
+
+#ifdef LS_IOURING_PBUF
+//do not use io_uring_buf_ring::bufs, the flexible array member is shifted
+//by the empty placeholder struct when the header is compiled as C++.
+static inline struct io_uring_buf *getRingBuf(struct io_uring_buf_ring *pRing,
+                                              unsigned idx)
+{   return (struct io_uring_buf *)pRing + idx;  }
+#endif
+
+
+static inline unsigned pollMask(short mask)
+{
+    unsigned m = (unsigned short)mask;
+#if __BYTE_ORDER == __BIG_ENDIAN
+    m = (m << 16) | (m >> 16);
+#endif
+    return m;
+}
+
+
+IoUring::IoUring()
+    : m_fdRing(-1)
+    , m_iFeatures(0)
+    , m_pSqHead(NULL)
+    , m_pSqTail(NULL)
+    , m_iSqMask(0)
+    , m_iSqEntries(0)
+    , m_iSqLocalTail(0)
+    , m_iSqSubmitted(0)
+    , m_pSqes(NULL)
+    , m_pCqHead(NULL)
+    , m_pCqTail(NULL)
+    , m_iCqMask(0)
+    , m_pCqes(NULL)
+    , m_pSqRing(NULL)
+    , m_iSqRingSize(0)
+    , m_pCqRing(NULL)
+    , m_iCqRingSize(0)
+    , m_iSqesSize(0)
+    , m_pBufRing(NULL)
+    , m_pRecvBufs(NULL)
+    , m_iBufRingSize(0)
+    , m_iRecvBufsSize(0)
+    , m_iBufRingTail(0)
+    , m_pFdStates(NULL)
+    , m_iFdStateCap(0)
+    , m_pResults(NULL)
+{
+    setFLTag(O_NONBLOCK | O_RDWR);
+    m_pUpdates = new TObjArray<int>();
+    m_pUpdates->setCapacity(100);
+    m_pPendingReads = new TObjArray<int>();
+    m_pPendingReads->setCapacity(16);
+}
+
+
+IoUring::~IoUring()
+{
+    releaseRing();
+    if (m_pFdStates)
+        free(m_pFdStates);
+    if (m_pResults)
+        free(m_pResults);
+    if (m_pUpdates)
+        delete m_pUpdates;
+    if (m_pPendingReads)
+        delete m_pPendingReads;
+}
+
+
+void IoUring::releaseRing()
+{
+    releaseBufRing();
+    if (m_pSqes)
+        munmap(m_pSqes, m_iSqesSize);
+    if (m_pCqRing && m_pCqRing != m_pSqRing)
+        munmap(m_pCqRing, m_iCqRingSize);
+    if (m_pSqRing)
+        munmap(m_pSqRing, m_iSqRingSize);
+    if (m_fdRing != -1)
+        close(m_fdRing);
+    m_pSqes = NULL;
+    m_pSqRing = NULL;
+    m_pCqRing = NULL;
+    m_fdRing = -1;
+}
+
+
+int IoUring::setupRing(int entries)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    m_fdRing = sys_io_uring_setup(entries, &params);
+    if (m_fdRing == -1)
+        return LS_FAIL;
+    ::fcntl(m_fdRing, F_SETFD, FD_CLOEXEC);
+    m_iFeatures = params.features;
+
+    m_iSqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_iCqRingSize = params.cq_off.cqes
+                    + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (m_iFeatures & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (m_iCqRingSize > m_iSqRingSize)
+            m_iSqRingSize = m_iCqRingSize;
+        m_iCqRingSize = m_iSqRingSize;
+    }
+    m_pSqRing = mmap(NULL, m_iSqRingSize, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, m_fdRing, IORING_OFF_SQ_RING);
+    if (m_pSqRing == MAP_FAILED)
+    {
+        m_pSqRing = NULL;
+        return LS_FAIL;
+    }
+    if (m_iFeatures & IORING_FEAT_SINGLE_MMAP)
+        m_pCqRing = m_pSqRing;
+    else
+    {
+        m_pCqRing = mmap(NULL, m_iCqRingSize, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, m_fdRing,
+                         IORING_OFF_CQ_RING);
+        if (m_pCqRing == MAP_FAILED)
+        {
+            m_pCqRing = NULL;
+            return LS_FAIL;
+        }
+    }
+    m_iSqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    m_pSqes = (struct io_uring_sqe *)mmap(NULL, m_iSqesSize,
+                                          PROT_READ | PROT_WRITE,
+                                          MAP_SHARED | MAP_POPULATE,
+                                          m_fdRing, IORING_OFF_SQES);
+    if (m_pSqes == MAP_FAILED)
+    {
+        m_pSqes = NULL;
+        return LS_FAIL;
+    }
+
+    char *pSq = (char *)m_pSqRing;
+    m_pSqHead = (unsigned *)(pSq + params.sq_off.head);
+    m_pSqTail = (unsigned *)(pSq + params.sq_off.tail);
+    m_iSqMask = *(unsigned *)(pSq + params.sq_off.ring_mask);
+    m_iSqEntries = params.sq_entries;
+    m_iSqLocalTail = m_iSqSubmitted = *m_pSqTail;
+    //SQE index i always lives in slot i, fill the indirection array once.
+    unsigned *pArray = (unsigned *)(pSq + params.sq_off.array);
+    for (unsigned i = 0; i < m_iSqEntries; ++i)
+        pArray[i] = i;
+
+    char *pCq = (char *)m_pCqRing;
+    m_pCqHead = (unsigned *)(pCq + params.cq_off.head);
+    m_pCqTail = (unsigned *)(pCq + params.cq_off.tail);
+    m_iCqMask = *(unsigned *)(pCq + params.cq_off.ring_mask);
+    m_pCqes = (struct io_uring_cqe *)(pCq + params.cq_off.cqes);
+    return LS_OK;
+}
+
+
+int IoUring::probeOpcodes()
+{
+    static const int s_required[] =
+    {   IORING_OP_POLL_ADD, IORING_OP_POLL_REMOVE   };
+
+    if (!(m_iFeatures & IORING_FEAT_EXT_ARG)
+        || !(m_iFeatures & IORING_FEAT_NODROP))
+        return LS_FAIL;
+
+    size_t size = sizeof(struct io_uring_probe)
+                  + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *pProbe = (struct io_uring_probe *)malloc(size);
+    if (!pProbe)
+        return LS_FAIL;
+    memset(pProbe, 0, size);
+    int ret = sys_io_uring_register(m_fdRing, IORING_REGISTER_PROBE, pProbe,
+                                    256);
+    if (ret == 0)
+    {
+        for (size_t i = 0; i < sizeof(s_required) / sizeof(int); ++i)
+        {
+            int op = s_required[i];
+            if (op > pProbe->last_op
+                || !(pProbe->ops[op].flags & IO_URING_OP_SUPPORTED))
+            {
+                ret = LS_FAIL;
+                break;
+            }
+        }
+    }
+    free(pProbe);
+    return ret ? LS_FAIL : LS_OK;
+}
+
+
+int IoUring::setupBufRing()
+{
+#ifdef LS_IOURING_PBUF
+    int count = s_iRecvBufCount;
+    int size = s_iRecvBufSize;
+    if (count <= 0 || size <= 0)
+        return LS_FAIL;
+    if (count > IOURING_MAX_RECV_BUFS)
+        count = IOURING_MAX_RECV_BUFS;
+    if (size > IOURING_MAX_RECV_BUF_SIZE)
+        size = IOURING_MAX_RECV_BUF_SIZE;
+    while (count & (count - 1))
+        count &= count - 1;
+    s_iRecvBufSize = size;
+
+    m_iBufRingSize = count * sizeof(struct io_uring_buf);
+    m_pBufRing = (struct io_uring_buf_ring *)mmap(NULL, m_iBufRingSize,
+                 PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (m_pBufRing == MAP_FAILED)
+    {
+        m_pBufRing = NULL;
+        return LS_FAIL;
+    }
+    m_iRecvBufsSize = (size_t)count * size;
+    m_pRecvBufs = (char *)mmap(NULL, m_iRecvBufsSize, PROT_READ | PROT_WRITE,
+                               MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (m_pRecvBufs == MAP_FAILED)
+    {
+        m_pRecvBufs = NULL;
+        releaseBufRing();
+        return LS_FAIL;
+    }
+
+    memset(m_pBufRing, 0, m_iBufRingSize);
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)m_pBufRing;
+    reg.ring_entries = count;
+    reg.bgid = IOURING_BGID;
+    if (sys_io_uring_register(m_fdRing, IORING_REGISTER_PBUF_RING, &reg, 1)
+        != 0)
+    {
+        releaseBufRing();
+        return LS_FAIL;
+    }
+    m_iBufRingTail = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        struct io_uring_buf *pBuf = getRingBuf(m_pBufRing, i);
+        pBuf->addr = (uint64_t)(uintptr_t)(m_pRecvBufs + (size_t)i * size);
+        pBuf->len = size;
+        pBuf->bid = i;
+    }
+    m_iBufRingTail = count;
+    __atomic_store_n(&m_pBufRing->tail, m_iBufRingTail, __ATOMIC_RELEASE);
+    return LS_OK;
+#else
+    return LS_FAIL;
+#endif
+}
+
+
+void IoUring::releaseBufRing()
+{
+#ifdef LS_IOURING_PBUF
+    if (m_pBufRing && m_fdRing != -1)
+    {
+        struct io_uring_buf_reg reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.bgid = IOURING_BGID;
+        sys_io_uring_register(m_fdRing, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    }
+#endif
+    if (m_pRecvBufs)
+        munmap(m_pRecvBufs, m_iRecvBufsSize);
+    if (m_pBufRing)
+        munmap(m_pBufRing, m_iBufRingSize);
+    m_pRecvBufs = NULL;
+    m_pBufRing = NULL;
+}
+
+
+void IoUring::recycleBuf(uint16_t bid)
+{
+#ifdef LS_IOURING_PBUF
+    unsigned mask = m_iBufRingSize / sizeof(struct io_uring_buf) - 1;
+    struct io_uring_buf *pBuf = getRingBuf(m_pBufRing,
+                                            m_iBufRingTail & mask);
+    pBuf->addr = (uint64_t)(uintptr_t)(m_pRecvBufs
+                                       + (size_t)bid * s_iRecvBufSize);
+    pBuf->len = s_iRecvBufSize;
+    pBuf->bid = bid;
+    ++m_iBufRingTail;
+    __atomic_store_n(&m_pBufRing->tail, m_iBufRingTail, __ATOMIC_RELEASE);
+#endif
+}
+
+
+int IoUring::isSupported()
+{
+    static int s_iSupported = -1;
+    if (s_iSupported == -1)
+    {
+        IoUring probe;
+        s_iSupported = (probe.setupRing(8) == LS_OK
+                        && probe.probeOpcodes() == LS_OK);
+    }
+    return s_iSupported;
+}
+
+
+int IoUring::init(int capacity)
+{
+    if (m_reactorIndex.allocate(capacity) == -1)
+        return LS_FAIL;
+    if (!m_pResults)
+    {
+        m_pResults = (struct io_uring_cqe *)malloc(
+                         sizeof(struct io_uring_cqe) * IOURING_RESULT_MAX);
+        if (!m_pResults)
+            return LS_FAIL;
+    }
+    releaseRing();
+    int entries = capacity;
+    if (entries > IOURING_MAX_ENTRIES)
+        entries = IOURING_MAX_ENTRIES;
+    else if (entries < IOURING_MIN_ENTRIES)
+        entries = IOURING_MIN_ENTRIES;
+    if (setupRing(entries) == LS_FAIL || probeOpcodes() == LS_FAIL)
+    {
+        int err = errno;
+        releaseRing();
+        errno = err ? err : ENOSYS;
+        return LS_FAIL;
+    }
+    //without a provided buffer ring every fd simply stays in poll mode.
+    setupBufRing();
+    return LS_OK;
+}
+
+
+IoUring::FdState *IoUring::getFdState(int fd)
+{
+    if ((unsigned)fd >= m_iFdStateCap)
+    {
+        if ((unsigned)fd > MAX_FDINDEX)
+            return NULL;
+        unsigned int newCap = m_iFdStateCap ? m_iFdStateCap * 2 : 1024;
+        if (newCap <= (unsigned)fd)
+            newCap = fd + 1;
+        FdState *pNew = (FdState *)realloc(m_pFdStates,
+                                           newCap * sizeof(FdState));
+        if (!pNew)
+            return NULL;
+        memset(pNew + m_iFdStateCap, 0,
+               (newCap - m_iFdStateCap) * sizeof(FdState));
+        m_pFdStates = pNew;
+        m_iFdStateCap = newCap;
+    }
+    return m_pFdStates + fd;
+}
+
+
+struct io_uring_sqe *IoUring::getSqe()
+{
+    unsigned head = __atomic_load_n(m_pSqHead, __ATOMIC_ACQUIRE);
+    if (m_iSqLocalTail - head >= m_iSqEntries)
+    {
+        submit(0, 0);
+        head = __atomic_load_n(m_pSqHead, __ATOMIC_ACQUIRE);
+        if (m_iSqLocalTail - head >= m_iSqEntries)
+            return NULL;
+    }
+    struct io_uring_sqe *pSqe = &m_pSqes[m_iSqLocalTail & m_iSqMask];
+    ++m_iSqLocalTail;
+    memset(pSqe, 0, sizeof(*pSqe));
+    return pSqe;
+}
+
+
+int IoUring::submit(int wait_nr, int iTimeoutMilliSec)
+{
+    unsigned toSubmit = m_iSqLocalTail - m_iSqSubmitted;
+    if (toSubmit)
+        __atomic_store_n(m_pSqTail, m_iSqLocalTail, __ATOMIC_RELEASE);
+    if (!toSubmit && !wait_nr)
+        return 0;
+
+    unsigned flags = 0;
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    const void *pArg = NULL;
+    size_t argSize = 0;
+    if (wait_nr)
+    {
+        flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        memset(&arg, 0, sizeof(arg));
+        if (iTimeoutMilliSec >= 0)
+        {
+            ts.tv_sec = iTimeoutMilliSec / 1000;
+            ts.tv_nsec = (iTimeoutMilliSec % 1000) * 1000000;
+            arg.ts = (uint64_t)(uintptr_t)&ts;
+        }
+        pArg = &arg;
+        argSize = sizeof(arg);
+    }
+    int ret = sys_io_uring_enter(m_fdRing, toSubmit, wait_nr, flags,
+                                 pArg, argSize);
+    if (ret >= 0)
+        m_iSqSubmitted += ret;
+    else if (errno == ETIME)
+    {
+        //timed out waiting, but everything queued has been consumed.
+        m_iSqSubmitted = m_iSqLocalTail;
+        ret = 0;
+    }
+    return ret;
+}
+
+
+int IoUring::armPoll(int fd, FdState *pState, short mask)
+{
+    struct io_uring_sqe *pSqe = getSqe();
+    if (!pSqe)
+        return LS_FAIL;
+    pSqe->opcode = IORING_OP_POLL_ADD;
+    pSqe->fd = fd;
+    pSqe->poll32_events = pollMask(mask | POLLHUP | POLLERR);
+    pSqe->user_data = makeUserData(fd, pState->m_seq);
+    pState->m_armed = (uint16_t)mask | 0x8000;
+    return LS_OK;
+}
+
+
+int IoUring::cancelPoll(int fd, FdState *pState)
+{
+    if (!pState->m_armed)
+        return LS_OK;
+    struct io_uring_sqe *pSqe = getSqe();
+    if (!pSqe)
+        return LS_FAIL;
+    pSqe->opcode = IORING_OP_POLL_REMOVE;
+    pSqe->fd = -1;
+    pSqe->addr = makeUserData(fd, pState->m_seq);
+    pSqe->user_data = IOURING_UD_IGNORE;
+    //completions still in flight for the canceled poll become stale.
+    ++pState->m_seq;
+    pState->m_armed = 0;
+    return LS_OK;
+}
+
+
+int IoUring::armRecv(int fd, FdState *pState)
+{
+    struct io_uring_sqe *pSqe = getSqe();
+    if (!pSqe)
+        return LS_FAIL;
+    pSqe->opcode = IORING_OP_RECV;
+    pSqe->fd = fd;
+    pSqe->len = s_iRecvBufSize;
+    pSqe->flags = IOSQE_BUFFER_SELECT;
+    pSqe->buf_group = IOURING_BGID;
+#ifdef LS_IOURING_PBUF
+    //re-armed right after the previous request was drained, the socket is
+    //most likely empty, skip the speculative read attempt.
+    pSqe->ioprio = IORING_RECVSEND_POLL_FIRST;
+#endif
+    pSqe->user_data = makeUserData(fd, pState->m_iRecvGen) | IOURING_UD_RECV;
+    pState->m_flags |= FDS_RECV_ARMED;
+    return LS_OK;
+}
+
+
+int IoUring::cancelRecv(int fd, FdState *pState)
+{
+    if (!(pState->m_flags & FDS_RECV_ARMED))
+        return LS_OK;
+    struct io_uring_sqe *pSqe = getSqe();
+    if (!pSqe)
+        return LS_FAIL;
+    pSqe->opcode = IORING_OP_ASYNC_CANCEL;
+    pSqe->fd = -1;
+    pSqe->addr = makeUserData(fd, pState->m_iRecvGen) | IOURING_UD_RECV;
+    pSqe->user_data = IOURING_UD_IGNORE;
+    ++pState->m_iRecvGen;
+    pState->m_flags &= ~FDS_RECV_ARMED;
+    return LS_OK;
+}
+
+
+void IoUring::resetRecv(FdState *pState)
+{
+    if ((pState->m_flags & FDS_RECV_DATA) && pState->m_iRecvRes > 0)
+        recycleBuf(pState->m_iRecvBid);
+    pState->m_flags &= ~(FDS_RECV_DATA | FDS_NO_RECV);
+    pState->m_iRecvRes = 0;
+    pState->m_iRecvOff = 0;
+}
+
+
+int IoUring::add(EventReactor *pHandler, short mask)
+{
+    int fd = pHandler->getfd();
+    if (fd == -1)
+        return LS_FAIL;
+    if (fd > 10000000)
+        return LS_FAIL;
+    FdState *pState = getFdState(fd);
+    if (!pState || m_reactorIndex.set(fd, pHandler) == LS_FAIL)
+        return LS_FAIL;
+    cancelPoll(fd, pState);
+    cancelRecv(fd, pState);
+    resetRecv(pState);
+    pState->m_flags &= ~FDS_IN_BATCH;
+    ++pState->m_seq;
+    pHandler->setPollfd();
+    pHandler->setMask2(mask);
+    pHandler->clearRevent();
+    //armed together with everything else right before the next wait.
+    appendEvent(fd);
+    return LS_OK;
+}
+
+
+int IoUring::remove(EventReactor *pHandler)
+{
+    int fd = pHandler->getfd();
+    if (fd == -1)
+        return LS_OK;
+    if (fd <= (int)m_reactorIndex.getUsed())
+    {
+        pHandler->clearRevent();
+        pHandler->updateEventSet();
+        m_reactorIndex.set(fd, NULL);
+    }
+    if ((unsigned)fd >= m_iFdStateCap)
+        return LS_OK;
+    FdState *pState = m_pFdStates + fd;
+    resetRecv(pState);
+    pState->m_flags &= ~FDS_IN_BATCH;
+    if (!pState->m_armed && !(pState->m_flags & FDS_RECV_ARMED))
+        return LS_OK;
+    cancelPoll(fd, pState);
+    cancelRecv(fd, pState);
+    //an armed request holds a reference to the file, push the cancel out
+    //now so a following close() of the socket takes effect right away.
+    return (submit(0, 0) >= 0) ? LS_OK : LS_FAIL;
+}
+
+
+int IoUring::updateEvents(EventReactor *pHandler, short mask)
+{
+    int fd = pHandler->getfd();
+    if (fd == -1)
+        return LS_OK;
+    assert(pHandler == m_reactorIndex.get(fd));
+    pHandler->setMask2(mask);
+    appendEvent(fd);
+    return LS_OK;
+}
+
+
+void IoUring::appendEvent(int fd)
+{
+    if (m_reactorIndex.getUpdateFlags(fd) & ERF_UPDATE)
+        return;
+    m_reactorIndex.setUpdateFlags(fd, ERF_UPDATE);
+    if (m_pUpdates->size() >= m_pUpdates->capacity())
+        m_pUpdates->guarantee(m_pUpdates->capacity() << 1);
+    int *p = m_pUpdates->getNew();
+    *p = fd;
+}
+
+
+void IoUring::applyEvents()
+{
+    int *p = m_pUpdates->begin();
+    int *pEnd = m_pUpdates->end();
+    while (p < pEnd)
+    {
+        int fd = *p++;
+        m_reactorIndex.setUpdateFlags(fd, 0);
+        EventReactor *pReactor = m_reactorIndex.get(fd);
+        if (!pReactor || (unsigned)fd >= m_iFdStateCap)
+            continue;
+        FdState *pState = m_pFdStates + fd;
+        short mask = pReactor->getEvents();
+        int needPoll = 1;
+        if (m_pBufRing && (pReactor->getEvtFlag() & ERF_RECV_COMPLETION)
+            && !(pState->m_flags & FDS_NO_RECV))
+        {
+            if (mask & POLLIN)
+            {
+                if (pState->m_flags & FDS_RECV_DATA)
+                {
+                    if (!(pState->m_flags & FDS_LISTED))
+                    {
+                        pState->m_flags |= FDS_LISTED;
+                        *(m_pPendingReads->getNew()) = fd;
+                    }
+                }
+                else if (!(pState->m_flags & FDS_RECV_ARMED))
+                    armRecv(fd, pState);
+            }
+            mask &= ~POLLIN;
+            //an armed recv reports EOF and errors, poll is for POLLOUT only.
+            if ((pState->m_flags & FDS_RECV_ARMED)
+                && !(mask & ~(POLLHUP | POLLERR)))
+                needPoll = 0;
+        }
+        if (pState->m_armed)
+        {
+            if (needPoll && (short)(pState->m_armed & 0x7fff) == mask)
+            {
+                pReactor->updateEventSet();
+                continue;
+            }
+            cancelPoll(fd, pState);
+        }
+        if (!needPoll || armPoll(fd, pState, mask) == LS_OK)
+            pReactor->updateEventSet();
+    }
+    m_pUpdates->clear();
+}
+
+
+int IoUring::waitAndProcessEvents(int iTimeoutMilliSec)
+{
+    applyEvents();
+    if (m_pPendingReads->size() > 0)
+        iTimeoutMilliSec = 0;
+    unsigned head = *m_pCqHead;
+    if (head == __atomic_load_n(m_pCqTail, __ATOMIC_ACQUIRE)
+        && iTimeoutMilliSec != 0)
+    {
+        if (submit(1, iTimeoutMilliSec) < 0)
+            return LS_FAIL;
+    }
+    else if (submit(0, 0) < 0)
+        return LS_FAIL;
+
+    unsigned tail = __atomic_load_n(m_pCqTail, __ATOMIC_ACQUIRE);
+    int count = 0;
+    while (head != tail && count < IOURING_RESULT_MAX)
+        m_pResults[count++] = m_pCqes[head++ & m_iCqMask];
+    __atomic_store_n(m_pCqHead, head, __ATOMIC_RELEASE);
+    setReadyEvents(count);
+    int n = 0;
+    if (count > 0)
+        n = processEvents(count);
+    if (m_pPendingReads->size() > 0)
+        n += processPendingReads();
+    return n;
+}
+
+
+int IoUring::completeRecv(int fd, FdState *pState, struct io_uring_cqe *pCqe)
+{
+    int hasBuf = pCqe->flags & IORING_CQE_F_BUFFER;
+    uint16_t bid = pCqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    if (getSeq(pCqe->user_data) != (pState->m_iRecvGen & 0x7fffffff)
+        || !(pState->m_flags & FDS_RECV_ARMED))
+    {
+        if (hasBuf)
+            recycleBuf(bid);
+        return 0;
+    }
+    pState->m_flags &= ~FDS_RECV_ARMED;
+    EventReactor *pReactor = m_reactorIndex.get(fd);
+    if (!pReactor)
+    {
+        if (hasBuf)
+            recycleBuf(bid);
+        return 0;
+    }
+    if (pCqe->res == -ENOBUFS || pCqe->res == -ECANCELED)
+    {
+        //ran out of provided buffers, poll for readiness until the next
+        //event and let the reactor read into its own buffer.
+        if (pCqe->res == -ENOBUFS)
+            pState->m_flags |= FDS_NO_RECV;
+        appendEvent(fd);
+        return 0;
+    }
+    pState->m_flags |= FDS_RECV_DATA;
+    pState->m_iRecvRes = pCqe->res;
+    pState->m_iRecvOff = 0;
+    pState->m_iRecvBid = bid;
+    if (pCqe->res > 0 && !hasBuf)
+        pState->m_iRecvRes = -EIO;
+    appendEvent(fd);
+    return (pReactor->getEvents() & POLLIN) ? POLLIN : 0;
+}
+
+
+int IoUring::processEvents(int count)
+{
+    struct io_uring_cqe *p = m_pResults;
+    struct io_uring_cqe *pEnd = m_pResults + count;
+    int n = 0;
+
+    for (; p < pEnd; ++p)
+    {
+        int fd = (int)(p->user_data & 0xffffffff);
+        if (fd == -1 || (unsigned)fd >= m_iFdStateCap)
+        {
+            p->user_data = IOURING_UD_IGNORE;
+            continue;
+        }
+        FdState *pState = m_pFdStates + fd;
+        EventReactor *pReactor;
+        short event;
+        if (p->user_data & IOURING_UD_RECV)
+        {
+            event = completeRecv(fd, pState, p);
+            pReactor = m_reactorIndex.get(fd);
+        }
+        else
+        {
+            if (getSeq(p->user_data) != (pState->m_seq & 0x7fffffff)
+                || !pState->m_armed)
+                continue;
+            //one-shot poll has fired, it is re-armed by applyEvents().
+            pState->m_armed = 0;
+            pState->m_flags &= ~FDS_NO_RECV;
+            pReactor = m_reactorIndex.get(fd);
+            if (!pReactor)
+                continue;
+            appendEvent(fd);
+            event = (p->res > 0) ? (short)p->res : 0;
+        }
+        if (!event || !pReactor || pReactor->getfd() != fd)
+            continue;
+        //a poll and a recv completion of the same fd are merged into
+        //one handleEvents() call, the same as a single epoll event.
+        if (pState->m_flags & FDS_IN_BATCH)
+            event |= pReactor->getAssignedRevent();
+        pState->m_flags |= FDS_IN_BATCH;
+        pReactor->assignRevent(event);
+    }
+
+    for (p = m_pResults; p < pEnd; ++p)
+    {
+        int fd = (int)(p->user_data & 0xffffffff);
+        if (fd == -1 || (unsigned)fd >= m_iFdStateCap
+            || !(m_pFdStates[fd].m_flags & FDS_IN_BATCH))
+            continue;
+        m_pFdStates[fd].m_flags &= ~FDS_IN_BATCH;
+        EventReactor *pReactor = m_reactorIndex.get(fd);
+        short event;
+        if (pReactor && (event = pReactor->getAssignedRevent()) != 0)
+        {
+            if (event & POLLHUP)
+                pReactor->incHupCounter();
+            pReactor->handleEvents(event);
+            ++n;
+        }
+    }
+    applyEvents();
+    return n;
+}
+
+
+int IoUring::processPendingReads()
+{
+    int n = 0;
+    int *p = m_pPendingReads->begin();
+    int *pEnd = m_pPendingReads->end();
+    for (; p < pEnd; ++p)
+    {
+        int fd = *p;
+        FdState *pState = m_pFdStates + fd;
+        pState->m_flags &= ~FDS_LISTED;
+        EventReactor *pReactor = m_reactorIndex.get(fd);
+        if (!pReactor || !(pState->m_flags & FDS_RECV_DATA)
+            || !(pReactor->getEvents() & POLLIN))
+            continue;
+        pReactor->assignRevent(POLLIN);
+        pReactor->handleEvents(POLLIN);
+        appendEvent(fd);
+        ++n;
+    }
+    m_pPendingReads->clear();
+    applyEvents();
+    return n;
+}
+
+
+bool IoUring::ownsRead(const EventReactor *pHandler) const
+{
+    int fd = pHandler->getfd();
+    if ((unsigned)fd >= m_iFdStateCap)
+        return false;
+    return (m_pFdStates[fd].m_flags & (FDS_RECV_ARMED | FDS_RECV_DATA)) != 0;
+}
+
+
+int IoUring::readCompleted(EventReactor *pHandler, char *pBuf, int size)
+{
+    int fd = pHandler->getfd();
+    if ((unsigned)fd >= m_iFdStateCap
+        || !(m_pFdStates[fd].m_flags & FDS_RECV_DATA))
+    {
+        errno = EAGAIN;
+        return LS_FAIL;
+    }
+    FdState *pState = m_pFdStates + fd;
+    int res = pState->m_iRecvRes;
+    if (res <= 0)
+    {
+        pState->m_flags &= ~FDS_RECV_DATA;
+        appendEvent(fd);
+        if (res == 0)
+            return 0;
+        errno = -res;
+        return LS_FAIL;
+    }
+    int len = res - pState->m_iRecvOff;
+    if (len > size)
+        len = size;
+    memmove(pBuf, m_pRecvBufs + (size_t)pState->m_iRecvBid * s_iRecvBufSize
+            + pState->m_iRecvOff, len);
+    pState->m_iRecvOff += len;
+    if (pState->m_iRecvOff >= res)
+    {
+        recycleBuf(pState->m_iRecvBid);
+        pState->m_flags &= ~FDS_RECV_DATA;
+        appendEvent(fd);
+    }
+    return len;
+}
+
+
+void IoUring::timerExecute()
+{
+    m_reactorIndex.timerExec();
+}
+
+
+void IoUring::continueRead(EventReactor *pHandler)
+{
+    if (!(pHandler->getEvents() & POLLIN))
+        addEvent(pHandler, POLLIN);
+}
+
+
+void IoUring::suspendRead(EventReactor *pHandler)
+{
+    if (pHandler->getEvents() & POLLIN)
+        removeEvent(pHandler, POLLIN);
+}
+
+
+void IoUring::continueWrite(EventReactor *pHandler)
+{
+    if (!(pHandler->getEvents() & POLLOUT))
+        addEvent(pHandler, POLLOUT);
+}
+
+
+void IoUring::suspendWrite(EventReactor *pHandler)
+{
+    if (pHandler->getEvents() & POLLOUT)
+        removeEvent(pHandler, POLLOUT);
+}
+
+
+void IoUring::switchWriteToRead(EventReactor *pHandler)
+{
+    setEvents(pHandler, POLLIN | POLLHUP | POLLERR);
+}
+
+
+void IoUring::switchReadToWrite(EventReactor *pHandler)
+{
+    setEvents(pHandler, POLLOUT | POLLHUP | POLLERR);
+}
+
+
+void IoUring::modEvent(EventReactor *pHandler, short mask, int add_remove)
+{
+    if (add_remove)
+        addEvent(pHandler, mask);
+    else
+        removeEvent(pHandler, mask);
+}
+
+#endif
@@ -0,0 +1,186 @@
+/*****************************************************************************
+*    Open LiteSpeed is an open source HTTP server.                           *
+*    Copyright (C) 2013 - 2020  LiteSpeed Technologies, Inc.                 *
+*                                                                            *
+*    This program is free software: you can redistribute it and/or modify    *
+*    it under the terms of the GNU General Public License as published by    *
+*    the Free Software Foundation, either version 3 of the License, or       *
+*    (at your option) any later version.                                     *
+*                                                                            *
+*    This program is distributed in the hope that it will be useful,         *
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            *
+*    GNU General Public License for more details.                            *
+*                                                                            *
+*    You should have received a copy of the GNU General Public License       *
+*    along with this program. If not, see http://www.gnu.org/licenses/.      *
+*****************************************************************************/
+#ifndef IOURING_H
+#define IOURING_H
+
+#if defined(linux) || defined(__linux) || defined(__linux__) || defined(__gnu_linux__)
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define LS_HAS_IO_URING
+#endif
+#endif
+
+#endif
+
+#ifdef LS_HAS_IO_URING
+
+#include <edio/multiplexer.h>
+#include <edio/reactorindex.h>
+
+#include <stdint.h>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+template< typename T >
+class TObjArray;
+
+
+/**
+ * Readiness multiplexer on top of io_uring.
+ *
+ * Each registered fd carries one one-shot IORING_OP_POLL_ADD. Arming,
+ * re-arming after an event and mask changes are queued as SQEs and
+ * submitted together with the wait, so an event loop iteration costs a
+ * single io_uring_enter() no matter how many fds changed state.
+ *
+ * Reactors flagged with ERF_RECV_COMPLETION are read in completion mode
+ * instead: an IORING_OP_RECV picks a buffer from the per-process provided
+ * buffer ring when data arrives, the reactor gets POLLIN and drains it with
+ * readCompleted(). An idle connection holds no buffer at all.
+ */
+class IoUring : public Multiplexer
+{
+public:
+    typedef struct
+    {
+        uint32_t    m_seq;
+        uint16_t    m_armed;
+        uint16_t    m_flags;
+        int32_t     m_iRecvRes;
+        uint16_t    m_iRecvBid;
+        uint16_t    m_iRecvOff;
+        uint32_t    m_iRecvGen;
+    } FdState;
+
+private:
+    int                 m_fdRing;
+    unsigned int        m_iFeatures;
+
+    unsigned int       *m_pSqHead;
+    unsigned int       *m_pSqTail;
+    unsigned int        m_iSqMask;
+    unsigned int        m_iSqEntries;
+    unsigned int        m_iSqLocalTail;
+    unsigned int        m_iSqSubmitted;
+    struct io_uring_sqe *m_pSqes;
+
+    unsigned int       *m_pCqHead;
+    unsigned int       *m_pCqTail;
+    unsigned int        m_iCqMask;
+    struct io_uring_cqe *m_pCqes;
+
+    void               *m_pSqRing;
+    size_t              m_iSqRingSize;
+    void               *m_pCqRing;
+    size_t              m_iCqRingSize;
+    size_t              m_iSqesSize;
+
+    struct io_uring_buf_ring *m_pBufRing;
+    char               *m_pRecvBufs;
+    size_t              m_iBufRingSize;
+    size_t              m_iRecvBufsSize;
+    uint16_t            m_iBufRingTail;
+
+    ReactorIndex        m_reactorIndex;
+    FdState            *m_pFdStates;
+    unsigned int        m_iFdStateCap;
+    TObjArray<int>     *m_pUpdates;
+    TObjArray<int>     *m_pPendingReads;
+    struct io_uring_cqe *m_pResults;
+
+    static int          s_iRecvBufCount;
+    static int          s_iRecvBufSize;
+
+    int  setupRing(int entries);
+    void releaseRing();
+    int  probeOpcodes();
+    int  setupBufRing();
+    void releaseBufRing();
+    void recycleBuf(uint16_t bid);
+    FdState *getFdState(int fd);
+
+    struct io_uring_sqe *getSqe();
+    int  submit(int wait_nr, int iTimeoutMilliSec);
+
+    int  armPoll(int fd, FdState *pState, short mask);
+    int  armRecv(int fd, FdState *pState);
+    int  cancelPoll(int fd, FdState *pState);
+    int  cancelRecv(int fd, FdState *pState);
+    void resetRecv(FdState *pState);
+
+    int  updateEvents(EventReactor *pHandler, short mask);
+    void addEvent(EventReactor *pHandler, short mask)
+    {
+        pHandler->orMask2(mask);
+        updateEvents(pHandler, pHandler->getEvents());
+    }
+    void removeEvent(EventReactor *pHandler, short mask)
+    {
+        pHandler->andMask2(~mask);
+        updateEvents(pHandler, pHandler->getEvents());
+    }
+    void setEvents(EventReactor *pHandler, short mask)
+    {
+        if (pHandler->getEvents() != mask)
+            updateEvents(pHandler, mask);
+    }
+
+    void appendEvent(int fd);
+    void applyEvents();
+    int  completeRecv(int fd, FdState *pState, struct io_uring_cqe *pCqe);
+    int  processEvents(int count);
+    int  processPendingReads();
+
+public:
+    IoUring();
+    ~IoUring();
+
+    static int isSupported();
+    static void setRecvBufs(int count, int size)
+    {
+        s_iRecvBufCount = count;
+        s_iRecvBufSize = size;
+    }
+
+    virtual int getHandle() const   {   return m_fdRing;    }
+    virtual int init(int capacity = DEFAULT_CAPACITY);
+    virtual int add(EventReactor *pHandler, short mask);
+    virtual int remove(EventReactor *pHandler);
+    virtual int waitAndProcessEvents(int iTimeoutMilliSec);
+    virtual void timerExecute();
+    virtual void setPriHandler(EventReactor::pri_handler handler) {};
+
+    virtual void continueRead(EventReactor *pHandler);
+    virtual void suspendRead(EventReactor *pHandler);
+    virtual void continueWrite(EventReactor *pHandler);
+    virtual void suspendWrite(EventReactor *pHandler);
+    virtual void switchWriteToRead(EventReactor *pHandler);
+    virtual void switchReadToWrite(EventReactor *pHandler);
+    virtual void modEvent(EventReactor *pHandler, short mask, int add_remove);
+
+    virtual bool ownsRead(const EventReactor *pHandler) const;
+    virtual int  readCompleted(EventReactor *pHandler, char *pBuf, int size);
+
+    LS_NO_COPY_ASSIGN(IoUring);
+};
+
+#endif
+
+#endif
@@ -282,6 +282,7 @@ int KQueuer::waitAndProcessEvents(int iTimeoutMilliSec)
     }
 //    else
 //        m_traceCounter = 0;
+    setReadyEvents(ret > 0 ? ret : 0);
     if (ret > 0)
     {
         struct kevent *pBegin = results;
@@ -21,7 +21,10 @@
 
 Multiplexer::Multiplexer()
     : m_iFLTag(O_NONBLOCK | O_RDWR)
-{}
+    , m_iReadyEvents(0)
+{
+    m_timingWheel.init(TimingWheel::now());
+}
 
 void Multiplexer::continueRead(EventReactor *pHandler)
 {   pHandler->orMask2(POLLIN);    }
@@ -21,10 +21,15 @@
 #include <lsdef.h>
 
 #include <edio/eventreactor.h>
+#include <util/timingwheel.h>
+
+#include <errno.h>
 
 class Multiplexer
 {
     int m_iFLTag;
+    int m_iReadyEvents;
+    TimingWheel m_timingWheel;
 protected:
     Multiplexer();
 public:
@@ -49,9 +54,28 @@ public:
     virtual void switchReadToWrite(EventReactor *pHandler);
     virtual void modEvent(EventReactor *pHandler, short mask, int add_remove);
 
+    /**
+     * Completion based multiplexers read on behalf of reactors flagged with
+     * ERF_RECV_COMPLETION; while ownsRead() is true the socket must only be
+     * read through readCompleted(), which fails with EAGAIN when no data
+     * has completed yet.
+     */
+    virtual bool ownsRead(const EventReactor *pHandler) const
+    {   return false;   }
+    virtual int  readCompleted(EventReactor *pHandler, char *pBuf, int size)
+    {   errno = EAGAIN; return LS_FAIL;    }
+
     int  getFLTag() const   {   return m_iFLTag;        }
     void setFLTag(int tag)  {   m_iFLTag = tag;         }
 
+    //number of events returned by the last wait, the size of the backlog
+    //being processed in the current loop iteration.
+    int  getReadyEvents() const     {   return m_iReadyEvents;  }
+    void setReadyEvents(int n)      {   m_iReadyEvents = n;     }
+
+    //per event loop timers, advanced by the dispatcher every iteration.
+    TimingWheel *getTimingWheel()   {   return &m_timingWheel;  }
+
     LS_NO_COPY_ASSIGN(Multiplexer);
 
 };
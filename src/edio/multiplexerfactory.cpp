@@ -19,6 +19,7 @@
 
 #include <edio/devpoller.h>
 #include <edio/epoll.h>
+#include <edio/iouring.h>
 #include <edio/kqueuer.h>
 #include <edio/poller.h>
 #include <edio/rtsigio.h>
@@ -34,6 +35,7 @@ static const char *s_sType[MultiplexerFactory::BEST + 1] =
     "kqueue",
     "rtsig",
     "epoll",
+    "iouring",
     "best"
 };
 
@@ -72,7 +74,8 @@ int MultiplexerFactory::getType(const char *pType)
             if (strcasecmp(pType, s_sType[i]) == 0)
                 break;
         }
-        i = BEST;
+        if (i > BEST)
+            i = BEST;
     }
     if (i == BEST)
     {
@@ -106,6 +109,10 @@ Multiplexer *MultiplexerFactory::getNew(int type)
     case BEST:
     case EPOLL:
         return new epoll();
+#ifdef LS_HAS_IO_URING
+    case IO_URING:
+        return new IoUring();
+#endif
 #endif
 
 #if defined(sun) || defined(__sun)
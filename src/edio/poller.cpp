@@ -71,6 +71,7 @@ int Poller::waitAndProcessEvents(int iTimeoutMilliSec)
     int events = ::poll(m_pfdReactors.getPollfd(),
                         m_pfdReactors.getSize(),
                         iTimeoutMilliSec);
+    setReadyEvents(events > 0 ? events : 0);
     if (events > 0)
     {
         m_pfdReactors.setEvents(events);
@@ -167,7 +167,7 @@ public:
         while (pCurReactor > m_pReactors)
         {
             EventReactor *pHandler = *--pCurReactor;
-            if (pHandler)
+            if (pHandler && !(pHandler->getEvtFlag() & ERF_TIMER_WHEEL))
                 pHandler->onTimer();
         }
     }
@@ -26,6 +26,9 @@ ReactorIndex::ReactorIndex()
     : m_pIndexes(NULL)
     , m_capacity(0)
     , m_iUsed(0)
+    , m_pTimerFds(NULL)
+    , m_iTimerFds(0)
+    , m_iTimerCap(0)
 {
 }
 
@@ -52,10 +55,65 @@ int ReactorIndex::deallocate()
 {
     if (m_pIndexes)
         free(m_pIndexes);
+    if (m_pTimerFds)
+        free(m_pTimerFds);
     return LS_OK;
 }
 
 
+int ReactorIndex::set(int fd, EventReactor *pReactor)
+{
+    if ((unsigned)fd >= m_capacity)
+    {
+        if ((unsigned)fd > MAX_FDINDEX)
+            return LS_FAIL;
+        int new_cap = m_capacity * 2;
+        if (new_cap <= fd)
+            new_cap = fd + 1;
+        if (allocate(new_cap) == -1)
+            return LS_FAIL;
+    }
+    if ((unsigned)fd > m_iUsed)
+        m_iUsed = fd;
+    if (m_pIndexes[fd].m_iTimerPos)
+        removeTimerFd(fd);
+    m_pIndexes[fd].m_pReactor = pReactor;
+    if (pReactor && !(pReactor->getEvtFlag() & ERF_TIMER_WHEEL))
+        return addTimerFd(fd);
+    return LS_OK;
+}
+
+
+int ReactorIndex::addTimerFd(int fd)
+{
+    if (m_iTimerFds >= m_iTimerCap)
+    {
+        unsigned int cap = m_iTimerCap ? m_iTimerCap * 2 : 64;
+        int *pFds = (int *)realloc(m_pTimerFds, cap * sizeof(int));
+        if (!pFds)
+            return LS_FAIL;
+        m_pTimerFds = pFds;
+        m_iTimerCap = cap;
+    }
+    m_pTimerFds[m_iTimerFds++] = fd;
+    m_pIndexes[fd].m_iTimerPos = m_iTimerFds;
+    return LS_OK;
+}
+
+
+void ReactorIndex::removeTimerFd(int fd)
+{
+    unsigned int pos = m_pIndexes[fd].m_iTimerPos - 1;
+    int last = m_pTimerFds[--m_iTimerFds];
+    if (last != fd)
+    {
+        m_pTimerFds[pos] = last;
+        m_pIndexes[last].m_iTimerPos = pos + 1;
+    }
+    m_pIndexes[fd].m_iTimerPos = 0;
+}
+
+
 //#include <typeinfo>
 //#include <unistd.h>
 //#include <http/httplog.h>
@@ -63,22 +121,26 @@ int ReactorIndex::deallocate()
 void ReactorIndex::timerExec()
 {
     unsigned int i;
+    int fd;
     while (((m_iUsed) > 0) && (m_pIndexes[m_iUsed].m_pReactor == NULL))
         --m_iUsed;
-    for (i = 0; i <= m_iUsed; ++i)
+    //backward, a reactor removed by onTimer() is swapped with the last one,
+    //which has been visited already.
+    for (i = m_iTimerFds; i > 0; --i)
     {
-        EventReactor *pReactor = m_pIndexes[i].m_pReactor;
-        if (pReactor)
+        if (i > m_iTimerFds)
+            continue;
+        fd = m_pTimerFds[i - 1];
+        EventReactor *pReactor = m_pIndexes[fd].m_pReactor;
+        if (pReactor->getfd() == fd)
+            pReactor->onTimer();
+        else
         {
-            if (pReactor->getfd() == (int)i)
-                pReactor->onTimer();
-            else
-            {
 //                LS_ERROR( "[%d] ReactorIndex[%d]=%p, getfd()=%d, type: %s", getpid(), i, m_pIndexes[i], m_pIndexes[i]->getfd(),
 //                typeid( *m_pIndexes[i] ).name() ));
 
-                m_pIndexes[i].m_pReactor = NULL;
-            }
+            removeTimerFd(fd);
+            m_pIndexes[fd].m_pReactor = NULL;
         }
     }
 }
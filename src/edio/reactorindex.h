@@ -30,6 +30,7 @@ typedef struct ReactorHolder
     EventReactor   *m_pReactor;
     unsigned short  m_eventSet;
     unsigned short  m_flags;
+    unsigned int    m_iTimerPos;    //1 based index in m_pTimerFds, 0 if not
 
 } ReactorHolder;
 
@@ -40,13 +41,22 @@ public:
     unsigned int    m_capacity;
     unsigned int    m_iUsed;
 
+    //fds of the reactors visited by timerExec(), the ones without a timing
+    //wheel entry, so that the scan does not touch every connection.
+    int            *m_pTimerFds;
+    unsigned int    m_iTimerFds;
+    unsigned int    m_iTimerCap;
+
     int deallocate();
+    int addTimerFd(int fd);
+    void removeTimerFd(int fd);
 
 public:
     ReactorIndex();
     ~ReactorIndex();
 
     unsigned int getUsed() const        {   return m_iUsed;         }
+    unsigned int getTimerCount() const  {   return m_iTimerFds;     }
     unsigned int getCapacity() const    {   return m_capacity;      }
 
     int allocate(int capacity);
@@ -54,23 +64,7 @@ public:
     EventReactor *get(int fd) const
     {   return ((unsigned)fd <= m_iUsed) ? m_pIndexes[fd].m_pReactor : NULL;  }
 
-    int set(int fd, EventReactor *pReactor)
-    {
-        if ((unsigned)fd >= m_capacity)
-        {
-            if ((unsigned)fd > MAX_FDINDEX)
-                return LS_FAIL;
-            int new_cap = m_capacity * 2;
-            if (new_cap <= fd)
-                new_cap = fd + 1;
-            if (allocate(new_cap) == -1)
-                return LS_FAIL;
-        }
-        if ((unsigned)fd > m_iUsed)
-            m_iUsed = fd;
-        m_pIndexes[fd].m_pReactor = pReactor;
-        return LS_OK;
-    }
+    int set(int fd, EventReactor *pReactor);
 
     void setUpdateFlags(int fd, int val)
     {   m_pIndexes[fd].m_flags = val;   }
@@ -0,0 +1,306 @@
+/*****************************************************************************
+*    Open LiteSpeed is an open source HTTP server.                           *
+*    Copyright (C) 2013 - 2020  LiteSpeed Technologies, Inc.                 *
+*                                                                            *
+*    This program is free software: you can redistribute it and/or modify    *
+*    it under the terms of the GNU General Public License as published by    *
+*    the Free Software Foundation, either version 3 of the License, or       *
+*    (at your option) any later version.                                     *
+*                                                                            *
+*    This program is distributed in the hope that it will be useful,         *
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            *
+*    GNU General Public License for more details.                            *
+*                                                                            *
+*    You should have received a copy of the GNU General Public License       *
+*    along with this program. If not, see http://www.gnu.org/licenses/.      *
+*****************************************************************************/
+#include "compressdict.h"
+
+#include <http/httpheader.h>
+#include <http/httpreq.h>
+#include <http/httpvhost.h>
+#include <http/staticfilecachedata.h>
+#include <log4cxx/logger.h>
+#include <lsr/ls_base64.h>
+#include <lsr/ls_fileio.h>
+#include <lsr/ls_offload.h>
+#include <util/autostr.h>
+#include <util/brotlibuf.h>
+#include <util/stringlist.h>
+#include <util/stringtool.h>
+
+#include <openssl/sha.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+int CompressDict::isSupported()
+{
+#if defined(USE_ZSTD) || defined(LS_BROTLI_SHARED_DICT)
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+
+int CompressDict::addPatterns(StringList &patterns, const char *pValue)
+{
+    StringList list;
+    list.split(pValue, pValue + strlen(pValue), ", ");
+    StringList::const_iterator iter;
+    for (iter = list.begin(); iter != list.end(); ++iter)
+    {
+        const char *p = (*iter)->c_str();
+        //goes out quoted in Use-As-Dictionary, keep it a plain path.
+        if ((*p != '/') || (strpbrk(p, "\"\\") != NULL))
+        {
+            LS_WARN("Invalid compression dictionary pattern [%s], ignored.",
+                    p);
+            continue;
+        }
+        patterns.add(p, (*iter)->len());
+    }
+    return patterns.size();
+}
+
+
+const AutoStr2 *CompressDict::match(const StringList &patterns,
+                                    const char *pURL, int len)
+{
+    char achURL[4096];
+    if ((len <= 0) || (len >= (int)sizeof(achURL)))
+        return NULL;
+    memmove(achURL, pURL, len);
+    achURL[len] = 0;
+    StringList::const_iterator iter;
+    for (iter = patterns.begin(); iter != patterns.end(); ++iter)
+    {
+        if (fnmatch((*iter)->c_str(), achURL, 0) == 0)
+            return *iter;
+    }
+    return NULL;
+}
+
+
+int CompressDict::parseAvailable(const char *pVal, int len, char *pHash)
+{
+    char achDecoded[HASH_LEN + 16];
+    while ((len > 0) && isspace(pVal[len - 1]))
+        --len;
+    while ((len > 0) && isspace(*pVal))
+    {
+        ++pVal;
+        --len;
+    }
+    //a structured field byte sequence, the base64 of a SHA-256 is 44 bytes.
+    if ((len != ls_base64_encodelen(HASH_LEN) + 2) || (*pVal != ':')
+        || (pVal[len - 1] != ':'))
+        return LS_FAIL;
+    if (ls_base64_decode(pVal + 1, len - 2, achDecoded) != HASH_LEN)
+        return LS_FAIL;
+    memmove(pHash, achDecoded, HASH_LEN);
+    return LS_OK;
+}
+
+
+#if defined(LS_BROTLI_SHARED_DICT) || defined(USE_ZSTD)
+static int hasEncoding(const char *pAE, int len, const char *pName)
+{
+    const char *pEnd = pAE + len;
+    const char *p;
+    while (pAE < pEnd)
+    {
+        while ((pAE < pEnd) && ((*pAE == ' ') || (*pAE == ',')))
+            ++pAE;
+        p = pAE;
+        while ((p < pEnd) && (*p != ',') && (*p != ';') && (*p != ' '))
+            ++p;
+        if ((p - pAE == 3) && (strncasecmp(pAE, pName, 3) == 0))
+            return 1;
+        while ((p < pEnd) && (*p != ','))
+            ++p;
+        pAE = p;
+    }
+    return 0;
+}
+#endif
+
+
+char CompressDict::getRequestMode(HttpReq *pReq, char *pHex)
+{
+#if !defined(LS_BROTLI_SHARED_DICT) && !defined(USE_ZSTD)
+    //no encoder to use a dictionary with
+    return 0;
+#else
+    int len;
+    char achHash[HASH_LEN];
+    char mode = 0;
+    const char *pVal = pReq->getHeader("Available-Dictionary", 20, len);
+    if (!pVal || (parseAvailable(pVal, len, achHash) == LS_FAIL))
+        return 0;
+    const char *pAE = pReq->getHeader(HttpHeader::H_ACC_ENCODING);
+    len = pReq->getHeaderLen(HttpHeader::H_ACC_ENCODING);
+#ifdef LS_BROTLI_SHARED_DICT
+    if (hasEncoding(pAE, len, "dcb"))
+        mode = SFCD_MODE_DCB;
+#endif
+#ifdef USE_ZSTD
+    if (!mode && hasEncoding(pAE, len, "dcz"))
+        mode = SFCD_MODE_DCZ;
+#endif
+    if (!mode || !pReq->getVHost())
+        return 0;
+    StringTool::hexEncode(achHash, HASH_LEN, pHex);
+    if (!isStored(pReq->getVHost()->getName(), pHex))
+        return 0;
+    return mode;
+#endif
+}
+
+
+int CompressDict::getStorePath(const char *pVHost, const char *pHex,
+                               char *pBuf, int len)
+{
+    if (!pVHost || !*pVHost || (*pVHost == '.') || strchr(pVHost, '/'))
+        return LS_FAIL;
+    int n = snprintf(pBuf, len, "%s/dict/%s/%s",
+                     StaticFileCacheData::getCompressCachePath(), pVHost,
+                     pHex);
+    return (n >= len) ? LS_FAIL : n;
+}
+
+
+int CompressDict::isStored(const char *pVHost, const char *pHex)
+{
+    char achPath[4096];
+    struct stat st;
+    if (getStorePath(pVHost, pHex, achPath, sizeof(achPath)) == LS_FAIL)
+        return 0;
+    return (ls_fio_stat(achPath, &st) == 0);
+}
+
+
+struct DictStoreJob
+{
+    AutoStr2    m_vhost;
+    AutoStr2    m_src;
+    off_t       m_size;
+    time_t      m_mtime;
+};
+
+
+//The store is content addressed, an entry never goes stale and a copy
+//written by another worker at the same time is identical.
+static int copyToStore(DictStoreJob *pJob, int srcFd)
+{
+    struct stat st;
+    if ((fstat(srcFd, &st) == -1) || (st.st_size != pJob->m_size)
+        || (st.st_mtime != pJob->m_mtime))
+        return LS_FAIL;
+
+    char achTmp[4096];
+    int n = snprintf(achTmp, sizeof(achTmp), "%s/dict",
+                     StaticFileCacheData::getCompressCachePath());
+    if ((mkdir(achTmp, 0700) == -1) && (errno != EEXIST))
+        return LS_FAIL;
+    n += snprintf(achTmp + n, sizeof(achTmp) - n, "/%s",
+                  pJob->m_vhost.c_str());
+    if ((n >= (int)sizeof(achTmp) - 12)
+        || ((mkdir(achTmp, 0700) == -1) && (errno != EEXIST)))
+        return LS_FAIL;
+    snprintf(achTmp + n, sizeof(achTmp) - n, "/.tmp.XXXXXX");
+    int fd = mkstemp(achTmp);
+    if (fd == -1)
+        return LS_FAIL;
+
+    SHA256_CTX ctx;
+    SHA256_Init(&ctx);
+    char achBuf[8192];
+    off_t offset = 0;
+    int len;
+    while (offset < pJob->m_size)
+    {
+        len = pread(srcFd, achBuf, sizeof(achBuf), offset);
+        if (len <= 0)
+            break;
+        SHA256_Update(&ctx, achBuf, len);
+        if (write(fd, achBuf, len) != len)
+            break;
+        offset += len;
+    }
+    close(fd);
+    if ((offset == pJob->m_size) && (fstat(srcFd, &st) == 0)
+        && (st.st_mtime == pJob->m_mtime))
+    {
+        unsigned char achHash[CompressDict::HASH_LEN];
+        char achHex[CompressDict::HEX_LEN + 1];
+        char achPath[4096];
+        SHA256_Final(achHash, &ctx);
+        StringTool::hexEncode((const char *)achHash, CompressDict::HASH_LEN,
+                              achHex);
+        if ((CompressDict::getStorePath(pJob->m_vhost.c_str(), achHex,
+                                        achPath, sizeof(achPath))
+             != LS_FAIL) && (rename(achTmp, achPath) == 0))
+            return offset;
+    }
+    unlink(achTmp);
+    return LS_FAIL;
+}
+
+
+static int performStoreJob(void *param)
+{
+    DictStoreJob *pJob = (DictStoreJob *)param;
+    int ret = LS_FAIL;
+    int srcFd = ::open(pJob->m_src.c_str(), O_RDONLY);
+    if (srcFd != -1)
+    {
+        ret = copyToStore(pJob, srcFd);
+        close(srcFd);
+    }
+    return ret;
+}
+
+
+static void onStoreJobDone(void *param, int result)
+{
+    DictStoreJob *pJob = (DictStoreJob *)param;
+    if (result == LS_FAIL)
+        LS_WARN("Failed to store compression dictionary %s.",
+                pJob->m_src.c_str());
+    else
+        LS_DBG_H("Stored compression dictionary %s, size %d.",
+                 pJob->m_src.c_str(), result);
+    delete pJob;
+}
+
+
+int CompressDict::offloadStore(const char *pVHost, const char *pReal,
+                               int len, off_t size, time_t mtime)
+{
+    struct Offloader *pOffloader = offloader_get_shared();
+    if (!pOffloader)
+        return LS_FAIL;
+    DictStoreJob *pJob = new DictStoreJob();
+    char achPath[4096];
+    if ((getStorePath(pVHost, "", achPath, sizeof(achPath)) == LS_FAIL)
+        || !pJob->m_src.setStr(pReal, len) || !pJob->m_vhost.setStr(pVHost))
+    {
+        delete pJob;
+        return LS_FAIL;
+    }
+    pJob->m_size = size;
+    pJob->m_mtime = mtime;
+    LS_DBG_H("To store compression dictionary %s in offload thread.", pReal);
+    offloader_submit(pOffloader, performStoreJob, onStoreJobDone, pJob);
+    return LS_OK;
+}
@@ -0,0 +1,69 @@
+/*****************************************************************************
+*    Open LiteSpeed is an open source HTTP server.                           *
+*    Copyright (C) 2013 - 2020  LiteSpeed Technologies, Inc.                 *
+*                                                                            *
+*    This program is free software: you can redistribute it and/or modify    *
+*    it under the terms of the GNU General Public License as published by    *
+*    the Free Software Foundation, either version 3 of the License, or       *
+*    (at your option) any later version.                                     *
+*                                                                            *
+*    This program is distributed in the hope that it will be useful,         *
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            *
+*    GNU General Public License for more details.                            *
+*                                                                            *
+*    You should have received a copy of the GNU General Public License       *
+*    along with this program. If not, see http://www.gnu.org/licenses/.      *
+*****************************************************************************/
+#ifndef COMPRESSDICT_H
+#define COMPRESSDICT_H
+
+#include <sys/types.h>
+
+class AutoStr2;
+class HttpReq;
+class StringList;
+
+/**
+ * Compression dictionary transport for static files. A response for a URL
+ * matching one of the vhost patterns is announced as a dictionary and its
+ * body is kept in the vhost's store under the compress cache, named by its
+ * SHA-256.
+ * A later request naming a stored dictionary in "Available-Dictionary" can
+ * then get the "dcb" or "dcz" variant of a file built against it.
+ */
+class CompressDict
+{
+public:
+    enum
+    {
+        HASH_LEN = 32,
+        HEX_LEN  = 64
+    };
+
+    /** 1 if dictionary encoding is built in, "dcz" or "dcb". */
+    static int isSupported();
+    /** Adds the comma separated patterns of a vhost, returns the count. */
+    static int addPatterns(StringList &patterns, const char *pValue);
+    static const AutoStr2 *match(const StringList &patterns,
+                                 const char *pURL, int len);
+
+    /** Decodes an ":<base64>:" hash, LS_FAIL unless it is HASH_LEN bytes. */
+    static int parseAvailable(const char *pVal, int len, char *pHash);
+    /**
+     * The SFCD_MODE_DCB/SFCD_MODE_DCZ encoding to serve the request with,
+     * 0 if it names no stored dictionary or accepts neither. pHex gets the
+     * hash of the dictionary, HEX_LEN + 1 bytes.
+     */
+    static char getRequestMode(HttpReq *pReq, char *pHex);
+
+    /** "<compress cache>/dict/<vhost>/<hex>" */
+    static int getStorePath(const char *pVHost, const char *pHex,
+                            char *pBuf, int len);
+    static int isStored(const char *pVHost, const char *pHex);
+    /** Hashes and copies a file into the vhost store in an offload thread. */
+    static int offloadStore(const char *pVHost, const char *pReal, int len,
+                            off_t size, time_t mtime);
+};
+
+#endif // COMPRESSDICT_H
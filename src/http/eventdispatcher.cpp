@@ -67,6 +67,14 @@ int EventDispatcher::init(const char *pType)
             //CallbackQueue::getInstance().initNotifier(pMultiplexer);
             return 0;
         }
+        if (MultiplexerFactory::s_iMultiplexerType
+            == MultiplexerFactory::IO_URING)
+        {
+            LS_NOTICE("[EventDispatcher] io_uring is not usable on this "
+                      "kernel (%s), fall back to epoll.", strerror(errno));
+            MultiplexerFactory::recycle(pMultiplexer);
+            return init("epoll");
+        }
     }
     return LS_FAIL;
 }
@@ -123,7 +131,9 @@ static void processTimer()
         pQuicEngine->onTimer();
     if (NtwkIOLink::getToken() < NtwkIOLink::getPrevToken())
         HttpServer::getInstance().onTimer();
-    MultiplexerFactory::getMultiplexer()->timerExecute();
+    Multiplexer *pMplx = MultiplexerFactory::getMultiplexer();
+    pMplx->getTimingWheel()->advance(TimingWheel::now());
+    pMplx->timerExecute();
 }
 
 
@@ -208,6 +218,8 @@ static inline void processTimerNew()
     DateTime::s_curTimeUs = tv.tv_usec;
     NtwkIOLink::setPrevToken(NtwkIOLink::getToken());
     NtwkIOLink::setToken(tv.tv_usec / (1000000 / TIMER_PRECISION));
+    MultiplexerFactory::getMultiplexer()->getTimingWheel()->advance(
+        TimingWheel::now());
     if (NtwkIOLink::getToken() != NtwkIOLink::getPrevToken())
     {
         QuicEngine *pQuicEngine = HttpServer::getInstance().getQuicEngine();
@@ -229,6 +241,21 @@ static inline void processTimerNew()
 
 
 #define MLTPLX_TIMEOUT 100
+
+//Shortens the multiplexer wait to the next timing wheel tick due.
+static inline int wheelTimeout(int to)
+{
+    TimingWheel *pWheel = MultiplexerFactory::getMultiplexer()->getTimingWheel();
+    uint64_t now = TimingWheel::now();
+    uint64_t next = pWheel->nextExpire();
+    if (next <= now)
+        return 0;
+    if (next - now < (uint64_t)to)
+        return next - now;
+    return to;
+}
+
+
 int EventDispatcher::run()
 {
     int ret;
@@ -250,7 +277,7 @@ int EventDispatcher::run()
             QuicEngine::detectBusyLoop(to);
         }
         ret = MultiplexerFactory::getMultiplexer()->waitAndProcessEvents(
-                  MLTPLX_TIMEOUT);
+                  wheelTimeout(to));
         if ((ret == -1) && errno)
         {
             if (!((errno == EINTR) || (errno == EAGAIN)))
@@ -313,7 +340,7 @@ int EventDispatcher::linger(int timeout)
             }
         }
         ret = MultiplexerFactory::getMultiplexer()->waitAndProcessEvents(
-                  MLTPLX_TIMEOUT);
+                  wheelTimeout(to));
         if (ret == -1)
         {
             if (!((errno == EINTR) || (errno == EAGAIN)))
@@ -322,6 +349,8 @@ int EventDispatcher::linger(int timeout)
                 return 1;
             }
         }
+        MultiplexerFactory::getMultiplexer()->getTimingWheel()->advance(
+            TimingWheel::now());
         Adns::getInstance().processPendingEvt();
 #ifdef LS_HAS_RTSIG
         SigEventDispatcher::getInstance().processSigEvent();
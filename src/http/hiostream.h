@@ -166,6 +166,15 @@ public:
     virtual int readv(struct iovec *vector, int count)
     {       return -1;      }
 
+    //Same as write(), but the stream may leave pBuf referenced by the
+    //kernel after return, *pRef is set if so and the caller must not
+    //overwrite that memory in place anymore.
+    virtual int writeNoCopy(const char *pBuf, int size, int *pRef)
+    {
+        *pRef = 0;
+        return write(pBuf, size);
+    }
+
     virtual int sendRespHeaders(HttpRespHeaders *pHeaders, int isNoBody) = 0;
 
     virtual void switchWriteToRead() = 0;
@@ -302,6 +311,10 @@ public:
     virtual int onCloseEx() = 0;
     virtual int onTimerEx() = 0;
 
+    //Time in seconds before which onTimerEx() has nothing to do, 0 to have
+    //it called every second.
+    virtual int32_t getTimerDeadline() const    {   return 0;   }
+
     virtual void recycle() = 0;
 
     virtual int h2cUpgrade(HioHandler *pOld, const char * pBuf, int size);
@@ -24,6 +24,7 @@
 #include <http/clientinfo.h>
 #include <http/connlimitctrl.h>
 #include <http/httpresourcemanager.h>
+#include <http/httpstats.h>
 #include <http/httpvhost.h>
 #include <http/ntwkiolink.h>
 #include <http/smartsettings.h>
@@ -53,8 +54,12 @@
 #include "httpserverconfig.h"
 #include <quic/udplistener.h>
 
+#define ACCEPT_BUDGET_MIN       4
+#define ACCEPT_LOOP_TARGET_US   2000
+
 int32_t      HttpListener::m_iSockSendBufSize = -1;
 int32_t      HttpListener::m_iSockRecvBufSize = -1;
+int32_t      HttpListener::s_iMaxAcceptBudget = 0;
 
 HttpListener::HttpListener(const char *pName, const char *pAddr)
     : m_sName(pName)
@@ -64,8 +69,10 @@ HttpListener::HttpListener(const char *pName, const char *pAddr)
     , m_iBinding(0xffffffffffffffffULL)
     , m_iAdmin(0)
     , m_isSSL(0)
+    , m_iKtls(0)
     , m_flag(0)
     , m_iSendZconf(0)
+    , m_iAcceptBudget(ACCEPT_BUDGET_MIN * 4)
     , m_pAdcPortList(NULL)
 {
     if (m_pMapVHost)
@@ -81,8 +88,10 @@ HttpListener::HttpListener()
     , m_iBinding(0xffffffffffffffffULL)
     , m_iAdmin(0)
     , m_isSSL(0)
+    , m_iKtls(0)
     , m_flag(0)
     , m_iSendZconf(0)
+    , m_iAcceptBudget(ACCEPT_BUDGET_MIN * 4)
     , m_pAdcPortList(NULL)
 {
 }
@@ -322,6 +331,19 @@ void HttpListener::adjustFds(int iNumChildren)
         }
     }
     m_reusePortFds.setSize(iNumChildren);
+    steerReusePort();
+}
+
+
+void HttpListener::steerReusePort()
+{
+    HttpServerConfig &config = HttpServerConfig::getInstance();
+    if (!config.getReusePortSteering() || m_reusePortFds.size() <= 1)
+        return;
+    if (m_reusePortFds.steerByCpu(getAddrStr(), config.getCpuAffinity())
+        != LS_OK)
+        LS_NOTICE("[%s] SO_REUSEPORT CPU steering is not enabled, it needs "
+                  "'cpuAffinity' set below the number of CPUs.", getAddrStr());
 }
 
 
@@ -402,6 +424,7 @@ int HttpListener::startReusePortSocket(int count)
         m_reusePortFds[i] = fd;
     }
     m_reusePortFds.setSize(count);
+    steerReusePort();
     return 0;
 }
 
@@ -555,6 +578,56 @@ struct conn_data
 };
 
 
+//Accept budget for this wake up, it is cut when other ready sockets are
+//waiting in the same loop iteration or the server is close to its limit,
+//so a connection storm cannot starve established connections.
+int HttpListener::getAcceptBudget(ConnLimitCtrl &ctrl)
+{
+    int budget = m_iAcceptBudget;
+    int ready = MultiplexerFactory::getMultiplexer()->getReadyEvents() - 1;
+    if (ready > budget)
+        budget >>= 1;
+    if ((ctrl.getMaxConns() - ctrl.availConn()) * 4 > ctrl.getMaxConns() * 3)
+        budget >>= 1;
+    if (budget < ACCEPT_BUDGET_MIN)
+        budget = ACCEPT_BUDGET_MIN;
+    if (budget > s_iMaxAcceptBudget)
+        budget = s_iMaxAcceptBudget;
+    return budget;
+}
+
+
+void HttpListener::adjustAcceptBudget(int accepted, int budget, long usec)
+{
+    if (usec > ACCEPT_LOOP_TARGET_US)
+    {
+        if (m_iAcceptBudget > ACCEPT_BUDGET_MIN)
+        {
+            m_iAcceptBudget >>= 1;
+            if (m_iAcceptBudget < ACCEPT_BUDGET_MIN)
+                m_iAcceptBudget = ACCEPT_BUDGET_MIN;
+            HttpStats::incAcceptShrink();
+        }
+    }
+    else if (accepted >= budget)
+    {
+        //more connections are pending, listener stays readable.
+        HttpStats::incAcceptCapped();
+        if (usec < ACCEPT_LOOP_TARGET_US / 2
+            && m_iAcceptBudget < s_iMaxAcceptBudget)
+        {
+            m_iAcceptBudget <<= 1;
+            if (m_iAcceptBudget > s_iMaxAcceptBudget)
+                m_iAcceptBudget = s_iMaxAcceptBudget;
+            HttpStats::incAcceptGrow();
+        }
+    }
+    HttpStats::setAcceptBudget(m_iAcceptBudget);
+    LS_DBG_H(this, "accepted %d of budget %d in %ld us, next budget %d.",
+             accepted, budget, usec, m_iAcceptBudget);
+}
+
+
 #define CONN_BATCH_SIZE 10
 int HttpListener::handleEvents(short event)
 {
@@ -563,6 +636,9 @@ int HttpListener::handleEvents(short event)
     struct conn_data *pCur = conns;
     int allowed;
     int iCount = 0;
+    int accepted = 0;
+    int budget = INT_MAX;
+    struct timeval tmBegin;
     ConnLimitCtrl &ctrl = ConnLimitCtrl::getInstance();
     int limitType = 1;
     allowed = ctrl.availConn();
@@ -574,8 +650,13 @@ int HttpListener::handleEvents(short event)
             limitType = 2;
         }
     }
+    if (s_iMaxAcceptBudget > 0)
+    {
+        budget = getAcceptBudget(ctrl);
+        gettimeofday(&tmBegin, NULL);
+    }
 
-    while (iCount < allowed)
+    while (iCount < allowed && accepted < budget)
     {
         socklen_t len = sizeof(pCur->achPeerAddr);
 #ifdef SOCK_CLOEXEC
@@ -615,6 +696,7 @@ int HttpListener::handleEvents(short event)
         //++iCount;
         //addConnection( conns, &iCount );
 
+        ++accepted;
         ++pCur;
         if (pCur == pEnd)
         {
@@ -646,6 +728,14 @@ int HttpListener::handleEvents(short event)
             m_pMapVHost->incRef(iCount);
         ctrl.incConn(iCount);
     }
+    if (s_iMaxAcceptBudget > 0)
+    {
+        struct timeval tmEnd;
+        gettimeofday(&tmEnd, NULL);
+        adjustAcceptBudget(accepted, budget,
+                           (tmEnd.tv_sec - tmBegin.tv_sec) * 1000000L
+                           + tmEnd.tv_usec - tmBegin.tv_usec);
+    }
     if (iCount >= allowed)
     {
         if (limitType == 1)
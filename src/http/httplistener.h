@@ -38,6 +38,7 @@ class SubIpMap;
 class HttpServerImpl;
 class AutoBuf;
 class UdpListener;
+class ConnLimitCtrl;
 struct ssl_st;
 
 class HttpListener : public EventReactor, public LogSession
@@ -45,6 +46,7 @@ class HttpListener : public EventReactor, public LogSession
     friend class HttpServerImpl;
     static int32_t      m_iSockSendBufSize;
     static int32_t      m_iSockRecvBufSize;
+    static int32_t      s_iMaxAcceptBudget;
 
     AutoStr             m_sName;
     VHostMap           *m_pMapVHost;
@@ -53,8 +55,10 @@ class HttpListener : public EventReactor, public LogSession
     unsigned long long  m_iBinding;
     char                m_iAdmin;
     char                m_isSSL;
+    char                m_iKtls;
     int                 m_flag;
     char                m_iSendZconf;
+    int                 m_iAcceptBudget;
     AutoStr            *m_pAdcPortList;
 
     ModuleConfig        m_moduleConfig;
@@ -73,6 +77,8 @@ class HttpListener : public EventReactor, public LogSession
     int checkAccess(struct conn_data *pData);
     int setSockAttr(int fd);
     VHostMap *getSubMap(int fd);
+    int getAcceptBudget(ConnLimitCtrl &ctrl);
+    void adjustAcceptBudget(int accepted, int budget, long usec);
 
 
 protected:
@@ -90,6 +96,9 @@ public:
 
     char isSSL() const                 {   return m_isSSL;     }
 
+    char isKtls() const                {   return m_iKtls;     }
+    void setKtls(char ktls)            {   m_iKtls = ktls;     }
+
     const char *getName() const        {   return m_sName.c_str();     }
     void setName(const char *pName)  {   m_sName = pName;    }
 
@@ -129,6 +138,8 @@ public:
     {   m_iSockSendBufSize = size;              }
     static void setSockRecvBufSize(int32_t size)
     {   m_iSockRecvBufSize = size;              }
+    static void setMaxAcceptBudget(int32_t budget)
+    {   s_iMaxAcceptBudget = budget;            }
 
     VHostMap *addIpMap(const char *pIP);
     int addDefaultVHost(HttpVHost *pVHost);
@@ -171,6 +182,7 @@ public:
     void addUdpSocket(int fd);
     int bindUdpPort();
     int startReusePortSocket(int count);
+    void steerReusePort();
 
 };
 
@@ -81,6 +81,9 @@ HttpRange::HttpRange(off_t entityLen)
     m_iCurRange = 0;
     m_pPartHeaderEnd = 0x00;
     m_pCurHeaderPos = 0x00;
+    m_pAllHeaders = 0x00;
+    m_pHeaderOffsets = 0x00;
+    m_lPartSent = 0;
 }
 
 
@@ -436,6 +439,33 @@ off_t HttpRange::getPartLen(int n, int iMimeTypeLen) const
     return len;
 }
 
+int HttpRange::buildAllPartHeaders(const char *pMimeType, ls_xpool_t *pool)
+{
+    int size = m_array.getSize();
+    int bufSize = (size + 1) * MAX_PART_HEADER_LEN;
+    int *pOffsets = (int *)ls_xpool_alloc(pool, (size + 2) * sizeof(int));
+    char *pBuf = (char *)ls_xpool_alloc(pool, bufSize);
+    if (!pOffsets || !pBuf)
+        return LS_FAIL;
+    int off = 0;
+    int len;
+    for (int i = 0; i <= size; ++i)
+    {
+        pOffsets[i] = off;
+        len = getPartHeader(i, pMimeType, pBuf + off, bufSize - off);
+        if (len <= 0)
+            return LS_FAIL;
+        off += len;
+    }
+    pOffsets[size + 1] = off;
+    m_pAllHeaders = pBuf;
+    m_pHeaderOffsets = pOffsets;
+    m_iCurRange = 0;
+    m_lPartSent = 0;
+    return off;
+}
+
+
 off_t HttpRange::getMultipartBodyLen(const AutoStr2 *pMimeType) const
 {
     assert(pMimeType);
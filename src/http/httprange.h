@@ -40,6 +40,9 @@ class HttpRange
     char    m_partHeaderBuf[MAX_PART_HEADER_LEN];
     char   *m_pPartHeaderEnd;
     char   *m_pCurHeaderPos;
+    char   *m_pAllHeaders;
+    int    *m_pHeaderOffsets;
+    off_t   m_lPartSent;
 
     ByteRange *getSlot(ls_xpool_t *pool);
     int  checkAndInsert(ByteRange &range, ls_xpool_t *pool);
@@ -93,6 +96,30 @@ public:
     }
 
     const char *getPartHeader() const {    return m_pCurHeaderPos; }
+
+    /**
+     * Builds the headers of all parts and the closing boundary at once into
+     * one buffer from the pool, so a batch of parts can go out in a single
+     * writev(). Part count() is the closing boundary.
+     */
+    int  buildAllPartHeaders(const char *pMimeType, ls_xpool_t *pool);
+    bool hasAllPartHeaders() const  {   return m_pHeaderOffsets != NULL;    }
+    const char *getPrebuiltHeader(int n, int &len) const
+    {
+        len = m_pHeaderOffsets[n + 1] - m_pHeaderOffsets[n];
+        return m_pAllHeaders + m_pHeaderOffsets[n];
+    }
+
+    int  getCurRange() const        {   return m_iCurRange;     }
+    //bytes of the current part, header then data, already sent.
+    off_t getPartSent() const       {   return m_lPartSent;     }
+    void partSent(off_t len)        {   m_lPartSent += len;     }
+    void nextPart()
+    {
+        ++m_iCurRange;
+        m_lPartSent = 0;
+    }
+
     LS_NO_COPY_ASSIGN(HttpRange);
 };
 
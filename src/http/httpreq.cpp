@@ -34,6 +34,7 @@
 #include <http/recaptcha.h>
 #include <http/requestvars.h>
 #include <http/serverprocessconfig.h>
+#include <http/staticfilecache.h>
 #include <http/vhostmap.h>
 #include <http/httprespheaders.h>
 
@@ -1044,6 +1045,10 @@ int HttpReq::processHeader(int index)
             if (strcasestr(pCur, "br") != NULL)
                 m_iAcceptBr = REQ_BR_ACCEPT |
                 (HttpServerConfig::getInstance().getBrCompress() ? BR_ENABLED : 0);
+            if ((m_commonHeaderLen[ index ] >= 4)
+                && (strcasestr(pCur, "zstd") != NULL))
+                m_iAcceptZstd = REQ_ZSTD_ACCEPT |
+                (HttpServerConfig::getInstance().getZstdCompress() ? ZSTD_ENABLED : 0);
             *((char *)pBEnd) = ch;
         }
         break;
@@ -1249,6 +1254,9 @@ int HttpReq::processNewReqData(const struct sockaddr *pAddr)
 
     if (!m_pVHost->enableBr())
         andBr(~BR_ENABLED);
+
+    if (!m_pVHost->enableZstd())
+        andZstd(~ZSTD_ENABLED);
     AccessCache *pAccessCache = m_pVHost->getAccessCache();
     if (pAccessCache)
     {
@@ -3121,7 +3129,12 @@ int HttpReq::fileStat(const char *pPath, struct stat *st)
     if (strcmp(pPath, m_lastStatPath.c_str()) != 0)
     {
         m_lastStatPath.setStr(pPath);
-        m_lastStatRes = ls_fio_stat(pPath, &m_lastStat);
+        //a cached file under inotify watch is known to be unchanged
+        if (StaticFileCache::getInstance().getWatchedStat(pPath,
+                                                          &m_lastStat) == 0)
+            m_lastStatRes = 0;
+        else
+            m_lastStatRes = ls_fio_stat(pPath, &m_lastStat);
         if (m_lastStatRes == -1)
         {
             m_lastStatRes = errno;
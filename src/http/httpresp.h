@@ -109,6 +109,16 @@ public:
         m_respHeaders.addBrEncodingHeader();
     }
 
+    void addZstdEncodingHeader()
+    {
+        m_respHeaders.addZstdEncodingHeader();
+    }
+
+    void addDictEncodingHeader(ETAG_ENCODING type)
+    {
+        m_respHeaders.addDictEncodingHeader(type);
+    }
+
     void appendChunked()
     {
         m_respHeaders.appendChunked();
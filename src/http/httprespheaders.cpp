@@ -55,6 +55,12 @@ static char s_sGzipEncodingHeader[48] =
     "content-encoding: gzip\r\nvary: Accept-Encoding\r\n";
 static char s_sBrEncodingHeader[46] =
     "content-encoding: br\r\nvary: Accept-Encoding\r\n";
+static char s_sZstdEncodingHeader[48] =
+    "content-encoding: zstd\r\nvary: Accept-Encoding\r\n";
+static char s_sDczEncodingHeader[70] =
+    "content-encoding: dcz\r\nvary: Accept-Encoding, Available-Dictionary\r\n";
+static char s_sDcbEncodingHeader[70] =
+    "content-encoding: dcb\r\nvary: Accept-Encoding, Available-Dictionary\r\n";
 static char s_sCommonHeaders[66] =
     "date: Tue, 09 Jul 2013 13:43:01 GMT\r\nserver";
 static char s_sTurboCharged[66] =
@@ -64,6 +70,9 @@ static int             s_commonHeadersCount = 2;
 static http_header_t   s_commonHeaders[2];
 static http_header_t   s_gzipHeaders[2];
 static http_header_t   s_brHeaders[2];
+static http_header_t   s_zstdHeaders[2];
+static http_header_t   s_dczHeaders[2];
+static http_header_t   s_dcbHeaders[2];
 static http_header_t   s_keepaliveHeader[2];
 static http_header_t   s_chunkedHeader;
 static http_header_t   s_concloseHeader;
@@ -206,6 +215,23 @@ void HttpRespHeaders::addBrEncodingHeader()
 }
 
 
+void HttpRespHeaders::addZstdEncodingHeader()
+{
+    add(s_zstdHeaders, 2, LSI_HEADER_MERGE);
+    updateEtag(ETAG_ZSTD);
+}
+
+
+void HttpRespHeaders::addDictEncodingHeader(ETAG_ENCODING type)
+{
+    if (type == ETAG_DCB)
+        add(s_dcbHeaders, 2, LSI_HEADER_MERGE);
+    else
+        add(s_dczHeaders, 2, LSI_HEADER_MERGE);
+    updateEtag(type);
+}
+
+
 void HttpRespHeaders::updateEtag(ETAG_ENCODING type)
 {
     int etagLen;
@@ -233,6 +259,18 @@ void HttpRespHeaders::updateEtag(ETAG_ENCODING type)
             *pUpdate++ = 'b';
             *pUpdate++ = 'r';
             break;
+        case ETAG_ZSTD:
+            *pUpdate++ = 'z';
+            *pUpdate++ = 's';
+            break;
+        case ETAG_DCZ:
+            *pUpdate++ = 'd';
+            *pUpdate++ = 'z';
+            break;
+        case ETAG_DCB:
+            *pUpdate++ = 'd';
+            *pUpdate++ = 'b';
+            break;
         }
     }
 }
@@ -1254,6 +1292,42 @@ void HttpRespHeaders::buildCommonHeaders()
     s_brHeaders[1].val      = s_sBrEncodingHeader + 28;
     s_brHeaders[1].valLen   = 15;
 
+    s_zstdHeaders[0].index    = HttpRespHeaders::H_CONTENT_ENCODING;
+    s_zstdHeaders[0].name     = s_sZstdEncodingHeader;
+    s_zstdHeaders[0].nameLen  = 16;
+    s_zstdHeaders[0].val      = s_sZstdEncodingHeader + 18;
+    s_zstdHeaders[0].valLen   = 4;
+
+    s_zstdHeaders[1].index    = HttpRespHeaders::H_VARY;
+    s_zstdHeaders[1].name     = s_sZstdEncodingHeader + 24;
+    s_zstdHeaders[1].nameLen  = 4;
+    s_zstdHeaders[1].val      = s_sZstdEncodingHeader + 30;
+    s_zstdHeaders[1].valLen   = 15;
+
+    s_dczHeaders[0].index    = HttpRespHeaders::H_CONTENT_ENCODING;
+    s_dczHeaders[0].name     = s_sDczEncodingHeader;
+    s_dczHeaders[0].nameLen  = 16;
+    s_dczHeaders[0].val      = s_sDczEncodingHeader + 18;
+    s_dczHeaders[0].valLen   = 3;
+
+    s_dczHeaders[1].index    = HttpRespHeaders::H_VARY;
+    s_dczHeaders[1].name     = s_sDczEncodingHeader + 23;
+    s_dczHeaders[1].nameLen  = 4;
+    s_dczHeaders[1].val      = s_sDczEncodingHeader + 29;
+    s_dczHeaders[1].valLen   = 37;
+
+    s_dcbHeaders[0].index    = HttpRespHeaders::H_CONTENT_ENCODING;
+    s_dcbHeaders[0].name     = s_sDcbEncodingHeader;
+    s_dcbHeaders[0].nameLen  = 16;
+    s_dcbHeaders[0].val      = s_sDcbEncodingHeader + 18;
+    s_dcbHeaders[0].valLen   = 3;
+
+    s_dcbHeaders[1].index    = HttpRespHeaders::H_VARY;
+    s_dcbHeaders[1].name     = s_sDcbEncodingHeader + 23;
+    s_dcbHeaders[1].nameLen  = 4;
+    s_dcbHeaders[1].val      = s_sDcbEncodingHeader + 29;
+    s_dcbHeaders[1].valLen   = 37;
+
     s_keepaliveHeader[0].index    = HttpRespHeaders::H_CONNECTION;
     s_keepaliveHeader[0].name     = s_sConnKeepAliveHeader;
     s_keepaliveHeader[0].nameLen  = 10;
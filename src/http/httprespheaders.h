@@ -33,6 +33,9 @@ enum ETAG_ENCODING
     ETAG_NO_ENCODE,
     ETAG_BROTLI,
     ETAG_GZIP,
+    ETAG_ZSTD,
+    ETAG_DCZ,
+    ETAG_DCB,
 };
 
 
@@ -201,6 +204,8 @@ public:
 
     void addGzipEncodingHeader();
     void addBrEncodingHeader();
+    void addZstdEncodingHeader();
+    void addDictEncodingHeader(ETAG_ENCODING type);
     void updateEtag(ETAG_ENCODING type);
     void appendChunked();
     void addCommonHeaders();
@@ -42,6 +42,7 @@ HttpServerConfig::HttpServerConfig()
     , m_iDynGzipCompress(0)
     , m_iCompressLevel(4)
     , m_iBrCompress(0)
+    , m_iZstdCompress(0)
     , m_iEnableLve(0)
     , m_iUsePagespeed(0)
     , m_iCheckDeniedSymLink(0)
@@ -56,6 +57,8 @@ HttpServerConfig::HttpServerConfig()
     , m_iDirForbiddenBits(000)   //S_IWOTH | S_IWGRP )
     , m_iRestartTimeout(300)
     , m_nCpuAffinity(0)
+    , m_iReusePortSteering(0)
+    , m_iOffloadThreads(2)
     , m_iDnsLookup(1)
     , m_iUseProxyHeader(0)
     , m_iEnableH2c(0)
@@ -46,6 +46,7 @@ class HttpServerConfig : public TSingleton<HttpServerConfig>
     int8_t          m_iDynGzipCompress;
     int8_t          m_iCompressLevel;
     int8_t          m_iBrCompress;
+    int8_t          m_iZstdCompress;
     int8_t          m_iEnableLve;
     int8_t          m_iUsePagespeed;
 
@@ -63,6 +64,8 @@ class HttpServerConfig : public TSingleton<HttpServerConfig>
     int32_t         m_iDirForbiddenBits;
     int32_t         m_iRestartTimeout;
     int32_t         m_nCpuAffinity;
+    int32_t         m_iReusePortSteering;
+    int32_t         m_iOffloadThreads;
 
     int             m_iDnsLookup;
     int             m_iUseProxyHeader;
@@ -129,6 +132,10 @@ public:
     {   m_iBrCompress = compress;     }
     int8_t  getBrCompress() const           {   return m_iBrCompress;       }
 
+    void setZstdCompress(int32_t compress)
+    {   m_iZstdCompress = compress;   }
+    int8_t  getZstdCompress() const         {   return m_iZstdCompress;     }
+
     void setDebugLevel(int32_t level);
 
     void setUsePagespeed(int n)                  {   m_iUsePagespeed = n;      }
@@ -203,6 +210,12 @@ public:
     int getCpuAffinity() const              {   return m_nCpuAffinity;      }
     void setCpuAffinity( int count)         {   m_nCpuAffinity = count;     }
 
+    int getReusePortSteering() const        {   return m_iReusePortSteering;    }
+    void setReusePortSteering(int val)      {   m_iReusePortSteering = val;     }
+
+    int getOffloadThreads() const           {   return m_iOffloadThreads;   }
+    void setOffloadThreads(int val)         {   m_iOffloadThreads = val;    }
+
     void setEnableMultiCerts(int v)  { m_iEnableMultiCerts = v; }
     int  getEnableMultiCerts() const { return m_iEnableMultiCerts; }
 };
@@ -58,6 +58,7 @@
 #include <lsiapi/lsiapi.h>
 #include <lsiapi/lsiapihooks.h>
 #include <lsiapi/modulemanager.h>
+#include <lsr/ls_offload.h>
 #include <lsr/ls_pool.h>
 #include <lsr/ls_strtool.h>
 #include <lsr/ls_threadcheck.h>
@@ -92,6 +93,11 @@
 #define SERVERPUSHTAG           "ls_smartpush"
 #define SERVERPUSHTAGLENGTH     (sizeof(SERVERPUSHTAG) - 1)
 
+//dynamic bodies of a known size in this range are gzipped on the shared
+//offloader, the others on the inline stream.
+#define GZIP_OFFLOAD_MIN_SIZE   (128 * 1024)
+#define GZIP_OFFLOAD_MAX_SIZE   (16 * 1024 * 1024)
+
 
 static const char * s_stateName[HSPS_END] =
 {
@@ -561,6 +567,7 @@ void HttpSession::nextRequest()
         else
             m_request.setCrypto(NULL);
 
+        detachGzipJob();
         if (getRespBodyBuf())
             releaseRespBody();
         if (getGzipBuf())
@@ -958,6 +965,7 @@ int HttpSession::restartHandlerProcess()
 
     clearFlag(HSF_RESP_HEADER_DONE | HSF_RESP_WAIT_FULL_BODY
               | HSF_RESP_FLUSHED | HSF_URI_MAPPED | HSF_HANDLER_DONE);
+    clearFlag2(HSF2_RESP_GZIP_OFFLOAD);
     return restartHandlerProcessEx();
 }
 
@@ -974,6 +982,7 @@ int HttpSession::restartHandlerProcessEx()
         m_pChunkOS->reset();
         releaseChunkOS();
     }
+    detachGzipJob();
     if (getRespBodyBuf())
         releaseRespBody();
     if (getGzipBuf())
@@ -3045,6 +3054,7 @@ void HttpSession::releaseResources()
     m_iReqTimeUs = DateTime::s_curTimeUs;
     m_iSubReqSeq = 0;
 
+    detachGzipJob();
     if (getRespBodyBuf())
         releaseRespBody();
 
@@ -3288,6 +3298,39 @@ int HttpSession::writeRespBodyDirect(const char *pBuf, int size)
 }
 
 
+//Body data in our own anonymous mapped buffer can be left referenced by
+//the kernel, the buffer is pinned so those blocks are never reused.
+int HttpSession::writeRespBodyNoCopy(const char *pBuf, int size)
+{
+    int ref;
+    int written = getStream()->writeNoCopy(pBuf, size, &ref);
+    if (ref)
+        getRespBodyBuf()->pin();
+    if (written > 0)
+    {
+        LS_DBG_H(getLogSession(), "writeRespBodyNoCopy(): write(%p, %d) written %d, total sent: %lld\n",
+                 pBuf, size, written, (long long)m_response.getBodySent() + written);
+        m_response.written(written);
+    }
+    return written;
+}
+
+
+//Unfiltered, the caller makes sure no body filter or chunking is active.
+int HttpSession::writeRespBodyv(IOVec &iov, int total)
+{
+    int written = getStream()->writev(iov, total);
+    if (written > 0)
+    {
+        LS_DBG_H(getLogSession(), "writeRespBodyv(): writev(%d, %d) written %d, total sent: %lld\n",
+                 iov.len(), total, written,
+                 (long long)m_response.getBodySent() + written);
+        m_response.written(written);
+    }
+    return written;
+}
+
+
 int HttpSession::isExtAppNoAbort()
 {
     if (getFlag(HSF_NO_ABORT))
@@ -3420,6 +3463,23 @@ int HttpSession::detectTimeout()
 }
 
 
+//Only a keep-alive wait can sleep past the next second, until the point
+//detectKeepAliveTimeout() would close it.
+int32_t HttpSession::getTimerDeadline() const
+{
+    if (getState() != HSS_WAITING)
+        return 0;
+    if (m_iReqServed != 0)
+    {
+        if (ConnLimitCtrl::getInstance().getConnOverflow())
+            return 0;
+        if (DateTime::s_curTime < m_lReqTime + 3)
+            return m_lReqTime + 3;
+    }
+    return m_lReqTime + HttpServerConfig::getInstance().getKeepAliveTimeout();
+}
+
+
 int HttpSession::onTimerEx()
 {
     if (getClientInfo())
@@ -3467,7 +3527,8 @@ int HttpSession::writeRespBody(const char *pBuf, int len)
 
 void HttpSession::rewindRespBodyBuf()
 {
-    if (getRespBodyBuf())
+    //the plain body is held for the offloaded gzip, nothing has been sent.
+    if (getRespBodyBuf() && !getFlag2(HSF2_RESP_GZIP_OFFLOAD))
     {
         off_t wPos = getRespBodyBuf()->getCurWBlkPos();
         if (wPos < 2048 * 1024)
@@ -3490,6 +3551,8 @@ int HttpSession::sendDynBody()
 {
     size_t toWrite;
     char *pBuf;
+    int noCopy = (!m_pChunkOS && getRespBodyBuf()->isAnonMapped()
+                  && m_sessionHooks.isDisabled(LSI_HKPT_SEND_RESP_BODY));
 
     while (((pBuf = getRespBodyBuf()->getReadBuffer(toWrite)) != NULL)
            && (toWrite > 0))
@@ -3507,7 +3570,8 @@ int HttpSession::sendDynBody()
             }
         }
 
-        int ret = writeRespBody(pBuf, len);
+        int ret = noCopy ? writeRespBodyNoCopy(pBuf, len)
+                         : writeRespBody(pBuf, len);
         LS_DBG_M(getLogSession(), "writeRespBody() len = %d, returned %d.\n",
                  len, ret);
         if (ret > 0)
@@ -3577,6 +3641,8 @@ inline int HttpSession::useGzip()
 
 extern int addModgzipFilter(lsi_session_t *session, int isSend,
                             uint8_t compressLevel);
+extern int addModzstdFilter(lsi_session_t *session, int isSend,
+                            uint8_t compressLevel);
 
 int HttpSession::addModgzipFilter(int isSend, uint8_t compressLevel)
 {
@@ -3589,12 +3655,37 @@ int HttpSession::addModgzipFilter(int isSend, uint8_t compressLevel)
     return 0;
 }
 
+
+int HttpSession::addModzstdFilter(int isSend, uint8_t compressLevel)
+{
+    if (m_sessionHooks.isNotInited())
+        return -1;
+
+    if (::addModzstdFilter((LsiSession *)this, isSend, compressLevel) == -1)
+        return LS_FAIL;
+
+    return 0;
+}
+
+
+//zstd is always applied at SEND_RESP_BODY filter, the response body buffer
+//keeps the uncompressed data.
+int HttpSession::setupZstdSendFilter()
+{
+    if (addModzstdFilter(1, HttpServerConfig::getInstance().getZstdCompress())
+        == -1)
+        return LS_FAIL;
+    m_response.addZstdEncodingHeader();
+    return 0;
+}
+
 int HttpSession::setupGzipFilter()
 {
     if (testFlag(HSF_RESP_HEADER_SENT))
         return 0;
 
     char gz = m_request.gzipAcceptable();
+    char zs = m_request.zstdAcceptable();
     int recvhkptNogzip = m_sessionHooks.getFlag(LSI_HKPT_RECV_RESP_BODY) &
                          LSI_FLAG_DECOMPRESS_REQUIRED;
     int  hkptNogzip = (m_sessionHooks.getFlag(LSI_HKPT_RECV_RESP_BODY)
@@ -3617,12 +3708,38 @@ int HttpSession::setupGzipFilter()
     else
         clearFlag(HSF_RESP_BODY_GZIPCOMPRESSED);
 
-    if (gz == GZIP_REQUIRED)
+    if (zs & UPSTREAM_ZSTD)
+    {
+        setFlag2(HSF2_RESP_BODY_ZSTDCOMPRESSED);
+        if (recvhkptNogzip || hkptNogzip || !(zs & REQ_ZSTD_ACCEPT))
+        {
+            if (addModzstdFilter(0, 0) == -1)
+                return LS_FAIL;
+            m_response.getRespHeaders().del(
+                HttpRespHeaders::H_CONTENT_ENCODING);
+            m_request.andZstd(~UPSTREAM_ZSTD);
+            clearFlag2(HSF2_RESP_BODY_ZSTDCOMPRESSED);
+        }
+        else
+            return 0;
+    }
+    else
+        clearFlag2(HSF2_RESP_BODY_ZSTDCOMPRESSED);
+
+    if ((zs == ZSTD_REQUIRED) && !(gz & (UPSTREAM_GZIP | UPSTREAM_DEFLATE)))
+    {
+        if (m_response.getContentLen() > 200 ||
+            m_response.getContentLen() < 0)
+            return setupZstdSendFilter();
+    }
+    else if (gz == GZIP_REQUIRED)
     {
         if (!hkptNogzip)
         {
             if (!getRespBodyBuf()->empty())
                 getRespBodyBuf()->rewindWriteBuf();
+            if (setupGzipOffload() == 0)
+                return 0;
             if (m_response.getContentLen() > 200 ||
                 m_response.getContentLen() < 0)
             {
@@ -3701,6 +3818,151 @@ void HttpSession::releaseGzipBuf()
 }
 
 
+class GzipOffloadJob
+{
+public:
+    HttpSession *m_pSession;
+    VMemBuf     *m_pBody;
+    VMemBuf     *m_pOut;
+    int          m_iLevel;
+};
+
+
+//Runs in an offload thread, the job owns both buffers until it is done.
+static int performGzipJob(void *param)
+{
+    GzipOffloadJob *pJob = (GzipOffloadJob *)param;
+    GzipBuf gzip;
+    size_t len;
+    char *pBuf;
+    gzip.setCompressCache(pJob->m_pOut);
+    if ((gzip.init(GzipBuf::COMPRESSOR_COMPRESS, pJob->m_iLevel) != 0)
+        || (gzip.beginStream() != 0))
+        return LS_FAIL;
+    while (((pBuf = pJob->m_pBody->getReadBuffer(len)) != NULL) && (len > 0))
+    {
+        if (gzip.write(pBuf, len) == LS_FAIL)
+            return LS_FAIL;
+        pJob->m_pBody->readUsed(len);
+    }
+    if (gzip.endStream() != 0)
+        return LS_FAIL;
+    return 0;
+}
+
+
+static void onGzipJobDone(void *param, int result)
+{
+    GzipOffloadJob *pJob = (GzipOffloadJob *)param;
+    VMemBuf *pKeep = pJob->m_pBody;
+    VMemBuf *pDrop = pJob->m_pOut;
+    if (result != LS_FAIL)
+    {
+        pKeep = pJob->m_pOut;
+        pDrop = pJob->m_pBody;
+    }
+    HttpResourceManager::getInstance().recycle(pDrop);
+    if (pJob->m_pSession)
+        pJob->m_pSession->onGzipOffloadDone(pKeep, result != LS_FAIL);
+    else
+        HttpResourceManager::getInstance().recycle(pKeep);
+    delete pJob;
+}
+
+
+//A large body of a known size is buffered plain while the handler runs and
+//gzipped on the shared offloader by endResponse(), see offloadGzip().
+int HttpSession::setupGzipOffload()
+{
+    off_t len = m_response.getContentLen();
+    if ((len < GZIP_OFFLOAD_MIN_SIZE) || (len > GZIP_OFFLOAD_MAX_SIZE)
+        || !offloader_get_shared() || !getRespBodyBuf() || getGzipBuf()
+        || isNoRespBody() || m_pMtSessData || getFlag(HSF_SUB_SESSION)
+        || (m_sendFileInfo.getRemain() > 0))
+        return LS_FAIL;
+    LS_DBG_M(getLogSession(), "GZIP the response body in offload thread.");
+    setFlag2(HSF2_RESP_GZIP_OFFLOAD);
+    setFlag(HSF_RESP_WAIT_FULL_BODY);
+    m_response.setContentLen(LSI_BODY_SIZE_UNKNOWN);
+    m_response.addGzipEncodingHeader();
+    m_request.orGzip(UPSTREAM_GZIP);
+    setFlag(HSF_RESP_BODY_GZIPCOMPRESSED);
+    return 0;
+}
+
+
+void HttpSession::cancelGzipOffload()
+{
+    clearFlag2(HSF2_RESP_GZIP_OFFLOAD);
+    m_response.getRespHeaders().del(HttpRespHeaders::H_CONTENT_ENCODING);
+    m_request.andGzip(~UPSTREAM_GZIP);
+    clearFlag(HSF_RESP_BODY_GZIPCOMPRESSED);
+}
+
+
+//Hands the plain body over to the offloader, the response is paused until
+//onGzipOffloadDone(), which may run inline when the task cannot be queued.
+int HttpSession::offloadGzip()
+{
+    VMemBuf *pBody = getRespBodyBuf();
+    VMemBuf *pOut = HttpResourceManager::getInstance().getVMemBuf();
+    if (!pBody || !pOut
+        || (pOut->set(VMBUF_ANON_MAP, VMemBuf::getBlockSize()) == -1)
+        || (pBody->flushSwapFile() == LS_FAIL))
+    {
+        LS_WARN(getLogSession(), "Failed to offload GZIP of the response "
+                "body, send it uncompressed.");
+        if (pOut)
+            HttpResourceManager::getInstance().recycle(pOut);
+        cancelGzipOffload();
+        return 0;
+    }
+    clearFlag2(HSF2_RESP_GZIP_OFFLOAD);
+    GzipOffloadJob *pJob = new GzipOffloadJob();
+    pJob->m_pSession = this;
+    pJob->m_pBody = pBody;
+    pJob->m_pOut = pOut;
+    pJob->m_iLevel = HttpServerConfig::getInstance().getCompressLevel();
+    setRespBodyBuf(NULL);
+    m_pGzipJob = pJob;
+    LS_DBG_M(getLogSession(), "Offload GZIP of %lld bytes response body.",
+             (long long)pBody->getCurWOffset());
+    offloader_submit(offloader_get_shared(), performGzipJob, onGzipJobDone,
+                     pJob);
+    return LS_AGAIN;
+}
+
+
+void HttpSession::onGzipOffloadDone(VMemBuf *pBody, int gzipped)
+{
+    m_pGzipJob = NULL;
+    setRespBodyBuf(pBody);
+    if (gzipped)
+        LS_DBG_M(getLogSession(), "Offloaded GZIP done, %lld bytes.",
+                 (long long)pBody->getCurWOffset());
+    else
+    {
+        LS_WARN(getLogSession(), "Failed to GZIP the response body in "
+                "offload thread, send it uncompressed.");
+        pBody->rewindReadBuf();
+        cancelGzipOffload();
+    }
+    if (runRcvdRespBodyHook() == 0)
+        endResponseTail();
+}
+
+
+//The job outlives the session, it frees its buffers in onGzipJobDone().
+void HttpSession::detachGzipJob()
+{
+    if (m_pGzipJob)
+    {
+        m_pGzipJob->m_pSession = NULL;
+        m_pGzipJob = NULL;
+    }
+}
+
+
 
 int appendDynBodyTermination(HttpSession *conn, const char *pBuf, int len)
 {
@@ -3860,7 +4122,7 @@ int HttpSession::appendRespBodyBufV(const iovec *vector, int count)
 
 int HttpSession::shouldSuspendReadingResp()
 {
-    if (getRespBodyBuf())
+    if (getRespBodyBuf() && !getFlag2(HSF2_RESP_GZIP_OFFLOAD))
     {
         int buffered = getRespBodyBuf()->getCurWBlkPos() -
                        getRespBodyBuf()->getCurRBlkPos();
@@ -4016,7 +4278,19 @@ int HttpSession::endResponseInternal(int success)
             LS_DBG_M(getLogSession(), "endResponse() end GZIP stream.");
     }
 
-    if (!ret && m_sessionHooks.isEnabled(LSI_HKPT_RCVD_RESP_BODY))
+    if (!ret && getFlag2(HSF2_RESP_GZIP_OFFLOAD))
+        return offloadGzip();
+
+    if (!ret)
+        ret = runRcvdRespBodyHook();
+    return ret;
+}
+
+
+int HttpSession::runRcvdRespBodyHook()
+{
+    int ret = 0;
+    if (m_sessionHooks.isEnabled(LSI_HKPT_RCVD_RESP_BODY))
     {
         ret = m_sessionHooks.runCallbackNoParam(LSI_HKPT_RCVD_RESP_BODY,
                                                 (LsiSession *)this);
@@ -4048,6 +4322,13 @@ int HttpSession::endResponse(int success)
     ret = endResponseInternal(success);
     if (ret)
         return ret;
+    return endResponseTail();
+}
+
+
+int HttpSession::endResponseTail()
+{
+    int ret;
     // FIXME ols orig code
 //     if (!isRespHeaderSent() && (m_response.getContentLen() < 0))
     if (!m_request.noRespBody() && !isRespHeaderSent()
@@ -4191,6 +4472,13 @@ int HttpSession::flush()
         return LS_AGAIN;
     }
 
+    if (m_pGzipJob)
+    {
+        LS_DBG_L(getLogSession(), "Response body is being gzipped, cannot flush.");
+        suspendWrite();
+        return LS_AGAIN;
+    }
+
     if (getFlag(HSF_RESP_FLUSHED))
     {
         LS_DBG_L(getLogSession(), "HSF_RESP_FLUSHED flag is set, skip flush.");
@@ -4877,6 +5165,8 @@ void HttpSession::setSendFileBeginEnd(off_t start, off_t end)
 {
     m_sendFileInfo.setCurPos(start);
     m_sendFileInfo.setCurEnd(end);
+    if ((end > start) && getFlag2(HSF2_RESP_GZIP_OFFLOAD))
+        cancelGzipOffload();
     if ((end > start) && getFlag(HSF_RESP_WAIT_FULL_BODY))
     {
         clearFlag(HSF_RESP_WAIT_FULL_BODY);
@@ -5013,7 +5303,8 @@ int HttpSession::sendStaticFileEx(SendFileInfo *pData)
 #if !defined( NO_SENDFILE )
     int fd = pData->getfd();
     int iModeSF = HttpServerConfig::getInstance().getUseSendfile();
-    if (iModeSF && fd != -1 && !isHttps() && !getStream()->isSpdy()
+    if (iModeSF && fd != -1 && !getStream()->isSpdy()
+        && (!isHttps() || getStream()->isSendfileAvail())
         && (!getGzipBuf() ||
             (pData->getECache() == pData->getFileData()->getGzip())))
     {
@@ -5238,7 +5529,8 @@ void HttpSession::testContentType()
     if (!pValue)
         return;
     const MimeSetting *pMIME = NULL;
-    int canCompress = pReq->gzipAcceptable() | pReq->brAcceptable();
+    int canCompress = pReq->gzipAcceptable() | pReq->brAcceptable()
+                      | pReq->zstdAcceptable();
     HttpContext *pContext = &(pReq->getVHost()->getRootContext());
     const ExpiresCtrl *pExpireDefault = pReq->shouldAddExpires();
     int enbale = pContext->getExpires().isEnabled();
@@ -5264,6 +5556,7 @@ void HttpSession::testContentType()
     {
         pReq->andGzip(~GZIP_ENABLED);
         pReq->andBr(~BR_ENABLED);
+        pReq->andZstd(~ZSTD_ENABLED);
     }
 
     if (enbale)
@@ -5283,7 +5576,8 @@ int HttpSession::updateContentCompressible()
 {
     int compressible = 0;
     if ((m_request.gzipAcceptable() == GZIP_REQUIRED)
-        || (m_request.brAcceptable() == BR_REQUIRED))
+        || (m_request.brAcceptable() == BR_REQUIRED)
+        || (m_request.zstdAcceptable() == ZSTD_REQUIRED))
     {
         int len;
         char *pContentType = (char *)m_response.getRespHeaders().getHeader(
@@ -5299,6 +5593,7 @@ int HttpSession::updateContentCompressible()
         {
             m_request.andGzip(~GZIP_ENABLED);
             m_request.andBr(~BR_ENABLED);
+            m_request.andZstd(~ZSTD_ENABLED);
         }
     }
     return compressible;
@@ -5311,7 +5606,25 @@ int HttpSession::contentEncodingFixup()
     int requireChunk = 0;
     const char *pContentEncoding = m_response.getRespHeaders().getHeader(
                                        HttpRespHeaders::H_CONTENT_ENCODING, &len);
-    if ((!(m_request.gzipAcceptable() & REQ_GZIP_ACCEPT))
+    if (pContentEncoding && len == 3
+        && strncasecmp(pContentEncoding, "dc", 2) == 0)
+    {
+        //dictionary encoded static file, only served to clients asking
+        //for it and no filter can decode it.
+    }
+    else if (pContentEncoding && len == 4
+        && strncasecmp(pContentEncoding, "zstd", 4) == 0)
+    {
+        if (!(m_request.zstdAcceptable() & REQ_ZSTD_ACCEPT))
+        {
+            if (addModzstdFilter(1, 0) == -1)
+                return LS_FAIL;
+            m_response.getRespHeaders().del(HttpRespHeaders::H_CONTENT_ENCODING);
+            clearFlag2(HSF2_RESP_BODY_ZSTDCOMPRESSED);
+            requireChunk = 1;
+        }
+    }
+    else if ((!(m_request.gzipAcceptable() & REQ_GZIP_ACCEPT))
         && (!(m_request.brAcceptable() & REQ_BR_ACCEPT)))
     {
         if (pContentEncoding)
@@ -5322,10 +5635,25 @@ int HttpSession::contentEncodingFixup()
             clearFlag(HSF_RESP_BODY_GZIPCOMPRESSED);
             requireChunk = 1;
         }
+        else if ((m_request.zstdAcceptable() == ZSTD_REQUIRED)
+                 && updateContentCompressible()
+                 && m_response.getContentLen() > 200)
+        {
+            if (setupZstdSendFilter() == -1)
+                return LS_FAIL;
+            requireChunk = 1;
+        }
     }
     else if (!pContentEncoding && updateContentCompressible())
     {
-        if (m_response.getContentLen() > 200)// && getReq()->getStatusCode() < SC_400)
+        if ((m_request.zstdAcceptable() == ZSTD_REQUIRED)
+            && m_response.getContentLen() > 200)
+        {
+            if (setupZstdSendFilter() == -1)
+                return LS_FAIL;
+            requireChunk = 1;
+        }
+        else if (m_response.getContentLen() > 200)// && getReq()->getStatusCode() < SC_400)
         {
             if (addModgzipFilter(1, HttpServerConfig::getInstance().getCompressLevel()) == -1)
                 return LS_FAIL;
@@ -56,6 +56,7 @@ class MtParamSendfile;
 class MtParamParseReqArgs;
 class MtLocalBufQ;
 class HioCrypto;
+class GzipOffloadJob;
 
 enum  HttpSessionState
 {
@@ -170,6 +171,8 @@ enum HSPState
 
 //Start flag2
 #define HSF2_IS_HTTP2               (1<<0)
+#define HSF2_RESP_BODY_ZSTDCOMPRESSED (1<<1)
+#define HSF2_RESP_GZIP_OFFLOAD      (1<<2)
 
 
 typedef int (*SubSessionCb)(HttpSession *pSubSession, void *param,
@@ -213,6 +216,7 @@ class HttpSession
 
     SsiStack             *m_pSsiStack;
     SsiRuntime           *m_pSsiRuntime;
+    GzipOffloadJob       *m_pGzipJob;
 
     off_t                 m_lDynBodySent;
 
@@ -540,6 +544,7 @@ public:
     int isEndResponse() const               { return testFlag(HSF_HANDLER_DONE);     };
 
     int resumeProcess(int resumeState, int retcode);
+    void onGzipOffloadDone(VMemBuf *pBody, int gzipped);
 
 public:
     void setupChunkOS(int nobuffer);
@@ -566,6 +571,8 @@ public:
     int32_t getReqTimeUs() const    {   return m_iReqTimeUs;    }
 
     int writeRespBodyDirect(const char *pBuf, int size);
+    int writeRespBodyNoCopy(const char *pBuf, int size);
+    int writeRespBodyv(IOVec &iov, int total);
     int writeRespBody(const char *pBuf, int len);
 
     int isNoRespBody() const
@@ -592,6 +599,7 @@ public:
                      const char *uploadTmpDir, int uploadTmpFilePermission);
 
     int  onTimerEx();
+    int32_t getTimerDeadline() const;
 
     //void accessGranted()    {   m_accessGranted = 1;  }
     void changeHandler() {    setState(HSS_REDIRECT); };
@@ -658,9 +666,17 @@ public:
 
     int useGzip();
     int addModgzipFilter(int isSend, uint8_t compressLevel);
+    int addModzstdFilter(int isSend, uint8_t compressLevel);
+    int setupZstdSendFilter();
     int setupGzipFilter();
     int setupGzipBuf();
     void releaseGzipBuf();
+    int setupGzipOffload();
+    void cancelGzipOffload();
+    int offloadGzip();
+    void detachGzipJob();
+    int endResponseTail();
+    int runRcvdRespBodyHook();
     GzipBuf *getGzipBuf() const     {   return getResp()->getGzipBuf();     }
     void setGzipBuf(GzipBuf *pGzip) {   getResp()->setGzipBuf(pGzip);       }
 
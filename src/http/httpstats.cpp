@@ -25,5 +25,13 @@ long        HttpStats::s_iBytesWritten = 0;
 long        HttpStats::s_iSSLBytesRead = 0;
 long        HttpStats::s_iSSLBytesWritten = 0;
 int         HttpStats::s_iIdleConns = 0;
+long        HttpStats::s_iKtlsConns = 0;
+long        HttpStats::s_iKtlsFallbacks = 0;
+long        HttpStats::s_iZeroCopySends = 0;
+long        HttpStats::s_iZeroCopyCopied = 0;
+int         HttpStats::s_iAcceptBudget = 0;
+long        HttpStats::s_iAcceptCapped = 0;
+long        HttpStats::s_iAcceptGrow = 0;
+long        HttpStats::s_iAcceptShrink = 0;
 ReqStats    HttpStats::s_reqStats;
 
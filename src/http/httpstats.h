@@ -28,6 +28,14 @@ class HttpStats
     static long     s_iSSLBytesRead;
     static long     s_iSSLBytesWritten;
     static int      s_iIdleConns;
+    static long     s_iKtlsConns;
+    static long     s_iKtlsFallbacks;
+    static long     s_iZeroCopySends;
+    static long     s_iZeroCopyCopied;
+    static int      s_iAcceptBudget;
+    static long     s_iAcceptCapped;
+    static long     s_iAcceptGrow;
+    static long     s_iAcceptShrink;
     static ReqStats s_reqStats;
 
     HttpStats() {};
@@ -63,6 +71,33 @@ public:
     static void incIdleConns(int val = 1)       {   s_iIdleConns += val;      }
     static void decIdleConns(int val = 1)       {   s_iIdleConns -= val;      }
 
+    static long getKtlsConns()                  {   return s_iKtlsConns;      }
+    static void incKtlsConns()                  {   ++s_iKtlsConns;           }
+
+    static long getKtlsFallbacks()              {   return s_iKtlsFallbacks;  }
+    static void incKtlsFallbacks()              {   ++s_iKtlsFallbacks;       }
+
+    static long getZeroCopySends()              {   return s_iZeroCopySends;  }
+    static void incZeroCopySends()              {   ++s_iZeroCopySends;       }
+
+    static long getZeroCopyCopied()             {   return s_iZeroCopyCopied; }
+    static void incZeroCopyCopied()             {   ++s_iZeroCopyCopied;      }
+
+    static int  getAcceptBudget()               {   return s_iAcceptBudget;   }
+    static void setAcceptBudget(int val)        {   s_iAcceptBudget = val;    }
+
+    static long getAcceptCapped()               {   return s_iAcceptCapped;   }
+    static void incAcceptCapped()               {   ++s_iAcceptCapped;        }
+
+    static long getAcceptGrow()                 {   return s_iAcceptGrow;     }
+    static void incAcceptGrow()                 {   ++s_iAcceptGrow;          }
+
+    static long getAcceptShrink()               {   return s_iAcceptShrink;   }
+    static void incAcceptShrink()               {   ++s_iAcceptShrink;        }
+
+    static void resetAcceptStats()
+    {   s_iAcceptCapped = s_iAcceptGrow = s_iAcceptShrink = 0;  }
+
     static ReqStats *getReqStats()              {   return &s_reqStats;       }
 
 };
@@ -20,6 +20,7 @@
 #include <http/accesscache.h>
 #include <http/accesslog.h>
 #include <http/awstats.h>
+#include <http/compressdict.h>
 #include <http/denieddir.h>
 #include <http/handlerfactory.h>
 #include <http/handlertype.h>
@@ -885,6 +886,20 @@ int HttpVHost::configBasics(const XmlNode *pVhConfNode, int iChrootLen)
     enableBr((HttpServerConfig::getInstance().getBrCompress()) ?
                ConfigCtx::getCurConfigCtx()->getLongValue(pVhConfNode, "enableBr", 0, 1,
                        1) : 0);
+
+    enableZstd((HttpServerConfig::getInstance().getZstdCompress()) ?
+               ConfigCtx::getCurConfigCtx()->getLongValue(pVhConfNode, "enableZstd", 0, 1,
+                       1) : 0);
+
+    const char *pDictMatch = pVhConfNode->getChildValue("compressDictMatch");
+    if (pDictMatch)
+    {
+        if (CompressDict::isSupported())
+            CompressDict::addPatterns(m_dictMatchList, pDictMatch);
+        else
+            LS_NOTICE(ConfigCtx::getCurConfigCtx(), "compressDictMatch needs"
+                      " zstd or brotli 1.1 support, ignored.");
+    }
     int val = ConfigCtx::getCurConfigCtx()->getLongValue(pVhConfNode, "enableIpGeo", -1, 1, -1);
     if (val == -1)
         val = HttpServer::getInstance().getServerContext().isGeoIpOn();
@@ -58,6 +58,7 @@ END_LOG4CXX_NS
 #define VH_CGROUP           2048
 #define VH_RECAPTCHA        4096
 #define VH_QUIC_LISTENER    8192
+#define VH_ZSTD             16384
 
 #define MAX_VHOST_PHP_NUM    100
 
@@ -165,6 +166,7 @@ private:
     HotlinkCtrl        *m_pHotlinkCtrl;
     RealmMap            m_realmMap;
     StringList          m_matchNameList;
+    StringList          m_dictMatchList;
 
     Awstats            *m_pAwstats;
 
@@ -306,6 +308,12 @@ public:
     void enableBr(int enable)         {   setFeature(VH_BR, enable);      }
     int  enableBr() const               {   return m_iFeatures & VH_BR;     }
 
+    void enableZstd(int enable)       {   setFeature(VH_ZSTD, enable);    }
+    int  enableZstd() const             {   return m_iFeatures & VH_ZSTD;   }
+
+    const StringList *getCompressDictMatch() const
+    {   return &m_dictMatchList;    }
+
     void enableCGroup(int enable)       {   setFeature(VH_CGROUP, enable);    }
     int  enableCGroup() const             {   return m_iFeatures & VH_CGROUP;   }
 
@@ -73,6 +73,8 @@ static uint32_t stsz_adjust(stsz_t *stsz, uint32_t s1, uint32_t s2);
 static uint32_t stco_co64_adjust(stco_co64_t *stco_co64, uint32_t c1,
                                  uint32_t c2);
 static uint32_t stss_adjust(stss_t *stss, uint32_t s1, uint32_t s2);
+static uint32_t stss_lower_bound(unsigned char *sync_table, uint32_t count,
+                                 uint32_t sample);
 static uint32_t ctts_adjust(ctts_t *ctts, uint32_t s1, uint32_t s2);
 
 static int calc_new_moov_diff(moov_t *moov_box, float start_time,
@@ -249,6 +251,34 @@ int get_mini_moov(int fd,                    //in - video file descriptor
 }
 
 
+/*    return: 0 -- error
+ *             1 -- moov parsed from mini_moov and adjusted to the time range
+ */
+static int moov_prepare(moov_t *moov, float start_time, float end_time,
+                        unsigned char *mini_moov, uint32_t mini_moov_size)
+{
+    boxheader_t dummy;
+    int i;
+    int64_t t;
+
+    memset(moov, 0, sizeof(*moov));
+    boxheader_read(mini_moov, &dummy, mini_moov + mini_moov_size);
+    moov->header = dummy;
+
+    if (mini_moov_read(mini_moov, moov) == 0)
+        return (0);
+    if (calc_new_moov_diff(moov, start_time, end_time) == 0)
+        return (0);
+
+    t = (int64_t)(moov->header.ExtendedSize + moov->header.deltaSize     -
+                  moov->mdat_start_offset + moov->mdat_header_length);
+
+    for (i = 0; i < moov->track_num; i++)
+        moov->trak[i].mdia.minf.stbl.stco_co64.deltaOffset = t;
+    return (1);
+}
+
+
 int get_moov(int
              fd,                            //in - video file descriptor
              float start_time,            //in - seconds
@@ -258,52 +288,27 @@ int get_moov(int
              uint32_t mini_moov_size)    //in
 {
     moov_t moov;
-    boxheader_t dummy;
-
-    int r, fail, i;
-    int64_t t;
-
-    memset(&moov, 0, sizeof(moov));
-    fail = 0;
-    do
-    {
-        boxheader_read(mini_moov, &dummy, mini_moov + mini_moov_size);
-        moov.header = dummy;
-
-        r = mini_moov_read(mini_moov, & moov);
-        if (r == 0)
-        {
-            fail = 1;
-            break;
-        }
-
-        r = calc_new_moov_diff(&moov, start_time, end_time);
-        if (r == 0)
-        {
-            fail = 1;
-            break;
-        }
-
-        t = (int64_t)(moov.header.ExtendedSize + moov.header.deltaSize     -
-                      moov.mdat_start_offset + moov.mdat_header_length);
 
-        for (i = 0; i < moov.track_num; i++)
-            moov.trak[i].mdia.minf.stbl.stco_co64.deltaOffset = t;
+    if (moov_prepare(&moov, start_time, end_time, mini_moov,
+                     mini_moov_size) == 0)
+        return (-1);
+    moov_write_chunk(moov_data, & moov);
+    if (moov_data->remaining_bytes == 0)
+        return (1);
+    else
+        return (0);
+}
 
-        moov_write_chunk(moov_data, & moov);
-        break;
-    }
-    while (1);
 
-    if (fail == 1)
-        return (-1);
+static void moov_get_mdat(moov_t *moov, uint64_t *mdat_start,
+                          uint64_t *mdat_size, int *mdat_64bit)
+{
+    *mdat_start = moov->mdat_start_offset;
+    *mdat_size = moov->mdat_end_offset - moov->mdat_start_offset;
+    if (moov->mdat_header_length == 16)
+        *mdat_64bit = 1;
     else
-    {
-        if (moov_data->remaining_bytes == 0)
-            return (1);
-        else
-            return (0);
-    }
+        *mdat_64bit = 0;
 }
 
 
@@ -318,45 +323,89 @@ int get_mdat(int
              uint32_t mini_moov_size)    //in
 {
     moov_t moov;
-    boxheader_t dummy;
 
-    int r, fail;
+    if (moov_prepare(&moov, start_time, end_time, mini_moov,
+                     mini_moov_size) == 0)
+        return (-1);
+    moov_get_mdat(&moov, mdat_start, mdat_size, mdat_64bit);
+    return (1);
+}
 
-    memset(&moov, 0, sizeof(moov));
-    fail = 0;
-    do
-    {
-        boxheader_read(mini_moov, &dummy, mini_moov + mini_moov_size);
-        moov.header = dummy;
 
-        r = mini_moov_read(mini_moov, & moov);
-        if (r == 0)
-        {
-            fail = 1;
-            break;
-        }
-        r = calc_new_moov_diff(&moov, start_time, end_time);
-        if (r == 0)
-        {
-            fail = 1;
-            break;
-        }
-        break;
-    }
-    while (1);
+struct moov_seek_s
+{
+    moov_t          moov;
+    moov_data_t     data;
+};
 
-    if (fail == 1)
-        return (-1);
+
+moov_seek_t *moov_seek_new(float start_time, unsigned char *mini_moov,
+                           uint32_t mini_moov_size)
+{
+    moov_seek_t *seek = (moov_seek_t *)malloc(sizeof(moov_seek_t));
+    if (!seek)
+        return NULL;
+    if (moov_prepare(&seek->moov, start_time, 0.0, mini_moov,
+                     mini_moov_size) == 0)
+    {
+        free(seek);
+        return NULL;
+    }
+    memset(&seek->data, 0, sizeof(seek->data));
+    seek->data.remaining_bytes = 1;  //first call
+    seek->data.start_time = start_time;
+    return seek;
+}
+
+
+moov_data_t *moov_seek_data(moov_seek_t *seek)
+{
+    return &seek->data;
+}
+
+
+uint64_t moov_seek_content_len(moov_seek_t *seek)
+{
+    moov_t *moov = &seek->moov;
+    //deltas are computed in 32 bits, moov_write_chunk() sums them the same way
+    uint64_t r = (uint32_t)(moov->header.ExtendedSize + moov->header.deltaSize);
+    if (moov->mdat_header_length == 16)
+        r += 16;
     else
+        r += 8;
+    r += moov->mdat_end_offset - moov->mdat_start_offset;
+    return (r);
+}
+
+
+int moov_seek_next(moov_seek_t *seek)
+{
+    if (seek->data.mem.buffer)
     {
-        *mdat_start = moov.mdat_start_offset;
-        *mdat_size = moov.mdat_end_offset - moov.mdat_start_offset;
-        if (moov.mdat_header_length == 16)
-            *mdat_64bit = 1;
-        else
-            *mdat_64bit = 0;
-        return (1);
+        free(seek->data.mem.buffer);
+        seek->data.mem.buffer = NULL;
     }
+    if (moov_write_chunk(&seek->data, &seek->moov) == -1)
+        return (-1);
+    if (seek->data.remaining_bytes == 0)
+        return (1);
+    else
+        return (0);
+}
+
+
+void moov_seek_mdat(moov_seek_t *seek, uint64_t *mdat_start,
+                    uint64_t *mdat_size, int *mdat_64bit)
+{
+    moov_get_mdat(&seek->moov, mdat_start, mdat_size, mdat_64bit);
+}
+
+
+void moov_seek_free(moov_seek_t *seek)
+{
+    if (seek->data.mem.buffer)
+        free(seek->data.mem.buffer);
+    free(seek);
 }
 
 
@@ -1475,16 +1524,14 @@ static unsigned char *stss_write(unsigned char *dst, void *box)
     dst = bytes_write(dst, 4, (uint64_t)newCount);
     buf += 1 + 3 + 4;
 
-    for (i = 0; i < stss_box->SyncCount; i++)
+    for (i = stss_lower_bound(buf, stss_box->SyncCount, n1);
+         i < stss_box->SyncCount; i++)
     {
         t = bytes_read(buf + 4 * i, 4);
         if (t > n2)
             break;
-        if (t >= n1 && t <= n2)
-        {
-            t -= n1 - 1;
-            dst = bytes_write(dst, 4, (uint64_t)t);
-        }
+        t -= n1 - 1;
+        dst = bytes_write(dst, 4, (uint64_t)t);
     }
 
     return (dst);
@@ -1810,23 +1857,35 @@ static uint32_t stco_co64_adjust(stco_co64_t *stco_co64, uint32_t c1,
 }
 
 
+//index of the first sync sample >= sample, the table is sorted.
+static uint32_t stss_lower_bound(unsigned char *sync_table, uint32_t count,
+                                 uint32_t sample)
+{
+    uint32_t lo = 0, hi = count, mid;
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        if (bytes_read(sync_table + 4 * mid, 4) < sample)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return (lo);
+}
+
+
 static uint32_t stss_adjust(stss_t *stss, uint32_t s1, uint32_t s2)
 {
-    uint32_t t, i, newCount = 0, count;
+    uint32_t newCount, count, first, last;
     unsigned char *buf = (unsigned char *)stss->SyncTable;
 
     if (stss->header.ExtendedSize == 0)
         return (1);
 
     count = stss->SyncCount;
-    for (i = 0; i < count; i++)
-    {
-        t = bytes_read(buf + 4 * i, 4);
-        if (t > s2)
-            break;
-        if (t >= s1 && t <= s2)
-            newCount ++;
-    }
+    first = stss_lower_bound(buf, count, s1);
+    last = (s2 == UINT32_MAX) ? count : stss_lower_bound(buf, count, s2 + 1);
+    newCount = (last > first) ? last - first : 0;
     stss->newCount = newCount;
     if (newCount == 0)      //add this branch -- bug fix 2009.06.28
         stss->header.deltaSize = -1 * stss->header.ExtendedSize;
@@ -80,6 +80,41 @@ extern int get_mdat(
     uint32_t mini_moov_size        //in
 );
 
+/*    desc:    state of one seek request, the mini_moov is parsed and
+ *             adjusted to start_time once, then the new moov is produced
+ *             chunk by chunk from it. mini_moov must outlive the state.
+ */
+typedef struct moov_seek_s moov_seek_t;
+
+/*    return: NULL -- error. start_time out of range or invalid mini_moov
+ */
+extern moov_seek_t *moov_seek_new(
+    float start_time,            //in - seconds
+    unsigned char *mini_moov,     //in
+    uint32_t mini_moov_size        //in
+);
+
+extern moov_data_t *moov_seek_data(moov_seek_t *seek);
+
+/*    desc:    size of the new moov box plus the mdat box
+*/
+extern uint64_t moov_seek_content_len(moov_seek_t *seek);
+
+/*    return: -1 -- error
+ *             0 -- moov_seek_data() holds a part of the moov box
+ *             1 -- moov_seek_data() holds the last part of the moov box
+*/
+extern int moov_seek_next(moov_seek_t *seek);
+
+extern void moov_seek_mdat(
+    moov_seek_t *seek,
+    uint64_t *mdat_start,        //out
+    uint64_t *mdat_size,        //out
+    int *mdat_64bit             //out
+);
+
+extern void moov_seek_free(moov_seek_t *seek);
+
 #ifdef __cplusplus
 }
 #endif
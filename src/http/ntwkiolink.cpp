@@ -56,16 +56,52 @@
 #include <util/gsendfile.h>
 #endif
 
+#if defined(linux) || defined(__linux) || defined(__linux__) || defined(__gnu_linux__)
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#define LS_HAS_ZEROCOPY
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY                 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY                0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY       5
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED  1
+#endif
+#endif
+
 #define IO_THROTTLE_READ    8
 #define IO_THROTTLE_WRITE   16
 #define IO_COUNTED          32
 
+//per connection house keeping, flush/handshake/idle checks
+#define CONN_TIMER_INTERVAL 1000
+
 //#define HTTP2_PLAIN_DEV
 
 //#define SPDY_PLAIN_DEV
 
+//With a completion based multiplexer the kernel may have received data
+//into a provided buffer already, it must be consumed from there.
+static inline int readSocket(EventReactor *pReactor, char *pBuf, int size)
+{
+    if (pReactor->getEvtFlag() & ERF_RECV_COMPLETION)
+    {
+        Multiplexer *pMplx = MultiplexerFactory::getMultiplexer();
+        if (pMplx->ownsRead(pReactor))
+            return pMplx->readCompleted(pReactor, pBuf, size);
+    }
+    return ::read(pReactor->getfd(), pBuf, size);
+}
+
+
 int NtwkIOLink::s_iPrevTmToken = 0;
 int NtwkIOLink::s_iTmToken = 0;
+int NtwkIOLink::s_iZeroCopyThreshold = 0;
 
 class NtwkIOLink::fp_list NtwkIOLink::s_normal
     (
@@ -127,13 +163,13 @@ NtwkIOLink::NtwkIOLink()
     , m_iRemotePort(0)
     , m_iInProcess(0)
     , m_iPeerShutdown(0)
-    , m_tmToken(0)
     , m_iSslLastWrite(0)
     , m_iHeaderToSend(0)
     , m_pFpList(NULL)
     , m_sessionHooks()
     , m_hasBufferedData(0)
     , m_aioSFQ()
+    , m_connTimer(this)
 {
     m_pModuleConfig = NULL;
 }
@@ -250,6 +286,117 @@ int NtwkIOLink::write(const char *pBuf, int size)
 }
 
 
+int NtwkIOLink::enableZeroCopy()
+{
+#ifdef LS_HAS_ZEROCOPY
+    int on = 1;
+    if (::setsockopt(getfd(), SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) == 0)
+    {
+        m_iZcState = 1;
+        return LS_OK;
+    }
+    LS_DBG_L(this, "SO_ZEROCOPY is not available: %s", strerror(errno));
+#endif
+    m_iZcState = -1;
+    return LS_FAIL;
+}
+
+
+//Large body writes on a plain connection go out with MSG_ZEROCOPY, the
+//kernel references pBuf until the completion shows up in the error queue.
+int NtwkIOLink::writeNoCopy(const char *pBuf, int size, int *pRef)
+{
+    *pRef = 0;
+#ifdef LS_HAS_ZEROCOPY
+    if (s_iZeroCopyThreshold <= 0 || size < s_iZeroCopyThreshold
+        || m_iZcState < 0 || m_iHeaderToSend > 0 || m_hasBufferedData
+        || m_pFpList != &s_normal)
+        return write(pBuf, size);
+    const LsiApiHooks *pWritevHooks = LsiApiHooks::getGlobalApiHooks(
+                                          LSI_HKPT_L4_SENDING);
+    if (pWritevHooks && !m_sessionHooks.isDisabled(LSI_HKPT_L4_SENDING))
+        return write(pBuf, size);
+    if (m_iZcState == 0 && enableZeroCopy() != LS_OK)
+        return write(pBuf, size);
+
+    struct iovec iov;
+    struct msghdr msg;
+    iov.iov_base = (void *)pBuf;
+    iov.iov_len = size;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    int ret = ::sendmsg(getfd(), &msg, MSG_ZEROCOPY | MSG_NOSIGNAL);
+    if (ret == -1 && errno == ENOBUFS)
+    {
+        //socket option memory is used up by pending notifications.
+        reapZeroCopy();
+        return write(pBuf, size);
+    }
+    if (ret >= 0)
+    {
+        ++m_iZcSent;
+        *pRef = 1;
+        HttpStats::incZeroCopySends();
+    }
+    return checkWriteRet(ret);
+#else
+    return write(pBuf, size);
+#endif
+}
+
+
+void NtwkIOLink::reapZeroCopy()
+{
+#ifdef LS_HAS_ZEROCOPY
+    char achCtrl[CMSG_SPACE(sizeof(struct sock_extended_err)
+                            + sizeof(struct sockaddr_in6))];
+    struct msghdr msg;
+    struct cmsghdr *cm;
+    struct sock_extended_err *serr;
+    while (m_iZcSent != m_iZcDone)
+    {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = achCtrl;
+        msg.msg_controllen = sizeof(achCtrl);
+        if (::recvmsg(getfd(), &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1)
+            break;
+        for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm))
+        {
+            if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+                  || (cm->cmsg_level == SOL_IPV6
+                      && cm->cmsg_type == IPV6_RECVERR)))
+                continue;
+            serr = (struct sock_extended_err *)CMSG_DATA(cm);
+            if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+                continue;
+            //ee_info to ee_data, inclusive, have been completed.
+            m_iZcDone = serr->ee_data + 1;
+            if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+            {
+                //data was copied anyway, loopback or no SG support.
+                LS_DBG_L(this, "MSG_ZEROCOPY fell back to copy, disabled.");
+                HttpStats::incZeroCopyCopied();
+                m_iZcState = -1;
+            }
+        }
+    }
+    LS_DBG_L(this, "MSG_ZEROCOPY sent %u, completed %u.",
+             m_iZcSent, m_iZcDone);
+#endif
+}
+
+
+int NtwkIOLink::checkSocketError()
+{
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (::getsockopt(getfd(), SOL_SOCKET, SO_ERROR, &err, &len) == -1)
+        return 1;
+    return err;
+}
+
+
 void NtwkIOLink::enableThrottle(int enable)
 {
     if (enable)
@@ -336,15 +483,20 @@ int NtwkIOLink::setLink(HttpListener *pListener,  int fd, ConnInfo *pInfo)
     memset(&m_iInProcess, 0, (char *)&m_ssl - (char *)(&m_iInProcess));
     m_iov.clear();
     HttpStats::incIdleConns();
-    m_tmToken = NtwkIOLink::getToken();
+    if (!pInfo->m_pSsl)
+        addFlag(ERF_RECV_COMPLETION);
+    addFlag(ERF_TIMER_WHEEL);
     if (MultiplexerFactory::getMultiplexer()->add(this,
             POLLIN | POLLHUP | POLLERR) == -1)
         return LS_FAIL;
+    armConnTimer();
     //set ssl context
     if (pInfo->m_pSsl)
     {
         ConnLimitCtrl::getInstance().incSSLConn();
         setSSL(pInfo->m_pSsl);
+        if (pListener->isKtls())
+            m_ssl.setFlag(SslConnection::F_KTLS, 1);
         ((ConnInfo *)getConnInfo())->m_pCrypto = &m_ssl;
         m_ssl.toAccept();
     }
@@ -372,7 +524,7 @@ void NtwkIOLink::drainReadBuf()
     char achDiscard[4096];
     int len = 4096;
     while (len == 4096)
-        len = ::read(getfd(), achDiscard, len);
+        len = readSocket(this, achDiscard, len);
     if (len <= 0)
         closeSocket();
 }
@@ -389,6 +541,13 @@ int NtwkIOLink::handleEvents(short evt)
     int event = evt;
     LS_DBG_M(this, "NtwkIOLink::handleEvents() fd: %d, mask=%hd, events=%hd!",
              getfd(), getEvents(), evt);
+    if ((event & POLLERR) && isZeroCopyBusy())
+    {
+        //POLLERR is raised for MSG_ZEROCOPY completions as well.
+        reapZeroCopy();
+        if (!checkSocketError())
+            event &= ~POLLERR;
+    }
     if (getState() == HIOS_SHUTDOWN)
     {
         if (event & (POLLHUP | POLLERR))
@@ -416,6 +575,7 @@ int NtwkIOLink::handleEvents(short evt)
             setAllowWrite();
             setFlag(HIO_FLAG_PAUSE_WRITE, 0);
         }
+        wakeConnTimer();
         (*m_pFpList->m_onRead_fp)(this);
     }
     if (event & (POLLHUP | POLLERR))
@@ -604,6 +764,25 @@ int NtwkIOLink::writevExSSL(LsiSession *pOS, const iovec *vector,
     char *pBufEnd;
     char *pCurEnd;
     char achBuf[4096];
+
+    if (pThis->m_ssl.isKtlsTx())
+    {
+        //records are built by the kernel, hand over the whole vector
+        ret = pThis->m_ssl.writev(vector, count, NULL);
+        if (ret > 0)
+        {
+            pThis->bytesSent(ret);
+            HttpStats::incSSLBytesWritten(ret);
+            pThis->setActiveTime(DateTime::s_curTime);
+        }
+        else if (ret == -1 && pThis->getState() != HIOS_SHUTDOWN)
+        {
+            LS_DBG_L(pThis, "kTLS writev() failed: %s", strerror(errno));
+            pThis->setState(HIOS_CLOSING);
+        }
+        return ret;
+    }
+
     pBufEnd = achBuf + 4096;
     pCurEnd = achBuf;
     for (int i = 0; i < count ;)
@@ -933,6 +1112,7 @@ void NtwkIOLink::closeSocket()
         m_sessionHooks.runCallbackNoParam(LSI_HKPT_L4_ENDSESSION, this);
 
     MultiplexerFactory::getMultiplexer()->remove(this);
+    m_connTimer.cancel();
     if (m_pFpList == s_pCur_fp_list_list->m_pSSL)
     {
         m_ssl.release();
@@ -979,14 +1159,42 @@ int NtwkIOLink::onWrite(NtwkIOLink *pThis)
 }
 
 
-static int matchToken(int token)
+//An idle connection sleeps until the deadline of its handler, anything
+//that needs a look every second keeps the regular interval.
+void NtwkIOLink::armConnTimer()
 {
-    if (NtwkIOLink::getPrevToken() < NtwkIOLink::getToken())
-        return ((token > NtwkIOLink::getPrevToken())
-                && (token <= NtwkIOLink::getToken()));
-    else
-        return ((token > NtwkIOLink::getPrevToken())
-                || (token <= NtwkIOLink::getToken()));
+    uint32_t delay = CONN_TIMER_INTERVAL;
+    if (getHandler() && m_pFpList && !isThrottle() && !hasBufferedData() && !m_aioSFQ.size()
+        && !(m_ssl.getSSL() && m_ssl.getStatus() == SslConnection::ACCEPTING))
+    {
+        int32_t tm = getHandler()->getTimerDeadline();
+        if (tm > DateTime::s_curTime + 1)
+            delay = (tm - DateTime::s_curTime) * 1000;
+    }
+    MultiplexerFactory::getMultiplexer()->getTimingWheel()->armAfter(
+        &m_connTimer, delay);
+}
+
+
+//Activity ends an idle wait, back to the regular interval.
+void NtwkIOLink::wakeConnTimer()
+{
+    TimingWheel *pWheel = MultiplexerFactory::getMultiplexer()->getTimingWheel();
+    if (m_connTimer.isArmed() && (m_connTimer.getExpire()
+                                  > pWheel->getCurrent() + CONN_TIMER_INTERVAL))
+        pWheel->armAfter(&m_connTimer, CONN_TIMER_INTERVAL);
+}
+
+
+void NtwkIOLink::ConnTimer::onExpire()
+{
+    //re-arm first, closing the connection cancels it, then move it to the
+    //deadline of the state onTimer() left the connection in.
+    MultiplexerFactory::getMultiplexer()->getTimingWheel()->armAfter(
+        this, CONN_TIMER_INTERVAL);
+    m_pLink->onTimer();
+    if (isArmed())
+        m_pLink->armConnTimer();
 }
 
 
@@ -998,36 +1206,33 @@ void NtwkIOLink::releaseIdleSslBuffer()
 
 int NtwkIOLink::onTimer()
 {
-    if (matchToken(this->m_tmToken))
+    if (this->hasBufferedData() && this->allowWrite())
+        this->flush();
+    if (m_aioSFQ.size())
     {
-        if (this->hasBufferedData() && this->allowWrite())
-            this->flush();
-        if (m_aioSFQ.size())
-        {
-            Aiosfcb *cb = (Aiosfcb *)m_aioSFQ.begin();
-            if (cb->getFlag(AIOSFCB_FLAG_TRYAGAIN))
-                addAioSFJob(cb);
-        }
+        Aiosfcb *cb = (Aiosfcb *)m_aioSFQ.begin();
+        if (cb->getFlag(AIOSFCB_FLAG_TRYAGAIN))
+            addAioSFJob(cb);
+    }
 
-        if (m_ssl.getSSL() && m_ssl.getStatus() == SslConnection::ACCEPTING
-            && DateTime::s_curTime - getActiveTime() >= 10)
-        {
-            LS_DBG_L(this, "SSL handshake timed out, close SSL.");
-            closeSSL(this);
-        }
+    if (m_ssl.getSSL() && m_ssl.getStatus() == SslConnection::ACCEPTING
+        && DateTime::s_curTime - getActiveTime() >= 10)
+    {
+        LS_DBG_L(this, "SSL handshake timed out, close SSL.");
+        closeSSL(this);
+    }
 
-        if (detectClose())
-            return 0;
-        m_iInProcess = 1;
-        (*m_pFpList->m_onTimer_fp)(this);
-        m_iInProcess = 0;
-        if (getState() == HIOS_CLOSING)
+    if (detectClose())
+        return 0;
+    m_iInProcess = 1;
+    (*m_pFpList->m_onTimer_fp)(this);
+    m_iInProcess = 0;
+    if (getState() == HIOS_CLOSING)
+    {
+        if (flushSslWpending() != 0)
         {
-            if (flushSslWpending() != 0)
-            {
-                onPeerClose();
-                return 1;
-            }
+            onPeerClose();
+            return 1;
         }
     }
     return 0;
@@ -1097,7 +1302,7 @@ int NtwkIOLink::readEx(LsiSession *pIS, char *pBuf, int size)
     NtwkIOLink *pThis = static_cast<NtwkIOLink *>(pIS);
     int ret;
     assert(pBuf);
-    ret = ::read(pThis->getfd(), pBuf, size);
+    ret = readSocket(pThis, pBuf, size);
     ret = pThis->checkReadRet(ret, size);
 //    if ( ret > 0 )
 //        ::write( 1, pBuf, ret );
@@ -1418,7 +1623,7 @@ int NtwkIOLink::readExT(LsiSession *pIS, char *pBuf, int size)
     if (size > iQuota)
         size = iQuota;
     assert(pBuf);
-    int ret = ::read(pThis->getfd(), pBuf, size);
+    int ret = readSocket(pThis, pBuf, size);
     ret = pThis->checkReadRet(ret, size);
     if (ret > 0)
     {
@@ -1699,6 +1904,20 @@ void NtwkIOLink::handle_acceptSSL_EIO_Err()
 
 void NtwkIOLink::enableTlsAccel()
 {
+    if (m_ssl.getFlag(SslConnection::F_KTLS))
+    {
+        if (m_ssl.enableKtlsTx() == LS_OK)
+        {
+            LS_DBG_L(this, "[SSL] kTLS TX offload enabled, cipher: %s.",
+                     m_ssl.getCipherName());
+            HttpStats::incKtlsConns();
+            setFlag(HIO_FLAG_SENDFILE, 1);
+            return;
+        }
+        LS_DBG_L(this, "[SSL] kTLS TX offload is not available, cipher: %s, "
+                 "stay in user space.", m_ssl.getCipherName());
+        HttpStats::incKtlsFallbacks();
+    }
     m_ssl.setWriteBuffering(1);
 }
 
@@ -1935,6 +2154,7 @@ void NtwkIOLink::suspendEventNotify()
     {
         LS_DBG_L(this, "Remove fd %d from multiplexer!", getfd());
         MultiplexerFactory::getMultiplexer()->remove(this);
+        m_connTimer.cancel();
     }
 }
 
@@ -1945,6 +2165,7 @@ void NtwkIOLink::resumeEventNotify()
     {
         LS_DBG_L(this, "Add fd %d back to multiplexer!", getfd());
         MultiplexerFactory::getMultiplexer()->add(this, POLLHUP | POLLERR);
+        armConnTimer();
     }
 }
 
@@ -25,6 +25,7 @@
 
 #include <sslpp/sslconnection.h>
 #include <util/dlinkqueue.h>
+#include <util/timingwheel.h>
 #include <log4cxx/logsession.h>
 #include <util/iovec.h>
 
@@ -52,6 +53,17 @@ private:
     typedef int (*onRW_fp)(NtwkIOLink *pThis);
     typedef void (*onTimer_fp)(NtwkIOLink *pThis);
     typedef int (*close_fp)(NtwkIOLink *pThis);
+
+    class ConnTimer : public TimingWheelEntry
+    {
+        NtwkIOLink *m_pLink;
+    public:
+        explicit ConnTimer(NtwkIOLink *pLink)
+            : m_pLink(pLink)
+        {}
+        virtual void onExpire();
+    };
+
     class fp_list
     {
     public:
@@ -97,6 +109,7 @@ private:
 
     static int                  s_iPrevTmToken;
     static int                  s_iTmToken;
+    static int                  s_iZeroCopyThreshold;
 
 
 
@@ -107,9 +120,11 @@ private:
 
     char                m_iInProcess;
     char                m_iPeerShutdown;
-    int                 m_tmToken;
     int                 m_iSslLastWrite;
     int                 m_iHeaderToSend;
+    uint32_t            m_iZcSent;
+    uint32_t            m_iZcDone;
+    char                m_iZcState;
     SslConnection       m_ssl;
 
     class fp_list      *m_pFpList;
@@ -118,6 +133,7 @@ private:
     short               m_hasBufferedData;
     IOVec               m_iov;
     DLinkQueue          m_aioSFQ;
+    ConnTimer           m_connTimer;
 
 
 
@@ -128,6 +144,9 @@ private:
     NtwkIOLink(const NtwkIOLink &rhs);
     void operator=(const NtwkIOLink &rhs);
 
+    void armConnTimer();
+    void wakeConnTimer();
+
     int doRead()
     {
         if (isWantRead() && getHandler())
@@ -220,6 +239,10 @@ private:
 
     void dumpState(const char *pFuncName, const char *action);
 
+    int  enableZeroCopy();
+    void reapZeroCopy();
+    int  checkSocketError();
+
     off_t sendfileSetUp(off_t size);
     int sendfileFinish(int written);
 
@@ -239,6 +262,11 @@ public:
     static int getToken()
     {   return s_iTmToken;        }
 
+    static void setZeroCopyThreshold(int val)
+    {   s_iZeroCopyThreshold = val;     }
+    static int getZeroCopyThreshold()
+    {   return s_iZeroCopyThreshold;    }
+
     int sendRespHeaders(HttpRespHeaders *pHeaders, int isNoBody);
 
     const char *buildLogId();
@@ -270,6 +298,8 @@ public:
     int write(const char *pBuf, int size);
     int writev_internal(const struct iovec *vector, int len, int flush_flag);
     int writev(const struct iovec *vector, int len);
+    int writeNoCopy(const char *pBuf, int size, int *pRef);
+    bool isZeroCopyBusy() const {   return m_iZcSent != m_iZcDone;  }
 
     int sendfile(int fdSrc, off_t off, size_t size, int flag);
 
@@ -40,10 +40,7 @@ SendFileInfo::~SendFileInfo()
 void SendFileInfo::releaseECache()
 {
     if (m_pECache && m_pECache->decRef() == 0)
-    {
-        if (m_pECache->getfd() != -1)
-            m_pECache->closefd();
-    }
+        m_pECache->parkfd();
 }
 
 
@@ -71,11 +68,14 @@ void SendFileInfo::setECache(FileCacheDataEx *pCache)
 {
     if (m_pECache == pCache)
         return;
-    if (m_pECache)
-        m_pECache->decRef();
+    if (m_pECache && m_pECache->decRef() == 0)
+        m_pECache->parkfd();
     m_pECache = pCache;
     if (m_pECache)
+    {
         m_pECache->incRef();
+        m_pECache->reusefd();
+    }
 }
 
 
@@ -88,10 +88,7 @@ void SendFileInfo::release()
         //m_pFileData->keepOrigFileClosed();
     }
     if (m_pECache && m_pECache->decRef() <= 0)
-    {
-        if (m_pECache->getfd() != -1)
-            m_pECache->closefd();
-    }
+        m_pECache->parkfd();
     memset(this, 0, sizeof(SendFileInfo));
 
 }
@@ -107,6 +104,8 @@ int SendFileInfo::readyCacheData(char compress, char mode)
         {
             if ((mode & SFCD_MODE_BROTLI) && (m_pFileData->getBrotli() != NULL))
                 setECache(m_pFileData->getBrotli());
+            else if ((mode & SFCD_MODE_ZSTD) && (m_pFileData->getZstd() != NULL))
+                setECache(m_pFileData->getZstd());
             else
                 setECache(m_pFileData->getGzip());
             return 0;
@@ -123,3 +122,17 @@ int SendFileInfo::readyCacheData(char compress, char mode)
         setECache(m_pFileData->getFileData());
     return ret;
 }
+
+
+int SendFileInfo::readyDictCacheData(const char *pVHost, const char *pHex,
+                                     char mode)
+{
+    if (!m_pFileData->getMimeType()->getExpires()->compressible())
+        return LS_FAIL;
+    FileCacheDataEx *pData = m_pFileData->readyDictCompressed(pVHost, pHex,
+                                                              mode);
+    if (!pData)
+        return LS_FAIL;
+    setECache(pData);
+    return 0;
+}
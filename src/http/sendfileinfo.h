@@ -83,6 +83,7 @@ public:
         m_lAioLen = 0;
     }
     int readyCacheData(char compress, char mode = 1);
+    int readyDictCacheData(const char *pVHost, const char *pHex, char mode);
     
     void copy(const SendFileInfo &rhs)
     {   memcpy(this, &rhs, sizeof(SendFileInfo));      }
@@ -19,9 +19,11 @@
 
 #include <http/httpstatuscode.h>
 #include <http/staticfilecachedata.h>
+#include <http/staticfilewatcher.h>
 
 #include <errno.h>
 #include <fcntl.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -34,12 +36,74 @@ LS_SINGLETON(StaticFileCache);
 
 StaticFileCache::StaticFileCache()
     : HttpCache(LS_STATICFILECACHE_INITSIZE)
+    , m_pWatcher(NULL)
+    , m_iWatchFiles(0)
 {
 }
 
 
 StaticFileCache::~StaticFileCache()
 {
+    if (m_pWatcher)
+        delete m_pWatcher;
+}
+
+
+int StaticFileCache::startWatcher(Multiplexer *pMplx)
+{
+    if (!m_iWatchFiles || m_pWatcher)
+        return LS_OK;
+    m_pWatcher = new StaticFileWatcher(this);
+    if (m_pWatcher->init(pMplx) == LS_FAIL)
+    {
+        delete m_pWatcher;
+        m_pWatcher = NULL;
+        return LS_FAIL;
+    }
+    return LS_OK;
+}
+
+
+int StaticFileCache::getWatchedDirs() const
+{
+    return m_pWatcher ? m_pWatcher->getDirCount() : 0;
+}
+
+
+int StaticFileCache::getWatchedStat(const char *pPath, struct stat *st)
+{
+    if (!m_pWatcher)
+        return LS_FAIL;
+    HttpCache::iterator iter = find(pPath);
+    if (!iter)
+        return LS_FAIL;
+    StaticFileCacheData *pData = (StaticFileCacheData *)iter.second();
+    if (!pData->getWatch())
+        return LS_FAIL;
+    memmove(st, &pData->getFileStat(), sizeof(*st));
+    return LS_OK;
+}
+
+
+void StaticFileCache::invalidate(StaticFileCacheData *pData)
+{
+    if (m_pWatcher)
+        m_pWatcher->unwatch(pData);
+    dirty(pData);
+}
+
+
+void StaticFileCache::invalidateWatched()
+{
+    StaticFileCacheData *pData;
+    HttpCache::iterator iter, iterNext;
+    for (iter = begin(); iter != end(); iter = iterNext)
+    {
+        iterNext = next(iter);
+        pData = (StaticFileCacheData *)iter.second();
+        if (pData->getWatch())
+            invalidate(pData);
+    }
 }
 
 
@@ -56,6 +120,8 @@ int StaticFileCache::getCacheElement(const char *pPath, int pathLen,
     {
         if ((*pData)->isDirty(fileStat))
         {
+            if (m_pWatcher)
+                m_pWatcher->unwatch(*pData);
             if (dirty(*pData))
                 return SC_500;
         }
@@ -67,6 +133,8 @@ int StaticFileCache::getCacheElement(const char *pPath, int pathLen,
     if (*pData == NULL)
         return SC_500;
     add(*pData);
+    if (m_pWatcher)
+        m_pWatcher->watch(*pData);
 
     return 0;
 }
@@ -101,5 +169,9 @@ CacheElement *StaticFileCache::allocElement()
 void StaticFileCache::recycle(CacheElement *pElement)
 {
     if (pElement)
+    {
+        if (m_pWatcher)
+            m_pWatcher->unwatch((StaticFileCacheData *)pElement);
         delete pElement;
+    }
 }
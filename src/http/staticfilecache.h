@@ -25,12 +25,17 @@
 
 class StaticFileCacheData;
 class FileCacheDataEx;
+class Multiplexer;
+class StaticFileWatcher;
 
 class StaticFileCache : public HttpCache,
     public TSingleton<StaticFileCache>
 {
     friend class TSingleton<StaticFileCache>;
 
+    StaticFileWatcher  *m_pWatcher;
+    int                 m_iWatchFiles;
+
     CacheElement *allocElement();
     void recycle(CacheElement *pElement);
     StaticFileCacheData * newCache(const char *pPath, int pathLen,
@@ -43,6 +48,18 @@ public:
                         const struct stat &fileStat, int fd,
                         StaticFileCacheData **pData);
     void returnCacheElement(StaticFileCacheData *pElement);
+
+    void setWatchFiles(int enable)      {   m_iWatchFiles = enable;     }
+    int  startWatcher(Multiplexer *pMplx);
+    int  getWatchedDirs() const;
+
+    /**
+     * Fills st from a cached entry that is under inotify watch, so the
+     * caller can skip the stat(); returns -1 when the path needs a stat.
+     */
+    int  getWatchedStat(const char *pPath, struct stat *st);
+    void invalidate(StaticFileCacheData *pData);
+    void invalidateWatched();
     LS_NO_COPY_ASSIGN(StaticFileCache);
 };
 
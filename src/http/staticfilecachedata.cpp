@@ -17,21 +17,27 @@
 *****************************************************************************/
 #include <http/staticfilecachedata.h>
 #include <main/httpserver.h>
+#include <http/compressdict.h>
 #include <http/httpcontext.h>
 #include <http/httpheader.h>
 #include <http/httpmime.h>
 #include <http/httpreq.h>
 #include <http/httpstatuscode.h>
+#include <http/staticfileshmcache.h>
+#include <http/staticprecompressor.h>
 #include <log4cxx/logger.h>
 #include <lsiapi/lsiapi.h>
 #include <lsr/ls_fileio.h>
+#include <lsr/ls_offload.h>
 #include <lsr/ls_strtool.h>
 #include <ssi/ssiscript.h>
 #include <util/datetime.h>
+#include <util/dlinkqueue.h>
 #include <util/brotlibuf.h>
 #include <util/gzipbuf.h>
 #include <util/stringtool.h>
 #include <util/vmembuf.h>
+#include <util/zstdbuf.h>
 
 #include <openssl/md5.h>
 #include <assert.h>
@@ -63,9 +69,18 @@ static int      s_iMaxFileSize          = 1024 * 1024;
 static int      s_iMinFileSize          = 300;
 
 static int      s_iBrCompressLevel    = 6;
+static int      s_iZstdCompressLevel  = 9;
 
 static const char *s_compressCachePath = DEFAULT_TMP_DIR;
 
+//Idle fds of bodies served straight from the file, most recently used
+//first. Bodies in use by a sender are not in the list.
+static DLinkQueue s_idleFds;
+static int      s_iMaxIdleFds     = 0;
+static long     s_iFdCacheHits    = 0;
+static long     s_iFdCacheMisses  = 0;
+static long     s_iFdCacheEvicted = 0;
+
 
 
 
@@ -95,6 +110,37 @@ void FileCacheDataEx::setMaxMMapCacheSize(size_t max)
 }
 
 
+void FileCacheDataEx::setMaxIdleFds(int max)
+{
+    s_iMaxIdleFds = max;
+    while (s_idleFds.size() > s_iMaxIdleFds)
+    {
+        ((FileCacheDataEx *)s_idleFds.rbegin())->closefd();
+        ++s_iFdCacheEvicted;
+    }
+}
+
+
+int FileCacheDataEx::getMaxIdleFds()
+{   return s_iMaxIdleFds;       }
+
+
+int FileCacheDataEx::getIdleFds()
+{   return s_idleFds.size();    }
+
+
+long FileCacheDataEx::getFdCacheHits()
+{   return s_iFdCacheHits;      }
+
+
+long FileCacheDataEx::getFdCacheMisses()
+{   return s_iFdCacheMisses;    }
+
+
+long FileCacheDataEx::getFdCacheEvicted()
+{   return s_iFdCacheEvicted;   }
+
+
 static int openFile(const char *pPath, int &fd)
 {
     fd = ls_fio_open(pPath, O_RDONLY, 0);
@@ -177,6 +223,9 @@ void FileCacheDataEx::release()
             free(m_pCache);
         }
         break;
+    case SHARED:
+        StaticFileShmCache::getInstance().detach(m_iShmBlock);
+        break;
     }
     closefd();
     memset(&m_iStatus, 0,
@@ -186,6 +235,7 @@ void FileCacheDataEx::release()
 
 void FileCacheDataEx::closefd()
 {
+    s_idleFds.remove(this);
     if (m_fd != -1)
     {
         close(m_fd);
@@ -194,6 +244,35 @@ void FileCacheDataEx::closefd()
 }
 
 
+void FileCacheDataEx::parkfd()
+{
+    if (m_fd == -1)
+        return;
+    if ((s_iMaxIdleFds <= 0) || isCached())
+    {
+        closefd();
+        return;
+    }
+    s_idleFds.remove(this);
+    s_idleFds.push_front(this);
+    while (s_idleFds.size() > s_iMaxIdleFds)
+    {
+        ((FileCacheDataEx *)s_idleFds.rbegin())->closefd();
+        ++s_iFdCacheEvicted;
+    }
+}
+
+
+void FileCacheDataEx::reusefd()
+{
+    if (isParked())
+    {
+        s_idleFds.remove(this);
+        ++s_iFdCacheHits;
+    }
+}
+
+
 int FileCacheDataEx::readyData(const char *pPath)
 {
     int ret;
@@ -202,9 +281,13 @@ int FileCacheDataEx::readyData(const char *pPath)
         ret = openFile(pPath, m_fd);
         if (ret)
             return ret;
+        if ((size_t)m_lSize >= s_iMaxInMemCacheSize)
+            ++s_iFdCacheMisses;
     }
     if ((size_t)m_lSize < s_iMaxInMemCacheSize)
     {
+        if (readySharedData(pPath) == 0)
+            return 0;
         ret = allocateCache(m_lSize);
         if (ret == 0)
         {
@@ -240,9 +323,43 @@ int FileCacheDataEx::readyData(const char *pPath)
 }
 
 
+//Small bodies are kept once per box in shared memory when that tier is
+//enabled, only the first worker to serve the file reads it.
+int FileCacheDataEx::readySharedData(const char *pPath)
+{
+    StaticFileShmCache &shmCache = StaticFileShmCache::getInstance();
+    if (!shmCache.isReady())
+        return LS_FAIL;
+    int pathLen = strlen(pPath);
+    m_iShmBlock = shmCache.attach(pPath, pathLen, m_inode, m_lSize,
+                                  m_lastMod);
+    if (!m_iShmBlock)
+    {
+        char achBuf[16384];
+        if (pread(m_fd, achBuf, m_lSize, 0) != m_lSize)
+            return LS_FAIL;
+        m_iShmBlock = shmCache.publish(pPath, pathLen, m_inode, m_lSize,
+                                       m_lastMod, achBuf);
+        if (!m_iShmBlock)
+            return LS_FAIL;
+    }
+    setStatus(SHARED);
+    closefd();
+    return 0;
+}
+
+
 const char *FileCacheDataEx::getCacheData(
     off_t offset, off_t &wanted, char *pBuf, long len)
 {
+    if (getStatus() == SHARED)
+    {
+        if (wanted > len)
+            wanted = len;
+        wanted = StaticFileShmCache::getInstance().read(m_iShmBlock, offset,
+                                                        pBuf, wanted);
+        return pBuf;
+    }
     if (isCached())
     {
         if (offset > m_lSize)
@@ -273,7 +390,7 @@ const char *FileCacheDataEx::getCacheData(
 StaticFileCacheData::StaticFileCacheData()
 {
     memset(&m_pMimeType, 0,
-           (char *)(&m_pBrotli + 1) - (char *)&m_pMimeType);
+           (char *)(&m_pZstd + 1) - (char *)&m_pMimeType);
 }
 
 
@@ -284,8 +401,21 @@ StaticFileCacheData::~StaticFileCacheData()
         delete m_pGzip;
     if (m_pBrotli)
         delete m_pBrotli;
+    if (m_pZstd)
+        delete m_pZstd;
+    if (m_pDictVariants)
+    {
+        for (int i = 0; i < m_iDictVariants; ++i)
+        {
+            if (m_pDictVariants[i].m_pData)
+                delete m_pDictVariants[i].m_pData;
+        }
+        delete [] m_pDictVariants;
+    }
     if (m_pSSIScript)
         delete m_pSSIScript;
+    if (m_pMiniMoov)
+        free(m_pMiniMoov);
 }
 
 
@@ -502,6 +632,7 @@ int StaticFileCacheData::build(int fd, const char   *pPath, int pathLen,
 {
     m_fileData.setfd(fd);
     m_fileData.setFileStat(fileStat);
+    m_fileStat = fileStat;
     m_real.setStr(pPath, pathLen);
     if (!m_real.c_str())
         return LS_FAIL;
@@ -531,10 +662,244 @@ static int createLockFile(const char *pReal, char *p)
 }
 
 
-int StaticFileCacheData::tryCreateCompressed(char useBrotli)
+struct CompressJob
+{
+    AutoStr2    m_src;
+    AutoStr2    m_dest;
+    off_t       m_size;
+    time_t      m_mtime;
+    int         m_iLevel;
+    char        m_compressMode;
+    //the store path of the dictionary for SFCD_MODE_DCB/SFCD_MODE_DCZ.
+    AutoStr2    m_dict;
+    char        m_achDictHash[CompressDict::HASH_LEN];
+};
+
+
+//One compressor per method built in, the one to use is picked by a single
+//SFCD_MODE_xxx bit.
+struct CompressorSet
+{
+    GzipBuf     m_gzip;
+#ifdef USE_BROTLI
+    BrotliBuf   m_brotli;
+#endif
+#ifdef USE_ZSTD
+    ZstdBuf     m_zstd;
+#endif
+
+    Compressor *get(char compressMode)
+    {
+#ifdef USE_BROTLI
+        if ((compressMode == SFCD_MODE_BROTLI)
+            || (compressMode == SFCD_MODE_DCB))
+            return &m_brotli;
+#endif
+#ifdef USE_ZSTD
+        if ((compressMode == SFCD_MODE_ZSTD)
+            || (compressMode == SFCD_MODE_DCZ))
+            return &m_zstd;
+#endif
+        if (compressMode == SFCD_MODE_GZIP)
+            return &m_gzip;
+        return NULL;
+    }
+};
+
+
+static int getCompressLevel(char compressMode)
+{
+    if ((compressMode == SFCD_MODE_BROTLI) || (compressMode == SFCD_MODE_DCB))
+        return s_iBrCompressLevel;
+    if ((compressMode == SFCD_MODE_ZSTD) || (compressMode == SFCD_MODE_DCZ))
+        return s_iZstdCompressLevel;
+    return s_iGzipCompressLevel;
+}
+
+
+static void unlinkLockFile(const AutoStr2 &dest)
+{
+    char achLock[4096];
+    snprintf(achLock, sizeof(achLock), "%sl", dest.c_str());
+    unlink(achLock);
+}
+
+
+//A dictionary encoded body starts with a fixed magic and the SHA-256 of
+//the dictionary, "dcz" wraps it in a zstd skippable frame.
+static int writeDictHeader(CompressJob *pJob, VMemBuf *pBuf)
+{
+    static const char s_dcbMagic[4] = { '\xff', 'D', 'C', 'B' };
+    static const char s_dczMagic[8] =
+    { '\x5e', '\x2a', '\x4d', '\x18', '\x20', 0, 0, 0 };
+    const char *pMagic = s_dczMagic;
+    int len = sizeof(s_dczMagic);
+    if (pJob->m_compressMode == SFCD_MODE_DCB)
+    {
+        pMagic = s_dcbMagic;
+        len = sizeof(s_dcbMagic);
+    }
+    if ((pBuf->write(pMagic, len) != len)
+        || (pBuf->write(pJob->m_achDictHash, CompressDict::HASH_LEN)
+            != CompressDict::HASH_LEN))
+        return LS_FAIL;
+    return LS_OK;
+}
+
+
+static char *readDictionary(const char *pPath, size_t &len)
+{
+    struct stat st;
+    char *pDict = NULL;
+    int fd = ::open(pPath, O_RDONLY);
+    if (fd == -1)
+        return NULL;
+    if ((fstat(fd, &st) == 0) && (st.st_size > 0)
+        && (st.st_size <= s_iMaxFileSize))
+    {
+        pDict = (char *)malloc(st.st_size);
+        if (pDict && (pread(fd, pDict, st.st_size, 0) != st.st_size))
+        {
+            free(pDict);
+            pDict = NULL;
+        }
+        len = st.st_size;
+    }
+    close(fd);
+    return pDict;
+}
+
+
+static int compressJobFile(CompressJob *pJob, int srcFd,
+                           const char *pDict, size_t dictLen)
+{
+    CompressorSet compressors;
+    Compressor *pCompressor = compressors.get(pJob->m_compressMode);
+    VMemBuf compressedFile;
+    struct stat st;
+    if (!pCompressor)
+        return LS_FAIL;
+    //the file changed since the job was queued, leave it to a later request.
+    if ((fstat(srcFd, &st) == -1) || (st.st_size != pJob->m_size)
+        || (st.st_mtime != pJob->m_mtime))
+        return LS_FAIL;
+    if (pCompressor->init(Compressor::COMPRESSOR_COMPRESS,
+                          pJob->m_iLevel) != 0)
+        return LS_FAIL;
+    if (pDict && (pCompressor->setDictionary(pDict, dictLen) != LS_OK))
+        return LS_FAIL;
+
+    char achFileName[4096];
+    snprintf(achFileName, 4096, "%s.XXXXXX", pJob->m_dest.c_str());
+    int fd = mkstemp(achFileName);
+    if (fd == -1)
+        return LS_FAIL;
+    if (compressedFile.setFd(achFileName, fd))
+    {
+        close(fd);
+        unlink(achFileName);
+        return LS_FAIL;
+    }
+    pCompressor->setCompressCache(&compressedFile);
+
+    char achBuf[8192];
+    off_t offset = 0;
+    off_t size;
+    int len;
+    if ((!pDict || (writeDictHeader(pJob, &compressedFile) == LS_OK))
+        && (pCompressor->beginStream() == 0))
+    {
+        while (offset < pJob->m_size)
+        {
+            len = pread(srcFd, achBuf, sizeof(achBuf), offset);
+            if (len <= 0)
+                break;
+            if (pCompressor->write(achBuf, len) == LS_FAIL)
+                break;
+            offset += len;
+        }
+        if ((offset == pJob->m_size) && (pCompressor->endStream() == 0)
+            && (compressedFile.exactSize(&size) == 0))
+        {
+            compressedFile.close();
+            unlink(pJob->m_dest.c_str());
+            rename(achFileName, pJob->m_dest.c_str());
+
+            struct utimbuf utmbuf;
+            utmbuf.actime = pJob->m_mtime;
+            utmbuf.modtime = pJob->m_mtime;
+            utime(pJob->m_dest.c_str(), &utmbuf);
+            return size;
+        }
+    }
+    compressedFile.close();
+    unlink(achFileName);
+    return LS_FAIL;
+}
+
+
+//Runs in an offload thread, only touches what has been copied into the job.
+static int performCompressJob(void *param)
+{
+    CompressJob *pJob = (CompressJob *)param;
+    int ret = LS_FAIL;
+    char *pDict = NULL;
+    size_t dictLen = 0;
+    if (pJob->m_dict.c_str())
+        pDict = readDictionary(pJob->m_dict.c_str(), dictLen);
+    int srcFd = ::open(pJob->m_src.c_str(), O_RDONLY);
+    if ((srcFd != -1) && (pDict || !pJob->m_dict.c_str()))
+        ret = compressJobFile(pJob, srcFd, pDict, dictLen);
+    if (srcFd != -1)
+        close(srcFd);
+    if (pDict)
+        free(pDict);
+    unlinkLockFile(pJob->m_dest);
+    return ret;
+}
+
+
+static void onCompressJobDone(void *param, int result)
+{
+    CompressJob *pJob = (CompressJob *)param;
+    if (result == LS_FAIL)
+        LS_WARN("Failed to compress file %s, file size %ld!",
+                pJob->m_src.c_str(), (long)pJob->m_size);
+    else
+        LS_DBG_H("Compressed file %s to %s, size %d.", pJob->m_src.c_str(),
+                 pJob->m_dest.c_str(), result);
+    delete pJob;
+}
+
+
+int StaticFileCacheData::offloadCompress(char compressMode)
+{
+    struct Offloader *pOffloader = offloader_get_shared();
+    if (!pOffloader)
+        return LS_FAIL;
+    const AutoStr2 &dest = *getCompressedPath(compressMode);
+    CompressJob *pJob = new CompressJob();
+    if (!pJob->m_src.setStr(m_real.c_str(), m_real.len())
+        || !pJob->m_dest.setStr(dest.c_str(), strlen(dest.c_str())))
+    {
+        delete pJob;
+        return LS_FAIL;
+    }
+    pJob->m_size = m_fileData.getFileSize();
+    pJob->m_mtime = m_fileData.getLastMod();
+    pJob->m_iLevel = getCompressLevel(compressMode);
+    pJob->m_compressMode = compressMode;
+    LS_DBG_H("To compress file %s in offload thread.", m_real.c_str());
+    offloader_submit(pOffloader, performCompressJob, onCompressJobDone, pJob);
+    return LS_OK;
+}
+
+
+int StaticFileCacheData::tryCreateCompressed(char compressMode)
 {
     AutoStr2 *pPath;
-    if (!s_iAutoUpdateStaticGzip)
+    StaticPrecompressor &precompressor = StaticPrecompressor::getInstance();
+    if (!s_iAutoUpdateStaticGzip && !precompressor.isEnabled())
     {
         LS_DBG_H("Cannot compress file %s due to setting.", m_real.c_str());
         return LS_FAIL;
@@ -546,8 +911,15 @@ int StaticFileCacheData::tryCreateCompressed(char useBrotli)
                     m_real.c_str(), (long)size);
         return LS_FAIL;
     }
+    //the request path never compresses when the pipeline owns the cache,
+    //it only hands the file over and picks up the variants once ready.
+    if (precompressor.isEnabled())
+    {
+        precompressor.addFile(m_real.c_str(), m_real.len());
+        return LS_FAIL;
+    }
 
-    pPath = useBrotli ? &m_bredPath : &m_gzippedPath;
+    pPath = getCompressedPath(compressMode);
     char *p = pPath->buf() + pPath->len() + 4;
     int fd = createLockFile(pPath->buf(), p);
     if (fd == -1)
@@ -556,10 +928,13 @@ int StaticFileCacheData::tryCreateCompressed(char useBrotli)
         return LS_FAIL;
     }
     close(fd);
+    //the compressed file is picked up by a later request once it is ready.
+    if (offloadCompress(compressMode) == LS_OK)
+        return LS_FAIL;
     if (size < 409600)
     {
 
-        long ret = compressFile(useBrotli);
+        long ret = compressFile(compressMode);
         if (ret == -1)
             LS_WARN("Failed to compress file %s, file size %ld!",
                     m_real.c_str(), (long)size);
@@ -584,7 +959,7 @@ int StaticFileCacheData::tryCreateCompressed(char useBrotli)
         //child process
         setpriority(PRIO_PROCESS, 0, 5);
 
-        long ret = compressFile(useBrotli);
+        long ret = compressFile(compressMode);
         if (ret == -1)
             LS_WARN("Failed to compress file %s, file size %ld!",
                     m_real.c_str(), (long)size);
@@ -628,34 +1003,18 @@ int StaticFileCacheData::detectTrancate()
 }
 
 
-int StaticFileCacheData::compressFile(char useBrotli)
+int StaticFileCacheData::compressFile(char compressMode)
 {
     int ret;
-    AutoStr2 *pPath;
+    AutoStr2 *pPath = getCompressedPath(compressMode);
 
-    GzipBuf gzBuf;
-    Compressor *pCompressor;
+    CompressorSet compressors;
+    Compressor *pCompressor = compressors.get(compressMode);
     VMemBuf compressedFile;
-    int iCompressLevel;
-
-#ifdef USE_BROTLI
-    BrotliBuf brBuf;
-    if (useBrotli)
-    {
-        pCompressor = &brBuf;
-        pPath = &m_bredPath;
-        iCompressLevel = s_iBrCompressLevel;
-    }
-    else
-    {
-#endif
-        pCompressor = &gzBuf;
-        pPath = &m_gzippedPath;
-        iCompressLevel = s_iGzipCompressLevel;
-#ifdef USE_BROTLI
-    }
-#endif
+    int iCompressLevel = getCompressLevel(compressMode);
 
+    if (!pCompressor)
+        return LS_FAIL;
     if (    //detectTrancate() ||
         (0 != pCompressor->init(Compressor::COMPRESSOR_COMPRESS, iCompressLevel)))
         return LS_FAIL;
@@ -744,11 +1103,16 @@ int StaticFileCacheData::buildCompressedCache(FileCacheDataEx *&pData,
 }
 
 
-int StaticFileCacheData::buildCompressedPaths()
+//All paths share the buffer layout createLockFile() expects: len() stops
+//before the ".lsz"/".lsb"/".lsd" suffix and there is room for the lock
+//suffix.
+static int buildCompressedPaths(const char *pReal, int realLen,
+                                AutoStr2 &gzPath, AutoStr2 &brPath,
+                                AutoStr2 &zsPath)
 {
     unsigned char achHash[MD5_DIGEST_LENGTH];
     char achPath[4096];
-    StringTool::getMd5(m_real.c_str(), m_real.len(), achHash);
+    StringTool::getMd5(pReal, realLen, achHash);
     struct stat st;
     int n = snprintf(achPath, 4096, "%s/%x/%x/", s_compressCachePath,
                      achHash[0] >> 4, achHash[0] & 0xf);
@@ -764,22 +1128,157 @@ int StaticFileCacheData::buildCompressedPaths()
     StringTool::hexEncode((const char *)&achHash[1], MD5_DIGEST_LENGTH - 1,
                           &achPath[n]);
     n += 30;
-    char *pReal = m_gzippedPath.prealloc(n + 6);
-    if ((!pReal) || (!m_bredPath.prealloc(n + 6)))
+    char *pGz = gzPath.prealloc(n + 6);
+    if ((!pGz) || (!brPath.prealloc(n + 6)))
         return LS_FAIL;
-    lstrncpy(pReal, achPath, n + 6);
-    m_gzippedPath.setLen(n);
-    memmove(pReal + n , ".lsz\0\0", 6);
-    if (!m_bredPath.setStr(pReal, n + 6))
+    lstrncpy(pGz, achPath, n + 6);
+    gzPath.setLen(n);
+    memmove(pGz + n , ".lsz\0\0", 6);
+    if (!brPath.setStr(pGz, n + 6))
         return LS_FAIL;
-    char *pBred = m_bredPath.buf();
+    char *pBred = brPath.buf();
     pBred[n + 3] = 'b'; // .lsb
-    m_bredPath.setLen(n);
+    brPath.setLen(n);
+    if (!zsPath.setStr(pGz, n + 6))
+        return LS_FAIL;
+    zsPath.buf()[n + 3] = 'd'; // .lsd
+    zsPath.setLen(n);
 
     return 0;
 }
 
 
+int StaticFileCacheData::buildCompressedPaths()
+{
+    return ::buildCompressedPaths(m_real.c_str(), m_real.len(),
+                                  m_gzippedPath, m_bredPath, m_zstdPath);
+}
+
+
+AutoStr2 *StaticFileCacheData::getCompressedPath(char compressMode)
+{
+    if (compressMode == SFCD_MODE_BROTLI)
+        return &m_bredPath;
+    if (compressMode == SFCD_MODE_ZSTD)
+        return &m_zstdPath;
+    return &m_gzippedPath;
+}
+
+
+FileCacheDataEx *&StaticFileCacheData::getCompressedData(char compressMode)
+{
+    if (compressMode == SFCD_MODE_BROTLI)
+        return m_pBrotli;
+    if (compressMode == SFCD_MODE_ZSTD)
+        return m_pZstd;
+    return m_pGzip;
+}
+
+
+//Brings one variant up to date in the calling thread, 1 if it was written.
+static int precompressOne(const char *pReal, const struct stat &st,
+                          AutoStr2 &dest, int level, char compressMode)
+{
+    struct stat stDest;
+    if ((ls_fio_stat(dest.c_str(), &stDest) == 0)
+        && (stDest.st_mtime == st.st_mtime))
+        return 0;
+    char *p = dest.buf() + dest.len() + 4;
+    int fd = createLockFile(dest.buf(), p);
+    if (fd == -1)   //being compressed by a request or another process
+        return 0;
+    close(fd);
+
+    CompressJob job;
+    if (!job.m_src.setStr(pReal)
+        || !job.m_dest.setStr(dest.c_str(), strlen(dest.c_str())))
+    {
+        unlinkLockFile(job.m_dest);
+        return LS_FAIL;
+    }
+    job.m_size = st.st_size;
+    job.m_mtime = st.st_mtime;
+    job.m_iLevel = level;
+    job.m_compressMode = compressMode;
+    if (performCompressJob(&job) == LS_FAIL)
+        return LS_FAIL;
+    LS_DBG_H("Precompressed file %s to %s.", pReal, dest.c_str());
+    return 1;
+}
+
+
+int StaticFileCacheData::isPrecompressed(const char *pReal, int len,
+        const struct stat &st, char compressMode)
+{
+    if ((st.st_size > s_iMaxFileSize) || (st.st_size < s_iMinFileSize))
+        return 1;
+    AutoStr2 gzPath;
+    AutoStr2 brPath;
+    AutoStr2 zsPath;
+    if (::buildCompressedPaths(pReal, len, gzPath, brPath, zsPath) == LS_FAIL)
+        return 1;
+    struct stat stDest;
+    if ((compressMode & SFCD_MODE_GZIP)
+        && ((ls_fio_stat(gzPath.c_str(), &stDest) == -1)
+            || (stDest.st_mtime != st.st_mtime)))
+        return 0;
+#ifdef USE_BROTLI
+    if ((compressMode & SFCD_MODE_BROTLI)
+        && ((ls_fio_stat(brPath.c_str(), &stDest) == -1)
+            || (stDest.st_mtime != st.st_mtime)))
+        return 0;
+#endif
+#ifdef USE_ZSTD
+    if ((compressMode & SFCD_MODE_ZSTD)
+        && ((ls_fio_stat(zsPath.c_str(), &stDest) == -1)
+            || (stDest.st_mtime != st.st_mtime)))
+        return 0;
+#endif
+    return 1;
+}
+
+
+int StaticFileCacheData::precompress(const char *pReal, int len,
+                                     const struct stat &st, char compressMode)
+{
+    if ((st.st_size > s_iMaxFileSize) || (st.st_size < s_iMinFileSize))
+        return 0;
+    AutoStr2 gzPath;
+    AutoStr2 brPath;
+    AutoStr2 zsPath;
+    if (::buildCompressedPaths(pReal, len, gzPath, brPath, zsPath) == LS_FAIL)
+        return LS_FAIL;
+    int ret;
+    int written = 0;
+    if (compressMode & SFCD_MODE_GZIP)
+    {
+        ret = precompressOne(pReal, st, gzPath, 9, SFCD_MODE_GZIP);
+        if (ret == LS_FAIL)
+            return LS_FAIL;
+        written += ret;
+    }
+#ifdef USE_BROTLI
+    if (compressMode & SFCD_MODE_BROTLI)
+    {
+        ret = precompressOne(pReal, st, brPath, 11, SFCD_MODE_BROTLI);
+        if (ret == LS_FAIL)
+            return LS_FAIL;
+        written += ret;
+    }
+#endif
+#ifdef USE_ZSTD
+    if (compressMode & SFCD_MODE_ZSTD)
+    {
+        ret = precompressOne(pReal, st, zsPath, 19, SFCD_MODE_ZSTD);
+        if (ret == LS_FAIL)
+            return LS_FAIL;
+        written += ret;
+    }
+#endif
+    return written;
+}
+
+
 int StaticFileCacheData::setReadiedCompressData(char compressMode)
 {
     if ((compressMode & SFCD_MODE_BROTLI) && (m_pBrotli))
@@ -789,6 +1288,13 @@ int StaticFileCacheData::setReadiedCompressData(char compressMode)
             return 0;
         return m_pBrotli->readyData(m_bredPath.c_str());
     }
+    if ((compressMode & SFCD_MODE_ZSTD) && (m_pZstd))
+    {
+        if ((m_pZstd->isCached() ||
+            (m_pZstd->getfd() != -1)))
+            return 0;
+        return m_pZstd->readyData(m_zstdPath.c_str());
+    }
     if (m_pGzip)
     {
         if ((m_pGzip->isCached() ||
@@ -801,12 +1307,12 @@ int StaticFileCacheData::setReadiedCompressData(char compressMode)
 
 
 int StaticFileCacheData::compressHelper(AutoStr2 &path, FileCacheDataEx *&pData,
-    struct stat &st, int exists, char isBrotli)
+    struct stat &st, int exists, char compressMode)
 {
     int ret;
     if (exists != -1)
         unlink(path.c_str());
-    ret = tryCreateCompressed(isBrotli);
+    ret = tryCreateCompressed(compressMode);
     if (ret == -1)
     {
         if (pData)
@@ -841,8 +1347,8 @@ int StaticFileCacheData::readyCompressed(char compressMode)
     struct stat stGzip;
     struct stat stBr;
     m_tmLastCheck = tm;
-    // Both paths matter, but bredPath is set last.
-    if (!m_bredPath.c_str() || !*m_bredPath.c_str())
+    // All paths matter, but zstdPath is set last.
+    if (!m_zstdPath.c_str() || !*m_zstdPath.c_str())
     {
         if (buildCompressedPaths() == -1)
         {
@@ -851,11 +1357,17 @@ int StaticFileCacheData::readyCompressed(char compressMode)
         }
     }
 
-    if (compressMode & SFCD_MODE_BROTLI)
+    // brotli and zstd are handled alike, statBr/stBr track the one asked for.
+    char brMode = compressMode & (SFCD_MODE_BROTLI | SFCD_MODE_ZSTD);
+    if (brMode & SFCD_MODE_BROTLI)
+        brMode = SFCD_MODE_BROTLI;
+    AutoStr2 &brPath = *getCompressedPath(brMode);
+    FileCacheDataEx *&pBrData = getCompressedData(brMode);
+    if (brMode)
     {
-        statBr = ls_fio_stat(m_bredPath.c_str(), &stBr);
+        statBr = ls_fio_stat(brPath.c_str(), &stBr);
         LS_DBG_H("readyCompressed() path %s statBr %d",
-                 m_bredPath.c_str(), statBr);
+                 brPath.c_str(), statBr);
     }
     if (compressMode & SFCD_MODE_GZIP)
     {
@@ -866,7 +1378,7 @@ int StaticFileCacheData::readyCompressed(char compressMode)
                  m_gzippedPath.c_str(), statGz, retGz);
     }
 
-    if (compressMode & SFCD_MODE_BROTLI) // brotli active AND not valid
+    if (brMode) // brotli/zstd active AND not valid
     {
         if ((statBr != -1) && (stBr.st_mtime == getLastMod()))
         {
@@ -875,21 +1387,23 @@ int StaticFileCacheData::readyCompressed(char compressMode)
         else if (!(compressMode & SFCD_MODE_GZIP) || retGz)
         {
             // update br
-            if ((statBr = compressHelper(m_bredPath, m_pBrotli, stBr, statBr, 1)))
+            if ((statBr = compressHelper(brPath, pBrData, stBr, statBr, brMode)))
             {
                 LS_DBG_H("readyCompressed compress br error %s.",
-                         m_bredPath.c_str());
+                         brPath.c_str());
                 return LS_FAIL;
             }
         }
         else
         {
-            compressMode &= ~SFCD_MODE_BROTLI;
+            compressMode &= ~brMode;
+            brMode = 0;
         }
     }
     else if (compressMode & SFCD_MODE_GZIP)
     {
-        if (retGz && (statGz = compressHelper(m_gzippedPath, m_pGzip, stGzip, statGz, 0)))
+        if (retGz && (statGz = compressHelper(m_gzippedPath, m_pGzip, stGzip, statGz,
+                                              SFCD_MODE_GZIP)))
         {
             LS_DBG_H("readyCompressed() compress gzip error %s or file size not suitable for gzip.",
                     m_gzippedPath.c_str());
@@ -899,13 +1413,13 @@ int StaticFileCacheData::readyCompressed(char compressMode)
     }
     else
     {
-        LS_ERROR("Compress with both Brotli and Gzip turned off.");
+        LS_ERROR("Compress with Brotli, Zstd and Gzip turned off.");
         return LS_FAIL;
     }
 
-    if ((compressMode & SFCD_MODE_BROTLI)
-        && (statBr != -1) && ((!m_pBrotli) || (m_pBrotli->isDirty(stBr))))
-        buildCompressedCache(m_pBrotli, stBr);
+    if (brMode
+        && (statBr != -1) && ((!pBrData) || (pBrData->isDirty(stBr))))
+        buildCompressedCache(pBrData, stBr);
     else if ((compressMode & SFCD_MODE_GZIP)
         && (statGz != -1) && ((!m_pGzip) || (m_pGzip->isDirty(stGzip))))
         buildCompressedCache(m_pGzip, stGzip);
@@ -913,6 +1427,156 @@ int StaticFileCacheData::readyCompressed(char compressMode)
 }
 
 
+//"<base>.<dictionary hash>.dcb" or ".dcz", with room for the lock suffix.
+int StaticFileCacheData::buildDictPath(DictVariant *pVariant)
+{
+    int n = m_gzippedPath.len();
+    char *p = pVariant->m_path.prealloc(n + CompressDict::HEX_LEN + 7);
+    if (!p)
+        return LS_FAIL;
+    memmove(p, m_gzippedPath.c_str(), n);
+    p[n] = '.';
+    memmove(p + n + 1, pVariant->m_achHex, CompressDict::HEX_LEN);
+    n += CompressDict::HEX_LEN + 1;
+    memmove(p + n, (pVariant->m_mode == SFCD_MODE_DCB) ? ".dcb\0\0"
+                                                       : ".dcz\0\0", 6);
+    pVariant->m_path.setLen(n);
+    return LS_OK;
+}
+
+
+//A slot is never reused, a session may still be sending its data; once
+//all are taken other dictionaries get the regular encodings.
+DictVariant *StaticFileCacheData::getDictVariant(const char *pHex,
+                                                 char compressMode)
+{
+    DictVariant *pVariant;
+    for (int i = 0; i < m_iDictVariants; ++i)
+    {
+        pVariant = &m_pDictVariants[i];
+        if ((pVariant->m_mode == compressMode)
+            && (memcmp(pHex, pVariant->m_achHex, CompressDict::HEX_LEN) == 0))
+            return pVariant;
+    }
+    if (m_iDictVariants >= SFCD_DICT_VARIANTS)
+        return NULL;
+    if (!m_pDictVariants)
+        m_pDictVariants = new DictVariant[SFCD_DICT_VARIANTS];
+    pVariant = &m_pDictVariants[m_iDictVariants];
+    memmove(pVariant->m_achHex, pHex, CompressDict::HEX_LEN);
+    pVariant->m_achHex[CompressDict::HEX_LEN] = 0;
+    pVariant->m_mode = compressMode;
+    pVariant->m_pData = NULL;
+    pVariant->m_tmCheck = 0;
+    if (buildDictPath(pVariant) == LS_FAIL)
+        return NULL;
+    ++m_iDictVariants;
+    return pVariant;
+}
+
+
+char StaticFileCacheData::getDictMode(const FileCacheDataEx *pData) const
+{
+    for (int i = 0; pData && (i < m_iDictVariants); ++i)
+    {
+        if (m_pDictVariants[i].m_pData == pData)
+            return m_pDictVariants[i].m_mode;
+    }
+    return 0;
+}
+
+
+int StaticFileCacheData::offloadDictCompress(DictVariant *pVariant,
+                                             const char *pVHost)
+{
+    off_t size = m_fileData.getFileSize();
+    if ((size > s_iMaxFileSize) || (size < s_iMinFileSize))
+        return LS_FAIL;
+    struct Offloader *pOffloader = offloader_get_shared();
+    if (!pOffloader)
+        return LS_FAIL;
+    AutoStr2 &path = pVariant->m_path;
+    char *p = path.buf() + path.len() + 4;
+    int fd = createLockFile(path.buf(), p);
+    if (fd == -1)
+        return LS_FAIL;
+    close(fd);
+
+    char achStore[4096];
+    CompressJob *pJob = new CompressJob();
+    if ((CompressDict::getStorePath(pVHost, pVariant->m_achHex, achStore,
+                                    sizeof(achStore)) == LS_FAIL)
+        || !pJob->m_src.setStr(m_real.c_str(), m_real.len())
+        || !pJob->m_dest.setStr(path.c_str(), strlen(path.c_str()))
+        || !pJob->m_dict.setStr(achStore))
+    {
+        if (pJob->m_dest.c_str())
+            unlinkLockFile(pJob->m_dest);
+        delete pJob;
+        return LS_FAIL;
+    }
+    StringTool::hexDecode(pVariant->m_achHex, CompressDict::HEX_LEN,
+                          pJob->m_achDictHash);
+    pJob->m_size = size;
+    pJob->m_mtime = m_fileData.getLastMod();
+    pJob->m_iLevel = getCompressLevel(pVariant->m_mode);
+    pJob->m_compressMode = pVariant->m_mode;
+    LS_DBG_H("To compress file %s with dictionary %s in offload thread.",
+             m_real.c_str(), pVariant->m_achHex);
+    offloader_submit(pOffloader, performCompressJob, onCompressJobDone, pJob);
+    return LS_OK;
+}
+
+
+FileCacheDataEx *StaticFileCacheData::readyDictCompressed(
+    const char *pVHost, const char *pHex, char compressMode)
+{
+    time_t tm = time(NULL);
+    if (tm == getLastMod())
+        return NULL;
+    if (!m_zstdPath.c_str() || !*m_zstdPath.c_str())
+    {
+        if (buildCompressedPaths() == -1)
+            return NULL;
+    }
+    DictVariant *pVariant = getDictVariant(pHex, compressMode);
+    if (!pVariant)
+        return NULL;
+    FileCacheDataEx *&pData = pVariant->m_pData;
+    if (!pData || (tm != pVariant->m_tmCheck))
+    {
+        pVariant->m_tmCheck = tm;
+        struct stat st;
+        if ((ls_fio_stat(pVariant->m_path.c_str(), &st) == -1)
+            || (st.st_mtime != getLastMod()))
+        {
+            //served with the regular encodings until the variant is ready.
+            offloadDictCompress(pVariant, pVHost);
+            return NULL;
+        }
+        if ((!pData || pData->isDirty(st))
+            && (buildCompressedCache(pData, st) == LS_FAIL))
+            return NULL;
+    }
+    if (pData->isCached() || (pData->getfd() != -1)
+        || (pData->readyData(pVariant->m_path.c_str()) == 0))
+        return pData;
+    return NULL;
+}
+
+
+int StaticFileCacheData::storeAsDictionary(const char *pVHost)
+{
+    off_t size = m_fileData.getFileSize();
+    if ((m_tmDictStored == getLastMod()) || (size > s_iMaxFileSize)
+        || (size <= 0))
+        return 0;
+    m_tmDictStored = getLastMod();
+    return CompressDict::offloadStore(pVHost, m_real.c_str(), m_real.len(),
+                                      size, getLastMod());
+}
+
+
 int StaticFileCacheData::release()
 {
     m_fileData.release();
@@ -920,6 +1584,13 @@ int StaticFileCacheData::release()
         m_pGzip->release();
     if (m_pBrotli)
         m_pBrotli->release();
+    if (m_pZstd)
+        m_pZstd->release();
+    for (int i = 0; i < m_iDictVariants; ++i)
+    {
+        if (m_pDictVariants[i].m_pData)
+            m_pDictVariants[i].m_pData->release();
+    }
     return 0;
 }
 
@@ -940,7 +1611,19 @@ void StaticFileCacheData::setCompressCachePath(const char *pPath)
 }
 
 
+const char *StaticFileCacheData::getCompressCachePath()
+{
+    return s_compressCachePath;
+}
+
+
 void StaticFileCacheData::setStaticBrOptions(int level)
 {
     s_iBrCompressLevel = level;
 }
+
+
+void StaticFileCacheData::setStaticZstdOptions(int level)
+{
+    s_iZstdCompressLevel = level;
+}
@@ -22,6 +22,7 @@
 
 #include <http/cacheelement.h>
 #include <util/autostr.h>
+#include <util/linkedobj.h>
 #include <lsiapi/lsimoduledata.h>
 
 #include <sys/stat.h>
@@ -36,8 +37,9 @@ class HttpReq;
 class StaticFileCacheData;
 class MimeSetting;
 class SsiScript;
+class WatchedDir;
 
-class FileCacheDataEx : public RefCounter
+class FileCacheDataEx : public RefCounter, public DLinkedObj
 {
     friend class StaticFileCacheData;
 
@@ -48,6 +50,7 @@ class FileCacheDataEx : public RefCounter
     ino_t           m_inode;
     time_t          m_lastMod;
     int8_t          m_iStatus;
+    uint32_t        m_iShmBlock;
     char           *m_pCache;
 
     FileCacheDataEx(const FileCacheDataEx &rhs);
@@ -70,7 +73,8 @@ public:
     {
         NONE,
         MMAPED,
-        CACHED
+        CACHED,
+        SHARED
 
     };
 
@@ -95,12 +99,21 @@ public:
     int  getfd() const              {   return m_fd;        }
     void closefd();
 
+    /**
+     * Called when the last sender lets go of the body, keeps the fd of an
+     * uncached body open in the idle fd LRU instead of closing it.
+     */
+    void parkfd();
+    void reusefd();
+    bool isParked() const           {   return next() != NULL;  }
+
     off_t getFileSize() const       {   return m_lSize;     }
 
     const char *getCacheData(off_t offset, off_t &wanted, char *pBuf,
                              long len);
 
     int readyData(const char *pPath);
+    int readySharedData(const char *pPath);
 
     void release();
 
@@ -110,17 +123,41 @@ public:
     static void setTotalInMemCacheSize(size_t max);
     static void setTotalMMapCacheSize(size_t max);
 
+    static void setMaxIdleFds(int max);
+    static int  getMaxIdleFds();
+    static int  getIdleFds();
+    static long getFdCacheHits();
+    static long getFdCacheMisses();
+    static long getFdCacheEvicted();
+
 
 };
 
 #define SFCD_MODE_GZIP      (1<<0)
 #define SFCD_MODE_BROTLI    (1<<1)
+#define SFCD_MODE_ZSTD      (1<<2)
+//encoded against a shared dictionary, never combined with the modes above.
+#define SFCD_MODE_DCB       (1<<3)
+#define SFCD_MODE_DCZ       (1<<4)
+
+#define SFCD_DICT_VARIANTS  4
+
+//A file encoded against one stored dictionary.
+struct DictVariant
+{
+    AutoStr2        m_path;
+    FileCacheDataEx *m_pData;
+    time_t          m_tmCheck;
+    char            m_mode;
+    char            m_achHex[65];
+};
 
 class StaticFileCacheData : public CacheElement
 {
     AutoStr2        m_real;
     AutoStr2        m_gzippedPath;
     AutoStr2        m_bredPath;
+    AutoStr2        m_zstdPath;
     AutoStr2        m_sHeaders;
 
     const MimeSetting *m_pMimeType;
@@ -140,8 +177,15 @@ class StaticFileCacheData : public CacheElement
     LsiModuleData   m_moduleData;
 
     time_t          m_tmLastCheck;
+    WatchedDir     *m_pWatch;
+    struct stat     m_fileStat;
+    time_t          m_tmDictStored;
+    //variants are only freed with the entry, a session may be sending one.
+    DictVariant    *m_pDictVariants;
+    int             m_iDictVariants;
     FileCacheDataEx *m_pGzip;
     FileCacheDataEx *m_pBrotli;
+    FileCacheDataEx *m_pZstd;
     FileCacheDataEx m_fileData;
 
     StaticFileCacheData(const StaticFileCacheData &rhs);
@@ -149,14 +193,19 @@ class StaticFileCacheData : public CacheElement
 
     int buildFixedHeaders(int etag);
     int buildCompressedCache(FileCacheDataEx *&pData, const struct stat &st);
-    int tryCreateCompressed(char useBrotli);
+    int tryCreateCompressed(char compressMode);
     
     int buildCompressedPaths();
+    AutoStr2 *getCompressedPath(char compressMode);
+    FileCacheDataEx *&getCompressedData(char compressMode);
     int detectTrancate();
 
     int setReadiedCompressData(char compressMode);
     int compressHelper(AutoStr2 &path, FileCacheDataEx *&pData,
-        struct stat &st, int exists, char isBrotli);
+        struct stat &st, int exists, char compressMode);
+    DictVariant *getDictVariant(const char *pHex, char compressMode);
+    int buildDictPath(DictVariant *pVariant);
+    int offloadDictCompress(DictVariant *pVariant, const char *pVHost);
 public:
 
     int readyCompressed(char compressMode);
@@ -181,6 +230,19 @@ public:
 
     FileCacheDataEx *getGzip() const    {   return m_pGzip;             }
     FileCacheDataEx *getBrotli() const  {   return m_pBrotli;           }
+    FileCacheDataEx *getZstd() const    {   return m_pZstd;             }
+    /** SFCD_MODE_DCB/SFCD_MODE_DCZ if pData is a dictionary variant. */
+    char getDictMode(const FileCacheDataEx *pData) const;
+
+    /**
+     * Readies the variant encoded against the dictionary pHex stored for
+     * the vhost, up to SFCD_DICT_VARIANTS per file. NULL while it is being
+     * built.
+     */
+    FileCacheDataEx *readyDictCompressed(const char *pVHost,
+                                         const char *pHex, char compressMode);
+    /** Queues the file for the vhost dictionary store once per change. */
+    int storeAsDictionary(const char *pVHost);
     const FileCacheDataEx *getFileData() const {   return &m_fileData;  }
     FileCacheDataEx *getFileData()      {   return &m_fileData;         }
 
@@ -204,13 +266,17 @@ public:
     
     bool isDirty(const struct stat &fileStat) const
     {   return m_fileData.isDirty(fileStat);      }
+    const struct stat &getFileStat() const  {   return m_fileStat;  }
+    WatchedDir *getWatch() const        {   return m_pWatch;            }
+    void setWatch(WatchedDir *p)        {   m_pWatch = p;               }
     int needUpdateHeaders(const MimeSetting *pMIME,
                           const AutoStr2 *pCharset, short etag) const
     {
         return (pMIME != m_pMimeType) || (pCharset != m_pCharset)
                || (m_iFileETag != etag);
     }
-    int compressFile(char useBrotli);
+    int compressFile(char compressMode);
+    int offloadCompress(char compressMode);
 
     int buildHeaders(const MimeSetting *pMIME,
                      const AutoStr2 *pCharset, short etag);
@@ -223,8 +289,21 @@ public:
     static void setUpdateStaticGzipFile(int enable, int level,
                                         size_t min, size_t max);
     static void setCompressCachePath(const char *pPath);
+    static const char *getCompressCachePath();
 
     static void setStaticBrOptions(int level);
+    static void setStaticZstdOptions(int level);
+
+    /**
+     * Brings the gzip, brotli and zstd variants of a file in the compress
+     * cache up to date at the maximum level, in the calling thread. Returns
+     * the number of variants written.
+     */
+    static int precompress(const char *pReal, int len,
+                           const struct stat &st, char compressMode);
+    /** 1 if the variants are current or the file is not to be compressed. */
+    static int isPrecompressed(const char *pReal, int len,
+                               const struct stat &st, char compressMode);
 };
 
 #endif
@@ -17,6 +17,7 @@
 *****************************************************************************/
 #include "staticfilehandler.h"
 
+#include <http/compressdict.h>
 #include <http/expiresctrl.h>
 #include <http/handlertype.h>
 #include <http/httpmethod.h>
@@ -30,12 +31,14 @@
 #include <http/moov.h>
 #include <http/sendfileinfo.h>
 #include <http/staticfilecachedata.h>
+#include <http/staticfileshmcache.h>
 #include "httpvhost.h"
 #include <log4cxx/logger.h>
 #include <lsr/ls_strtool.h>
 #include <lsr/ls_xpool.h>
 #include <util/datetime.h>
 #include <util/gzipbuf.h>
+#include <util/iovec.h>
 #include <util/stringtool.h>
 
 #include <arpa/inet.h>
@@ -116,6 +119,21 @@ inline int buildStaticFileHeaders(HttpResp *pResp, HttpReq *pReq,
 }
 
 
+//Announces the body as a dictionary for the matching URLs, it has to be in
+//the dictionary store by the time a client names it in Available-Dictionary.
+static void addUseAsDictionary(HttpResp *pResp, StaticFileCacheData *pData,
+                               const AutoStr2 *pPattern, const char *pVHost)
+{
+    char achVal[4096];
+    int n = snprintf(achVal, sizeof(achVal), "match=\"%s\"",
+                     pPattern->c_str());
+    if (n >= (int)sizeof(achVal))
+        return;
+    pResp->getRespHeaders().add("use-as-dictionary", 17, achVal, n);
+    pData->storeAsDictionary(pVHost);
+}
+
+
 #define FLV_MIME "video/x-flv"
 #define FLV_HEADER "FLV\x1\x1\0\0\0\x9\0\0\0\x9"
 #define FLV_HEADER_LEN (sizeof(FLV_HEADER)-1)
@@ -147,96 +165,20 @@ static int processFlvStream(HttpSession *pSession, off_t start)
 }
 
 
-int calcMoovContentLen(HttpSession *pSession, off_t &contentLen)
-{
-    int ret = 0;
-    SendFileInfo *pData = pSession->getSendFileInfo();
-
-    FileCacheDataEx *pECache = pData->getECache();
-
-    unsigned char *mini_moov = NULL;
-    uint32_t mini_moov_size;
-    mini_moov = pData->getFileData()->getMiniMoov();
-    mini_moov_size = pData->getFileData()->getMiniMoovSize();
-
-    contentLen = 0;
-
-    moov_data_t *moov_data = (moov_data_t *)pData->getParam();
-    if (!moov_data)
-        return LS_FAIL;
-
-    while (moov_data->remaining_bytes > 0)
-    {
-        ret = get_moov(
-                  pECache->getfd(),
-                  moov_data->start_time,
-                  0.0,
-                  moov_data,
-                  mini_moov,
-                  mini_moov_size);
-        if (ret == -1)
-            return LS_FAIL;
-        if (moov_data->is_mem == 1)
-        {
-            contentLen += moov_data->mem.buf_size;
-            free(moov_data->mem.buffer);
-            moov_data->mem.buffer = NULL;
-        }
-        else
-            contentLen += moov_data->file.data_size;
-    }
-
-    //static char mdat_header64[16] = { 0, 0, 0, 1, 'm', 'd', 'a', 't' };
-    uint64_t mdat_start;
-    uint64_t mdat_size;
-    int      mdat_64bit;
-
-    ret = get_mdat(
-              pECache->getfd(),
-              moov_data->start_time,
-              0.0,
-              & mdat_start,
-              & mdat_size,
-              & mdat_64bit,
-              mini_moov,
-              mini_moov_size);
-    if (ret == -1)
-        return LS_FAIL;
-    if (mdat_64bit)
-        contentLen += 16;
-    else
-        contentLen += 8;
-    contentLen += mdat_size;
-    return 1;
-
-}
-
-
 int buildMoov(HttpSession *pSession)
 {
     int ret = 0;
     HttpReq *pReq = pSession->getReq();
     SendFileInfo *pData = pSession->getSendFileInfo();
 
-    unsigned char *mini_moov = NULL;
-    uint32_t mini_moov_size;
-    mini_moov = pData->getFileData()->getMiniMoov();
-    mini_moov_size = pData->getFileData()->getMiniMoovSize();
-
-    moov_data_t *moov_data = (moov_data_t *)pData->getParam();
-    if (!moov_data)
+    moov_seek_t *pSeek = (moov_seek_t *)pData->getParam();
+    if (!pSeek)
         return LS_FAIL;
+    moov_data_t *moov_data = moov_seek_data(pSeek);
 
-    FileCacheDataEx *pECache = pData->getECache();
     while (moov_data->remaining_bytes > 0)
     {
-        ret = get_moov(
-                  pECache->getfd(),
-                  moov_data->start_time,
-                  0.0,
-                  moov_data,
-                  mini_moov,
-                  mini_moov_size);
+        ret = moov_seek_next(pSeek);
         if (ret == -1)
             return LS_FAIL;
         if (moov_data->is_mem == 1)
@@ -244,12 +186,8 @@ int buildMoov(HttpSession *pSession)
             LS_DBG_L(pReq->getLogSession(), "is_mem, buf_size=%u, remaining=%d",
                      moov_data->mem.buf_size, moov_data->remaining_bytes);
             if (moov_data->mem.buffer)
-            {
                 pSession->appendDynBody((char *)moov_data->mem.buffer,
-                                    moov_data->mem.buf_size);
-                free(moov_data->mem.buffer);
-            }
-            moov_data->mem.buffer = NULL;
+                                        moov_data->mem.buf_size);
         }
         else
         {
@@ -262,10 +200,6 @@ int buildMoov(HttpSession *pSession)
             pSession->setSendFileBeginEnd(moov_data->file.start_offset,
                                           moov_data->file.start_offset + moov_data->file.data_size);
             return 1;
-            //sendfile( pECache->getfd(), moov_data.file.start_offset,
-            //            moov_data.file.data_size );
-            //fseek(infile, moov_data.file.start_offset, SEEK_SET);
-            //copy_data(infile, outfile, moov_data.file.data_size);
         }
     }
 
@@ -277,19 +211,9 @@ int buildMoov(HttpSession *pSession)
     int      mdat_64bit;
     uint32_t *pLen32;
 
-    ret = get_mdat(
-              pECache->getfd(),
-              moov_data->start_time,
-              0.0,
-              & mdat_start,
-              & mdat_size,
-              & mdat_64bit,
-              mini_moov,
-              mini_moov_size);
-    free(moov_data);
+    moov_seek_mdat(pSeek, &mdat_start, &mdat_size, &mdat_64bit);
+    moov_seek_free(pSeek);
     pData->setParam(NULL);
-    if (ret == -1)
-        return LS_FAIL;
     LS_DBG_L(pReq->getLogSession(),
              "mdat_start=%u, mdat_size=%u, mdat_64bit=%d",
              (uint32_t)mdat_start, (uint32_t)mdat_size, mdat_64bit);
@@ -313,6 +237,42 @@ int buildMoov(HttpSession *pSession)
 }
 
 
+/**
+ * The mini moov, the sample tables of a video without the sample sizes,
+ * is kept with the file cache entry, and in the shared static file tier
+ * when enabled, so each worker parses the moov box of a file at most once.
+ */
+static unsigned char *getMiniMoov(HttpSession *pSession, uint32_t &size)
+{
+    HttpReq *pReq = pSession->getReq();
+    SendFileInfo *pData = pSession->getSendFileInfo();
+    StaticFileCacheData *pFileData = pData->getFileData();
+    unsigned char *mini_moov = pFileData->getMiniMoov();
+    if (mini_moov)
+    {
+        size = pFileData->getMiniMoovSize();
+        return mini_moov;
+    }
+
+    const struct stat &st = pReq->getFileStat();
+    const AutoStr2 *pPath = pReq->getRealPath();
+    StaticFileShmCache &shmCache = StaticFileShmCache::getInstance();
+    mini_moov = shmCache.attachMoovIndex(pPath->c_str(), pPath->len(),
+                                         st.st_ino, st.st_size, st.st_mtime,
+                                         &size);
+    if (!mini_moov)
+    {
+        if (get_mini_moov(pData->getECache()->getfd(), &mini_moov,
+                          &size) != 1)
+            return NULL;
+        shmCache.publishMoovIndex(pPath->c_str(), pPath->len(), st.st_ino,
+                                  st.st_size, st.st_mtime, mini_moov, size);
+    }
+    pFileData->setMiniMoov(mini_moov, size);
+    return mini_moov;
+}
+
+
 int processH264Stream(HttpSession *pSession, double start)
 {
     HttpReq *pReq = pSession->getReq();
@@ -321,46 +281,30 @@ int processH264Stream(HttpSession *pSession, double start)
     int ret = pData->readyCacheData(0);
     if (ret)
         return ret;
-    unsigned char *mini_moov = NULL;
     uint32_t mini_moov_size;
-    mini_moov = pData->getFileData()->getMiniMoov();
-    FileCacheDataEx *pECache = pData->getECache();
+    unsigned char *mini_moov = getMiniMoov(pSession, mini_moov_size);
     if (!mini_moov)
     {
-        if (get_mini_moov(pECache->getfd(),     //in - video file descriptor
-                          &mini_moov,                     //out
-                          &mini_moov_size                 //out
-                         ) == 1)
-            pData->getFileData()->setMiniMoov(mini_moov, mini_moov_size);
-        else
-        {
-            LS_NOTICE(pReq->getLogSession(),
-                      "Failed to parse moov header from MP4/H.264 video file [%s].",
-                      pReq->getRealPath()->c_str());
-            return SC_500;
-        }
-    }
-
-    moov_data_t *moov_data;
-    moov_data = (moov_data_t *)malloc(sizeof(moov_data_t));
-    if (!moov_data)
+        LS_NOTICE(pReq->getLogSession(),
+                  "Failed to parse moov header from MP4/H.264 video file [%s].",
+                  pReq->getRealPath()->c_str());
         return SC_500;
-    pSession->getReq()->orContextState(MP4_SEEK);
-    pData->setParam(moov_data);
-    moov_data->remaining_bytes = 1;  //first call
-    moov_data->start_time = start;
-
-    pSession->resetResp();
+    }
 
-    off_t contentLen = 0;
-    if (calcMoovContentLen(pSession, contentLen) == -1)
+    //the new moov is computed once, its length needs no extra pass.
+    moov_seek_t *pSeek = moov_seek_new(start, mini_moov, mini_moov_size);
+    if (!pSeek)
     {
         LS_NOTICE(pReq->getLogSession(),
                   "Failed to calculate content length for seek request for MP4/H.264 video file [%s].",
                   pReq->getRealPath()->c_str());
         return SC_500;
     }
-    pSession->getResp()->setContentLen(contentLen);
+    pSession->getReq()->orContextState(MP4_SEEK);
+    pData->setParam(pSeek);
+
+    pSession->resetResp();
+    pSession->getResp()->setContentLen(moov_seek_content_len(pSeek));
 
 //    pSession->setupRespCache();
     //pSession->getReq()->setVersion( HTTP_1_0 );
@@ -369,7 +313,6 @@ int processH264Stream(HttpSession *pSession, double start)
             "video/mp4", 9);
 
 
-    moov_data->remaining_bytes = 1;  //first call
     ret = buildMoov(pSession);
     if (ret <= 1)
         ret = pSession->flush();
@@ -516,20 +459,41 @@ int StaticFileHandler::process(HttpSession *pSession,
         }
     }
 
-    char compressed = (((pReq->gzipAcceptable() == GZIP_REQUIRED)
-                        || (pReq->brAcceptable() == BR_REQUIRED)) &&
-                       ((pSession->getSessionHooks()->getFlag(LSI_HKPT_RECV_RESP_BODY)
+    char noDecompress = (((pSession->getSessionHooks()->getFlag(LSI_HKPT_RECV_RESP_BODY)
                          | pSession->getSessionHooks()->getFlag(LSI_HKPT_SEND_RESP_BODY))
                         & LSI_FLAG_DECOMPRESS_REQUIRED) == 0);
+    char compressed = (((pReq->gzipAcceptable() == GZIP_REQUIRED)
+                        || (pReq->brAcceptable() == BR_REQUIRED)
+                        || (pReq->zstdAcceptable() == ZSTD_REQUIRED)) &&
+                       noDecompress);
 
     char mode = (pReq->brAcceptable() == BR_REQUIRED ? SFCD_MODE_BROTLI : 0);
-    if (pReq->gzipAcceptable() == GZIP_REQUIRED &&
-        pReq->brAcceptable() != BR_REQUIRED)
+    if (!mode && pReq->zstdAcceptable() == ZSTD_REQUIRED)
+        mode = SFCD_MODE_ZSTD;
+    if (pReq->gzipAcceptable() == GZIP_REQUIRED && !mode)
         mode |= SFCD_MODE_GZIP;
 
-    ret = pInfo->readyCacheData(compressed, mode);
-    LS_DBG_L(pReq->getLogSession(), "readyCacheData(%d, %d) return %d",
-             compressed, mode, ret);
+    HttpVHost *pVHost = (HttpVHost *)pReq->getVHost();
+    const AutoStr2 *pDictPattern = NULL;
+    char dictMode = 0;
+    char achDictHex[CompressDict::HEX_LEN + 1];
+    if (!isSSI && pVHost && (pVHost->getCompressDictMatch()->size() > 0))
+    {
+        if (code == SC_200)
+            pDictPattern = CompressDict::match(*pVHost->getCompressDictMatch(),
+                                    pReq->getOrgURI(), pReq->getOrgURILen());
+        if (noDecompress)
+            dictMode = CompressDict::getRequestMode(pReq, achDictHex);
+    }
+    if (dictMode && (pInfo->readyDictCacheData(pVHost->getName(), achDictHex,
+                                               dictMode) == 0))
+        ret = 0;
+    else
+    {
+        ret = pInfo->readyCacheData(compressed, mode);
+        LS_DBG_L(pReq->getLogSession(), "readyCacheData(%d, %d) return %d",
+                 compressed, mode, ret);
+    }
     FileCacheDataEx *pECache = pInfo->getECache();
 
     if (!ret)
@@ -573,11 +537,22 @@ int StaticFileHandler::process(HttpSession *pSession,
                     pResp->addBrotliEncodingHeader();
                     pReq->orBr(UPSTREAM_BR);
                 }
+                if (pECache == pCache->getZstd())
+                {
+                    pResp->addZstdEncodingHeader();
+                    pReq->orZstd(UPSTREAM_ZSTD);
+                }
                 if (pECache == pCache->getGzip())
                 {
                     pResp->addGzipEncodingHeader();
                     pReq->orGzip(UPSTREAM_GZIP);
                 }
+                if ((dictMode = pCache->getDictMode(pECache)) != 0)
+                    pResp->addDictEncodingHeader(
+                        (dictMode == SFCD_MODE_DCB) ? ETAG_DCB : ETAG_DCZ);
+                if (pDictPattern)
+                    addUseAsDictionary(pResp, pCache, pDictPattern,
+                                       pVHost->getName());
                 pSession->setSendFileBeginEnd(0, pInfo->getECache()->getFileSize());
             }
         } //Xuedong Add for SSI Start
@@ -625,6 +600,14 @@ int StaticFileHandler::process(HttpSession *pSession,
 
 int StaticFileHandler::cleanUp(HttpSession *pSession)
 {
+    if (pSession->getReq()->getContextState(MP4_SEEK))
+    {
+        SendFileInfo *pData = pSession->getSendFileInfo();
+        if (pData->getParam())
+            moov_seek_free((moov_seek_t *)pData->getParam());
+        pData->setParam(NULL);
+        pSession->getReq()->clearContextState(MP4_SEEK);
+    }
     return 0;
 }
 
@@ -654,6 +637,156 @@ bool StaticFileHandler::notAllowed(int Method) const
 }
 
 
+/**
+ * Multipart ranges go out in batches, the headers of all parts are built
+ * up front and one writev() carries the headers along with the body data
+ * of as many parts as the file cache holds in memory. Body data only on
+ * disk is sent with sendfile() right after its part header, that works for
+ * HTTP/2 streams as well, the stream frames it with flow control.
+ */
+#define MULTIPART_BATCH_IOV     8
+#define MULTIPART_BATCH_SIZE    (1024 * 1024)
+
+static int canBatchMultipart(HttpSession *pSession)
+{
+    return (pSession->isHookDisabled(LSI_HKPT_SEND_RESP_BODY)
+            && !pSession->getGzipBuf()
+            && HttpServerConfig::getInstance().getUseSendfile() != 2);
+}
+
+
+#if !defined( NO_SENDFILE )
+static int canSendfile(HttpSession *pSession)
+{
+    HioStream *pStream = pSession->getStream();
+    if (!HttpServerConfig::getInstance().getUseSendfile())
+        return 0;
+    if (pStream->isSpdy())
+        return pStream->isSendfileAvail();
+    return (!pSession->isHttps() || pStream->isSendfileAvail());
+}
+#endif
+
+
+static void multipartSent(HttpRange &range, off_t len)
+{
+    off_t begin, end, remain;
+    int hdrLen;
+    while (len > 0)
+    {
+        range.getPrebuiltHeader(range.getCurRange(), hdrLen);
+        remain = hdrLen - range.getPartSent();
+        if ((range.getCurRange() < range.count())
+            && (range.getContentOffset(range.getCurRange(), begin, end) == 0))
+            remain += end - begin;
+        if (len < remain)
+        {
+            range.partSent(len);
+            return;
+        }
+        len -= remain;
+        range.nextPart();
+    }
+}
+
+
+static off_t sendPartFromFile(HttpSession *pSession, HttpRange &range)
+{
+    SendFileInfo *pData = pSession->getSendFileInfo();
+    off_t begin, end;
+    int hdrLen;
+    range.getPrebuiltHeader(range.getCurRange(), hdrLen);
+    if (range.getContentOffset(range.getCurRange(), begin, end) != 0)
+        return LS_FAIL;
+    begin += range.getPartSent() - hdrLen;
+
+#if !defined( NO_SENDFILE )
+    int fd = pData->getfd();
+    if ((fd != -1) && canSendfile(pSession))
+        return pSession->writeRespBodySendFile(fd, begin, end - begin, 0);
+#endif
+
+    char achBuf[16384];
+    off_t wanted = end - begin;
+    if (wanted > (off_t)sizeof(achBuf))
+        wanted = sizeof(achBuf);
+    const char *pBuf = pData->getECache()->getCacheData(begin, wanted, achBuf,
+                                                        wanted);
+    if (wanted <= 0)
+        return LS_FAIL;
+    return pSession->writeRespBodyDirect(pBuf, wanted);
+}
+
+
+static int sendMultipartBatch(HttpSession *pSession, HttpRange &range)
+{
+    FileCacheDataEx *pECache = pSession->getSendFileInfo()->getECache();
+    int inMemory = ((pECache->getStatus() == FileCacheDataEx::CACHED)
+                    || pECache->isMapped());
+    int count = range.count();
+    const char *pHeader;
+    off_t begin, end, skip, wanted, ret;
+    int hdrLen, total, n;
+
+    while (range.getCurRange() <= count)
+    {
+        IOVec iov;
+        total = 0;
+        skip = range.getPartSent();
+        for (n = range.getCurRange(); n <= count; ++n, skip = 0)
+        {
+            pHeader = range.getPrebuiltHeader(n, hdrLen);
+            if (skip < hdrLen)
+            {
+                iov.append(pHeader + skip, hdrLen - skip);
+                total += hdrLen - skip;
+                skip = 0;
+            }
+            else
+                skip -= hdrLen;
+            if ((n == count) || !inMemory)
+                break;
+            if (range.getContentOffset(n, begin, end) != 0)
+                return LS_FAIL;
+            begin += skip;
+            wanted = end - begin;
+            if (wanted > MULTIPART_BATCH_SIZE - total)
+                wanted = MULTIPART_BATCH_SIZE - total;
+            iov.append(pECache->getCacheData(begin, wanted, NULL, 0), wanted);
+            total += wanted;
+            if ((begin + wanted < end) || (total >= MULTIPART_BATCH_SIZE)
+                || (iov.len() + 2 > MULTIPART_BATCH_IOV))
+                break;
+        }
+
+        if (total > 0)
+        {
+            ret = pSession->writeRespBodyv(iov, total);
+            LS_DBG_L(pSession, "send %d range parts, %d bytes, written %lld",
+                     iov.len(), total, (long long)ret);
+            if (ret < 0)
+                return LS_FAIL;
+            multipartSent(range, ret);
+            if (ret < total)
+                return 1;
+        }
+        else
+        {
+            ret = sendPartFromFile(pSession, range);
+            LS_DBG_L(pSession, "send range part %d from file, written %lld",
+                     range.getCurRange(), (long long)ret);
+            if (ret < 0)
+                return LS_FAIL;
+            if (ret == 0)
+                return 1;
+            multipartSent(range, ret);
+        }
+    }
+    pSession->endResponse(1);
+    return 0;
+}
+
+
 static int buildRangeHeaders(HttpSession *pSession, HttpRange &range)
 {
     HttpResp *pResp = pSession->getResp();
@@ -710,6 +843,9 @@ static int buildRangeHeaders(HttpSession *pSession, HttpRange &range)
         buf.appendLastVal(range.getBoundary(), strlen(range.getBoundary()));
         bodyLen = range.getMultipartBodyLen(pData->getMimeType()->getMIME());
         pResp->setContentLen(bodyLen);
+        if (canBatchMultipart(pSession))
+            range.buildAllPartHeaders(pData->getMimeType()->getMIME()->c_str(),
+                                      pSession->getReq()->getPool());
         pSession->sendRespHeaders();
         return sendMultipart(pSession, range);
 
@@ -724,6 +860,8 @@ static int sendMultipart(HttpSession *pSession, HttpRange &range)
     int  ret = 0;
     SendFileInfo *pData = pSession->getSendFileInfo();
     int headerLen;
+    if (range.hasAllPartHeaders())
+        return sendMultipartBatch(pSession, range);
     while (true)
     {
         headerLen = range.getPartHeaderLen();
@@ -0,0 +1,359 @@
+/*****************************************************************************
+*    Open LiteSpeed is an open source HTTP server.                           *
+*    Copyright (C) 2013 - 2020  LiteSpeed Technologies, Inc.                 *
+*                                                                            *
+*    This program is free software: you can redistribute it and/or modify    *
+*    it under the terms of the GNU General Public License as published by    *
+*    the Free Software Foundation, either version 3 of the License, or       *
+*    (at your option) any later version.                                     *
+*                                                                            *
+*    This program is distributed in the hope that it will be useful,         *
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            *
+*    GNU General Public License for more details.                            *
+*                                                                            *
+*    You should have received a copy of the GNU General Public License       *
+*    along with this program. If not, see http://www.gnu.org/licenses/.      *
+*****************************************************************************/
+#include "staticfileshmcache.h"
+
+#include <log4cxx/logger.h>
+#include <lsr/ls_atomic.h>
+#include <shm/lsshm.h>
+#include <shm/lsshmhash.h>
+#include <shm/lsshmpool.h>
+#include <util/datetime.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#define SFSC_SHM_NAME       "static_file"
+#define SFSC_HASH_NAME      "static_file_body"
+#define SFSC_MOOV_HASH_NAME "static_file_moov"
+#define SFSC_IDLE_TIMEOUT   300
+
+typedef struct
+{
+    int32_t         m_iRefs;
+    LsShmSize_t     m_iAllocSize;
+    int64_t         m_inode;
+    int64_t         m_iSize;
+    int64_t         m_mtime;
+    char            m_data[0];
+} SfShmBlock;
+
+//stored in place as the hash value, a moov index is only copied out.
+typedef struct
+{
+    int64_t         m_inode;
+    int64_t         m_iSize;
+    int64_t         m_mtime;
+    char            m_data[0];
+} SfShmMoovIndex;
+
+//kept in the reserved area of the hash table header, updated under the
+//hash lock.
+typedef struct
+{
+    int64_t         m_iBytes;
+    int32_t         m_iEntries;
+} SfShmStat;
+
+static_assert(sizeof(SfShmStat) <= LSSHM_HTABLE_RESERVED_SIZE,
+              "SfShmStat does not fit the hash table reserved area");
+
+
+LS_SINGLETON(StaticFileShmCache);
+
+
+StaticFileShmCache::StaticFileShmCache()
+    : m_pStore(NULL)
+    , m_pMoovStore(NULL)
+    , m_iMaxSize(0)
+{
+}
+
+
+StaticFileShmCache::~StaticFileShmCache()
+{
+}
+
+
+int StaticFileShmCache::init(size_t maxSize, int uid, int gid)
+{
+    m_iMaxSize = maxSize;
+    if (m_pStore)
+        return LS_OK;
+    if ((m_pStore = LsShmHash::open(SFSC_SHM_NAME, SFSC_HASH_NAME, 1000,
+                                    LSSHM_FLAG_LRU)) == NULL)
+    {
+        LS_WARN("[StaticFileShmCache] Failed to open shared memory.");
+        return LS_FAIL;
+    }
+    m_pStore->getPool()->getShm()->chperm(uid, gid, 0600);
+    m_pStore->disableAutoLock();
+    if ((m_pMoovStore = LsShmHash::open(SFSC_SHM_NAME, SFSC_MOOV_HASH_NAME,
+                                        100, LSSHM_FLAG_LRU)) == NULL)
+        LS_WARN("[StaticFileShmCache] Failed to open MP4 index store.");
+    else
+        m_pMoovStore->disableAutoLock();
+    return LS_OK;
+}
+
+
+static SfShmStat *getStat(LsShmHash *pHash)
+{
+    return (SfShmStat *)pHash->offset2ptr(pHash->getHTableReservedOffset());
+}
+
+
+static bool isSameFile(const SfShmBlock *pBlock, ino_t inode, off_t size,
+                       time_t mtime)
+{
+    return (pBlock->m_inode == (int64_t)inode)
+           && (pBlock->m_iSize == (int64_t)size)
+           && (pBlock->m_mtime == (int64_t)mtime);
+}
+
+
+void StaticFileShmCache::unrefBlock(LsShmOffset_t offBlock)
+{
+    if (!offBlock)
+        return;
+    SfShmBlock *pBlock = (SfShmBlock *)m_pStore->offset2ptr(offBlock);
+    if (ls_atomic_sub_fetch(&pBlock->m_iRefs, 1) == 0)
+        m_pStore->getPool()->release2(offBlock, pBlock->m_iAllocSize);
+}
+
+
+//the hash must be locked.
+LsShmOffset_t StaticFileShmCache::attachLocked(const char *pPath,
+        int pathLen, ino_t inode, off_t size, time_t mtime)
+{
+    ls_strpair_t parms;
+    LsShmHash::iteroffset iterOff;
+    ls_str_set(&parms.key, (char *)pPath, pathLen);
+    iterOff = m_pStore->findIterator(&parms);
+    if (iterOff.m_iOffset == 0)
+        return 0;
+    LsShmOffset_t offBlock =
+        *(LsShmOffset_t *)m_pStore->offset2iteratorData(iterOff);
+    SfShmBlock *pBlock = (SfShmBlock *)m_pStore->offset2ptr(offBlock);
+    if (!isSameFile(pBlock, inode, size, mtime))
+        return 0;
+    ls_atomic_add_fetch(&pBlock->m_iRefs, 1);
+    m_pStore->touchLru(iterOff);
+    return offBlock;
+}
+
+
+LsShmOffset_t StaticFileShmCache::attach(const char *pPath, int pathLen,
+        ino_t inode, off_t size, time_t mtime)
+{
+    if (!m_pStore)
+        return 0;
+    m_pStore->lock();
+    LsShmOffset_t offBlock = attachLocked(pPath, pathLen, inode, size, mtime);
+    m_pStore->unlock();
+    return offBlock;
+}
+
+
+LsShmOffset_t StaticFileShmCache::publish(const char *pPath, int pathLen,
+        ino_t inode, off_t size, time_t mtime, const char *pBody)
+{
+    if (!m_pStore)
+        return 0;
+    int remapped;
+    LsShmSize_t allocSize = sizeof(SfShmBlock) + size;
+    LsShmOffset_t offBlock = m_pStore->getPool()->alloc2(allocSize, remapped);
+    if (!offBlock)
+        return 0;
+    SfShmBlock *pBlock = (SfShmBlock *)m_pStore->offset2ptr(offBlock);
+    pBlock->m_iRefs = 2;    //the hash entry and the caller
+    pBlock->m_iAllocSize = allocSize;
+    pBlock->m_inode = inode;
+    pBlock->m_iSize = size;
+    pBlock->m_mtime = mtime;
+    memmove(pBlock->m_data, pBody, size);
+
+    LsShmOffset_t offExist, offOld = 0;
+    int valLen;
+    m_pStore->lock();
+    SfShmStat *pStat = getStat(m_pStore);
+    if ((offExist = attachLocked(pPath, pathLen, inode, size, mtime)) != 0)
+    {
+        //another process got here first
+        m_pStore->unlock();
+        m_pStore->getPool()->release2(offBlock, allocSize);
+        return offExist;
+    }
+    LsShmOffset_t offVal = m_pStore->find(pPath, pathLen, &valLen);
+    if (offVal)
+        offOld = *(LsShmOffset_t *)m_pStore->offset2ptr(offVal);
+    else if (pStat->m_iBytes + allocSize > (int64_t)m_iMaxSize)
+    {
+        m_pStore->unlock();
+        m_pStore->getPool()->release2(offBlock, allocSize);
+        return 0;
+    }
+    if (m_pStore->set(pPath, pathLen, &offBlock, sizeof(offBlock)) == 0)
+    {
+        m_pStore->unlock();
+        m_pStore->getPool()->release2(offBlock, allocSize);
+        return 0;
+    }
+    pStat = getStat(m_pStore);
+    pStat->m_iBytes += allocSize;
+    if (offOld)
+    {
+        pStat->m_iBytes -= ((SfShmBlock *)m_pStore->offset2ptr(offOld))
+                                ->m_iAllocSize;
+        unrefBlock(offOld);
+    }
+    else
+        ++pStat->m_iEntries;
+    m_pStore->unlock();
+    return offBlock;
+}
+
+
+int StaticFileShmCache::read(LsShmOffset_t offBlock, off_t offset,
+                             char *pBuf, int len)
+{
+    m_pStore->getPool()->chkRemap();
+    const SfShmBlock *pBlock =
+        (const SfShmBlock *)m_pStore->offset2ptr(offBlock);
+    if (offset >= pBlock->m_iSize)
+        return 0;
+    if (len > pBlock->m_iSize - offset)
+        len = pBlock->m_iSize - offset;
+    memmove(pBuf, pBlock->m_data + offset, len);
+    return len;
+}
+
+
+unsigned char *StaticFileShmCache::attachMoovIndex(const char *pPath,
+        int pathLen, ino_t inode, off_t size, time_t mtime,
+        uint32_t *pIndexLen)
+{
+    if (!m_pMoovStore)
+        return NULL;
+    unsigned char *pIndex = NULL;
+    ls_strpair_t parms;
+    LsShmHash::iteroffset iterOff;
+    ls_str_set(&parms.key, (char *)pPath, pathLen);
+    m_pMoovStore->lock();
+    iterOff = m_pMoovStore->findIterator(&parms);
+    if (iterOff.m_iOffset != 0)
+    {
+        LsShmHash::iterator iter = m_pMoovStore->offset2iterator(iterOff);
+        const SfShmMoovIndex *pStored = (const SfShmMoovIndex *)iter->getVal();
+        int len = iter->getValLen() - sizeof(SfShmMoovIndex);
+        if ((pStored->m_inode == (int64_t)inode)
+            && (pStored->m_iSize == (int64_t)size)
+            && (pStored->m_mtime == (int64_t)mtime) && (len > 0)
+            && ((pIndex = (unsigned char *)malloc(len)) != NULL))
+        {
+            memmove(pIndex, pStored->m_data, len);
+            *pIndexLen = len;
+            m_pMoovStore->touchLru(iterOff);
+        }
+    }
+    m_pMoovStore->unlock();
+    return pIndex;
+}
+
+
+void StaticFileShmCache::publishMoovIndex(const char *pPath, int pathLen,
+        ino_t inode, off_t size, time_t mtime, const unsigned char *pIndex,
+        uint32_t indexLen)
+{
+    if (!m_pMoovStore)
+        return;
+    int valLen = sizeof(SfShmMoovIndex) + indexLen;
+    SfShmMoovIndex *pVal = (SfShmMoovIndex *)malloc(valLen);
+    if (!pVal)
+        return;
+    pVal->m_inode = inode;
+    pVal->m_iSize = size;
+    pVal->m_mtime = mtime;
+    memmove(pVal->m_data, pIndex, indexLen);
+
+    m_pMoovStore->lock();
+    SfShmStat *pStat = getStat(m_pMoovStore);
+    int oldLen = 0;
+    LsShmOffset_t offVal = m_pMoovStore->find(pPath, pathLen, &oldLen);
+    if (offVal || (pStat->m_iBytes + valLen <= (int64_t)m_iMaxSize))
+    {
+        if (m_pMoovStore->set(pPath, pathLen, pVal, valLen) != 0)
+        {
+            pStat = getStat(m_pMoovStore);
+            pStat->m_iBytes += valLen - oldLen;
+            if (!offVal)
+                ++pStat->m_iEntries;
+        }
+    }
+    m_pMoovStore->unlock();
+    free(pVal);
+}
+
+
+static int trimMoovIndex(LsShmHash::iterator iter, void *arg)
+{
+    SfShmStat *pStat = getStat((LsShmHash *)arg);
+    pStat->m_iBytes -= iter->getValLen();
+    --pStat->m_iEntries;
+    return 1;
+}
+
+
+static int trimBlock(LsShmHash::iterator iter, void *arg)
+{
+    StaticFileShmCache *pCache = (StaticFileShmCache *)arg;
+    LsShmHash *pHash = (LsShmHash *)pCache->getStore();
+    LsShmOffset_t offBlock = *(LsShmOffset_t *)iter->getVal();
+    SfShmStat *pStat = getStat(pHash);
+    pStat->m_iBytes -= ((SfShmBlock *)pHash->offset2ptr(offBlock))
+                            ->m_iAllocSize;
+    --pStat->m_iEntries;
+    pCache->detach(offBlock);
+    return 1;
+}
+
+
+void StaticFileShmCache::onTimer()
+{
+    if (!m_pStore)
+        return;
+    m_pStore->lock();
+    int n = m_pStore->trim(DateTime::s_curTime - SFSC_IDLE_TIMEOUT,
+                           trimBlock, this);
+    m_pStore->unlock();
+    if (n > 0)
+        LS_DBG_L("[StaticFileShmCache] trimmed %d idle entries.", n);
+    if (!m_pMoovStore)
+        return;
+    m_pMoovStore->lock();
+    n = m_pMoovStore->trim(DateTime::s_curTime - SFSC_IDLE_TIMEOUT,
+                           trimMoovIndex, m_pMoovStore);
+    m_pMoovStore->unlock();
+    if (n > 0)
+        LS_DBG_L("[StaticFileShmCache] trimmed %d idle MP4 indexes.", n);
+}
+
+
+void StaticFileShmCache::getStats(long *pEntries, long *pBytes)
+{
+    if (!m_pStore)
+    {
+        *pEntries = *pBytes = 0;
+        return;
+    }
+    m_pStore->lock();
+    SfShmStat *pStat = getStat(m_pStore);
+    *pEntries = pStat->m_iEntries;
+    *pBytes = pStat->m_iBytes;
+    m_pStore->unlock();
+}
+
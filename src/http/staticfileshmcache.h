@@ -0,0 +1,92 @@
+/*****************************************************************************
+*    Open LiteSpeed is an open source HTTP server.                           *
+*    Copyright (C) 2013 - 2020  LiteSpeed Technologies, Inc.                 *
+*                                                                            *
+*    This program is free software: you can redistribute it and/or modify    *
+*    it under the terms of the GNU General Public License as published by    *
+*    the Free Software Foundation, either version 3 of the License, or       *
+*    (at your option) any later version.                                     *
+*                                                                            *
+*    This program is distributed in the hope that it will be useful,         *
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            *
+*    GNU General Public License for more details.                            *
+*                                                                            *
+*    You should have received a copy of the GNU General Public License       *
+*    along with this program. If not, see http://www.gnu.org/licenses/.      *
+*****************************************************************************/
+#ifndef STATICFILESHMCACHE_H
+#define STATICFILESHMCACHE_H
+
+
+#include <lsdef.h>
+#include <shm/lsshmtypes.h>
+#include <util/tsingleton.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+class LsShmHash;
+
+/**
+ * Box wide tier for the bodies of small static files, shared by all
+ * worker processes. Each body lives in a reference counted block of the
+ * global pool: the hash entry holds one reference and every
+ * FileCacheDataEx using it holds another, so a block replaced or trimmed
+ * by one process stays valid for the others until they let it go.
+ */
+class StaticFileShmCache : public TSingleton<StaticFileShmCache>
+{
+    friend class TSingleton<StaticFileShmCache>;
+
+    LsShmHash  *m_pStore;
+    LsShmHash  *m_pMoovStore;
+    size_t      m_iMaxSize;
+
+    StaticFileShmCache();
+    ~StaticFileShmCache();
+    LsShmOffset_t attachLocked(const char *pPath, int pathLen,
+                               ino_t inode, off_t size, time_t mtime);
+    void unrefBlock(LsShmOffset_t offBlock);
+
+    LS_NO_COPY_ASSIGN(StaticFileShmCache);
+public:
+    int  init(size_t maxSize, int uid, int gid);
+    int  isReady() const            {   return m_pStore != NULL;    }
+    LsShmHash *getStore() const     {   return m_pStore;            }
+
+    /** Takes a reference on a matching body, 0 when there is none. */
+    LsShmOffset_t attach(const char *pPath, int pathLen,
+                         ino_t inode, off_t size, time_t mtime);
+
+    /**
+     * Stores a body read by this process, replacing an outdated one, and
+     * takes a reference on it; 0 if it does not fit.
+     */
+    LsShmOffset_t publish(const char *pPath, int pathLen, ino_t inode,
+                          off_t size, time_t mtime, const char *pBody);
+
+    void detach(LsShmOffset_t offBlock)     {   unrefBlock(offBlock);   }
+
+    /** Copies up to len bytes from offset, returns the bytes copied. */
+    int  read(LsShmOffset_t offBlock, off_t offset, char *pBuf, int len);
+
+    /**
+     * The mini moov index of an MP4 file parsed by another process, copied
+     * into a malloc()ed buffer the caller owns; NULL when there is none for
+     * this version of the file.
+     */
+    unsigned char *attachMoovIndex(const char *pPath, int pathLen,
+                                   ino_t inode, off_t size, time_t mtime,
+                                   uint32_t *pIndexLen);
+    void publishMoovIndex(const char *pPath, int pathLen, ino_t inode,
+                          off_t size, time_t mtime,
+                          const unsigned char *pIndex, uint32_t indexLen);
+
+    void onTimer();
+    void getStats(long *pEntries, long *pBytes);
+};
+
+LS_SINGLETON_DECL(StaticFileShmCache);
+
+#endif // STATICFILESHMCACHE_H
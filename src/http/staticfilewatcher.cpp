@@ -0,0 +1,291 @@
+/*****************************************************************************
+*    Open LiteSpeed is an open source HTTP server.                           *
+*    Copyright (C) 2013 - 2020  LiteSpeed Technologies, Inc.                 *
+*                                                                            *
+*    This program is free software: you can redistribute it and/or modify    *
+*    it under the terms of the GNU General Public License as published by    *
+*    the Free Software Foundation, either version 3 of the License, or       *
+*    (at your option) any later version.                                     *
+*                                                                            *
+*    This program is distributed in the hope that it will be useful,         *
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            *
+*    GNU General Public License for more details.                            *
+*                                                                            *
+*    You should have received a copy of the GNU General Public License       *
+*    along with this program. If not, see http://www.gnu.org/licenses/.      *
+*****************************************************************************/
+#include "staticfilewatcher.h"
+
+#include <edio/multiplexer.h>
+#include <http/staticfilecache.h>
+#include <http/staticfilecachedata.h>
+#include <log4cxx/logger.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef LS_INOTIFY_AVAIL
+#include <sys/inotify.h>
+
+#define SFW_DIR_EVENTS  (IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVED_FROM \
+                         | IN_MOVED_TO | IN_CREATE | IN_DELETE \
+                         | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+#define SFW_SELF_EVENTS (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED | IN_UNMOUNT)
+#endif
+
+
+StaticFileWatcher::StaticFileWatcher(StaticFileCache *pCache)
+    : m_pCache(pCache)
+    , m_dirs(29)
+    , m_wds(29, NULL, NULL)
+{
+}
+
+
+StaticFileWatcher::~StaticFileWatcher()
+{
+    m_wds.clear();
+    m_dirs.release_objects();
+    if (getfd() != -1)
+        close(getfd());
+}
+
+
+int StaticFileWatcher::init(Multiplexer *pMplx)
+{
+#ifdef LS_INOTIFY_AVAIL
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd == -1)
+    {
+        LS_ERROR("[StaticFileWatcher] inotify_init1() failed: %s",
+                 strerror(errno));
+        return LS_FAIL;
+    }
+    setfd(fd);
+    pMplx->add(this, POLLIN | POLLHUP | POLLERR);
+    return LS_OK;
+#else
+    return LS_FAIL;
+#endif
+}
+
+
+int StaticFileWatcher::watch(StaticFileCacheData *pData)
+{
+#ifdef LS_INOTIFY_AVAIL
+    if (getfd() == -1 || pData->getWatch())
+        return LS_FAIL;
+    const char *pPath = pData->getKey();
+    const char *pSlash = strrchr(pPath, '/');
+    if (!pSlash)
+        return LS_FAIL;
+
+    char achDir[PATH_MAX];
+    char achReal[PATH_MAX];
+    int len = pSlash - pPath + 1;
+    if (len >= (int)sizeof(achDir))
+        return LS_FAIL;
+    memmove(achDir, pPath, len);
+    achDir[len] = 0;
+
+    WatchedDir *pDir = getDir(achDir, len);
+    if (!pDir)
+        return LS_FAIL;
+
+    //checked once the watches are in place, the file may have changed
+    //before. A symlink, the file itself or an ancestor like a swapped
+    //"current" release link, is not covered by the directory watches.
+    struct stat st;
+    if ((lstat(pPath, &st) == -1) || !S_ISREG(st.st_mode)
+        || pData->isDirty(st) || !realpath(achDir, achReal)
+        || ((len > 1) && ((strncmp(achReal, achDir, len - 1) != 0)
+                          || achReal[len - 1] != 0)))
+    {
+        if (pDir->m_iRefs == 0)
+            dropDir(pDir);
+        return LS_FAIL;
+    }
+    ++pDir->m_iRefs;
+    pData->setWatch(pDir);
+    return LS_OK;
+#else
+    return LS_FAIL;
+#endif
+}
+
+
+//Finds or adds the watch of a directory, its ancestors first.
+WatchedDir *StaticFileWatcher::getDir(char *pPath, int len)
+{
+#ifdef LS_INOTIFY_AVAIL
+    HashStringMap<WatchedDir *>::iterator iter = m_dirs.find(pPath);
+    if (iter != m_dirs.end())
+        return iter.second();
+
+    WatchedDir *pParent = NULL;
+    if (len > 1)
+    {
+        const char *p = (const char *)memrchr(pPath, '/', len - 1);
+        if (!p)
+            return NULL;
+        int parentLen = p - pPath + 1;
+        char ch = pPath[parentLen];
+        pPath[parentLen] = 0;
+        pParent = getDir(pPath, parentLen);
+        pPath[parentLen] = ch;
+        if (!pParent)
+            return NULL;
+    }
+
+    int wd = inotify_add_watch(getfd(), pPath, SFW_DIR_EVENTS);
+    if (wd == -1)
+        LS_DBG_L("[StaticFileWatcher] inotify_add_watch(%s) failed: %s",
+                 pPath, strerror(errno));
+    //same directory reached through another path, events would only
+    //be matched against the first one.
+    if ((wd == -1) || m_wds.find((void *)(long)wd))
+    {
+        if (pParent && pParent->m_iRefs == 0)
+            dropDir(pParent);
+        return NULL;
+    }
+    WatchedDir *pDir = new WatchedDir();
+    pDir->m_path.setStr(pPath, len);
+    pDir->m_pParent = pParent;
+    pDir->m_wd = wd;
+    pDir->m_iRefs = 0;
+    if (pParent)
+        ++pParent->m_iRefs;
+    m_dirs.insert(pDir->m_path.c_str(), pDir);
+    m_wds.insert((void *)(long)wd, pDir);
+    return pDir;
+#else
+    return NULL;
+#endif
+}
+
+
+void StaticFileWatcher::unwatch(StaticFileCacheData *pData)
+{
+    WatchedDir *pDir = pData->getWatch();
+    if (!pDir)
+        return;
+    pData->setWatch(NULL);
+    if (--pDir->m_iRefs <= 0)
+        dropDir(pDir);
+}
+
+
+void StaticFileWatcher::dropDir(WatchedDir *pDir)
+{
+    if (pDir->m_wd != -1)
+    {
+        GHash::iterator iter = m_wds.find((void *)(long)pDir->m_wd);
+        if (iter)
+            m_wds.erase(iter);
+#ifdef LS_INOTIFY_AVAIL
+        inotify_rm_watch(getfd(), pDir->m_wd);
+#endif
+    }
+    m_dirs.remove(pDir->m_path.c_str());
+    WatchedDir *pParent = pDir->m_pParent;
+    delete pDir;
+    if (pParent && --pParent->m_iRefs <= 0)
+        dropDir(pParent);
+}
+
+
+void StaticFileWatcher::invalidateDir(WatchedDir *pDir)
+{
+    StaticFileCacheData *pData;
+    WatchedDir *pWatch;
+    HttpCache::iterator iter, iterNext;
+    //keep pDir alive until the last entry is gone.
+    ++pDir->m_iRefs;
+    for (iter = m_pCache->begin(); iter != m_pCache->end(); iter = iterNext)
+    {
+        iterNext = m_pCache->next(iter);
+        pData = (StaticFileCacheData *)iter.second();
+        for (pWatch = pData->getWatch(); pWatch; pWatch = pWatch->m_pParent)
+        {
+            if (pWatch == pDir)
+            {
+                m_pCache->invalidate(pData);
+                break;
+            }
+        }
+    }
+    if (--pDir->m_iRefs <= 0)
+        dropDir(pDir);
+}
+
+
+void StaticFileWatcher::onEvent(int wd, int mask, const char *pName)
+{
+#ifdef LS_INOTIFY_AVAIL
+    if (mask & IN_Q_OVERFLOW)
+    {
+        LS_NOTICE("[StaticFileWatcher] inotify queue overflow, "
+                  "invalidate all watched files.");
+        m_pCache->invalidateWatched();
+        return;
+    }
+    GHash::iterator iter = m_wds.find((void *)(long)wd);
+    if (!iter)
+        return;
+    WatchedDir *pDir = (WatchedDir *)iter->second();
+    if (mask & SFW_SELF_EVENTS)
+    {
+        if (mask & IN_IGNORED)
+        {
+            //the kernel has dropped the watch already.
+            m_wds.erase(iter);
+            pDir->m_wd = -1;
+        }
+        invalidateDir(pDir);
+        return;
+    }
+    if (!pName || !*pName)
+        return;
+    char achPath[4096];
+    if (snprintf(achPath, sizeof(achPath), "%s%s", pDir->m_path.c_str(),
+                 pName) >= (int)sizeof(achPath))
+        return;
+    HttpCache::iterator cIter = m_pCache->find(achPath);
+    if (cIter)
+    {
+        LS_DBG_H("[StaticFileWatcher] %s changed, mask %x.", achPath, mask);
+        m_pCache->invalidate((StaticFileCacheData *)cIter.second());
+    }
+#endif
+}
+
+
+int StaticFileWatcher::handleEvents(short event)
+{
+#ifdef LS_INOTIFY_AVAIL
+    char achBuf[8192]
+        __attribute__((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *pEvent;
+    const char *p;
+    int len;
+    while ((len = read(getfd(), achBuf, sizeof(achBuf))) > 0)
+    {
+        for (p = achBuf; p < achBuf + len;
+             p += sizeof(struct inotify_event) + pEvent->len)
+        {
+            pEvent = (const struct inotify_event *)p;
+            onEvent(pEvent->wd, pEvent->mask,
+                    pEvent->len ? pEvent->name : NULL);
+        }
+    }
+#endif
+    return 0;
+}
+
@@ -0,0 +1,79 @@
+/*****************************************************************************
+*    Open LiteSpeed is an open source HTTP server.                           *
+*    Copyright (C) 2013 - 2020  LiteSpeed Technologies, Inc.                 *
+*                                                                            *
+*    This program is free software: you can redistribute it and/or modify    *
+*    it under the terms of the GNU General Public License as published by    *
+*    the Free Software Foundation, either version 3 of the License, or       *
+*    (at your option) any later version.                                     *
+*                                                                            *
+*    This program is distributed in the hope that it will be useful,         *
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            *
+*    GNU General Public License for more details.                            *
+*                                                                            *
+*    You should have received a copy of the GNU General Public License       *
+*    along with this program. If not, see http://www.gnu.org/licenses/.      *
+*****************************************************************************/
+#ifndef STATICFILEWATCHER_H
+#define STATICFILEWATCHER_H
+
+
+#include <lsdef.h>
+#include <edio/eventreactor.h>
+#include <util/autostr.h>
+#include <util/ghash.h>
+#include <util/hashstringmap.h>
+
+#if defined(linux) || defined(__linux) || defined(__linux__) || defined(__gnu_linux__)
+#define LS_INOTIFY_AVAIL
+#endif
+
+class Multiplexer;
+class StaticFileCache;
+class StaticFileCacheData;
+
+class WatchedDir
+{
+public:
+    AutoStr2    m_path;     //with the trailing '/'
+    WatchedDir *m_pParent;
+    int         m_wd;
+    int         m_iRefs;    //files and sub directories watching it
+};
+
+
+/**
+ * Keeps an inotify watch on the directory of every cached static file, a
+ * change event invalidates the matching StaticFileCacheData so entries
+ * still in the cache can be trusted without a stat() per request.
+ * Every ancestor is watched as well, moving or replacing one of them
+ * invalidates all files below it, and only paths without symlinks are
+ * watched. Directories are reference counted by the entries and sub
+ * directories watching them.
+ */
+class StaticFileWatcher : public EventReactor
+{
+    StaticFileCache            *m_pCache;
+    HashStringMap<WatchedDir *> m_dirs;
+    GHash                       m_wds;
+
+    void onEvent(int wd, int mask, const char *pName);
+    WatchedDir *getDir(char *pPath, int len);
+    void dropDir(WatchedDir *pDir);
+    void invalidateDir(WatchedDir *pDir);
+
+    LS_NO_COPY_ASSIGN(StaticFileWatcher);
+public:
+    explicit StaticFileWatcher(StaticFileCache *pCache);
+    ~StaticFileWatcher();
+
+    int init(Multiplexer *pMplx);
+    virtual int handleEvents(short event);
+
+    int watch(StaticFileCacheData *pData);
+    void unwatch(StaticFileCacheData *pData);
+    int getDirCount() const     {   return m_dirs.size();   }
+};
+
+#endif // STATICFILEWATCHER_H
@@ -0,0 +1,246 @@
+/*****************************************************************************
+*    Open LiteSpeed is an open source HTTP server.                           *
+*    Copyright (C) 2013 - 2020  LiteSpeed Technologies, Inc.                 *
+*                                                                            *
+*    This program is free software: you can redistribute it and/or modify    *
+*    it under the terms of the GNU General Public License as published by    *
+*    the Free Software Foundation, either version 3 of the License, or       *
+*    (at your option) any later version.                                     *
+*                                                                            *
+*    This program is distributed in the hope that it will be useful,         *
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            *
+*    GNU General Public License for more details.                            *
+*                                                                            *
+*    You should have received a copy of the GNU General Public License       *
+*    along with this program. If not, see http://www.gnu.org/licenses/.      *
+*****************************************************************************/
+#include "staticprecompressor.h"
+
+#include <http/httpmime.h>
+#include <http/staticfilecachedata.h>
+#include <log4cxx/logger.h>
+#include <lsr/ls_offload.h>
+#include <util/datetime.h>
+
+#include <dirent.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+//bounds the queue, files left out are found again by the next walk.
+#define SPC_MAX_PENDING     65536
+
+
+struct ScanJob
+{
+    AutoStr2    m_root;
+    char        m_compressMode;
+    StringList  m_files;
+};
+
+
+struct PrecompressJob
+{
+    AutoStr2   *m_pPath;
+    char        m_compressMode;
+};
+
+
+LS_SINGLETON(StaticPrecompressor);
+
+
+StaticPrecompressor::StaticPrecompressor()
+    : m_pOffloader(NULL)
+    , m_iThreads(0)
+    , m_iRescanInterval(0)
+    , m_compressMode(SFCD_MODE_GZIP)
+    , m_iScanning(0)
+    , m_tmLastScan(0)
+    , m_pending(29)
+    , m_iCompressed(0)
+    , m_iFailed(0)
+{
+}
+
+
+StaticPrecompressor::~StaticPrecompressor()
+{
+    m_pending.release_objects();
+}
+
+
+void StaticPrecompressor::setConfig(int threads, int rescanInterval,
+                                    char compressMode)
+{
+    m_iThreads = threads;
+    m_iRescanInterval = rescanInterval;
+    m_compressMode = compressMode;
+}
+
+
+void StaticPrecompressor::addRoot(const char *pRoot)
+{
+    char achReal[PATH_MAX];
+    //keys of the compress cache are real paths.
+    if (!realpath(pRoot, achReal) || m_roots.find(achReal))
+        return;
+    m_roots.add(achReal);
+}
+
+
+int StaticPrecompressor::start(int walkRoots)
+{
+    if (m_iThreads <= 0)
+        return LS_OK;
+    if (!m_pOffloader)
+    {
+        m_pOffloader = offloader_new2("PRECOMPRESS", m_iThreads, 1,
+                                      m_iThreads, 10);
+        if (!m_pOffloader)
+            return LS_FAIL;
+    }
+    if (!walkRoots)
+        m_roots.clear();
+    scan();
+    return LS_OK;
+}
+
+
+void StaticPrecompressor::scan()
+{
+    StringList::const_iterator iter;
+    m_tmLastScan = DateTime::s_curTime;
+    for (iter = m_roots.begin(); iter != m_roots.end(); ++iter)
+    {
+        ScanJob *pJob = new ScanJob();
+        if (!pJob->m_root.setStr((*iter)->c_str(), (*iter)->len()))
+        {
+            delete pJob;
+            continue;
+        }
+        pJob->m_compressMode = m_compressMode;
+        ++m_iScanning;
+        LS_DBG_L("[PRECOMPRESS] Walking document root %s.",
+                 pJob->m_root.c_str());
+        offloader_submit(m_pOffloader, performScan, onScanDone, pJob);
+    }
+}
+
+
+void StaticPrecompressor::onTimer()
+{
+    if (!m_pOffloader || m_iScanning || m_roots.size() == 0
+        || m_iRescanInterval <= 0)
+        return;
+    if (DateTime::s_curTime - m_tmLastScan >= m_iRescanInterval)
+        scan();
+}
+
+
+void StaticPrecompressor::addFile(const char *pPath, int len)
+{
+    if (!m_pOffloader || (m_pending.size() >= SPC_MAX_PENDING))
+        return;
+    if (m_pending.find(pPath) != m_pending.end())
+        return;
+    PrecompressJob *pJob = new PrecompressJob();
+    pJob->m_pPath = new AutoStr2(pPath, len);
+    pJob->m_compressMode = m_compressMode;
+    m_pending.insert(pJob->m_pPath->c_str(), pJob->m_pPath);
+    offloader_submit(m_pOffloader, performFile, onFileDone, pJob);
+}
+
+
+//Runs in a pool thread, collects the files with a missing or outdated
+//variant. Hidden entries and symbolic links are skipped.
+int StaticPrecompressor::performScan(void *param)
+{
+    ScanJob *pJob = (ScanJob *)param;
+    const HttpMime *pMime = HttpMime::getMime();
+    StringList dirs;
+    char achPath[PATH_MAX];
+    struct stat st;
+    struct dirent *pEnt;
+    dirs.add(pJob->m_root.c_str(), pJob->m_root.len());
+    while ((dirs.size() > 0)
+           && (pJob->m_files.size() < SPC_MAX_PENDING))
+    {
+        AutoStr2 *pDir = dirs.pop_back();
+        DIR *d = opendir(pDir->c_str());
+        if (d)
+        {
+            while ((pEnt = readdir(d)) != NULL)
+            {
+                if (pEnt->d_name[0] == '.')
+                    continue;
+                int len = snprintf(achPath, sizeof(achPath), "%s/%s",
+                                   pDir->c_str(), pEnt->d_name);
+                if ((len >= (int)sizeof(achPath))
+                    || (lstat(achPath, &st) == -1))
+                    continue;
+                if (S_ISDIR(st.st_mode))
+                    dirs.add(achPath, len);
+                else if (S_ISREG(st.st_mode))
+                {
+                    const MimeSetting *pSetting = pMime->getFileMime(achPath,
+                                                                     len);
+                    if (!pSetting || !pSetting->getExpires()->compressible())
+                        continue;
+                    if (!StaticFileCacheData::isPrecompressed(achPath, len, st,
+                            pJob->m_compressMode))
+                        pJob->m_files.add(achPath, len);
+                }
+            }
+            closedir(d);
+        }
+        delete pDir;
+    }
+    return pJob->m_files.size();
+}
+
+
+void StaticPrecompressor::onScanDone(void *param, int result)
+{
+    ScanJob *pJob = (ScanJob *)param;
+    StaticPrecompressor &self = StaticPrecompressor::getInstance();
+    LS_NOTICE("[PRECOMPRESS] Document root %s walked, %d files to compress.",
+              pJob->m_root.c_str(), result);
+    StringList::const_iterator iter;
+    for (iter = pJob->m_files.begin(); iter != pJob->m_files.end(); ++iter)
+        self.addFile((*iter)->c_str(), (*iter)->len());
+    --self.m_iScanning;
+    self.m_tmLastScan = DateTime::s_curTime;
+    delete pJob;
+}
+
+
+int StaticPrecompressor::performFile(void *param)
+{
+    PrecompressJob *pJob = (PrecompressJob *)param;
+    struct stat st;
+    if ((stat(pJob->m_pPath->c_str(), &st) == -1) || !S_ISREG(st.st_mode))
+        return 0;
+    return StaticFileCacheData::precompress(pJob->m_pPath->c_str(),
+                                            pJob->m_pPath->len(), st,
+                                            pJob->m_compressMode);
+}
+
+
+void StaticPrecompressor::onFileDone(void *param, int result)
+{
+    PrecompressJob *pJob = (PrecompressJob *)param;
+    StaticPrecompressor &self = StaticPrecompressor::getInstance();
+    if (result == LS_FAIL)
+    {
+        ++self.m_iFailed;
+        LS_WARN("[PRECOMPRESS] Failed to compress file %s.",
+                pJob->m_pPath->c_str());
+    }
+    else
+        self.m_iCompressed += result;
+    self.m_pending.remove(pJob->m_pPath->c_str());
+    delete pJob->m_pPath;
+    delete pJob;
+}
@@ -0,0 +1,87 @@
+/*****************************************************************************
+*    Open LiteSpeed is an open source HTTP server.                           *
+*    Copyright (C) 2013 - 2020  LiteSpeed Technologies, Inc.                 *
+*                                                                            *
+*    This program is free software: you can redistribute it and/or modify    *
+*    it under the terms of the GNU General Public License as published by    *
+*    the Free Software Foundation, either version 3 of the License, or       *
+*    (at your option) any later version.                                     *
+*                                                                            *
+*    This program is distributed in the hope that it will be useful,         *
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            *
+*    GNU General Public License for more details.                            *
+*                                                                            *
+*    You should have received a copy of the GNU General Public License       *
+*    along with this program. If not, see http://www.gnu.org/licenses/.      *
+*****************************************************************************/
+#ifndef STATICPRECOMPRESSOR_H
+#define STATICPRECOMPRESSOR_H
+
+
+#include <lsdef.h>
+#include <util/autostr.h>
+#include <util/hashstringmap.h>
+#include <util/stringlist.h>
+#include <util/tsingleton.h>
+
+#include <time.h>
+
+struct Offloader;
+
+/**
+ * Produces the gzip, brotli and zstd variants of static files in the
+ * compress cache at the maximum level, on a low priority thread pool of its
+ * own. Document roots are walked at start and again every rescan interval,
+ * files a request found without a ready variant are queued as well. When
+ * the pipeline is running the request path never compresses, it only
+ * picks up variants that are ready.
+ */
+class StaticPrecompressor : public TSingleton<StaticPrecompressor>
+{
+    friend class TSingleton<StaticPrecompressor>;
+
+    struct Offloader           *m_pOffloader;
+    int                         m_iThreads;
+    int                         m_iRescanInterval;
+    char                        m_compressMode;
+    int                         m_iScanning;
+    time_t                      m_tmLastScan;
+    StringList                  m_roots;
+    HashStringMap<AutoStr2 *>   m_pending;
+    long                        m_iCompressed;
+    long                        m_iFailed;
+
+    StaticPrecompressor();
+    ~StaticPrecompressor();
+
+    void scan();
+
+    static int  performScan(void *param);
+    static void onScanDone(void *param, int result);
+    static int  performFile(void *param);
+    static void onFileDone(void *param, int result);
+
+    LS_NO_COPY_ASSIGN(StaticPrecompressor);
+public:
+    void setConfig(int threads, int rescanInterval, char compressMode);
+    int  getThreads() const         {   return m_iThreads;              }
+    int  isEnabled() const          {   return m_pOffloader != NULL;    }
+
+    void addRoot(const char *pRoot);
+
+    /**
+     * Starts the thread pool of this process, the document roots are
+     * walked only by the process asked to, one per box is enough.
+     */
+    int  start(int walkRoots);
+
+    /** Queues a file unless it is queued already, event loop only. */
+    void addFile(const char *pPath, int len);
+
+    void onTimer();
+};
+
+LS_SINGLETON_DECL(StaticPrecompressor);
+
+#endif // STATICPRECOMPRESSOR_H
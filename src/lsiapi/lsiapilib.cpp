@@ -40,6 +40,7 @@
 #include <http/ntwkiolink.h>
 
 #include <log4cxx/logger.h>
+#include <lsr/ls_offload.h>
 #include <lsiapi/envmanager.h>
 #include <lsiapi/internal.h>
 #include <lsiapi/lsiapi.h>
@@ -1540,6 +1541,8 @@ static int get_resp_buffer_compress_method(const lsi_session_t *session)
 
     if (pSession->getFlag(HSF_RESP_BODY_BRCOMPRESSED))
         return LSI_BR_COMPRESS;
+    else if (pSession->getFlag2(HSF2_RESP_BODY_ZSTDCOMPRESSED))
+        return LSI_ZSTD_COMPRESS;
     else if (pSession->getFlag(HSF_RESP_BODY_GZIPCOMPRESSED))
         return LSI_GZIP_COMPRESS;
     return LSI_NO_COMPRESS;//0
@@ -1554,8 +1557,11 @@ static int set_resp_buffer_compress_method(const lsi_session_t *session, int met
 
     pSession->clearFlag(HSF_RESP_BODY_BRCOMPRESSED);
     pSession->clearFlag(HSF_RESP_BODY_GZIPCOMPRESSED);
+    pSession->clearFlag2(HSF2_RESP_BODY_ZSTDCOMPRESSED);
     if (method == LSI_BR_COMPRESS)
         pSession->setFlag(HSF_RESP_BODY_BRCOMPRESSED);
+    else if (method == LSI_ZSTD_COMPRESS)
+        pSession->setFlag2(HSF2_RESP_BODY_ZSTDCOMPRESSED);
     else if (method == LSI_GZIP_COMPRESS)
         pSession->setFlag(HSF_RESP_BODY_GZIPCOMPRESSED);
 
@@ -2031,6 +2037,8 @@ static int   get_body_buf_fd(void *pBuf)
 {
     if (!pBuf)
         return LS_FAIL;
+    if (((VMemBuf *)pBuf)->flushSwapFile() == LS_FAIL)
+        return LS_FAIL;
     return ((VMemBuf *)pBuf)->getfd();
 
 }
@@ -2847,6 +2855,31 @@ void register_thread_cleanup_ts(const lsi_module_t *pModule, void (*routine)(voi
     pWC->pushCleanup(routine, arg);
 }
 
+static void *offload_task(lsi_offload_pf perform,
+                          lsi_offload_done_pf on_done, void *param)
+{
+    if (!perform)
+        return NULL;
+    return offloader_submit(offloader_get_shared(), perform, on_done, param);
+}
+
+
+static void *offload_task_ts(lsi_offload_pf perform,
+                             lsi_offload_done_pf on_done, void *param)
+{
+    //already off the event loop, run it in the calling thread.
+    if (!perform)
+        return NULL;
+    return offloader_submit(NULL, perform, on_done, param);
+}
+
+
+static int cancel_offload_task(void *handle)
+{
+    return offloader_cancel((ls_offload_t *)handle);
+}
+
+
 static time_t get_cur_time_ts(int32_t *usec)
 {
     LS_TH_IGN_RD_BEG();
@@ -3777,6 +3810,8 @@ void lsiapi_init_server_api()
     pApi->_log_level_ptr = log4cxx::Level::getDefaultLevelPtr();
     pApi->schedule_remove_session_cbs_event = schedule_remove_session_cbs_event;
     pApi->register_thread_cleanup = register_thread_cleanup_ts;
+    pApi->offload_task = offload_task;
+    pApi->cancel_offload_task = cancel_offload_task;
 
     g_lsiapi_ts = g_lsiapi;
 
@@ -3806,6 +3841,7 @@ void lsiapi_init_server_api()
     pApi->module_log = module_log_ts;
     pApi->c_log      = c_log_ts;
     pApi->register_thread_cleanup = register_thread_cleanup_ts;
+    pApi->offload_task = offload_task_ts;
 
     g_api = &g_lsiapi;
 }
@@ -50,6 +50,35 @@ ls_inline struct Offloader *offloader_new(const char *log_id, int workers)
 
 int offloader_enqueue(struct Offloader *, struct ls_offload *task);
 
+/**
+ * General purpose jobs. perform() runs in a worker thread, on_done() is
+ * called from the event loop with the value returned by perform(). When
+ * the offloader is NULL or the job cannot be queued, both run inline and
+ * NULL is returned; otherwise the returned handle stays valid until
+ * on_done() is called or the job is canceled.
+ */
+typedef int  (*offload_perform_fn)(void *param);
+typedef void (*offload_result_cb)(void *param, int result);
+
+ls_offload_t *offloader_submit(struct Offloader *, offload_perform_fn perform,
+                               offload_result_cb on_done, void *param);
+
+/**
+ * Marks a queued task canceled, on_task_done() will not be called for it.
+ * perform() may still be running, the data it uses must outlive the task.
+ */
+int offloader_cancel(ls_offload_t *task);
+
+/**
+ * Process wide offloader shared by the server core and modules for jobs
+ * too heavy for the event loop: static file precompression, dictionary
+ * stores, swap file writes, gzip of large dynamic response bodies and
+ * module jobs. Smaller dynamic responses and SSI are still compressed
+ * inline.
+ */
+int offloader_start_shared(int workers);
+struct Offloader *offloader_get_shared(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -22,6 +22,7 @@
 
 #include <adns/adns.h>
 
+#include <edio/iouring.h>
 #include <edio/multiplexer.h>
 #include <edio/multiplexerfactory.h>
 #include <edio/sigeventdispatcher.h>
@@ -68,6 +69,8 @@
 #include <http/recaptcha.h>
 #include <http/serverprocessconfig.h>
 #include <http/staticfilecache.h>
+#include <http/staticfileshmcache.h>
+#include <http/staticprecompressor.h>
 #include <http/staticfilecachedata.h>
 #include <http/stderrlogger.h>
 #include <http/vhostmap.h>
@@ -75,6 +78,7 @@
 
 #include <log4cxx/appender.h>
 #include <log4cxx/logger.h>
+#include <lsr/ls_offload.h>
 #include <lsr/ls_strtool.h>
 #include <lsr/ls_time.h>
 
@@ -534,6 +538,34 @@ int HttpServerImpl::start()
     // if child 1
     if (1 == HttpServerConfig::getInstance().getProcNo())
         ZConfManager::getInstance().sendStartUp();
+    if (StaticFileCache::getInstance().startWatcher(
+            MultiplexerFactory::getMultiplexer()) != LS_OK)
+        LS_ERROR("[Child: %d] Failed to start static file watcher, "
+                 "fall back to stat() per request.", m_pid);
+    if (StaticPrecompressor::getInstance().getThreads() > 0)
+    {
+        //the first worker walks the document roots for the whole box.
+        if (1 == HttpServerConfig::getInstance().getProcNo())
+        {
+            for (int i = 0; i < m_vhosts.size(); ++i)
+            {
+                const AutoStr2 *pRoot = m_vhosts.get(i)->getDocRoot();
+                if (pRoot && pRoot->c_str())
+                    StaticPrecompressor::getInstance().addRoot(pRoot->c_str());
+            }
+        }
+        if (StaticPrecompressor::getInstance().start(
+                1 == HttpServerConfig::getInstance().getProcNo()) != LS_OK)
+            LS_ERROR("[Child: %d] Failed to start static precompression "
+                     "threads, compress on request instead.", m_pid);
+    }
+    if (HttpServerConfig::getInstance().getOffloadThreads() > 0)
+    {
+        if (offloader_start_shared(
+                HttpServerConfig::getInstance().getOffloadThreads()) != LS_OK)
+            LS_ERROR("[Child: %d] Failed to start offload threads, "
+                     "offloadable jobs will run inline.", m_pid);
+    }
     m_dispatcher.run();
     LS_NOTICE("[Child: %d] Start shutting down gracefully ...", m_pid);
     gracefulShutdown();
@@ -613,7 +645,14 @@ int generateConnReport(int fd)
                         "REQ_RATE []: REQ_PROCESSING: %d, REQ_PER_SEC: %d, TOT_REQS: %d, "
                         "PUB_CACHE_HITS_PER_SEC: %d, TOTAL_PUB_CACHE_HITS: %d, "
                         "PRIVATE_CACHE_HITS_PER_SEC: %d, TOTAL_PRIVATE_CACHE_HITS: %d, "
-                        "STATIC_HITS_PER_SEC: %d, TOTAL_STATIC_HITS: %d\n",
+                        "STATIC_HITS_PER_SEC: %d, TOTAL_STATIC_HITS: %d\n"
+                        "TOTAL_KTLS_CONN: %ld, TOTAL_KTLS_FALLBACK: %ld\n"
+                        "TOTAL_ZEROCOPY_SEND: %ld, TOTAL_ZEROCOPY_COPIED: %ld\n"
+                        "ACCEPT_BUDGET: %d, ACCEPT_CAPPED: %ld, "
+                        "ACCEPT_BUDGET_GROW: %ld, ACCEPT_BUDGET_SHRINK: %ld\n"
+                        "IDLE_FILE_FDS: %d, MAX_IDLE_FILE_FDS: %d, "
+                        "TOTAL_FD_CACHE_HITS: %ld, TOTAL_FD_CACHE_MISSES: %ld, "
+                        "TOTAL_FD_CACHE_EVICTED: %ld\n",
 
                         HttpStats::getBytesRead() / 1024,
                         HttpStats::getBytesWritten() / 1024,
@@ -633,7 +672,20 @@ int generateConnReport(int fd)
                         HttpStats::getReqStats()->getPrivHitsPS(),
                         HttpStats::getReqStats()->getTotalPrivHits(),
                         HttpStats::getReqStats()->getHitsPS(),
-                        HttpStats::getReqStats()->getTotalHits());
+                        HttpStats::getReqStats()->getTotalHits(),
+                        HttpStats::getKtlsConns(),
+                        HttpStats::getKtlsFallbacks(),
+                        HttpStats::getZeroCopySends(),
+                        HttpStats::getZeroCopyCopied(),
+                        HttpStats::getAcceptBudget(),
+                        HttpStats::getAcceptCapped(),
+                        HttpStats::getAcceptGrow(),
+                        HttpStats::getAcceptShrink(),
+                        FileCacheDataEx::getIdleFds(),
+                        FileCacheDataEx::getMaxIdleFds(),
+                        FileCacheDataEx::getFdCacheHits(),
+                        FileCacheDataEx::getFdCacheMisses(),
+                        FileCacheDataEx::getFdCacheEvicted());
 
     write(fd, achBuf, n);
 
@@ -641,6 +693,7 @@ int generateConnReport(int fd)
     HttpStats::setBytesWritten(0);
     HttpStats::setSSLBytesRead(0);
     HttpStats::setSSLBytesWritten(0);
+    HttpStats::resetAcceptStats();
     HttpStats::getReqStats()->reset();
     return 0;
 }
@@ -973,6 +1026,8 @@ void HttpServerImpl::onTimer30Secs()
 {
     ClientCache::getClientCache()->onTimer30Secs();
     StaticFileCache::getInstance().onTimer();
+    StaticFileShmCache::getInstance().onTimer();
+    StaticPrecompressor::getInstance().onTimer();
     m_vhosts.onTimer30Secs();
     static int s_timeOut = 2;
     s_timeOut --;
@@ -1733,9 +1788,12 @@ HttpListener *HttpServerImpl::configListener(const XmlNode *pNode,
 
         int secure = ConfigCtx::getCurConfigCtx()->getLongValue(pNode, "secure", 0,
                      1, 0);
+        int ktls = 0;
         if (secure)
         {
             ConfigCtx currentCtx("ssl");
+            ktls = ConfigCtx::getCurConfigCtx()->getLongValue(pNode,
+                                        "enableKtls", 0, 1, 0);
             pSSLCtx = ConfigCtx::getCurConfigCtx()->newSSLContext(pNode, pAddr, NULL);
             if (!pSSLCtx)
             {
@@ -1793,6 +1851,7 @@ HttpListener *HttpServerImpl::configListener(const XmlNode *pNode,
 
         if (pSSLCtx)
         {
+            pListener->setKtls(ktls);
             pListener->getVHostMap()->setSslContext(pSSLCtx);
             if (pSSLCtx->initSNI(pListener->getVHostMap()) == -1)
             {
@@ -2327,6 +2386,8 @@ int HttpServerImpl::configTuning(const XmlNode *pRoot)
         currentCtx.getLongValue(pNode, "sndBufSize", 0, 512 * 1024, 0));
     HttpListener::setSockRecvBufSize(
         currentCtx.getLongValue(pNode, "rcvBufSize", 0, 512 * 1024, 0));
+    HttpListener::setMaxAcceptBudget(
+        currentCtx.getLongValue(pNode, "maxAcceptBudget", 0, 65536, 0));
     HttpServerConfig &config = HttpServerConfig::getInstance();
     config.setKeepAliveTimeout(
         currentCtx.getLongValue(pNode, "keepAliveTimeout", 1, 10000, 15));
@@ -2361,6 +2422,19 @@ int HttpServerImpl::configTuning(const XmlNode *pRoot)
     FileCacheDataEx::setMaxMMapCacheSize(currentCtx.getLongValue(pNode,
                                          "maxMMapFileSize",
                                          0, LONG_MAX, 256 * 1024));
+    FileCacheDataEx::setMaxIdleFds(currentCtx.getLongValue(pNode,
+                                   "maxIdleFileFds", 0, 65535, 0));
+    StaticFileCache::getInstance().setWatchFiles(
+        currentCtx.getLongValue(pNode, "staticFileWatch", 0, 1, 0));
+    long shmCacheSize = currentCtx.getLongValue(pNode,
+                        "staticFileShmCacheSize", 0, INT_MAX, 0);
+    if (shmCacheSize > 0)
+    {
+        ServerProcessConfig &procConfig = ServerProcessConfig::getInstance();
+        if (StaticFileShmCache::getInstance().init(shmCacheSize,
+                procConfig.getUid(), procConfig.getGid()) != LS_OK)
+            LS_WARN("Failed to init shared static file cache.");
+    }
     int etag = currentCtx.getLongValue(pNode, "fileETag", 0, 4 + 8 + 16,
                                        4 + 8 + 16);
     HttpServer::getInstance().getServerContext().setFileEtag(etag);
@@ -2372,6 +2446,9 @@ int HttpServerImpl::configTuning(const XmlNode *pRoot)
 #endif
     config.setUseSendfile(val);
 
+    NtwkIOLink::setZeroCopyThreshold(currentCtx.getLongValue(pNode,
+                                     "zeroCopyThreshold", 0, 64 * 1024 * 1024, 0));
+
 //     if (val)
 //         FileCacheDataEx::setMaxMMapCacheSize(0);
 
@@ -2395,6 +2472,13 @@ int HttpServerImpl::configTuning(const XmlNode *pRoot)
         currentCtx.getLongValue(pNode, "enableBrCompress", 0, 6, 4)
 #else
         0
+#endif
+    );
+    config.setZstdCompress(
+#ifdef USE_ZSTD
+        currentCtx.getLongValue(pNode, "enableZstdCompress", 0, 19, 0)
+#else
+        0
 #endif
     );
     pValue = pNode->getChildValue("compressibleTypes");
@@ -2412,6 +2496,22 @@ int HttpServerImpl::configTuning(const XmlNode *pRoot)
     StaticFileCacheData::setStaticBrOptions(
         currentCtx.getLongValue(pNode, "brStaticCompressLevel", 1, 11, 6)
     );
+    StaticFileCacheData::setStaticZstdOptions(
+        currentCtx.getLongValue(pNode, "zstdStaticCompressLevel", 1, 19, 9)
+    );
+    char precompressMode = 0;
+    if (config.getGzipCompress())
+        precompressMode |= SFCD_MODE_GZIP;
+    if (config.getBrCompress())
+        precompressMode |= SFCD_MODE_BROTLI;
+    if (config.getZstdCompress())
+        precompressMode |= SFCD_MODE_ZSTD;
+    StaticPrecompressor::getInstance().setConfig(
+        precompressMode ? currentCtx.getLongValue(pNode,
+                          "staticPrecompressThreads", 0, 16, 0) : 0,
+        currentCtx.getLongValue(pNode, "staticPrecompressInterval",
+                                0, 86400, 300),
+        precompressMode);
 
 
     pValue = pNode->getChildValue("gzipCacheDir");
@@ -2803,6 +2903,13 @@ int HttpServerImpl::configServerBasic2(const XmlNode *pRoot,
                             "inMemBufSize", 0,
                             LONG_MAX, 20 * 1024 * 1024);
         VMemBuf::setMaxAnonMapSize(inMemBufSize);
+        VMemBuf::setAnonHugePages(ConfigCtx::getCurConfigCtx()->getLongValue(
+                                      pRoot, "anonHugePages",
+                                      VMBUF_HUGEPAGE_OFF,
+                                      VMBUF_HUGEPAGE_EXPLICIT,
+                                      VMBUF_HUGEPAGE_OFF));
+        VMemBuf::setAsyncSwap(ConfigCtx::getCurConfigCtx()->getLongValue(
+                                  pRoot, "asyncSwap", 0, 1, 1));
         //const char *pValue = m_pRoot->getChildValue( "swappingDir" );
 
         if (pSwapDir)
@@ -2878,7 +2985,16 @@ int HttpServerImpl::configMultiplexer(const XmlNode *pNode)
     //const XmlNode *pNode = m_pRoot->getChild( "tuning" );
 
     if (pNode)
+    {
         pType = pNode->getChildValue("eventDispatcher");
+#ifdef LS_HAS_IO_URING
+        ConfigCtx currentCtx("server", "tuning");
+        IoUring::setRecvBufs(
+            currentCtx.getLongValue(pNode, "ioUringRecvBufs", 0, 32768, 256),
+            currentCtx.getLongValue(pNode, "ioUringRecvBufSize", 1024,
+                                    1024 * 1024, 16384));
+#endif
+    }
 
     if (m_dispatcher.init(pType) == -1)
     {
@@ -3319,6 +3435,12 @@ int HttpServerImpl::configServerBasics(int reconfig, const XmlNode *pRoot)
         HttpServerConfig::getInstance().setCpuAffinity(
             ConfigCtx::getCurConfigCtx()->getLongValue(pRoot, "cpuAffinity", 0,
                                                        64, 0));
+        HttpServerConfig::getInstance().setReusePortSteering(
+            ConfigCtx::getCurConfigCtx()->getLongValue(pRoot,
+                    "reusePortCpuSteering", 0, 1, 0));
+        HttpServerConfig::getInstance().setOffloadThreads(
+            ConfigCtx::getCurConfigCtx()->getLongValue(pRoot,
+                    "offloadThreads", 0, 64, 2));
 
         //this value can only be set once when server start.
         if (MainServerConfigObj.getCrashGuard() == 2)
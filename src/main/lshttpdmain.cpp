@@ -1037,6 +1037,7 @@ int LshttpdMain::init(int argc, char *argv[])
         m_pServer->initAdns();
         m_pServer->enableAioLogging();
         m_pServer->startServing();
+        VMemBuf::initAnonArena();
         EvtcbQue::getInstance().initNotifier();
         cleanEnvVars();
 
@@ -1256,6 +1257,7 @@ void LshttpdMain::onNewChildStart(ChildProc * pProc)
     LsShmPool::setPid(pProc->m_pid);
     StdErrLogger::getInstance().movePipeFdToStdErr();
     m_pServer->startServing();
+    VMemBuf::initAnonArena();
     //setIntercommFds(pProc->m_iProcNo);
     m_pServer->enableAioLogging();
     EvtcbQue::getInstance().initNotifier();
@@ -67,6 +67,8 @@ plainconfKeywords plainconf::sKeywords[] =
     {"allowedrobothits",                         NULL},
     {"allowsetuid",                              NULL},
     {"allowsymbollink",                          NULL},
+    {"anonhugepages",                            NULL},
+    {"asyncswap",                                NULL},
     {"authname",                                 NULL},
     {"authorizer",                               NULL},
     {"autofix503",                               NULL},
@@ -100,6 +102,7 @@ plainconfKeywords plainconf::sKeywords[] =
     {"ciphers",                                  NULL},
     {"clientverify",                             NULL},
     {"compressarchive",                          NULL},
+    {"compressdictmatch",                        NULL},
     {"compressibletypes",                        NULL},
     {"configfile",                               NULL},
     {"conntimeout",                              NULL},
@@ -135,11 +138,14 @@ plainconfKeywords plainconf::sKeywords[] =
     {"enablegzipcompress",                       NULL},
     {"enablehotlinkctrl",                        NULL},
     {"enableh2c",                                NULL},
+    {"enablektls",                               NULL},
     {"enableipgeo",                              NULL},
     {"enablescript",                             NULL},
     {"enablespdy",                               NULL},
     {"enablestapling",                           NULL},
     {"enablestderrlog",                          NULL},
+    {"enablezstd",                               NULL},
+    {"enablezstdcompress",                       NULL},
     {"env",                                      NULL},
     {"errcode",                                  NULL},
     {"errorlog",                                 NULL},
@@ -188,6 +194,8 @@ plainconfKeywords plainconf::sKeywords[] =
     {"internal",                                 NULL},
     {"inmembufsize",                             NULL},
     {"instances",                                NULL},
+    {"iouringrecvbufs",                          NULL},
+    {"iouringrecvbufsize",                       NULL},
     {"iptogeo",                                  NULL},
     {"ip2locdb",                                 NULL},
     {"ip2locdbcache",                            NULL},
@@ -218,6 +226,7 @@ plainconfKeywords plainconf::sKeywords[] =
     {"maxconns",                                 NULL},
     {"maxdynrespheadersize",                     NULL},
     {"maxdynrespsize",                           NULL},
+    {"maxidlefilefds",                           NULL},
     {"maxkeepalivereq",                          NULL},
     {"maxminddbenable",                          NULL},
     {"maxminddbenv",                             NULL},
@@ -301,6 +310,10 @@ plainconfKeywords plainconf::sKeywords[] =
     {"sslcryptodevice",                          NULL},
     {"sslprotocol",                              NULL},
     {"statdir",                                  NULL},
+    {"staticfileshmcachesize",                   NULL},
+    {"staticfilewatch",                          NULL},
+    {"staticprecompressinterval",                NULL},
+    {"staticprecompressthreads",                 NULL},
     {"staticreqpersec",                          NULL},
     {"statuscode",                               NULL},
     {"suffix",                                   NULL},
@@ -322,6 +335,8 @@ plainconfKeywords plainconf::sKeywords[] =
     {"user",                                     NULL},
     {"userdb",                                   NULL},
     {"usesendfile",                              NULL},
+    {"zerocopythreshold",                        NULL},
+    {"maxacceptbudget",                          NULL},
     {"useserver",                                NULL},
     {"verifydepth",                              NULL},
     {"vhaliases",                                NULL},
@@ -349,6 +364,7 @@ plainconfKeywords plainconf::sKeywords[] =
     {"zconfname",                                NULL},
     {"zconfportlist",                            NULL},
     {"zconfsend",                                NULL},
+    {"zstdstaticcompresslevel",                  NULL},
 
 
     {"disableinitlogrotation",                   NULL},
@@ -419,6 +435,8 @@ plainconfKeywords plainconf::sKeywords[] =
     {"appserverenv", NULL},
     {"enablelve",  NULL},
     {"cpuaffinity", NULL},
+    {"reuseportcpusteering", NULL},
+    {"offloadthreads", NULL},
 
     {"enablequic", NULL},
     {"quicenable", NULL},
@@ -26,6 +26,8 @@
 #include <lsr/ls_confparser.h>
 #include <util/autostr.h>
 #include <util/datetime.h>
+#include <util/dlinkqueue.h>
+#include <util/hashstringmap.h>
 #include <util/stringtool.h>
 #include <util/ni_fio.h>
 
@@ -69,6 +71,13 @@
 #define MAX_HEADER_LEN      16384
 #define Z_BUF_SIZE          16384
 
+//How long a miss waits for another request fetching the same entry
+#define CACHE_FETCH_WAIT_MS     10000
+//Seconds a stale copy is served after its refresh got a server error
+#define CACHE_STALE_RETRY       10
+//Seconds misses of a URL that was not cacheable go to the backend at once
+#define CACHE_PASS_SECS         5
+
 /////////////////////////////////////////////////////////////////////////////
 extern lsi_module_t MNAME;
 
@@ -76,6 +85,9 @@ static const char s_x_cached[] = "X-LiteSpeed-Cache";
 static const char *s_hits[3] = { "hit", "hit,private", "hit,litemage" };
 static int s_hitsLen[3] = { 3, 11, 12 };
 
+//entry copied from or to the hot tier, used within a call to handlerProcess
+static char s_achHotBuf[CACHE_HOT_MAX_ENTRY];
+
 static const char *cache_env_key = "cache-control";
 static int icache_env_key = 13;
 
@@ -151,6 +163,49 @@ enum HTTP_METHOD
     HTTP_METHOD_END,
 };
 
+/**
+ * A request missing a public entry that another request of this process
+ * is already fetching from the backend. It is suspended in URI_MAP until
+ * that fetch ends, then looks the entry up again.
+ */
+struct CacheWaiter : public DLinkedObj
+{
+    const lsi_session_t *m_pSession;
+    DLinkQueue          *m_pQueue;
+    int                  m_iTimerId;
+};
+
+
+struct CacheFetch
+{
+    CacheHash   m_hash;
+    DLinkQueue  m_waitQ;
+    int32_t     m_tmPass;   //not a fetch, misses pass through until then
+};
+
+
+//public entries being fetched by requests of this process, by hash
+static HashStringMap<CacheFetch *> s_fetching(29, CacheHash::to_ghash_key,
+                                              CacheHash::compare);
+
+
+static void prunePassMarks()
+{
+    GHash::iterator iter = s_fetching.begin();
+    while (iter != s_fetching.end())
+    {
+        CacheFetch *pFetch = (CacheFetch *)iter->second();
+        GHash::iterator next = s_fetching.next(iter);
+        if (pFetch->m_tmPass && pFetch->m_tmPass <= DateTime_s_curTime)
+        {
+            s_fetching.erase(iter);
+            delete pFetch;
+        }
+        iter = next;
+    }
+}
+
+
 struct MyMData
 {
     CacheConfig    *pConfig;
@@ -172,16 +227,20 @@ struct MyMData
     unsigned char   iHaveAddedHook;
     unsigned char   iCacheSendBody;
     CacheCtrl       cacheCtrl;
+    CacheCtrl       staleCtrl;  //RFC 5861 windows from the response only
     CacheHash       cePublicHash;
     CacheHash       cePrivateHash;
     CacheKey        cacheKey;
     uint8_t         hkptIndex;
     uint8_t         hasCacheFrontend;
-    uint8_t         reqCompressType; //0, no, 1: gzip, 2:br
+    uint8_t         reqCompressType; //0, no, 1: gzip, 2:br, 3:zstd
     uint8_t         saveFailed;
     XXH64_state_t   contentState;
     z_stream       *zstream;
     off_t           orgFileLength;
+    CacheFetch     *pFetch;     //the backend fetch this request is doing
+    CacheWaiter    *pWaiter;
+    uint8_t         iWaited;
 
 
 };
@@ -251,6 +310,7 @@ static void house_keeping_cb(const void *p)
     {
         pStore->houseKeeping();
         pStore->cleanByTracking(100, 100);
+        prunePassMarks();
         g_api->log(NULL, LSI_LOG_DEBUG, "[%s]house_keeping_cb with store %p.\n",
                    ModuleNameStr, pStore);
     }
@@ -1368,7 +1428,8 @@ short lookUpCache(lsi_param_t *rec, MyMData *myData, int no_vary,
         myData->cacheKey.m_ipLen = savedIpLen;
         if (*pEntry)
         {
-            if ((*pEntry)->isStale() && !(*pEntry)->isUpdating())
+            if ((*pEntry)->isStale() && !(*pEntry)->isUpdating()
+                && (*pEntry)->getNextRefresh() <= DateTime_s_curTime)
             {
                 CacheEntry *pNewEntry = myData->pConfig->getStore()->
                                         createCacheEntry(myData->cePublicHash,
@@ -1401,11 +1462,130 @@ short lookUpCache(lsi_param_t *rec, MyMData *myData, int no_vary,
 }
 
 
+static int checkAssignHandler(lsi_param_t *rec);
+
+
+static int resumeWaiter(evtcbhead_t *session, const long lParam,
+                        void *pParam)
+{
+    MyMData *myData = (MyMData *)g_api->get_module_data(session, &MNAME,
+                      LSI_DATA_HTTP);
+    if (!myData || !myData->pWaiter)
+        return 0;
+    delete myData->pWaiter;
+    myData->pWaiter = NULL;
+    myData->iWaited = 1;
+
+    //the hook returned LSI_SUSPEND, look the entry up again before the
+    //session continues with the next URI_MAP hook.
+    lsi_param_t param;
+    memset(&param, 0, sizeof(param));
+    param.session = session;
+    checkAssignHandler(&param);
+    g_api->resume(session, 0);
+    return 0;
+}
+
+
+static void scheduleResume(CacheWaiter *pWaiter)
+{
+    if (pWaiter->m_iTimerId != LS_FAIL)
+    {
+        g_api->remove_timer(pWaiter->m_iTimerId);
+        pWaiter->m_iTimerId = LS_FAIL;
+    }
+    g_api->create_event(resumeWaiter, pWaiter->m_pSession, 0, NULL, 1);
+}
+
+
+static void fetchWaitTimeout(const void *param)
+{
+    CacheWaiter *pWaiter = (CacheWaiter *)param;
+    pWaiter->m_iTimerId = LS_FAIL;
+    pWaiter->m_pQueue->remove(pWaiter);
+    g_api->log(pWaiter->m_pSession, LSI_LOG_DEBUG,
+               "[%s]timed out waiting for the backend fetch.\n",
+               ModuleNameStr);
+    scheduleResume(pWaiter);
+}
+
+
+//Return 1 if another request of this process is fetching the public entry
+//and this one has been queued behind it, otherwise this request becomes
+//the one fetching it, unless the last fetch found the URL not cacheable.
+static int waitForFetch(lsi_param_t *rec, MyMData *myData)
+{
+    CacheFetch *pFetch;
+    HashStringMap<CacheFetch *>::iterator iter =
+        s_fetching.find(myData->cePublicHash.getKey());
+    if (iter == s_fetching.end())
+    {
+        pFetch = new CacheFetch;
+        pFetch->m_hash.copy(myData->cePublicHash);
+        pFetch->m_tmPass = 0;
+        s_fetching.insert((const char *)pFetch->m_hash.getKey(), pFetch);
+        myData->pFetch = pFetch;
+        return 0;
+    }
+
+    pFetch = iter.second();
+    if (pFetch->m_tmPass)
+    {
+        if (pFetch->m_tmPass > DateTime_s_curTime)
+            return 0;
+        pFetch->m_tmPass = 0;
+        myData->pFetch = pFetch;
+        return 0;
+    }
+    CacheWaiter *pWaiter = new CacheWaiter;
+    pWaiter->m_pSession = rec->session;
+    pWaiter->m_pQueue = &pFetch->m_waitQ;
+    pWaiter->m_iTimerId = g_api->set_timer(CACHE_FETCH_WAIT_MS, 0,
+                                           fetchWaitTimeout, pWaiter);
+    pFetch->m_waitQ.append(pWaiter);
+    myData->pWaiter = pWaiter;
+    return 1;
+}
+
+
+//The fetch is over or will not leave a public entry, wake the requests
+//waiting for it. If the response was not cacheable, keep a pass mark so
+//misses of the next few seconds do not queue up behind another fetch.
+static void endFetch(MyMData *myData, int pass)
+{
+    CacheFetch *pFetch = myData->pFetch;
+    if (!pFetch)
+        return;
+    myData->pFetch = NULL;
+
+    CacheWaiter *pWaiter;
+    while ((pWaiter = (CacheWaiter *)pFetch->m_waitQ.pop_front()) != NULL)
+        scheduleResume(pWaiter);
+    if (pass)
+    {
+        pFetch->m_tmPass = DateTime_s_curTime + CACHE_PASS_SECS;
+        return;
+    }
+    s_fetching.remove((const char *)pFetch->m_hash.getKey());
+    delete pFetch;
+}
+
+
 static int releaseMData(void *data)
 {
     MyMData *myData = (MyMData *)data;
     if (myData)
     {
+        endFetch(myData, 0);
+        if (myData->pWaiter)
+        {
+            if (myData->pWaiter->m_iTimerId != LS_FAIL)
+                g_api->remove_timer(myData->pWaiter->m_iTimerId);
+            if (myData->pWaiter->next())
+                myData->pWaiter->m_pQueue->remove(myData->pWaiter);
+            delete myData->pWaiter;
+        }
+
         if (myData->pOrgUri)
             delete []myData->pOrgUri;
 
@@ -1702,6 +1882,53 @@ static int getControlFlag(CacheConfig *pConfig)
 }
 
 
+//The refresh of a stale entry got an error page, drop the new entry and
+//keep the stale copy. A server error within the stale-if-error window of
+//the copy also holds off the next refresh for a while, return 1 then so
+//the stale copy is served instead of the error.
+static int cancelStaleUpdate(MyMData *myData, int code)
+{
+    int serveStale = 0;
+    CacheStore *pStore = myData->pConfig->getStore();
+    CacheStore::iterator iter = pStore->find(
+                                    myData->pEntry->getHashKey().getKey());
+    if ((code >= 500) && (iter != pStore->end())
+        && (iter.second() != myData->pEntry))
+    {
+        CacheEntry *pStale = iter.second();
+        if (DateTime_s_curTime - pStale->getExpireTime()
+            <= pStale->getStaleIfError())
+        {
+            pStale->setNextRefresh(DateTime_s_curTime + CACHE_STALE_RETRY);
+            serveStale = 1;
+        }
+    }
+    g_api->log(NULL, LSI_LOG_DEBUG,
+               "[%s]update of stale entry cancelled, code=%d.\n",
+               ModuleNameStr, code);
+    pStore->cancelEntry(myData->pEntry, 1);
+    myData->pEntry = NULL;
+    myData->iCacheState = CE_STATE_NOCACHE;
+    return serveStale;
+}
+
+
+//Restart the request with its original URL, URI_MAP then finds the stale
+//copy held off from refresh and serves it.
+static int redirectToStale(const lsi_session_t *session)
+{
+    HttpReq *pReq = ((HttpSession *)session)->getReq();
+    const char *pUrl = pReq->getOrgReqURL();
+    int len = pReq->getOrgReqURLLen();
+    const char *pQs = (const char *)memchr(pUrl, '?', len);
+    int uriLen = (pQs ? pQs - pUrl : len);
+    int qsLen = (pQs ? len - uriLen - 1 : 0);
+    return g_api->set_uri_qs(session, LSI_URL_REDIRECT_INTERNAL
+                             | LSI_URL_QS_SET | LSI_URL_ENCODED,
+                             pUrl, uriLen, (pQs ? pQs + 1 : NULL), qsLen);
+}
+
+
 static void processPurge(const lsi_session_t *session,
                          const char *pValue, int valLen);
 static int createEntry(lsi_param_t *rec)
@@ -1723,6 +1950,8 @@ static int createEntry(lsi_param_t *rec)
                                                         LSI_DATA_HTTP);
     if (myData == NULL || myData->iHaveAddedHook == 0)
     {
+        if (myData)
+            endFetch(myData, 0);
         clearHooks(rec->session);
         g_api->log(rec->session, LSI_LOG_DEBUG,
                    "[%s]createEntry quit, code 2.\n", ModuleNameStr);
@@ -1748,7 +1977,18 @@ static int createEntry(lsi_param_t *rec)
     count = g_api->get_resp_header(rec->session,
                     LSI_RSPHDR_LITESPEED_CACHE_CONTROL, NULL, 0, iov, 3);
     for (int i = 0; i < count; ++i)
+    {
         myData->cacheCtrl.parse((char *)iov[i].iov_base, iov[i].iov_len);
+        myData->staleCtrl.parseStale((char *)iov[i].iov_base, iov[i].iov_len);
+    }
+    if (myData->staleCtrl.getStaleWindow() < 0)
+    {
+        int n = g_api->get_resp_header(rec->session,
+                    LSI_RSPHDR_CACHE_CTRL, NULL, 0, iov, 3);
+        for (int i = 0; i < n; ++i)
+            myData->staleCtrl.parseStale((char *)iov[i].iov_base,
+                                         iov[i].iov_len);
+    }
 
     /**
      * If no LSI_RSPHDR_LITESPEED_CACHE_CONTROL, then we can check
@@ -1765,6 +2005,7 @@ static int createEntry(lsi_param_t *rec)
 
     if (myData->cacheCtrl.isCacheOff())
     {
+        endFetch(myData, 1);
         clearHooks(rec->session);
         g_api->log(rec->session, LSI_LOG_DEBUG,
                    "[%s]createEntry abort, code 1.\n", ModuleNameStr);
@@ -1776,6 +2017,7 @@ static int createEntry(lsi_param_t *rec)
     //For a HEAD request, do not save it
     if (myData->iMethod == HTTP_HEAD)
     {
+        endFetch(myData, 0);
         clearHooks(rec->session);
         g_api->log(rec->session, LSI_LOG_DEBUG,
                    "[%s]cacheTofile to be cancelled for HEAD request.\n",
@@ -1785,13 +2027,23 @@ static int createEntry(lsi_param_t *rec)
 
     //if no LSI_RSPHDR_LITESPEED_CACHE_CONTROL and not 200, do nothing
     //if 304, do nothing
+    //a server error never replaces a stale copy
     int code = g_api->get_status_code(rec->session);
-    if (code == 304 || (code != 200 && count == 0))
+    if (code == 304 || (code != 200 && count == 0)
+        || (code >= 500 && myData->iCacheState == CE_STATE_UPDATE_STALE))
     {
+        int serveStale = 0;
+        if (myData->iCacheState == CE_STATE_UPDATE_STALE)
+            serveStale = cancelStaleUpdate(myData, code);
+        endFetch(myData, 1);
         clearHooks(rec->session);
         g_api->log(rec->session, LSI_LOG_DEBUG,
                    "[%s]cacheTofile to be cancelled for error page, code=%d.\n",
                    ModuleNameStr, code);
+        if (serveStale && redirectToStale(rec->session) == LS_OK)
+            g_api->log(rec->session, LSI_LOG_DEBUG,
+                       "[%s]serve the stale copy instead of the error.\n",
+                       ModuleNameStr);
         return 0;
     }
 
@@ -1814,6 +2066,7 @@ static int createEntry(lsi_param_t *rec)
          * will stop the hook chain and cause 500 error
          */
         g_api->set_status_code(rec->session, 500);
+        endFetch(myData, 1);
         clearHooks(rec->session);
         g_api->log(rec->session, LSI_LOG_DEBUG,
                        "[%s]createEntry set 500 error and returned.\n",
@@ -1845,6 +2098,7 @@ static int createEntry(lsi_param_t *rec)
     {
         if (!myData->pConfig->isSet(CACHE_RESP_COOKIE_CACHE))
         {
+            endFetch(myData, 1);
             clearHooks(rec->session);
             g_api->log(rec->session, LSI_LOG_DEBUG,
                        "[%s]cacheTofile to be cancelled for having respcookie.\n",
@@ -1887,6 +2141,7 @@ static int createEntry(lsi_param_t *rec)
             myData->hkptIndex = LSI_HKPT_RCVD_RESP_BODY;
         else
         {
+            endFetch(myData, 1);
             clearHooks(rec->session);
             g_api->log(rec->session, LSI_LOG_DEBUG,
                        "[%s]cacheTofile to be cancelled for static file type.\n",
@@ -1898,6 +2153,7 @@ static int createEntry(lsi_param_t *rec)
 
     if (myData->cacheCtrl.isCacheOff())
     {
+        endFetch(myData, 1);
         clearHooks(rec->session);
         g_api->log(rec->session, LSI_LOG_DEBUG,
                    "[%s] createEntry abort due to cache is off.\n", ModuleNameStr);
@@ -1918,12 +2174,17 @@ static int createEntry(lsi_param_t *rec)
 
     if (myData->pEntry == NULL)
     {
+        endFetch(myData, !myData->cacheCtrl.isPublicCacheable());
         clearHooks(rec->session);
         g_api->log(rec->session, LSI_LOG_ERROR,
                    "[%s] createEntry failed.\n", ModuleNameStr);
         return 0;
     }
 
+    //a private entry is of no use to the requests waiting on this fetch
+    if (myData->pEntry->isPrivate())
+        endFetch(myData, 1);
+
     dumpCacheKey(rec->session, &myData->cacheKey);
     dumpCacheHash(rec->session, "Create cache with hash",
                   &myData->pEntry->getHashKey());
@@ -1945,7 +2206,12 @@ static int createEntry(lsi_param_t *rec)
 
 int cacheHeader(lsi_param_t *rec, MyMData *myData)
 {
-    myData->pEntry->setMaxStale(myData->pConfig->getMaxStale());
+    int maxStale = myData->staleCtrl.getStaleWindow();
+    if (maxStale < 0)
+        maxStale = myData->pConfig->getMaxStale();
+    myData->pEntry->setMaxStale(maxStale);
+    myData->pEntry->getHeader().m_iMaxStale = maxStale;
+    myData->pEntry->setStaleIfError(myData->staleCtrl.getStaleIfError());
     int fd = myData->pEntry->getFdStore();
     g_api->log(rec->session,
                (fd != -1 ? LSI_LOG_DEBUG : LSI_LOG_ERROR),
@@ -2693,6 +2959,9 @@ static int checkAssignHandler(lsi_param_t *rec)
     if (myData->reqCompressType == LSI_NO_COMPRESS &&
         encodingLen >= 2 && strcasestr(encoding, "br"))
         myData->reqCompressType = LSI_BR_COMPRESS;
+    if (myData->reqCompressType == LSI_NO_COMPRESS &&
+        encodingLen >= 4 && strcasestr(encoding, "zstd"))
+        myData->reqCompressType = LSI_ZSTD_COMPRESS;
 
     myData->iCacheState = lookUpCache(rec, myData,
                                    cacheCtrl.getFlags() & CacheCtrl::no_vary,
@@ -2771,6 +3040,19 @@ static int checkAssignHandler(lsi_param_t *rec)
         if (!myData->cacheCtrl.isCacheOff()
             || (myData->pConfig->isCheckPublic() || myData->pConfig->isPrivateCheck()))
         {
+            //Collapse concurrent misses in this process onto one backend
+            //fetch, a request with a private cookie likely gets a private
+            //response and goes on its own.
+            if (!myData->iWaited && !myData->pFetch
+                && !myData->cacheCtrl.isCacheOff()
+                && myData->cacheKey.m_iCookiePrivate == 0
+                && waitForFetch(rec, myData))
+            {
+                g_api->log(rec->session, LSI_LOG_DEBUG,
+                           "[%s]checkAssignHandler wait for the fetch in progress.\n",
+                           ModuleNameStr);
+                return LSI_SUSPEND;
+            }
             myData->iHaveAddedHook = 1;
 
             //g_api->set_session_hook_flag( rec->_session, LSI_HKPT_RCVD_RESP_BODY, &MNAME, 1 );
@@ -3065,6 +3347,9 @@ static void decref_and_free_data(MyMData *myData, const lsi_session_t *session)
 static void updateCacheEntry(CacheConfig *pConfig, CacheEntry *pEntry, int tmpfd,
                              char *tmppath, int compressType, off_t length)
 {
+    pConfig->getStore()->getManager()->removeHotCopy(
+        pEntry->getHashKey().getKey(), HASH_KEY_LEN);
+
     //length change
     pEntry->setPart2Len(length);
 
@@ -3352,8 +3637,11 @@ static int handlerProcess(const lsi_session_t *session)
 
     char *buff = NULL;
     char *pBuffOrg = NULL;
+    char *pHot = NULL;
+    CacheManager *pManager = myData->pConfig->getStore()->getManager();
     int part1offset = myData->pEntry->getPart1Offset();
     int part2offset = myData->pEntry->getPart2Offset();
+    int hotLen = myData->pEntry->getContentTotalLen();
     if (part2offset - part1offset > 0)
     {
 #ifdef CACHE_RESP_HEADER
@@ -3361,6 +3649,17 @@ static int handlerProcess(const lsi_session_t *session)
             buff = (char *)(myData->m_pEntry->m_sRespHeader.c_str());
         else
 #endif
+        if ((hotLen <= CACHE_HOT_MAX_ENTRY)
+            && (pManager->getHotCopy(myData->pEntry, s_achHotBuf,
+                                     sizeof(s_achHotBuf)) == hotLen))
+        {
+            pHot = s_achHotBuf;
+            buff = pHot;
+            g_api->log(session, LSI_LOG_DEBUG,
+                       "[%s]handlerProcess serve from hot tier.\n",
+                       ModuleNameStr);
+        }
+        else
         {
             buff  = (char *)mmap((caddr_t)0, part2offset,
                                  PROT_READ, MAP_SHARED, fd, 0);
@@ -3424,6 +3723,11 @@ static int handlerProcess(const lsi_session_t *session)
                     *pUpdate++ = 'b';
                     *pUpdate++ = 'r';
                 }
+                else if (compressType == 3)
+                {
+                    *pUpdate++ = 'z';
+                    *pUpdate++ = 's';
+                }
             }
 
             g_api->set_resp_header(session, LSI_RSPHDR_ETAG, NULL, 0, pEtag,
@@ -3521,6 +3825,14 @@ static int handlerProcess(const lsi_session_t *session)
                        "[%s]set_resp_header [Content-Encoding: br].\n",
                        ModuleNameStr);
         }
+        else if (compressType == LSI_ZSTD_COMPRESS)
+        {
+            g_api->set_resp_header(session, LSI_RSPHDR_CONTENT_ENCODING,
+                                   NULL, 0, "zstd", 4, LSI_HEADEROP_SET);
+            g_api->log(session, LSI_LOG_DEBUG,
+                       "[%s]set_resp_header [Content-Encoding: zstd].\n",
+                       ModuleNameStr);
+        }
         g_api->set_resp_buffer_compress_method(session, compressType);
 
 
@@ -3531,8 +3843,28 @@ static int handlerProcess(const lsi_session_t *session)
                    "[%s]handlerProcess fd %d, offset %d, length %ld\n",
                    ModuleNameStr, fd, part2offset, length);
 
-        if (g_api->send_file2(session, fd, part2offset, length) == 0)
+        if (pHot)
+        {
+            if (g_api->append_resp_body(session,
+                                        pHot + part2offset - part1offset,
+                                        length) != LS_FAIL)
+                g_api->end_resp(session);
+            else
+                ret = 500;
+        }
+        else if (g_api->send_file2(session, fd, part2offset, length) == 0)
+        {
             g_api->end_resp(session);
+            //small entries hit often enough are copied to the hot tier
+            if (pBuffOrg && (hotLen <= CACHE_HOT_MAX_ENTRY))
+            {
+                int hits = pManager->countHit(myData->pEntry);
+                if ((hits >= CACHE_HOT_MIN_HITS)
+                    && (pread(fd, s_achHotBuf, hotLen, part1offset) == hotLen))
+                    pManager->addHotCopy(myData->pEntry, hits, s_achHotBuf,
+                                         hotLen);
+            }
+        }
         else
             ret = 500;
 
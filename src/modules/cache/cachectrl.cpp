@@ -29,6 +29,8 @@ CacheCtrl::CacheCtrl()
     : m_flags(0)
     , m_iMaxAge(INT_MAX)
     , m_iMaxStale(0)
+    , m_iStaleRevalidate(0)
+    , m_iStaleIfError(0)
 {
 }
 
@@ -62,6 +64,23 @@ static const int s_dirLen[CACHE_DIRECTIVES] =
 {   8, 8, 7, 9, 9, 12, 14, 6, 7, 15, 16, 8, 3, 7, 9, 6, 12   };
 
 
+//RFC 5861 extensions, kept out of the table above since bits 17 and 18
+//are not directives.
+static int parseStaleAge(const char *p, int len, const char *pName,
+                         int nameLen, int *pAge)
+{
+    if ((len < nameLen) || (strncasecmp(p, pName, nameLen) != 0))
+        return 0;
+    p += nameLen;
+    while ((*p == ' ') || (*p == '=') || (*p == '"'))
+        ++p;
+    if (!isdigit(*p))
+        return 0;
+    *pAge = atoi(p);
+    return 1;
+}
+
+
 int CacheCtrl::parse(const char *pHeader, int len)
 {
     StrParse parser(pHeader, pHeader + len, ",");
@@ -132,3 +151,29 @@ int CacheCtrl::parse(const char *pHeader, int len)
     return 0;
 }
 
+
+//Only a response header may set how long a shared copy is served stale,
+//so these are not picked up by parse().
+int CacheCtrl::parseStale(const char *pHeader, int len)
+{
+    StrParse parser(pHeader, pHeader + len, ",");
+    const char *p;
+    while (!parser.isEnd())
+    {
+        p = parser.trim_parse();
+        if (!p)
+            break;
+        if (p != parser.getStrEnd())
+        {
+            AutoStr2 s(p, parser.getStrEnd() - p);
+            if (parseStaleAge(s.c_str(), s.len(), "stale-while-revalidate", 22,
+                              &m_iStaleRevalidate))
+                m_flags |= stale_revalidate;
+            else if (parseStaleAge(s.c_str(), s.len(), "stale-if-error", 14,
+                                   &m_iStaleIfError))
+                m_flags |= stale_if_error;
+        }
+    }
+    return 0;
+}
+
@@ -47,7 +47,9 @@ public:
         shared = (1 << 15),
         no_autoflush = (1 << 16),
         esi_on = (1 << 17),
-        has_cookie = (1 << 18)
+        has_cookie = (1 << 18),
+        stale_revalidate = (1 << 19),
+        stale_if_error = (1 << 20)
     };
 
     int isCacheOff() const  {   return m_flags & (no_cache | no_store);    }
@@ -66,6 +68,8 @@ public:
         m_flags = 0;
         m_iMaxAge = 0;
         m_iMaxStale = 0;
+        m_iStaleRevalidate = 0;
+        m_iStaleIfError = 0;
     }
 
     void init(int flags, int iMaxAge, int iMaxStale)
@@ -83,11 +87,23 @@ public:
     }
 
     int parse(const char *pHeader, int len);
+    int parseStale(const char *pHeader, int len);
     int isMaxAgeSet() const {   return m_flags & (max_age | s_maxage);  }
     void setMaxAge(int age)     {   m_iMaxAge = age;        }
     int isMaxStaleSet() const   {   return m_flags & max_stale;     }
     int getMaxStale() const     {   return m_iMaxStale;     }
     void setMaxStale(int age)   {   m_iMaxStale = age;      }
+    int getStaleIfError() const {   return m_iStaleIfError; }
+
+    //How long a stale copy may be served, the longer one of
+    //stale-while-revalidate and stale-if-error, -1 if neither is set.
+    int getStaleWindow() const
+    {
+        if (!(m_flags & (stale_revalidate | stale_if_error)))
+            return -1;
+        return (m_iStaleRevalidate > m_iStaleIfError) ? m_iStaleRevalidate
+               : m_iStaleIfError;
+    }
     void copy(CacheCtrl &rhs)
     {
         memcpy(this, &rhs, sizeof(CacheCtrl));
@@ -97,6 +113,8 @@ private:
     int m_flags;
     int m_iMaxAge;
     int m_iMaxStale;
+    int m_iStaleRevalidate;
+    int m_iStaleIfError;
 
 };
 
@@ -27,6 +27,7 @@ CacheEntry::CacheEntry()
     : m_lastAccess(0)
     , m_lastPurgrCheck(0)
     , m_iMaxStale(0)
+    , m_tmNextRefresh(0)
     , m_iHits(0)
     , m_isDirty(0)
     , m_isBuilding(0)
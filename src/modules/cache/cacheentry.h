@@ -94,6 +94,13 @@ public:
     void setMaxStale(int age)     {   m_iMaxStale = age;      }
     int  getMaxStale() const        {   return m_iMaxStale;     }
 
+    void setStaleIfError(int age)   {   m_header.m_iStaleIfError = age;  }
+    int  getStaleIfError() const    {   return m_header.m_iStaleIfError; }
+
+    //a failed refresh of the stale copy holds off the next one until then
+    void setNextRefresh(int32_t tm) {   m_tmNextRefresh = tm;   }
+    int32_t getNextRefresh() const  {   return m_tmNextRefresh; }
+
     off_t getHeaderSize() const
     {
         return CACHE_ENTRY_MAGIC_LEN + sizeof(CeHeader)
@@ -133,18 +140,23 @@ public:
     void markReady(int compressed_method)
     {
         m_header.m_flag = (m_header.m_flag & ~CeHeader::CEH_IN_CONSTRUCT);
-        m_header.m_flag &= (~CeHeader::CEH_BR & ~CeHeader::CEH_GZIP);
+        m_header.m_flag &= (~CeHeader::CEH_BR & ~CeHeader::CEH_GZIP
+                            & ~CeHeader::CEH_ZSTD);
         
-        if (compressed_method == 2)
+        if (compressed_method == 3)
+            m_header.m_flag |= CeHeader::CEH_ZSTD;
+        else if (compressed_method == 2)
             m_header.m_flag |= CeHeader::CEH_BR;
         else if (compressed_method == 1)
             m_header.m_flag |= CeHeader::CEH_GZIP;
     }
 
-    //Return 0, no compressed, 1 Gzip, 2 Br
+    //Return 0, no compressed, 1 Gzip, 2 Br, 3 Zstd
     int getCompressType() const
     {
-        if (m_header.m_flag & CeHeader::CEH_BR)
+        if (m_header.m_flag & CeHeader::CEH_ZSTD)
+            return 3;
+        else if (m_header.m_flag & CeHeader::CEH_BR)
             return 2;
         else if (m_header.m_flag & CeHeader::CEH_GZIP)
             return 1;
@@ -205,6 +217,7 @@ private:
     long        m_lastPurgrCheck;
    
     int         m_iMaxStale;
+    int32_t     m_tmNextRefresh;
     
     /**
      * When this reach 10, then means currrent cache need to change gzip/ungzip
@@ -55,16 +55,39 @@ class UrlVary;
 #define CM_TRACK_LITEMAGE 1
 #define CM_TRACK_PRIVATE  2
 
+//In memory copies of small, frequently hit entries, see ShmCacheManager.
+#define CACHE_HOT_MAX_ENTRY     (64 * 1024)
+#define CACHE_HOT_MAX_TOTAL     (32 * 1024 * 1024)
+#define CACHE_HOT_MIN_HITS      3
+#define CACHE_HOT_SAMPLE_WINDOW 10000
+#define CACHE_HOT_MAX_IDLE      600
+
 typedef struct shm_objtrack_s
 {
     uint32_t    x_tmCreated;
     uint32_t    x_tmExpire;
     uint8_t     x_flag;
     uint8_t     x_hits;
-    uint8_t     x_reserve[2];
+    uint8_t     x_hitEpoch;
+    uint8_t     x_reserve[1];
 }shm_objtrack_t;
 
 
+//Header of an entry in the hot tier, followed by the part of the cache
+//file after the CeHeader, the response header then the body.
+typedef struct shm_hotcopy_s
+{
+    int32_t     x_tmCreated;
+    int16_t     x_msCreated;
+    int16_t     x_flag;
+    int32_t     x_part1Len;
+    int32_t     x_part2Len;
+    uint8_t     x_hits;
+    uint8_t     x_hitEpoch;
+    uint8_t     x_reserve[2];
+}shm_hotcopy_t;
+
+
 typedef struct purgeinfo_s
 {
     int32_t     tmSecs;
@@ -152,6 +175,20 @@ public:
     int32_t getNewPurgeCount() const
     {   return m_iSessionPurged - m_iLastCleanSessPurge;    }
 
+    //Hit counts are halved every CACHE_HOT_SAMPLE_WINDOW hits, lazily, by
+    //comparing the epoch stored with a count to this one.
+    uint8_t getHotEpoch() const     {   return (uint8_t)m_iHotEpoch;    }
+    void countHotSample()
+    {
+        if (ls_atomic_fetch_add(&m_iHotSamples, 1) % CACHE_HOT_SAMPLE_WINDOW
+            == CACHE_HOT_SAMPLE_WINDOW - 1)
+            ls_atomic_add(&m_iHotEpoch, 1);
+    }
+
+    //changed with the hot tier hash locked.
+    int32_t getHotBytes() const     {   return m_iHotBytes;     }
+    void addHotBytes(int32_t n)     {   m_iHotBytes += n;       }
+
     uint32_t getFlags() const       {   return m_iFlags;        }
     void     setFlags(uint32_t f)   {   m_iFlags = f;        }
     
@@ -183,7 +220,10 @@ private:
     uint32_t        m_tmLastCleanDiskCache;
     uint32_t        m_iLastCleanSessPurge;
     uint32_t        m_iFlags;
-    char            m_reserved[252] __attribute__ ((unused)); /* Padding, do not remove */
+    uint32_t        m_iHotSamples;
+    uint32_t        m_iHotEpoch;
+    int32_t         m_iHotBytes;
+    char            m_reserved[240] __attribute__ ((unused)); /* Padding, do not remove */
 };
 
 
@@ -262,6 +302,12 @@ public:
     virtual int  isInTracker(const unsigned char* getKey, int keyLen, 
                              int isPrivate) = 0;
 
+    virtual int  countHit(CacheEntry *pEntry) = 0;
+    virtual int  getHotCopy(CacheEntry *pEntry, char *pBuf, int bufLen) = 0;
+    virtual int  addHotCopy(CacheEntry *pEntry, int hits, const char *pData,
+                            int len) = 0;
+    virtual void removeHotCopy(const unsigned char *pKey, int keyLen) = 0;
+
 private:
     virtual CacheInfo *getCacheInfo() = 0;
 
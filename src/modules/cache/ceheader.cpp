@@ -35,6 +35,8 @@ CeHeader::CeHeader()
     , m_lSize(0)
     , m_inode(0)
     , m_tmFileLastMod(0)
+    , m_iMaxStale(-1)
+    , m_iStaleIfError(0)
 {
 }
 
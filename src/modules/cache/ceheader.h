@@ -22,7 +22,7 @@
 #include <http/platforms.h>
 #include <sys/types.h>
 
-#define CE_ID MK_DWORD4( 'L', 'S', 'C', 'H' )
+#define CE_ID MK_DWORD4( 'L', 'S', 'C', '2' )
 #define CACHE_ENTRY_MAGIC_LEN        4
 
 struct CeHeader
@@ -41,7 +41,8 @@ public:
         CEH_STALE        = 1 << 4,
         CEH_UPDATING     = 1 << 5,
         CEH_ESI          = 1 << 6,
-        CEH_BR           = 1 << 7
+        CEH_BR           = 1 << 7,
+        CEH_ZSTD         = 1 << 8
     };
 
     int32_t m_tmCreated;        //Created Time
@@ -65,6 +66,8 @@ public:
     off_t   m_lSize;
     ino_t   m_inode;
     time_t  m_tmFileLastMod;    //The static file or dynmaic script file last modified time 
+    int32_t m_iMaxStale;        //Seconds a stale copy may be served, -1 if not set
+    int32_t m_iStaleIfError;    //Seconds a stale copy may stand in for a server error
 };
 
 #endif
@@ -42,7 +42,7 @@ DirHashCacheEntry::~DirHashCacheEntry()
         close(getFdStore());
 
 }
-//<"LSCH"><CeHeader><CacheKey><ResponseHeader><ResponseBody>
+//<"LSC2"><CeHeader><CacheKey><ResponseHeader><ResponseBody>
 int DirHashCacheEntry::loadCeHeader()
 {
     int fd = getFdStore();
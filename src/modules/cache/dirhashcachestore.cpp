@@ -265,6 +265,9 @@ CacheEntry *DirHashCacheStore::getCacheEntry(CacheHash &hash,
                        pEntry->getHashKey().to_str(NULL));
             pEntry->setStale(1);
         }
+        //keep the stale window the entry was saved with
+        if (pEntry->getHeader().m_iMaxStale >= 0)
+            maxStale = pEntry->getHeader().m_iMaxStale;
         pEntry->setMaxStale(maxStale);
     }
 
@@ -566,6 +569,7 @@ int DirHashCacheStore::saveEntry(CacheEntry *pEntry)
 void DirHashCacheStore::removePermEntry(CacheEntry *pEntry)
 {
     char achBuf[4096];
+    getManager()->removeHotCopy(pEntry->getHashKey().getKey(), HASH_KEY_LEN);
     buildCacheLocation(achBuf, 4096, pEntry->getHashKey().getKey(),
                        pEntry->isPrivate());
     unlink(achBuf);
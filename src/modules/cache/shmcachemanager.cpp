@@ -317,6 +317,8 @@ ShmCacheManager::~ShmCacheManager()
         m_pPubTracker->close();
     if (m_pPrivTracker != NULL)
         m_pPrivTracker->close();
+    if (m_pHotTier != NULL)
+        m_pHotTier->close();
 //     if (m_pPurgeShmBridge)
 //         delete m_pPurgeShmBridge;
     m_id2StrList.release_objects();
@@ -514,7 +516,7 @@ int ShmCacheManager::findTagId(const char *pTag, int len)
 {
     int valLen;
     LsShmOffset_t offVal;
-    offVal = m_pStr2IdHash->find(pTag, len, &valLen);
+    offVal = m_pStr2IdHash->findNoLock(pTag, len, &valLen);
     if (offVal != 0)
         return *(int32_t *)m_pStr2IdHash->offset2ptr(offVal);
     return -1;
@@ -745,7 +747,8 @@ int ShmCacheManager::shouldPurge(const char *pKey, int keyLen,
             --pTagEndBak;
 
         if (pTagEndBak > p &&
-            (offVal = m_pPublicPurge->find(p, pTagEndBak - p, &valLen)) != 0)
+            (offVal = m_pPublicPurge->findNoLock(p, pTagEndBak - p,
+                                                 &valLen)) != 0)
         {
             purgeinfo_t *pData = (purgeinfo_t *)m_pPublicPurge->offset2ptr(offVal);
             //         LOG4CXX_NS::Logger::getRootLogger()->debug(
@@ -961,6 +964,11 @@ int ShmCacheManager::initTables(LsShmPool *pPool)
                                          LSSHM_FLAG_LRU);
     if (!m_pPrivTracker)
         return -1;
+
+    m_pHotTier = pPool->getNamedHash("hottier", 1000, LsShmHash::hashXXH32,
+                                     memcmp, LSSHM_FLAG_LRU);
+    if (!m_pHotTier)
+        return -1;
     
     populatePrivateTag();
     return 0;
@@ -1119,9 +1127,7 @@ int32_t ShmCacheManager::getUrlVaryId(const char *pUrl, int len)
 {
     int valLen;
     LsShmOffset_t offVal;
-    m_pUrlVary->lock();
-    offVal = m_pUrlVary->find(pUrl, len, &valLen);
-    m_pUrlVary->unlock();
+    offVal = m_pUrlVary->findNoLock(pUrl, len, &valLen);
 
     if (offVal != 0)
     {
@@ -1135,9 +1141,7 @@ const AutoStr2 *ShmCacheManager::getUrlVary(const char *pUrl, int len)
 {
     int valLen;
     LsShmOffset_t offVal;
-    m_pUrlVary->lock();
-    offVal = m_pUrlVary->find(pUrl, len, &valLen);
-    m_pUrlVary->unlock();
+    offVal = m_pUrlVary->findNoLock(pUrl, len, &valLen);
 
     if (offVal != 0)
     {
@@ -1155,6 +1159,13 @@ int ShmCacheManager::getNextPrivateTagId()
 {   return getCacheInfo()->getNextPrivateTagId(); }
 
 
+static int hotcopy_trim_cb(LsShmHash::iterator iter, void *pArg)
+{
+    ((ShmCacheManager *)pArg)->getCacheInfo()->addHotBytes(-iter->x_iLen);
+    return 1;
+}
+
+
 int ShmCacheManager::houseKeeping()
 {
     int last = getCacheInfo()->getLastHouseKeeping();
@@ -1163,6 +1174,12 @@ int ShmCacheManager::houseKeeping()
     if (getCacheInfo()->setLastHouseKeeping(last, DateTime::s_curTime) == 0)
         return 0;
     cleanupExpiredSessions();
+    m_pHotTier->disableAutoLock();
+    m_pHotTier->lock();
+    m_pHotTier->trim(DateTime::s_curTime - CACHE_HOT_MAX_IDLE,
+                     hotcopy_trim_cb, this);
+    m_pHotTier->unlock();
+    m_pHotTier->enableAutoLock();
     return 1;
 }
 
@@ -1257,6 +1274,7 @@ int ShmCacheManager::removeTracking(const char *pKey, int keyLen, int isPrivate)
     }
     pTracker->unlock();
     pTracker->enableAutoLock();
+    removeHotCopy((const unsigned char *)pKey, keyLen);
     return iterOff.m_iOffset != 0;
 }
 
@@ -1284,3 +1302,210 @@ int ShmCacheManager::isInTracker(const unsigned char* pKey, int keyLen,
 }
 
 
+static uint8_t ageHits(uint8_t hits, uint8_t *pEpoch, uint8_t epoch)
+{
+    uint8_t shift = epoch - *pEpoch;
+    if (shift != 0)
+    {
+        hits = (shift >= 8) ? 0 : (hits >> shift);
+        *pEpoch = epoch;
+    }
+    return hits;
+}
+
+
+static int isSameVersion(const shm_hotcopy_t *pCopy, CacheEntry *pEntry)
+{
+    CeHeader &header = pEntry->getHeader();
+    return ((pCopy->x_tmCreated == header.m_tmCreated)
+            && (pCopy->x_msCreated == header.m_msCreated)
+            && (pCopy->x_flag == header.m_flag)
+            && (pCopy->x_part1Len == header.m_valPart1Len)
+            && (pCopy->x_part2Len == header.m_valPart2Len));
+}
+
+
+//Lock free hit count: only the caller moving the epoch ages the count, a
+//hit racing with the aging may be lost, the count is an estimate anyway.
+static int bumpHits(uint8_t *pHits, uint8_t *pEpoch, uint8_t epoch)
+{
+    uint8_t oldEpoch = *(volatile uint8_t *)pEpoch;
+    uint8_t shift = epoch - oldEpoch;
+    uint8_t hits;
+    if ((shift != 0) && ls_atomic_cas8(pEpoch, oldEpoch, epoch))
+    {
+        do
+            hits = *(volatile uint8_t *)pHits;
+        while (!ls_atomic_cas8(pHits, hits,
+                               (uint8_t)((shift >= 8) ? 0 : (hits >> shift))));
+    }
+    do
+    {
+        hits = *(volatile uint8_t *)pHits;
+        if (hits == 255)
+            return hits;
+    }
+    while (!ls_atomic_cas8(pHits, hits, (uint8_t)(hits + 1)));
+    return hits + 1;
+}
+
+
+//Counts a hit served from disk in the tracker, returns the aged count used
+//to decide if the entry goes to the hot tier.
+int ShmCacheManager::countHit(CacheEntry *pEntry)
+{
+    shm_objtrack_t *pData;
+    LsShmHash *pTracker = getTracker(pEntry->isPrivate());
+    LsShmOffset_t offVal;
+    int valLen;
+    getCacheInfo()->countHotSample();
+    offVal = pTracker->findNoLock(pEntry->getHashKey().getKey(),
+                                  HASH_KEY_LEN, &valLen);
+    if ((offVal == 0) || (valLen < (int)sizeof(shm_objtrack_t)))
+        return 0;
+    pData = (shm_objtrack_t *)pTracker->offset2ptr(offVal);
+    return bumpHits(&pData->x_hits, &pData->x_hitEpoch,
+                    getCacheInfo()->getHotEpoch());
+}
+
+
+static void releaseHotCopy(ShmCacheManager *pManager, LsShmHash *pHotTier,
+                           LsShmHash::iteroffset iterOff)
+{
+    int size = pHotTier->offset2iterator(iterOff)->x_iLen;
+    pHotTier->eraseIterator(iterOff);
+    pManager->getCacheInfo()->addHotBytes(-size);
+}
+
+
+//Copies the response header and body of pEntry to pBuf if the hot tier has
+//this version of it, returns the length copied, or LS_FAIL. The copy is
+//taken without the lock, checked against the bucket sequence counters.
+int ShmCacheManager::getHotCopy(CacheEntry *pEntry, char *pBuf, int bufLen)
+{
+    shm_hotcopy_t copy;
+    struct iovec iov[2];
+    LsShmOffset_t offVal;
+    LsShmHash::iteroffset iterOff;
+    ls_strpair_t parms;
+    const void *pKey = pEntry->getHashKey().getKey();
+    int valLen;
+    int len;
+
+    iov[0].iov_base = &copy;
+    iov[0].iov_len = sizeof(copy);
+    iov[1].iov_base = pBuf;
+    iov[1].iov_len = bufLen;
+    valLen = m_pHotTier->copyNoLock(pKey, HASH_KEY_LEN, iov, 2);
+    len = valLen - sizeof(shm_hotcopy_t);
+    if (len < 0)
+        return LS_FAIL;
+    if (!isSameVersion(&copy, pEntry))
+    {
+        m_pHotTier->disableAutoLock();
+        m_pHotTier->lock();
+        iterOff = m_pHotTier->findIterator(
+                      LsShmHash::setParms(&parms, pKey, HASH_KEY_LEN, NULL, 0));
+        if ((iterOff.m_iOffset != 0) && !isSameVersion(
+                (shm_hotcopy_t *)m_pHotTier->offset2iteratorData(iterOff),
+                pEntry))
+            releaseHotCopy(this, m_pHotTier, iterOff);
+        m_pHotTier->unlock();
+        m_pHotTier->enableAutoLock();
+        return LS_FAIL;
+    }
+    if (len > bufLen)
+        return LS_FAIL;
+    //recency comes from the hit count, the LRU list is left to the writers
+    offVal = m_pHotTier->findNoLock(pKey, HASH_KEY_LEN, &valLen);
+    if (offVal != 0)
+    {
+        shm_hotcopy_t *pCopy = (shm_hotcopy_t *)m_pHotTier->offset2ptr(offVal);
+        bumpHits(&pCopy->x_hits, &pCopy->x_hitEpoch,
+                 getCacheInfo()->getHotEpoch());
+    }
+    return len;
+}
+
+
+//TinyLFU style admission: when the hot tier is full, a new copy only takes
+//the place of the least recently used ones if it is hit more often.
+int ShmCacheManager::addHotCopy(CacheEntry *pEntry, int hits,
+                                const char *pData, int len)
+{
+    shm_hotcopy_t *pCopy;
+    shm_hotcopy_t copy;
+    struct iovec iov[2];
+    LsShmHash::iteroffset iterOff;
+    int need;
+    int ret = LS_FAIL;
+    ls_strpair_t parms;
+    const void *pKey = pEntry->getHashKey().getKey();
+    if (len > CACHE_HOT_MAX_ENTRY)
+        return LS_FAIL;
+
+    m_pHotTier->disableAutoLock();
+    m_pHotTier->lock();
+    iterOff = m_pHotTier->findIterator(
+                  LsShmHash::setParms(&parms, pKey, HASH_KEY_LEN, NULL, 0));
+    if (iterOff.m_iOffset != 0)
+        releaseHotCopy(this, m_pHotTier, iterOff);
+
+    need = getCacheInfo()->getHotBytes() + len + sizeof(shm_hotcopy_t)
+           - CACHE_HOT_MAX_TOTAL;
+    while (need > 0)
+    {
+        iterOff = m_pHotTier->getLruOldest();
+        if (iterOff.m_iOffset == 0)
+            break;
+        pCopy = (shm_hotcopy_t *)m_pHotTier->offset2iteratorData(iterOff);
+        if (ageHits(pCopy->x_hits, &pCopy->x_hitEpoch,
+                    getCacheInfo()->getHotEpoch()) >= hits)
+            break;
+        need -= m_pHotTier->offset2iterator(iterOff)->x_iLen;
+        releaseHotCopy(this, m_pHotTier, iterOff);
+    }
+
+    if (need <= 0)
+    {
+        //filled in before it is linked, getHotCopy() reads without lock
+        CeHeader &header = pEntry->getHeader();
+        memset(&copy, 0, sizeof(copy));
+        copy.x_tmCreated = header.m_tmCreated;
+        copy.x_msCreated = header.m_msCreated;
+        copy.x_flag = header.m_flag;
+        copy.x_part1Len = header.m_valPart1Len;
+        copy.x_part2Len = header.m_valPart2Len;
+        copy.x_hits = (hits > 255) ? 255 : hits;
+        copy.x_hitEpoch = getCacheInfo()->getHotEpoch();
+        iov[0].iov_base = &copy;
+        iov[0].iov_len = sizeof(copy);
+        iov[1].iov_base = (void *)pData;
+        iov[1].iov_len = len;
+        if (m_pHotTier->insertIov(pKey, HASH_KEY_LEN, iov, 2) != 0)
+        {
+            iterOff = m_pHotTier->findIterator(
+                      LsShmHash::setParms(&parms, pKey, HASH_KEY_LEN, NULL, 0));
+            getCacheInfo()->addHotBytes(
+                m_pHotTier->offset2iterator(iterOff)->x_iLen);
+            ret = LS_OK;
+        }
+    }
+    m_pHotTier->unlock();
+    m_pHotTier->enableAutoLock();
+    return ret;
+}
+
+
+void ShmCacheManager::removeHotCopy(const unsigned char *pKey, int keyLen)
+{
+    ls_strpair_t parms;
+    ls_str_set(&parms.key, (char *)pKey, keyLen);
+    m_pHotTier->disableAutoLock();
+    m_pHotTier->lock();
+    LsShmHash::iteroffset iterOff = m_pHotTier->findIterator(&parms);
+    if (iterOff.m_iOffset != 0)
+        releaseHotCopy(this, m_pHotTier, iterOff);
+    m_pHotTier->unlock();
+    m_pHotTier->enableAutoLock();
+}
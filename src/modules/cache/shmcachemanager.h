@@ -38,6 +38,7 @@ public:
         , m_pSessions(NULL)
         , m_pPubTracker(NULL)
         , m_pPrivTracker(NULL)
+        , m_pHotTier(NULL)
         , m_pStr2IdHash(NULL)
         , m_pUrlVary(NULL)
         , m_pId2VaryStr(NULL)
@@ -99,12 +100,18 @@ public:
     int  trimExpiredByTracking(int isPrivate, int maxCnt, int (*removeEntry)(void *, void *), void *param);
     int  isInTracker(const unsigned char* getKey, int keyLen, int isPrivate);
 
+    int  countHit(CacheEntry *pEntry);
+    int  getHotCopy(CacheEntry *pEntry, char *pBuf, int bufLen);
+    int  addHotCopy(CacheEntry *pEntry, int hits, const char *pData, int len);
+    void removeHotCopy(const unsigned char *pKey, int keyLen);
+
 
 private:
     LsShmHash               *m_pPublicPurge;
     LsShmHash               *m_pSessions;
     LsShmHash               *m_pPubTracker;
     LsShmHash               *m_pPrivTracker;
+    LsShmHash               *m_pHotTier;
     LsShmHash               *m_pStr2IdHash;
     TShmHash<int32_t>       *m_pUrlVary;
     LsShmHash               *m_pId2VaryStr;
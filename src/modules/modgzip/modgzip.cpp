@@ -15,6 +15,7 @@
 *    You should have received a copy of the GNU General Public License       *
 *    along with this program. If not, see http://www.gnu.org/licenses/.      *
 *****************************************************************************/
+#include <config.h>
 #include <lsdef.h>
 #include <ls.h>
 #include <lsr/ls_loopbuf.h>
@@ -24,6 +25,9 @@
 #include <string.h>
 #include <zlib.h>
 #include <lsdef.h>
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
 
 
 #define     MODULE_VERSION      "1.1"
@@ -35,9 +39,15 @@
 #define     DECOMPRESS_STR  "+++"
 #define     ZIP_STR         "Gzip"
 #define     UNZIP_STR       "un-Gzip"
+#define     ZSTD_STR        "Zstd"
+#define     UNZSTD_STR      "un-Zstd"
 
 static ls_objpool_t zpooldeflate;
 static ls_objpool_t zpoolinflate;
+#ifdef USE_ZSTD
+static ls_objpool_t zpoolzstdc;
+static ls_objpool_t zpoolzstdd;
+#endif
 static int          zpooltimerid = 0;
 
 enum
@@ -48,11 +58,26 @@ enum
     Z_END,
 };
 
+enum
+{
+    ZM_GZIP = 0,
+    ZM_ZSTD,
+};
+
 typedef struct zbufinfo_s
 {
-    uint8_t         compresslevel; //0: Decompress, 1-9:compress
+    uint8_t         compresslevel; //0: Decompress, 1-9(19 for zstd):compress
+    uint8_t         method;
     int16_t         zstate;
+    //For zstd, only the next/avail in/out fields are used.
     z_stream        zstream;
+#ifdef USE_ZSTD
+    union
+    {
+        ZSTD_CCtx  *cctx;
+        ZSTD_DCtx  *dctx;
+    } zstd;
+#endif
     ls_loopbuf_t    loopbuf;
 } zbufinfo_t;
 
@@ -66,6 +91,20 @@ static void ls_zpool_manage(const void *)
 {
     ls_objpool_shrinkto(&zpooldeflate, 10);
     ls_objpool_shrinkto(&zpoolinflate, 10);
+#ifdef USE_ZSTD
+    ls_objpool_shrinkto(&zpoolzstdc, 10);
+    ls_objpool_shrinkto(&zpoolzstdd, 10);
+#endif
+}
+
+
+static ls_objpool_t *ls_zbufinfo_pool(uint8_t method, uint8_t compresslevel)
+{
+#ifdef USE_ZSTD
+    if (method == ZM_ZSTD)
+        return (compresslevel == 0) ? &zpoolzstdd : &zpoolzstdc;
+#endif
+    return (compresslevel == 0) ? &zpoolinflate : &zpooldeflate;
 }
 
 
@@ -93,6 +132,16 @@ static void ls_zbufinfo_release(void *pObj)
     ls_loopbuf_d(&pBuf->loopbuf);
     if (pBuf->zstate == Z_INITED || pBuf->zstate == Z_EOF)
     {
+#ifdef USE_ZSTD
+        if (pBuf->method == ZM_ZSTD)
+        {
+            if (pBuf->compresslevel == 0)
+                ZSTD_freeDCtx(pBuf->zstd.dctx);
+            else
+                ZSTD_freeCCtx(pBuf->zstd.cctx);
+        }
+        else
+#endif
         if (pBuf->compresslevel == 0)
             inflateEnd(&pBuf->zstream);
         else
@@ -106,31 +155,44 @@ static void ls_zbufinfo_recycle(zbufinfo_t *pBuf)
 {
     ls_loopbuf_clear(&pBuf->loopbuf);
     pBuf->zstate = Z_INITED;
-    if (pBuf->compresslevel == 0)
+#ifdef USE_ZSTD
+    if (pBuf->method == ZM_ZSTD)
     {
-        inflateReset(&pBuf->zstream);
-        ls_objpool_recycle(&zpoolinflate, pBuf);
+        if (pBuf->compresslevel == 0)
+            ZSTD_DCtx_reset(pBuf->zstd.dctx, ZSTD_reset_session_only);
+        else
+            ZSTD_CCtx_reset(pBuf->zstd.cctx, ZSTD_reset_session_only);
     }
     else
-    {
+#endif
+    if (pBuf->compresslevel == 0)
+        inflateReset(&pBuf->zstream);
+    else
         deflateReset(&pBuf->zstream);
-        ls_objpool_recycle(&zpooldeflate, pBuf);
-    }
+    ls_objpool_recycle(ls_zbufinfo_pool(pBuf->method, pBuf->compresslevel),
+                       pBuf);
 }
 
 
 static zbufinfo_t *ls_zbufinfo_get(lsi_session_t *session,
                                    lsi_module_t *pModule,
-                                   uint8_t compresslevel)
+                                   uint8_t compresslevel, uint8_t method)
 {
     zbufinfo_t *pBuf;
-    if (compresslevel == 0)
-        pBuf = (zbufinfo_t *)ls_objpool_get(&zpoolinflate);
-    else
-        pBuf = (zbufinfo_t *)ls_objpool_get(&zpooldeflate);
+    pBuf = (zbufinfo_t *)ls_objpool_get(ls_zbufinfo_pool(method,
+                                        compresslevel));
     if (pBuf == NULL)
         return NULL;
+#ifdef USE_ZSTD
+    //a pooled zstd context keeps its parameters, only a compress level
+    //different from the last user needs to be applied again.
+    if (method == ZM_ZSTD && compresslevel != 0
+        && pBuf->zstate == Z_INITED && pBuf->compresslevel != compresslevel)
+        ZSTD_CCtx_setParameter(pBuf->zstd.cctx, ZSTD_c_compressionLevel,
+                               compresslevel);
+#endif
     pBuf->compresslevel = compresslevel;
+    pBuf->method = method;
     return pBuf;
 }
 
@@ -155,10 +217,34 @@ static int ls_zmoddata_release(void *data)
 }
 
 
-static int initstream(z_stream *pStream, uint8_t compresslevel)
+static int initstream(zbufinfo_t *pBufInfo)
 {
+    z_stream *pStream = &pBufInfo->zstream;
+    uint8_t compresslevel = pBufInfo->compresslevel;
     pStream->avail_in = 0;
     pStream->next_in = Z_NULL;
+#ifdef USE_ZSTD
+    if (pBufInfo->method == ZM_ZSTD)
+    {
+        if (compresslevel == 0)
+        {
+            if ((pBufInfo->zstd.dctx = ZSTD_createDCtx()) == NULL)
+                return LS_FAIL;
+        }
+        else
+        {
+            if ((pBufInfo->zstd.cctx = ZSTD_createCCtx()) == NULL)
+                return LS_FAIL;
+            if (ZSTD_isError(ZSTD_CCtx_setParameter(pBufInfo->zstd.cctx,
+                             ZSTD_c_compressionLevel, compresslevel)))
+            {
+                ZSTD_freeCCtx(pBufInfo->zstd.cctx);
+                return LS_FAIL;
+            }
+        }
+        return LS_OK;
+    }
+#endif
     if (compresslevel == 0)
     {
         if (inflateInit2(pStream, 32 + MAX_WBITS) != Z_OK)
@@ -203,6 +289,37 @@ int flushloopbuf(lsi_param_t *rec, int iState, ls_loopbuf_t *pBuf)
 }
 
 
+#ifdef USE_ZSTD
+/**
+ * Runs zstd over the buffers described by the z_stream and returns zlib
+ * style codes, so doCompression() drives both methods the same way.
+ */
+static int zstdstream(zbufinfo_t *pBufInfo, int iDoFlush)
+{
+    z_stream *pStream = &pBufInfo->zstream;
+    ZSTD_inBuffer in = { pStream->next_in, pStream->avail_in, 0 };
+    ZSTD_outBuffer out = { pStream->next_out, pStream->avail_out, 0 };
+    size_t ret;
+    if (pBufInfo->compresslevel == 0)
+        ret = ZSTD_decompressStream(pBufInfo->zstd.dctx, &out, &in);
+    else
+        ret = ZSTD_compressStream2(pBufInfo->zstd.cctx, &out, &in,
+                                   (iDoFlush == Z_FINISH) ? ZSTD_e_end
+                                   : (iDoFlush == Z_NO_FLUSH) ? ZSTD_e_continue
+                                   : ZSTD_e_flush);
+    pStream->next_in += in.pos;
+    pStream->avail_in -= in.pos;
+    pStream->next_out += out.pos;
+    pStream->avail_out -= out.pos;
+    if (ZSTD_isError(ret))
+        return Z_STREAM_ERROR;
+    if (ret == 0 && (pBufInfo->compresslevel == 0 || iDoFlush == Z_FINISH))
+        return Z_STREAM_END;
+    return Z_OK;
+}
+#endif
+
+
 static int doCompression(lsi_param_t *rec, zbufinfo_t *pBufInfo,
                          int iDoFlush, const char *pModuleStr,
                          const char *pSendingStr, const char *pCompressStr)
@@ -235,6 +352,11 @@ static int doCompression(lsi_param_t *rec, zbufinfo_t *pBufInfo,
         pStream->avail_out = len;
         pStream->next_out = (unsigned char *)ls_loopbuf_end(pBuf);
 
+#ifdef USE_ZSTD
+        if (pBufInfo->method == ZM_ZSTD)
+            ret = zstdstream(pBufInfo, iDoFlush);
+        else
+#endif
         if (pBufInfo->compresslevel == 0)
             ret = inflate(pStream, iDoFlush);
         else
@@ -320,12 +442,15 @@ static int compressbuf(lsi_param_t *rec, lsi_module_t *pModule,
 
     pStream = &pBufInfo->zstream;
     pCompressStr = pBufInfo->compresslevel ? COMPRESS_STR : DECOMPRESS_STR;
-    pZipStr = pBufInfo->compresslevel ? ZIP_STR : UNZIP_STR;
+    if (pBufInfo->method == ZM_ZSTD)
+        pZipStr = pBufInfo->compresslevel ? ZSTD_STR : UNZSTD_STR;
+    else
+        pZipStr = pBufInfo->compresslevel ? ZIP_STR : UNZIP_STR;
     pModuleStr = g_api->get_module_name(pModule);
 
     if (pBufInfo->zstate == Z_UNINITED)
     {
-        if (initstream(pStream, pBufInfo->compresslevel) == LS_FAIL)
+        if (initstream(pBufInfo) == LS_FAIL)
         {
             g_api->log(rec->session, LSI_LOG_ERROR,
                        "[%s%s] initZstream init method [%s], failed.\n",
@@ -412,6 +537,10 @@ static int init(lsi_module_t *pModule)
 {
     ls_objpool(&zpooldeflate, 0, ls_zbufinfo_new, ls_zbufinfo_release);
     ls_objpool(&zpoolinflate, 0, ls_zbufinfo_new, ls_zbufinfo_release);
+#ifdef USE_ZSTD
+    ls_objpool(&zpoolzstdc, 0, ls_zbufinfo_new, ls_zbufinfo_release);
+    ls_objpool(&zpoolzstdd, 0, ls_zbufinfo_new, ls_zbufinfo_release);
+#endif
     if (zpooltimerid == 0)
         zpooltimerid = g_api->set_timer(10000, 1, ls_zpool_manage, NULL);
     if (zpooltimerid == LS_FAIL)
@@ -457,7 +586,7 @@ lsi_module_t moddecompress = { LSI_MODULE_SIGNATURE, init, NULL, NULL,
 
 
 static int enablehook(lsi_session_t *session, lsi_module_t *pModule,
-                      int isSend, uint8_t compresslevel)
+                      int isSend, uint8_t compresslevel, uint8_t method)
 {
     int ret, aEnableHkpt[5], iEnableCount = 0;
     zmoddata_t *myData = (zmoddata_t *)g_api->get_module_data(session,
@@ -482,14 +611,14 @@ static int enablehook(lsi_session_t *session, lsi_module_t *pModule,
     {
         if ((myData->send != NULL)
             || ((myData->send = ls_zbufinfo_get(session, pModule,
-                                                compresslevel)) != NULL))
+                                                compresslevel, method)) != NULL))
             aEnableHkpt[iEnableCount++] = LSI_HKPT_SEND_RESP_BODY;
     }
     else
     {
         if ((myData->recv != NULL)
             || ((myData->recv = ls_zbufinfo_get(session, pModule,
-                                                compresslevel)) != NULL))
+                                                compresslevel, method)) != NULL))
         {
             aEnableHkpt[iEnableCount++] = LSI_HKPT_RECV_RESP_BODY;
             aEnableHkpt[iEnableCount++] = LSI_HKPT_RCVD_RESP_BODY;
@@ -509,12 +638,14 @@ static int enablehook(lsi_session_t *session, lsi_module_t *pModule,
     }
     if (myData->recv != NULL)
     {
-        ls_objpool_recycle(&zpooldeflate, myData->recv);
+        ls_objpool_recycle(ls_zbufinfo_pool(myData->recv->method,
+                           myData->recv->compresslevel), myData->recv);
         myData->recv = NULL;
     }
     if (myData->send != NULL)
     {
-        ls_objpool_recycle(&zpooldeflate, myData->send);
+        ls_objpool_recycle(ls_zbufinfo_pool(myData->send->method,
+                           myData->send->compresslevel), myData->send);
         myData->send = NULL;
     }
 
@@ -529,8 +660,24 @@ int addModgzipFilter(lsi_session_t *session, int isSend,
                      uint8_t compresslevel)
 {
     if (compresslevel == 0)
-        return enablehook(session, &moddecompress, isSend, 0);
+        return enablehook(session, &moddecompress, isSend, 0, ZM_GZIP);
+    else
+        return enablehook(session, &modcompress, isSend, compresslevel,
+                          ZM_GZIP);
+}
+
+
+int addModzstdFilter(lsi_session_t *session, int isSend,
+                     uint8_t compresslevel)
+{
+#ifdef USE_ZSTD
+    if (compresslevel == 0)
+        return enablehook(session, &moddecompress, isSend, 0, ZM_ZSTD);
     else
-        return enablehook(session, &modcompress, isSend, compresslevel);
+        return enablehook(session, &modcompress, isSend, compresslevel,
+                          ZM_ZSTD);
+#else
+    return LS_FAIL;
+#endif
 }
 
@@ -148,14 +148,27 @@ int AddrMap::addLargePage(AddrOffPair info, size_t size)
 
 int AddrMap::mapAddrSpace(size_t total)
 {
-    int needed = total - getMaxOffset();
-    if (needed <= 0)
+    if (total <= getMaxOffset())
         return LS_OK;
+    size_t needed = total - getMaxOffset();
     AddrOffPair pair;
+    //reserve as much again as is mapped, up to a cap, so the file keeps
+    //growing into one contiguous range and large allocations fit.
+    size_t headroom = getMaxOffset();
+    if (headroom > ADDR_RESERVE_MAX)
+        headroom = ADDR_RESERVE_MAX;
+    if (needed < headroom)
+        needed = headroom;
     size_t bytes = (needed + LARGE_PAGE_MASK ) & ~LARGE_PAGE_MASK;
     pair.m_ptr = (char *) mmap(NULL, bytes + LARGE_PAGE_SIZE, PROT_NONE,
-                               MAP_ANON|MAP_SHARED, -1, 0);
-    if (!pair.m_ptr)
+                               MAP_ANON|MAP_PRIVATE|MAP_NORESERVE, -1, 0);
+    if ((pair.m_ptr == MAP_FAILED) && (bytes > total - getMaxOffset()))
+    {
+        bytes = (total - getMaxOffset() + LARGE_PAGE_MASK) & ~LARGE_PAGE_MASK;
+        pair.m_ptr = (char *) mmap(NULL, bytes + LARGE_PAGE_SIZE, PROT_NONE,
+                                   MAP_ANON|MAP_PRIVATE|MAP_NORESERVE, -1, 0);
+    }
+    if (pair.m_ptr == MAP_FAILED)
         return LS_FAIL;
     if (((unsigned long)pair.m_ptr & LARGE_PAGE_MASK) == 0)
         bytes += LARGE_PAGE_SIZE;
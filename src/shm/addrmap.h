@@ -10,6 +10,7 @@
 #define LARGE_PAGE_SIZE  0x100000l    //1MB
 #define LARGE_PAGE_MASK  0xfffffl
 #define LARGE_PAGE_BITS  20
+#define ADDR_RESERVE_MAX ((sizeof(void *) > 4) ? 0x40000000l : 0x4000000l)
 
 struct AddrOffPair
 {
@@ -57,6 +57,11 @@ int ls_expandfile(int fd, LsShmOffset_t fromsize, LsShmXSize_t incrsize)
     if (newsize <= fromsize)
         return 0;
 
+#if defined(__linux__)
+    //one call instead of touching every page with the lock held.
+    if (posix_fallocate(fd, (off_t)fromsize, (off_t)incrsize) == 0)
+        return 0;
+#endif
     fromloc = fromsize++;
     do
     {
@@ -818,11 +823,21 @@ LsShmOffset_t LsShm::allocPage(LsShmSize_t pagesize, int &remap)
 
         if (needSize > 0)
         {
-            LsShmXSize_t targetSize = x_pShmMap->x_stat.m_iFileSize + needSize;
+            LsShmXSize_t fileSize = x_pShmMap->x_stat.m_iFileSize;
+            LsShmXSize_t targetSize = fileSize + needSize;
             targetSize = (targetSize + (16 * LSSHM_SHM_UNITSIZE - 1)) &
                             ~(16 * LSSHM_SHM_UNITSIZE - 1);
-
-            if (expand(targetSize - x_pShmMap->x_stat.m_iFileSize) != LSSHM_OK)
+            //grow by a fraction of the file, every worker remaps after
+            //a growth so fewer larger steps stall them less often.
+            LsShmXSize_t growSize = fileSize / 8;
+            if (growSize > LSSHM_MAXGROWSIZE)
+                growSize = LSSHM_MAXGROWSIZE;
+            growSize = (fileSize + growSize + (LSSHM_PAGESIZE - 1))
+                       & ~(LSSHM_PAGESIZE - 1);
+
+            if (((growSize <= targetSize)
+                 || (expand(growSize - fileSize) != LSSHM_OK))
+                && (expand(targetSize - fileSize) != LSSHM_OK))
             {
                 offset = 0;
                 goto out;
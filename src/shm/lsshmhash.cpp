@@ -17,6 +17,7 @@
 *****************************************************************************/
 #include <shm/lsshmhash.h>
 
+#include <lsr/ls_atomic.h>
 #include <lsr/xxhash.h>
 #include <shm/lsshmpool.h>
 #include <shm/lsshmtidmgr.h>
@@ -42,6 +43,21 @@ struct LsHashLruInfo_s
 };
 
 
+// Sequence counters for lock free lookups, odd while a writer is changing
+// the buckets mapped to the slot, or the whole index on rehash.
+#define LSSHM_SEQ_SLOTS     32
+#define LSSHM_SEQ_RETRY     3
+
+// old buckets moved to the new index by each locked operation in rehash
+#define LSSHM_REHASH_STEP   64
+
+typedef struct
+{
+    uint32_t        x_iTableSeq;
+    uint32_t        x_aSlotSeq[LSSHM_SEQ_SLOTS];
+} LsShmHSeq;
+
+
 static int s_tidOffset[2] = { 
     sizeof(LsShmTidInfo), 
     sizeof(LsShmTidInfo) + sizeof(LsHashLruInfo_s)   
@@ -66,7 +82,17 @@ typedef struct ls_shmhtable_s
     uint8_t         x_iFlags;
     uint8_t         x_unused[2];
     LsShmHTableStat x_stat;         // hash statistics
+    // LSSHM_HTABLE_RESERVED_SIZE bytes for the user of the hash first,
+    // the rest is for the hash itself.
     uint8_t         x_reserved[256];
+
+    LsShmHSeq       *getSeq()
+    {   return (LsShmHSeq *)&x_reserved[LSSHM_HTABLE_RESERVED_SIZE];  }
+
+    // buckets of the old index below it have been moved in rehash
+    LsShmSize_t     *getRehashIdx()
+    {   return (LsShmSize_t *)&x_reserved[LSSHM_HTABLE_RESERVED_SIZE
+                                          + sizeof(LsShmHSeq)];  }
     
     LsHashLruInfo_s *getLruInfo()
     {   return (LsHashLruInfo_s *)&x_reserved[sizeof(x_reserved) 
@@ -77,6 +103,11 @@ typedef struct ls_shmhtable_s
                           - s_tidOffset[x_iMode & LSSHM_FLAG_LRU]]; }
 } LsShmHTable;
 
+static_assert(LSSHM_HTABLE_RESERVED_SIZE + sizeof(LsShmHSeq)
+              + sizeof(LsShmSize_t) + sizeof(LsShmTidInfo)
+              + sizeof(LsHashLruInfo_s) <= sizeof(((LsShmHTable *)0)->x_reserved),
+              "LsShmHTable reserved space overflow");
+
 
 struct lsshmobsiter_s
 {
@@ -261,6 +292,28 @@ inline LsShmHIterOff *LsShmHash::getHidx(uint32_t idx) const
                                         idx * sizeof(LsShmHIterOff));   }
 
 
+//While rehash is in progress the buckets of the old index below the rehash
+//index have been moved to the new one, an element is always in the bucket
+//returned. The bitmap belongs to the new index, inNew tells if it applies.
+inline LsShmHIterOff *LsShmHash::getBucket(LsShmHKey key, uint32_t &hashIndx,
+                                           int &inNew) const
+{
+    LsShmHTable *pTable = getHTable();
+    hashIndx = getIndex(key, pTable->x_iCapacity);
+    inNew = 1;
+    if (pTable->x_iHIdx == pTable->x_iHIdxNew)
+        return getHidx(hashIndx);
+    if (hashIndx >= *pTable->getRehashIdx())
+    {
+        inNew = 0;
+        return getHidx(hashIndx);
+    }
+    hashIndx = getIndex(key, pTable->x_iCapacityNew);
+    return (LsShmHIterOff *)m_pPool->offset2ptr(pTable->x_iHIdxNew
+                                        + hashIndx * sizeof(LsShmHIterOff));
+}
+
+
 inline uint8_t *LsShmHash::getBitMap(uint32_t idx) const
 {
     LsShmHTable *pTable = getHTable();
@@ -272,15 +325,57 @@ inline uint8_t *LsShmHash::getBitMap(uint32_t idx) const
 
 void LsShmHash::lockChkRehash()
 {
-    if ((lock() < 0) && (getHTable()->x_iHIdx != getHTable()->x_iHIdxNew))
-        rehash();
+    lock();
+    if (getHTable()->x_iHIdx != getHTable()->x_iHIdxNew)
+        rehashStep(LSSHM_REHASH_STEP);
 }
 
 
 void LsShmHash::autoLockChkRehash()
 {
-    if ((autoLock() < 0) && (getHTable()->x_iHIdx != getHTable()->x_iHIdxNew))
-        rehash();
+    autoLock();
+    if (getHTable()->x_iHIdx != getHTable()->x_iHIdxNew)
+        rehashStep(LSSHM_REHASH_STEP);
+}
+
+
+//A writer that died half way leaves a counter odd, begin always ends odd
+//and end always ends even so the next write repairs it.
+static inline void seqBegin(uint32_t *pSeq)
+{
+    *(volatile uint32_t *)pSeq = (*pSeq + 1) | 1;
+    ls_barrier();
+}
+
+
+static inline void seqEnd(uint32_t *pSeq)
+{
+    ls_barrier();
+    *(volatile uint32_t *)pSeq = (*pSeq + 1) & ~1;
+}
+
+
+void LsShmHash::seqBucketBegin(uint32_t hashIndx)
+{
+    seqBegin(&getHTable()->getSeq()->x_aSlotSeq[hashIndx % LSSHM_SEQ_SLOTS]);
+}
+
+
+void LsShmHash::seqBucketEnd(uint32_t hashIndx)
+{
+    seqEnd(&getHTable()->getSeq()->x_aSlotSeq[hashIndx % LSSHM_SEQ_SLOTS]);
+}
+
+
+void LsShmHash::seqTableBegin()
+{
+    seqBegin(&getHTable()->getSeq()->x_iTableSeq);
+}
+
+
+void LsShmHash::seqTableEnd()
+{
+    seqEnd(&getHTable()->getSeq()->x_iTableSeq);
 }
 
 
@@ -642,6 +737,15 @@ void LsShmHash::releaseHTableShm()
     if (m_iOffset != 0)
     {
         LsShmHTable *pTable = getHTable();
+        if (pTable->x_iHIdx != pTable->x_iHIdxNew)
+        {
+            m_pPool->release2(
+                pTable->x_iHIdx - sz2BitMapSz(pTable->x_iCapacity),
+                sz2BitMapSz(pTable->x_iCapacity)
+                + sz2TableSz(pTable->x_iCapacity));
+            pTable = getHTable();
+            pTable->x_iCapacity = pTable->x_iCapacityNew;
+        }
         if (pTable->x_iBitMap != 0)
         {
             m_pPool->release2(pTable->x_iBitMap,
@@ -692,101 +796,120 @@ void LsShmHash::destroy()
 }
 
 
+//Starts growing the index, the buckets are moved over by rehashStep() a
+//few at a time so no single operation has to move the whole table.
 int LsShmHash::rehash()
 {
-    LsShmSize_t oldSize = capacity();
-    LsShmSize_t newSize;
-    LsShmOffset_t newIdxOff;
-    LsShmOffset_t newBitOff;
+    LsShmHTable *pTable = getHTable();
+    if (pTable->x_iHIdx == pTable->x_iHIdxNew)
+    {
+        int remapped;
+        LsShmSize_t newSize = s_primeList[findRange(capacity()) + growFactor()];
+        int szTable = sz2TableSz(newSize);
+        int szBitMap = sz2BitMapSz(newSize);
+        LsShmOffset_t newBitOff;
+#ifdef DEBUG_RUN
+        SHM_NOTICE("LsShmHash::rehash %6d %X size %d cap %d NEW %d",
+                   getpid(), m_pPool->getShmMap(),
+                   size(),
+                   capacity(),
+                   newSize
+                  );
+#endif
+        if ((newBitOff = alloc2(szTable + szBitMap, remapped)) == 0)
+            return LS_FAIL;
+        ::memset(offset2ptr(newBitOff), 0, szTable + szBitMap);
+        pTable = getHTable();
+        seqTableBegin();
+        pTable->x_iBitMap = newBitOff;
+        pTable->x_iBitMapSz = szBitMap;
+        pTable->x_iCapacityNew = newSize;
+        *pTable->getRehashIdx() = 0;
+        pTable->x_iHIdxNew = newBitOff + szBitMap;
+        seqTableEnd();
+    }
+    rehashStep(LSSHM_REHASH_STEP);
+    return 0;
+}
+
+
+void LsShmHash::rehashStep(LsShmSize_t buckets)
+{
+    LsShmHTable *pTable = getHTable();
+    LsShmSize_t oldSize = pTable->x_iCapacity;
+    LsShmSize_t newSize = pTable->x_iCapacityNew;
+    LsShmSize_t *pRehashIdx = pTable->getRehashIdx();
     LsShmHIterOff *pIdxOld;
     LsShmHIterOff *pIdxNew;
     LsShmHIterOff *opIdx;
     LsShmHIterOff *npIdx;
     iterator iter;
     iteroffset iterOff;
-    iteroffset iterNextOff;
-    int szTable;
-    int szBitMap;
+    uint32_t hashIndx;
     uint count = 0;
-#ifdef DEBUG_RUN
-    SHM_NOTICE("LsShmHash::rehash %6d %X size %d cap %d NEW %d",
-               getpid(), m_pPool->getShmMap(),
-               size(),
-               oldSize,
-               s_primeList[findRange(oldSize) + growFactor()]
-              );
-#endif
-    LsShmHTable *pTable = getHTable();
+
     pIdxOld = (LsShmHIterOff *)m_pPool->offset2ptr(pTable->x_iHIdx);
-    if (pTable->x_iHIdx != pTable->x_iHIdxNew)          // rehash in progress
+    pIdxNew = (LsShmHIterOff *)m_pPool->offset2ptr(pTable->x_iHIdxNew);
+    seqTableBegin();
+    if ((iterOff.m_iOffset = pTable->x_iWorkIterOff) != 0)    // iter in progress
     {
-        newSize = pTable->x_iCapacityNew;
-        newIdxOff = pTable->x_iHIdxNew;
-        pIdxNew = (LsShmHIterOff *)m_pPool->offset2ptr(newIdxOff);
-        if ((iterOff.m_iOffset = pTable->x_iWorkIterOff) != 0)    // iter in progress
+        iter = offset2iterator(iterOff);
+        npIdx = pIdxNew + getIndex(iter->x_hkey, newSize);
+        if (npIdx->m_iOffset != iterOff.m_iOffset)            // not there yet
+        {
+            opIdx = pIdxOld + getIndex(iter->x_hkey, oldSize);
+            if (opIdx->m_iOffset == iterOff.m_iOffset)
+                opIdx->m_iOffset = iter->x_iNext.m_iOffset;   // remove from old
+            iter->x_iNext.m_iOffset = npIdx->m_iOffset;
+            npIdx->m_iOffset = iterOff.m_iOffset;
+        }
+        pTable->x_iWorkIterOff = 0;
+    }
+
+    while ((buckets > 0) && (*pRehashIdx < oldSize))
+    {
+        opIdx = pIdxOld + *pRehashIdx;
+        while ((iterOff.m_iOffset = opIdx->m_iOffset) != 0)
         {
             iter = offset2iterator(iterOff);
-            npIdx = pIdxNew + getIndex(iter->x_hkey, newSize);
-            if (npIdx->m_iOffset != iterOff.m_iOffset)            // not there yet
+            hashIndx = getIndex(iter->x_hkey, newSize);
+            npIdx = pIdxNew + hashIndx;
+            setBitMapEnt(hashIndx);
+            pTable->x_iWorkIterOff = iterOff.m_iOffset;
+            opIdx->m_iOffset = iter->x_iNext.m_iOffset;
+            iter->x_iNext.m_iOffset = npIdx->m_iOffset;
+            npIdx->m_iOffset = iterOff.m_iOffset;
+            if (++count > size() + 1)
             {
-                opIdx = pIdxOld + getIndex(iter->x_hkey, oldSize);
-                if (opIdx->m_iOffset == iterOff.m_iOffset)
-                    opIdx->m_iOffset = iter->x_iNext.m_iOffset;   // remove from old
-                iter->x_iNext.m_iOffset = npIdx->m_iOffset;
-                npIdx->m_iOffset = iterOff.m_iOffset;
+                fprintf(stderr, "LsShmHash::rehash() is in a infinity loop, likely due to SHM corruption. remove corrupted file.");
+                getPool()->getShm()->tryRecoverCorruption();
+                abort();
             }
-
         }
+        pTable->x_iWorkIterOff = 0;
+        ++*pRehashIdx;
+        --buckets;
     }
-    else
+
+    if (*pRehashIdx >= oldSize)
     {
-        int remapped;
-        newSize = s_primeList[findRange(oldSize) + growFactor()];
-        szTable = sz2TableSz(newSize);
-        szBitMap = sz2BitMapSz(newSize);
-        if ((newBitOff = alloc2(szTable + szBitMap, remapped)) == 0)
-            return LS_FAIL;
-        uint8_t *ptr = (uint8_t *)offset2ptr(newBitOff);
-        ::memset(ptr, 0, szTable + szBitMap);
-        newIdxOff = newBitOff + szBitMap;
-        pIdxNew = (LsShmHIterOff *)(ptr + szBitMap);
+        int szTable = sz2TableSz(oldSize);
+        int szBitMap = sz2BitMapSz(oldSize);
+        release2(pTable->x_iHIdx - szBitMap, szTable + szBitMap);
         pTable = getHTable();
-        pTable->x_iBitMap = newBitOff;
-        pTable->x_iBitMapSz = szBitMap;
-        pTable->x_iCapacityNew = newSize;
-        pTable->x_iHIdxNew = newIdxOff;
-        iterOff = begin();
+        pTable->x_iCapacity = newSize;
+        pTable->x_iHIdx = pTable->x_iHIdxNew;
+        *pTable->getRehashIdx() = 0;
     }
+    seqTableEnd();
+}
 
-    pIdxOld = (LsShmHIterOff *)m_pPool->offset2ptr(pTable->x_iHIdx);
-    while(iterOff.m_iOffset != 0)
-    {
-        uint32_t hashIndx;
-        iter = offset2iterator(iterOff);
-        iterNextOff = next(iterOff);
-        hashIndx = getIndex(iter->x_hkey, newSize);
-        npIdx = pIdxNew + hashIndx;
-        setBitMapEnt(hashIndx);
-        pTable->x_iWorkIterOff = iterOff.m_iOffset;
-        (pIdxOld + getIndex(iter->x_hkey, oldSize))->m_iOffset = iter->x_iNext.m_iOffset;
-        iter->x_iNext.m_iOffset = npIdx->m_iOffset;
-        npIdx->m_iOffset = iterOff.m_iOffset;
-        iterOff = iterNextOff;
-        if (++count > oldSize + oldSize / 2)
-        {
-            fprintf(stderr, "LsShmHash::rehash() is in a infinity loop, likely due to SHM corruption. remove corrupted file.");
-            getPool()->getShm()->tryRecoverCorruption();
-            abort();
-        }
-    }
-    pTable->x_iWorkIterOff = 0;
 
-    szTable = sz2TableSz(oldSize);
-    szBitMap = sz2BitMapSz(oldSize);
-    release2(pTable->x_iHIdx - szBitMap, szTable + szBitMap);
-    pTable->x_iCapacity = newSize;
-    pTable->x_iHIdx = newIdxOff;
-    return 0;
+void LsShmHash::finishRehash()
+{
+    LsShmHTable *pTable = getHTable();
+    if (pTable->x_iHIdx != pTable->x_iHIdxNew)
+        rehashStep(pTable->x_iCapacity);
 }
 
 
@@ -802,13 +925,16 @@ int LsShmHash::release_hash_elem(LsShmHash::iteroffset iterOff,
 
 void LsShmHash::clear()
 {
+    finishRehash();
     LsShmHTable *pTable = getHTable();
     int n = for_each2(begin(), end(), release_hash_elem, this);
     assert(n == (int)size());
 
+    seqTableBegin();
     ::memset(offset2ptr(pTable->x_iBitMap), 0,
         pTable->x_iBitMapSz + sz2TableSz(pTable->x_iCapacity));
     pTable->x_iSize = 0;
+    seqTableEnd();
     if (m_iFlags & LSSHM_FLAG_LRU)
     {
         LsHashLruInfo *pLru = getLru();
@@ -880,8 +1006,14 @@ LsShmHash::iteroffset LsShmHash::doSet(
         iterator iter = offset2iterator(iterOff);
         if (iter->realValLen() >= (LsShmSize_t)ls_str_len(&pParms->val))
         {
+            //rewritten in place, copyNoLock() must not see it half done
+            uint32_t hashIndx;
+            int inNew;
+            getBucket(iter->x_hkey, hashIndx, inNew);
+            seqBucketBegin(hashIndx);
             iter->setValLen(ls_str_len(&pParms->val));
             setIterData(iter, ls_str_buf(&pParms->val));
+            seqBucketEnd(hashIndx);
             if (m_iFlags & LSSHM_FLAG_LRU)
                 lruMarkNewest(iter, iterOff);
             if (m_pTidMgr != NULL && isTidMaster())
@@ -924,9 +1056,9 @@ uint64_t LsShmHash::doUpdateTid(iteroffset iterOff)
 
 void LsShmHash::remove(iteroffset iterOff, iterator iter)
 {
-
-    uint32_t hashIndx = getIndex(iter->x_hkey, capacity());
-    LsShmHIterOff *pIdx = getHidx(hashIndx);
+    uint32_t hashIndx;
+    int inNew;
+    LsShmHIterOff *pIdx = getBucket(iter->x_hkey, hashIndx, inNew);
     LsShmOffset_t offset = pIdx->m_iOffset;
     LsShmHElem *pElem;
     LsShmOffset_t next = iter->x_iNext.m_iOffset;     // in case of remap in tid list
@@ -955,11 +1087,12 @@ void LsShmHash::remove(iteroffset iterOff, iterator iter)
     if (m_pTidMgr != NULL)
     {
         m_pTidMgr->eraseIterCb(iter);
-        pIdx = getHidx(hashIndx);
+        pIdx = getBucket(iter->x_hkey, hashIndx, inNew);
     }
+    seqBucketBegin(hashIndx);
     if (offset == iterOff.m_iOffset)
     {
-        if ((pIdx->m_iOffset = next) == 0) // last one
+        if (((pIdx->m_iOffset = next) == 0) && inNew) // last one
             clrBitMapEnt(hashIndx);
     }
     else
@@ -976,6 +1109,7 @@ void LsShmHash::remove(iteroffset iterOff, iterator iter)
             offset = pElem->x_iNext.m_iOffset;
         }
     }
+    seqBucketEnd(hashIndx);
 
     decrTableSize();
     if (m_iFlags & LSSHM_FLAG_LRU)
@@ -1019,10 +1153,11 @@ LsShmHash::iteroffset LsShmHash::find2(LsShmHKey key,
 {
     assert(m_pPool->getShm()->isLocked(m_pShmLock));
 
-    uint32_t hashIndx = getIndex(key, capacity());
-    if (getBitMapEnt(hashIndx) == 0)     // quick check
+    uint32_t hashIndx;
+    int inNew;
+    LsShmHIterOff *pIdx = getBucket(key, hashIndx, inNew);
+    if (inNew && (getBitMapEnt(hashIndx) == 0))     // quick check
         return end();
-    LsShmHIterOff *pIdx = getHidx(hashIndx);
 
 #ifdef DEBUG_RUN
     SHM_NOTICE("LsShmHash::find %6d %X size %d cap %d <%p> %d",
@@ -1050,6 +1185,186 @@ LsShmHash::iteroffset LsShmHash::find2(LsShmHKey key,
 }
 
 
+//Walks a chain with no lock held. The chain may be changed or freed under
+//the walk, so every offset is checked against what this process has
+//mapped and the walk is bounded; the caller validates the result with the
+//sequence counters. LS_FAIL means the walk could not be trusted.
+int LsShmHash::findUnlocked(LsShmHKey key, ls_strpair_t *pParms,
+                            iteroffset *pIterOff)
+{
+    LsShmHTable *pTable = getHTable();
+    LsShmXSize_t maxOff = m_pPool->getShm()->oldMaxSize();
+    LsShmSize_t steps = pTable->x_iSize + 1;
+    int keyLen = (m_hf != NULL) ? ls_str_len(&pParms->key)
+                                : (int)sizeof(LsShmHKey);
+    LsShmHElem *pElem;
+    uint32_t hashIndx;
+    int inNew;
+    LsShmOffset_t offset = ptr2offset(getBucket(key, hashIndx, inNew));
+
+    pIterOff->m_iOffset = 0;
+    if (offset + sizeof(LsShmHIterOff) > maxOff)
+        return LS_FAIL;
+    offset = ((LsShmHIterOff *)m_pPool->offset2ptr(offset))->m_iOffset;
+    while (offset != 0)
+    {
+        if ((steps-- == 0) || (offset + sizeof(LsShmHElem)
+                + sizeof(ls_vardata_t) + keyLen > maxOff))
+            return LS_FAIL;
+        pElem = (LsShmHElem *)m_pPool->offset2ptr(offset);
+        if ((pElem->x_hkey == key) && (pElem->getKeyLen() == keyLen))
+        {
+            if (offset + (LsShmSize_t)pElem->x_iLen > maxOff)
+                return LS_FAIL;
+            if (m_hf == NULL)
+            {
+                if (*(LsShmHKey *)pElem->getKey() == key)
+                    break;
+            }
+            else if ((*m_vc)(ls_str_buf(&pParms->key), pElem->getKey(),
+                             keyLen) == 0)
+                break;
+        }
+        offset = pElem->x_iNext.m_iOffset;
+    }
+    pIterOff->m_iOffset = offset;
+    return LS_OK;
+}
+
+
+//one lock free walk for key, checked against the sequence counters.
+//If pIov is set, the value is copied out before the check so the copy
+//is known to be consistent. Returns LS_FAIL if a writer got in the way.
+int LsShmHash::findSeq(LsShmHKey key, ls_strpair_t *pParms,
+                       iteroffset *pIterOff, const struct iovec *pIov,
+                       int iovCnt, int *pValLen)
+{
+    LsShmHTable *pTable;
+    uint32_t hashIndx;
+    int inNew;
+    volatile uint32_t *pTableSeq;
+    volatile uint32_t *pSlotSeq;
+    uint32_t tableSeq;
+    uint32_t slotSeq;
+
+    pTable = getHTable();
+    pTableSeq = &pTable->getSeq()->x_iTableSeq;
+    ls_atomic_load(tableSeq, pTableSeq);
+    if (tableSeq & 1)
+        return LS_FAIL;
+    getBucket(key, hashIndx, inNew);
+    pSlotSeq = &pTable->getSeq()->x_aSlotSeq[hashIndx % LSSHM_SEQ_SLOTS];
+    ls_atomic_load(slotSeq, pSlotSeq);
+    if (slotSeq & 1)
+        return LS_FAIL;
+    if (findUnlocked(key, pParms, pIterOff) == LS_FAIL)
+        return LS_FAIL;
+    *pValLen = 0;
+    if ((pIterOff->m_iOffset != 0) && (pIov != NULL))
+    {
+        iterator iter = offset2iterator(*pIterOff);
+        *pValLen = copyVal(iter, pIov, iovCnt);
+    }
+    ls_barrier();
+    if ((*pSlotSeq != slotSeq) || (*pTableSeq != tableSeq))
+        return LS_FAIL;
+    return LS_OK;
+}
+
+
+int LsShmHash::copyVal(iterator iter, const struct iovec *pIov,
+                       int iovCnt)
+{
+    LsShmHElemLen_t elemLen = iter->x_iLen;
+    LsShmHElemOffs_t valOff = iter->x_iValOff;
+    const uint8_t *pVal;
+    int valLen;
+    int left;
+    int n;
+
+    //keep inside the element even if a racing writer changed it
+    if ((sizeof(LsShmHElem) + valOff + sizeof(ls_vardata_t)
+            > (LsShmSize_t)elemLen)
+        || (m_pPool->ptr2offset(iter) + (LsShmSize_t)elemLen
+            > m_pPool->getShm()->oldMaxSize()))
+        return 0;
+    pVal = (uint8_t *)iter->x_aData + valOff + sizeof(ls_vardata_t);
+    valLen = ((ls_vardata_t *)((uint8_t *)iter->x_aData + valOff))->x_size;
+    left = elemLen - (pVal - (uint8_t *)iter);
+    if ((valLen >= 0) && (valLen < left))
+        left = valLen;
+    for (; (iovCnt > 0) && (left > 0); ++pIov, --iovCnt)
+    {
+        n = ((int)pIov->iov_len < left) ? (int)pIov->iov_len : left;
+        memmove(pIov->iov_base, pVal, n);
+        pVal += n;
+        left -= n;
+    }
+    return valLen;
+}
+
+
+LsShmOffset_t LsShmHash::findNoLock(const void *pKey, int keyLen,
+                                    int *valLen)
+{
+    ls_strpair_t parms;
+    iteroffset iterOff;
+    LsShmHKey key;
+    int i;
+
+    ls_str_set(&parms.key, (char *)pKey, keyLen);
+    key = (m_hf != NULL) ? (*m_hf)(pKey, keyLen) : (LsShmHKey)(long)pKey;
+    for (i = 0; i < LSSHM_SEQ_RETRY; ++i)
+    {
+        if (findSeq(key, &parms, &iterOff, NULL, 0, valLen) == LS_FAIL)
+            continue;
+        if (iterOff.m_iOffset == 0)
+            return 0;
+        //the element was linked when the counters were read, an entry
+        //removed after this is no different from one found by find().
+        iterator iter = offset2iterator(iterOff);
+        *valLen = iter->getValLen();
+        return ptr2offset(iter->getVal());
+    }
+
+    if (m_iAutoLock)
+        return find(pKey, keyLen, valLen);
+    lock();
+    LsShmOffset_t offVal = find(pKey, keyLen, valLen);
+    unlock();
+    return offVal;
+}
+
+
+int LsShmHash::copyNoLock(const void *pKey, int keyLen,
+                          const struct iovec *pIov, int iovCnt)
+{
+    ls_strpair_t parms;
+    iteroffset iterOff;
+    LsShmHKey key;
+    int valLen;
+    int i;
+
+    ls_str_set(&parms.key, (char *)pKey, keyLen);
+    key = (m_hf != NULL) ? (*m_hf)(pKey, keyLen) : (LsShmHKey)(long)pKey;
+    for (i = 0; i < LSSHM_SEQ_RETRY; ++i)
+    {
+        if (findSeq(key, &parms, &iterOff, pIov, iovCnt, &valLen) == LS_OK)
+            return valLen;
+    }
+
+    valLen = 0;
+    lock();
+    autoLockChkRehash();
+    iterOff = (*m_find)(this, &parms);
+    if (iterOff.m_iOffset != 0)
+        valLen = copyVal(offset2iterator(iterOff), pIov, iovCnt);
+    autoUnlock();
+    unlock();
+    return valLen;
+}
+
+
 LsShmHash::iteroffset LsShmHash::allocIter(int keyLen, int realValLen)
 {
     LsShmHElemOffs_t valueOff = sizeof(ls_vardata_t) + round4(keyLen)
@@ -1084,7 +1399,7 @@ LsShmHash::iteroffset LsShmHash::insert2(
 
 
 LsShmHash::iteroffset LsShmHash::insertCopy2(LsShmHKey key,
-        ls_strpair_t *pParms)
+        ls_strpair_t *pParms, const struct iovec *pIov, int iovCnt)
 {
     assert(m_pPool->getShm()->isLocked(m_pShmLock));
 
@@ -1110,19 +1425,68 @@ LsShmHash::iteroffset LsShmHash::insertCopy2(LsShmHKey key,
 
     setIterKey(pNew, ls_str_buf(&pParms->key));
     setIterData(pNew, ls_str_buf(&pParms->val));
+    if (pIov != NULL)
+        gatherVal(pNew, pIov, iovCnt);
 
     insertAlloced(offset, pNew);
     return offset;
 }
 
 
+void LsShmHash::gatherVal(iterator iter, const struct iovec *pIov,
+                          int iovCnt)
+{
+    uint8_t *pVal = iter->getVal();
+    for (; iovCnt > 0; ++pIov, --iovCnt)
+    {
+        memmove(pVal, pIov->iov_base, pIov->iov_len);
+        pVal += pIov->iov_len;
+    }
+}
+
+
+LsShmOffset_t LsShmHash::insertIov(const void *pKey, int keyLen,
+                                   const struct iovec *pIov, int iovCnt)
+{
+    ls_strpair_t parms;
+    iteroffset iterOff;
+    LsShmHKey key;
+    int valLen = 0;
+    int i;
+
+    for (i = 0; i < iovCnt; ++i)
+        valLen += pIov[i].iov_len;
+    if ((valLen < 0) || (valLen > LSSHM_MAXSIZE))
+        return 0;
+    setParms(&parms, pKey, keyLen, NULL, valLen);
+    key = (m_hf != NULL) ? (*m_hf)(pKey, keyLen) : (LsShmHKey)(long)pKey;
+    autoLockChkRehash();
+    iterOff = find2(key, &parms);
+    if (iterOff.m_iOffset != 0)
+        iterOff.m_iOffset = 0;
+    else
+    {
+        iterOff = insertCopy2(key, &parms, pIov, iovCnt);
+        if (m_pTidMgr != NULL && isTidMaster())
+            m_pTidMgr->insertIterCb(iterOff);
+    }
+    autoUnlock();
+    return (iterOff.m_iOffset == 0) ?
+           0 : ptr2offset(offset2iteratorData(iterOff));
+}
+
+
 void LsShmHash::insertAlloced(iteroffset iterOff, iterator iter)
 {
-    uint32_t hashIndx = getIndex(iter->x_hkey, capacity());
-    LsShmHIterOff *pIdx = getHidx(hashIndx);
+    uint32_t hashIndx;
+    int inNew;
+    LsShmHIterOff *pIdx = getBucket(iter->x_hkey, hashIndx, inNew);
+    seqBucketBegin(hashIndx);
     iter->x_iNext.m_iOffset = pIdx->m_iOffset;
     pIdx->m_iOffset = iterOff.m_iOffset;
-    setBitMapEnt(hashIndx);
+    if (inNew)
+        setBitMapEnt(hashIndx);
+    seqBucketEnd(hashIndx);
 
 #ifdef DEBUG_RUN
     SHM_NOTICE("LsShmHash::insert %6d %X size %d cap %d <%p> %d",
@@ -1161,8 +1525,9 @@ void LsShmHash::replace(iteroffset oldIterOff, iterator oldIter,
         return;
 
     LsShmSize_t size = oldIter->x_iLen;
-    uint32_t hashIndx = getIndex(oldIter->x_hkey, capacity());
-    LsShmHIterOff *pIdx = getHidx(hashIndx);
+    uint32_t hashIndx;
+    int inNew;
+    LsShmHIterOff *pIdx = getBucket(oldIter->x_hkey, hashIndx, inNew);
     LsShmOffset_t offset = pIdx->m_iOffset;
     LsShmHElem *pElem;
     LsShmOffset_t next = oldIter->x_iNext.m_iOffset;     // in case of remap in tid list
@@ -1191,9 +1556,10 @@ void LsShmHash::replace(iteroffset oldIterOff, iterator oldIter,
     if (m_pTidMgr != NULL)
     {
         m_pTidMgr->eraseIterCb(oldIter);
-        pIdx = getHidx(hashIndx);
+        pIdx = getBucket(oldIter->x_hkey, hashIndx, inNew);
     }
 
+    seqBucketBegin(hashIndx);
     if (offset == oldIterOff.m_iOffset)
     {
         pIdx->m_iOffset = newIterOff.m_iOffset;
@@ -1216,6 +1582,7 @@ void LsShmHash::replace(iteroffset oldIterOff, iterator oldIter,
             offset = pElem->x_iNext.m_iOffset;
         }
     }
+    seqBucketEnd(hashIndx);
 
     if (m_iFlags & LSSHM_FLAG_LRU)
     {
@@ -1275,11 +1642,15 @@ LsShmHash::iteroffset LsShmHash::iterGrowValue(iteroffset iterOff,
         pNew = offset2iterator(offset);
     }
 
-    uint32_t hashIndx = getIndex(pNew->x_hkey, capacity());
-    LsShmHIterOff *pIdx = getHidx(hashIndx);
+    uint32_t hashIndx;
+    int inNew;
+    LsShmHIterOff *pIdx = getBucket(pNew->x_hkey, hashIndx, inNew);
+    seqBucketBegin(hashIndx);
     pNew->x_iNext.m_iOffset = pIdx->m_iOffset;
     pIdx->m_iOffset = offset.m_iOffset;
-    setBitMapEnt(hashIndx);
+    if (inNew)
+        setBitMapEnt(hashIndx);
+    seqBucketEnd(hashIndx);
 
     incrTableSize();
     return offset;
@@ -1293,10 +1664,11 @@ LsShmHash::iteroffset LsShmHash::findNum(LsShmHash *pThis, ls_strpair_t *pParms)
 {
     LsShmHash::iteroffset offset = {0};
     LsShmHKey key = (LsShmHKey)(long)ls_str_buf(&pParms->key);
-    uint32_t hashIndx = pThis->getIndex(key, pThis->capacity());
-    if (pThis->getBitMapEnt(hashIndx) == 0)     // quick check
+    uint32_t hashIndx;
+    int inNew;
+    LsShmHIterOff *pIdx = pThis->getBucket(key, hashIndx, inNew);
+    if (inNew && (pThis->getBitMapEnt(hashIndx) == 0))     // quick check
         return offset;
-    LsShmHIterOff *pIdx = pThis->getHidx(hashIndx);
     offset = *pIdx;
     LsShmHElem *pElem;
 
@@ -1458,17 +1830,40 @@ LsShmHash::iteroffset LsShmHash::begin()
     if (size() == 0)
         return end();
 
+    LsShmHIterOff *p = firstFrom(0);
+    return (p != NULL) ? *p : end();
+}
+
+
+//While rehash is in progress, positions from 0 to the new capacity are the
+//buckets of the new index, followed by the buckets of the old index not
+//moved yet.
+LsShmHIterOff *LsShmHash::firstFrom(uint32_t pos) const
+{
+    LsShmHTable *pTable = getHTable();
     LsShmHIterOff *p;
-    int i = 0;
-    int n = capacity();
-    while (i < n)
+    uint32_t n = pTable->x_iCapacity;
+    if (pTable->x_iHIdx != pTable->x_iHIdxNew)
     {
-        p = getHidx(i);
+        n = pTable->x_iCapacityNew;
+        p = (LsShmHIterOff *)m_pPool->offset2ptr(pTable->x_iHIdxNew);
+        for (; pos < n; ++pos)
+        {
+            if (p[pos].m_iOffset != 0)
+                return &p[pos];
+        }
+        pos -= n;
+        if (pos < *pTable->getRehashIdx())
+            pos = *pTable->getRehashIdx();
+        n = pTable->x_iCapacity;
+    }
+    for (; pos < n; ++pos)
+    {
+        p = getHidx(pos);
         if (p->m_iOffset != 0)
-            return *p;
-        ++i;
+            return p;
     }
-    return end();
+    return NULL;
 }
 
 
@@ -1490,37 +1885,32 @@ LsShmHash::iteroffset LsShmHash::next(iteroffset iterOff)
             return iter->x_iNext;
     }
     LsShmHIterOff *p;
-    int i = getIndex(iter->x_hkey, capacity()) + 1;
-    int n = capacity();
-    while (i < n)
+    uint32_t i;
+    int inNew;
+    getBucket(iter->x_hkey, i, inNew);
+    if (!inNew)
+        i += getHTable()->x_iCapacityNew;
+    while ((p = firstFrom(i + 1)) != NULL)
     {
-        p = getHidx(i);
-        if (p->m_iOffset != 0)
-        {
 #ifdef DEBUG_RUN
-            iterator xiter = (iterator)m_pPool->offset2ptr(p->m_iOffset);
-            if (xiter != NULL)
-            {
-                if ((xiter->getKeyLen() == 0)
-                    || (xiter->x_hkey == 0)
-                    || (xiter->x_iLen == 0))
-                {
-                    SHM_NOTICE(
-                        "LsShmHash::next PROBLEM %6d %X SLEEPING",
-                        getpid(), m_pPool->getShmMap());
-                    sleep(10);
-                }
-            }
-#endif
-            if ((*p).m_iOffset == iterOff.m_iOffset)
+        iterator xiter = (iterator)m_pPool->offset2ptr(p->m_iOffset);
+        if (xiter != NULL)
+        {
+            if ((xiter->getKeyLen() == 0)
+                || (xiter->x_hkey == 0)
+                || (xiter->x_iLen == 0))
             {
-                (*p).m_iOffset = 0;
-                //assert("looping next offset detected" == 0);
+                SHM_NOTICE(
+                    "LsShmHash::next PROBLEM %6d %X SLEEPING",
+                    getpid(), m_pPool->getShmMap());
+                sleep(10);
             }
-            else
-                return *p;
         }
-        ++i;
+#endif
+        if ((*p).m_iOffset != iterOff.m_iOffset)
+            return *p;
+        (*p).m_iOffset = 0;
+        //assert("looping next offset detected" == 0);
     }
     return end();
 }
@@ -2137,6 +2527,7 @@ int LsShmHash::stat(LsHashStat *pHashStat, for_each_fn2 fun, void *pData)
     pHashStat->userData = pData;
 
     autoLockChkRehash();
+    finishRehash();
     // search each idx
     LsShmHIterOff *p;
     int i = 0;
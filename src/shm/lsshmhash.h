@@ -27,11 +27,17 @@ class debugBase;
 #include <shm/lsshm.h>
 #include <shm/lsshmpool.h>
 
+#include <sys/uio.h>
+
 #define LSSHM_FLAG_NONE         0
 #define LSSHM_FLAG_LRU          (1<<0)
 #define LSSHM_FLAG_TID          (1<<1)    // `transaction' id
 #define LSSHM_FLAG_TID_SLAVE    (1<<2)    // do *not* generate new tid, nor notify
 
+// bytes at getHTableReservedOffset() free for the user of a hash, the
+// rest of the table header is used by the hash itself.
+#define LSSHM_HTABLE_RESERVED_SIZE  24
+
 /**
  * @file
  *  HASH element
@@ -319,6 +325,23 @@ public:
         return ptr2offset(iter->getVal());
     }
 
+    //  Lookup without taking the lock, for tables mostly read. Writers
+    //  bump a sequence counter of the bucket they change; a walk that
+    //  raced with one is retried, then done with the lock held.
+    LsShmOffset_t findNoLock(const void *pKey, int keyLen, int *valLen);
+
+    //  Copy the value out without the lock, the copy is only returned if
+    //  no writer touched the bucket meanwhile. Returns the full value
+    //  length, 0 if not found; only what fits the iovecs is copied.
+    int copyNoLock(const void *pKey, int keyLen,
+                   const struct iovec *pIov, int iovCnt);
+
+    //  Insert a value gathered from the iovecs, filled in before it is
+    //  linked so copyNoLock() never sees it half written. Returns 0 if
+    //  the key exists already.
+    LsShmOffset_t insertIov(const void *pKey, int keyLen,
+                            const struct iovec *pIov, int iovCnt);
+
     LsShmOffset_t get(
         const void *pKey, int keyLen, int *valLen, int *pFlag)
     {
@@ -676,6 +699,9 @@ protected:
     LsShmSize_t growFactor() const;
 
     ls_attr_inline LsShmHIterOff *getHidx(uint32_t idx) const;
+    ls_attr_inline LsShmHIterOff *getBucket(LsShmHKey key, uint32_t &hashIndx,
+                                            int &inNew) const;
+    LsShmHIterOff *firstFrom(uint32_t pos) const;
 
     ls_attr_inline uint8_t *getBitMap(uint32_t indx) const;
     int getBitMapEnt(uint32_t indx);
@@ -683,9 +709,13 @@ protected:
     void clrBitMapEnt(uint32_t indx);
 
     int         rehash();
+    void        rehashStep(LsShmSize_t buckets);
+    void        finishRehash();
     iteroffset  find2(LsShmHKey key, ls_strpair_t *pParms);
     iteroffset  insert2(LsShmHKey key, ls_strpair_t *pParms);
-    iteroffset  insertCopy2(LsShmHKey key, ls_strpair_t *pParms);
+    iteroffset  insertCopy2(LsShmHKey key, ls_strpair_t *pParms,
+                            const struct iovec *pIov = NULL, int iovCnt = 0);
+    void gatherVal(iterator iter, const struct iovec *pIov, int iovCnt);
 
     static iteroffset findNum(LsShmHash *pThis, ls_strpair_t *pParms);
     static iteroffset getNum(LsShmHash *pThis, ls_strpair_t *pParms,
@@ -741,6 +771,17 @@ protected:
 
     void autoLockChkRehash();
 
+    // seqlock for findNoLock(), a begin/end pair around each change
+    void seqBucketBegin(uint32_t hashIndx);
+    void seqBucketEnd(uint32_t hashIndx);
+    void seqTableBegin();
+    void seqTableEnd();
+    int findUnlocked(LsShmHKey key, ls_strpair_t *pParms,
+                     iteroffset *pIterOff);
+    int findSeq(LsShmHKey key, ls_strpair_t *pParms, iteroffset *pIterOff,
+                const struct iovec *pIov, int iovCnt, int *pValLen);
+    int copyVal(iterator iter, const struct iovec *pIov, int iovCnt);
+
     // stat helper
     int statIdx(iteroffset iterOff, for_each_fn2 fun, void *pUData);
 
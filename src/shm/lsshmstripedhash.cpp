@@ -0,0 +1,115 @@
+/*****************************************************************************
+*    Open LiteSpeed is an open source HTTP server.                           *
+*    Copyright (C) 2013 - 2020  LiteSpeed Technologies, Inc.                 *
+*                                                                            *
+*    This program is free software: you can redistribute it and/or modify    *
+*    it under the terms of the GNU General Public License as published by    *
+*    the Free Software Foundation, either version 3 of the License, or       *
+*    (at your option) any later version.                                     *
+*                                                                            *
+*    This program is distributed in the hope that it will be useful,         *
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            *
+*    GNU General Public License for more details.                            *
+*                                                                            *
+*    You should have received a copy of the GNU General Public License       *
+*    along with this program. If not, see http://www.gnu.org/licenses/.      *
+*****************************************************************************/
+#include <shm/lsshmstripedhash.h>
+
+#include <shm/lsshmpool.h>
+
+#include <stdio.h>
+#include <string.h>
+
+
+LsShmStripedHash::LsShmStripedHash(LsShmHasher_fn hf, int stripes)
+    : m_hf(hf)
+    , m_iStripes(stripes)
+{
+    memset(m_pStripes, 0, sizeof(m_pStripes));
+}
+
+
+LsShmStripedHash::~LsShmStripedHash()
+{
+}
+
+
+LsShmStripedHash *LsShmStripedHash::get(LsShmPool *pPool, const char *name,
+                                        int stripes, LsShmSize_t init_size,
+                                        LsShmHasher_fn hf, LsShmValComp_fn vc,
+                                        int iFlags)
+{
+    char achName[LSSHM_MAXNAMELEN];
+    int i;
+
+    if ((stripes <= 0) || (stripes > LSSHM_MAX_STRIPES))
+        return NULL;
+    init_size = (init_size + stripes - 1) / stripes;
+
+    LsShmStripedHash *pStriped = new LsShmStripedHash(hf, stripes);
+    for (i = 0; i < stripes; ++i)
+    {
+        snprintf(achName, sizeof(achName), "%.8s.%02x", name, i);
+        if ((pStriped->m_pStripes[i] = pPool->getNamedHash(achName,
+                                       init_size, hf, vc, iFlags)) == NULL)
+        {
+            pStriped->close();
+            return NULL;
+        }
+    }
+    return pStriped;
+}
+
+
+void LsShmStripedHash::enableAutoLock()
+{
+    for (int i = 0; i < m_iStripes; ++i)
+        m_pStripes[i]->enableAutoLock();
+}
+
+
+void LsShmStripedHash::disableAutoLock()
+{
+    for (int i = 0; i < m_iStripes; ++i)
+        m_pStripes[i]->disableAutoLock();
+}
+
+
+int LsShmStripedHash::trim(time_t tmCutoff, LsShmHash::TrimCb cb, void *arg)
+{
+    int ret;
+    int num = 0;
+    LsShmHash *pHash;
+    for (int i = 0; i < m_iStripes; ++i)
+    {
+        pHash = m_pStripes[i];
+        pHash->lock();
+        ret = pHash->trim(tmCutoff, cb, arg);
+        pHash->unlock();
+        if (ret > 0)
+            num += ret;
+    }
+    return num;
+}
+
+
+LsShmSize_t LsShmStripedHash::size() const
+{
+    LsShmSize_t total = 0;
+    for (int i = 0; i < m_iStripes; ++i)
+        total += m_pStripes[i]->size();
+    return total;
+}
+
+
+void LsShmStripedHash::close()
+{
+    for (int i = 0; i < m_iStripes; ++i)
+    {
+        if (m_pStripes[i] != NULL)
+            m_pStripes[i]->close();
+    }
+    delete this;
+}
@@ -0,0 +1,81 @@
+/*****************************************************************************
+*    Open LiteSpeed is an open source HTTP server.                           *
+*    Copyright (C) 2013 - 2020  LiteSpeed Technologies, Inc.                 *
+*                                                                            *
+*    This program is free software: you can redistribute it and/or modify    *
+*    it under the terms of the GNU General Public License as published by    *
+*    the Free Software Foundation, either version 3 of the License, or       *
+*    (at your option) any later version.                                     *
+*                                                                            *
+*    This program is distributed in the hope that it will be useful,         *
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            *
+*    GNU General Public License for more details.                            *
+*                                                                            *
+*    You should have received a copy of the GNU General Public License       *
+*    along with this program. If not, see http://www.gnu.org/licenses/.      *
+*****************************************************************************/
+#ifndef LSSHMSTRIPEDHASH_H
+#define LSSHMSTRIPEDHASH_H
+
+#include <lsdef.h>
+#include <shm/lsshmhash.h>
+
+#define LSSHM_MAX_STRIPES       64
+
+/**
+ * @file
+ *  A hash table split into stripes by key. Each stripe is a complete
+ *  LsShmHash of its own in the same pool, named "<name>.<nn>", with its
+ *  own lock, LRU list and TID, and it grows and rehashes by itself, so
+ *  workers touching different stripes never wait for each other.
+ *
+ *  The stripe names leave room for 8 characters of the base name.
+ *  Operations spanning several keys must lock every stripe involved;
+ *  trim() and size() visit the stripes one at a time.
+ */
+
+class LsShmStripedHash
+{
+public:
+    static LsShmStripedHash *get(LsShmPool *pPool, const char *name,
+                                 int stripes, LsShmSize_t init_size,
+                                 LsShmHasher_fn hf, LsShmValComp_fn vc,
+                                 int iFlags);
+    ~LsShmStripedHash();
+
+    int getStripes() const
+    {   return m_iStripes;  }
+
+    LsShmHash *getStripe(int i) const
+    {   return m_pStripes[i];   }
+
+    LsShmHash *getStripeByKey(const void *pKey, int keyLen) const
+    {
+        LsShmHKey key = m_hf ? (*m_hf)(pKey, keyLen)
+                        : (LsShmHKey)(long)pKey;
+        //the stripe tables index buckets by key % size, take the stripe
+        //from the high bits so they do not share a pattern.
+        return m_pStripes[((key * 2654435761U) >> 16) % m_iStripes];
+    }
+
+    void enableAutoLock();
+    void disableAutoLock();
+
+    // Each stripe is locked while it is trimmed.
+    int trim(time_t tmCutoff, LsShmHash::TrimCb cb, void *arg);
+    LsShmSize_t size() const;
+
+    void close();
+
+private:
+    LsShmStripedHash(LsShmHasher_fn hf, int stripes);
+
+    LsShmHasher_fn  m_hf;
+    int             m_iStripes;
+    LsShmHash      *m_pStripes[LSSHM_MAX_STRIPES];
+
+    LS_NO_COPY_ASSIGN(LsShmStripedHash);
+};
+
+#endif // LSSHMSTRIPEDHASH_H
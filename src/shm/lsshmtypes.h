@@ -125,6 +125,7 @@ typedef v2_comp                 LsShmValComp_fn;
 #define LSSHM_INITSIZE          LSSHM_PAGESIZE  // default SHM SIZE
 
 #define LSSHM_SHM_UNITSIZE      0x400           // 1K byte increments
+#define LSSHM_MAXGROWSIZE       0x1000000       // max 16M extra per growth
 #define LSSHM_POOL_UNITSIZE     16              //  8 byte increments
 #define LSSHM_POOL_BCKTINCR     16              // byte increment for buckets
 #define LSSHM_MINHASH           0x400
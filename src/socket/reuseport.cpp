@@ -2,9 +2,25 @@
 #include <socket/reuseport.h>
 #include <socket/ls_sock.h>
 #include <log4cxx/logger.h>
+#include <lsdef.h>
+#include <util/pcutil.h>
 
+#include <errno.h>
+#include <string.h>
 #include <unistd.h>
 
+#if defined(linux) || defined(__linux) || defined(__linux__) || defined(__gnu_linux__)
+#include <sys/socket.h>
+#include <linux/filter.h>
+#define LS_HAS_REUSEPORT_STEER
+#ifndef SO_INCOMING_CPU
+#define SO_INCOMING_CPU             49
+#endif
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF    51
+#endif
+#endif
+
 
 int ReusePortFds::passFds(const char *type, const char *addr, int target_fd)
 {
@@ -71,3 +87,127 @@ int ReusePortFds::getActiveFd(int seq, int *n)
 }
 
 
+#ifdef LS_HAS_REUSEPORT_STEER
+static int buildCpuMap(int *pMap, int nCpu, int nProc, int iCpusPerProc)
+{
+    cpu_set_t mask;
+    int i, cpu, mapped = 0;
+    for(cpu = 0; cpu < nCpu; ++cpu)
+        pMap[cpu] = -1;
+    for(i = 0; i < nProc; ++i)
+    {
+        PCUtil::getAffinityMask(nCpu, i, iCpusPerProc, &mask);
+        for(cpu = 0; cpu < nCpu; ++cpu)
+        {
+            if (CPU_ISSET(cpu, &mask) && pMap[cpu] == -1)
+            {
+                pMap[cpu] = i;
+                ++mapped;
+            }
+        }
+    }
+    return mapped;
+}
+
+
+static inline struct sock_filter *bpfInsn(struct sock_filter *p,
+        unsigned short code, unsigned char jt, unsigned char jf, uint32_t k)
+{
+    p->code = code;
+    p->jt = jt;
+    p->jf = jf;
+    p->k = k;
+    return p + 1;
+}
+
+
+//Classic BPF program run by the kernel against each new connection, it
+//returns the index of the socket in the group:
+//    ld   cpu
+//    jeq  #cpu, 0, 1     } one pair per CPU that is not cpu % nProc
+//    ret  #index         }
+//    mod  #nProc
+//    ret  a
+static int attachCpuBpf(int fd, const int *pMap, int nCpu, int nProc)
+{
+    if (nCpu * 2 + 3 > BPF_MAXINSNS)
+    {
+        errno = E2BIG;
+        return LS_FAIL;
+    }
+    struct sock_filter *pCode = new struct sock_filter[nCpu * 2 + 3];
+    struct sock_filter *p = pCode;
+    struct sock_fprog prog;
+    int cpu, ret;
+
+    p = bpfInsn(p, BPF_LD | BPF_W | BPF_ABS, 0, 0, SKF_AD_OFF + SKF_AD_CPU);
+    for(cpu = 0; cpu < nCpu; ++cpu)
+    {
+        if (pMap[cpu] == -1 || pMap[cpu] == cpu % nProc)
+            continue;
+        p = bpfInsn(p, BPF_JMP | BPF_JEQ | BPF_K, 0, 1, cpu);
+        p = bpfInsn(p, BPF_RET | BPF_K, 0, 0, pMap[cpu]);
+    }
+    p = bpfInsn(p, BPF_ALU | BPF_MOD | BPF_K, 0, 0, nProc);
+    p = bpfInsn(p, BPF_RET | BPF_A, 0, 0, 0);
+
+    prog.len = p - pCode;
+    prog.filter = pCode;
+    ret = setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog,
+                     sizeof(prog));
+    delete [] pCode;
+    return ret;
+}
+#endif
+
+
+int ReusePortFds::steerByCpu(const char *addr, int iCpusPerProc)
+{
+#ifdef LS_HAS_REUSEPORT_STEER
+    int nProc = size();
+    int nCpu = PCUtil::getNumProcessors();
+    int i, cpu;
+    if (nProc <= 1 || iCpusPerProc <= 0 || iCpusPerProc >= nCpu
+        || nCpu > CPU_SETSIZE)
+        return LS_FAIL;
+    for(i = 0; i < nProc; ++i)
+        if ((*this)[i] == -1)
+            return LS_FAIL;
+
+    int *pMap = new int[nCpu];
+    buildCpuMap(pMap, nCpu, nProc, iCpusPerProc);
+
+    //the program is shared by the whole group, any member will do.
+    if (attachCpuBpf((*this)[0], pMap, nCpu, nProc) == 0)
+    {
+        LS_NOTICE("[%s] SO_REUSEPORT connections are steered to the worker "
+                  "on the receiving CPU.", addr);
+        delete [] pMap;
+        return LS_OK;
+    }
+    LS_INFO("[%s] failed to attach SO_REUSEPORT BPF program: %s, "
+            "use SO_INCOMING_CPU.", addr, strerror(errno));
+
+    int ret = LS_OK;
+    for(i = 0; i < nProc; ++i)
+    {
+        for(cpu = 0; cpu < nCpu; ++cpu)
+            if (pMap[cpu] == i)
+                break;
+        if (cpu >= nCpu)
+            continue;
+        if (setsockopt((*this)[i], SOL_SOCKET, SO_INCOMING_CPU, &cpu,
+                       sizeof(cpu)) == -1)
+        {
+            LS_INFO("[%s] failed to set SO_INCOMING_CPU: %s.", addr,
+                    strerror(errno));
+            ret = LS_FAIL;
+            break;
+        }
+    }
+    delete [] pMap;
+    return ret;
+#else
+    return LS_FAIL;
+#endif
+}
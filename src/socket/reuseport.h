@@ -16,6 +16,10 @@ public:
 
     int getActiveFd(int seq, int *n);
 
+    //Send new connections to the socket of the worker pinned on the CPU
+    //that received the packet, worker #n owns socket #n of the group.
+    int steerByCpu(const char *addr, int iCpusPerProc);
+
     void close();
 };
 
@@ -409,6 +409,13 @@ static int bio_fd_write(BIO *b, const char *in, int inl)
     ls_fdbio_data *fdbio = LS_FDBUF_FROM_BIO(b);
 
     DEBUG_MESSAGE("[FDBIO] bio_fd_write: %p, %d bytes on %d\n", b, inl, fd);
+    if (fdbio->m_flag & LS_FDBIO_WDISABLED)
+    {
+        DEBUG_MESSAGE("[FDBIO] bio_fd_write, record layer owned by kernel, refuse write\n");
+        BIO_clear_retry_flags(b);
+        errno = EIO;
+        return -1;
+    }
     if (fdbio->m_flag & LS_FDBIO_WBLOCK)
     {
         DEBUG_MESSAGE("[FDBIO] bio_fd_write, FDBIO_WBLOCK flag is set, set errno to EAGAIN\n");
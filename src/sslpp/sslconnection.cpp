@@ -28,6 +28,30 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+
+#if defined(OPENSSL_IS_BORINGSSL) && defined(__has_include) \
+    && (defined(linux) || defined(__linux) || defined(__linux__) \
+        || defined(__gnu_linux__))
+#if __has_include(<linux/tls.h>)
+#define LS_HAS_KTLS
+#endif
+#endif
+
+#ifdef LS_HAS_KTLS
+#include <linux/tls.h>
+#include <netinet/tcp.h>
+
+#ifndef TCP_ULP
+#define TCP_ULP     31
+#endif
+#ifndef SOL_TLS
+#define SOL_TLS     282
+#endif
+
+#define TLS_RECORD_TYPE_ALERT   21
+#endif
 
 #define DEBUGGING
 
@@ -152,6 +176,11 @@ int SslConnection::write(const char *pBuf, int len)
     m_iWant = 0;
     if (len <= 0)
         return 0;
+    if (m_flag & F_KTLS_TX)
+    {
+        struct iovec iov = { (void *)pBuf, (size_t)len };
+        return ktlsWritev(&iov, 1);
+    }
     int ret = SSL_write(m_ssl, pBuf, len);
 
     LS_DBG_M("SSL_write( %p, %p, %d) return %d, pending %d\n",
@@ -184,7 +213,21 @@ int SslConnection::writev(const struct iovec *vect, int count,
     char *pBufEnd;
     char *pCurEnd;
     char achBuf[4096];
-    
+
+    if (m_flag & F_KTLS_TX)
+    {
+        m_iWant = 0;
+        ret = ktlsWritev(vect, count);
+        if (finished)
+        {
+            written = ret;
+            while (vect < pEnd && written >= (int)vect->iov_len)
+                written -= (vect++)->iov_len;
+            *finished = (vect == pEnd);
+        }
+        return ret;
+    }
+
     pBufEnd = achBuf + 4096;
     pCurEnd = achBuf;
     for (; vect < pEnd ;)
@@ -253,7 +296,8 @@ int SslConnection::flush()
 int SslConnection::shutdown(int bidirectional)
 {
     assert(m_ssl);
-    
+
+    int ktls = m_flag & F_KTLS_TX;
     m_flag = 0;
     if (m_iStatus == ACCEPTING)
     {
@@ -265,6 +309,11 @@ int SslConnection::shutdown(int bidirectional)
     {
         m_iWant = 0;
         setWriteBuffering(0);
+        if (ktls)
+        {
+            ktlsCloseNotify();
+            SSL_set_quiet_shutdown(m_ssl, 1);
+        }
         SSL_set_shutdown(m_ssl, SSL_RECEIVED_SHUTDOWN);
         //SSL_set_quiet_shutdown( m_ssl, !bidirectional );
         int ret = SSL_shutdown(m_ssl);
@@ -741,3 +790,175 @@ int SslConnection::bufferInput()
 bool SslConnection::needReadEvent() const
 {   return m_bio.m_flag & LS_FDBIO_NEED_READ_EVT; }
 
+
+
+#ifdef LS_HAS_KTLS
+
+union ktls_crypto_info
+{
+    struct tls_crypto_info                      info;
+    struct tls12_crypto_info_aes_gcm_128        gcm128;
+    struct tls12_crypto_info_aes_gcm_256        gcm256;
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+    struct tls12_crypto_info_chacha20_poly1305  chacha;
+#endif
+};
+
+
+template<class T>
+static int fillGcmInfo(T *pInfo, const unsigned char *pKey,
+                       const unsigned char *pIv, const unsigned char *pSeq)
+{
+    memcpy(pInfo->key, pKey, sizeof(pInfo->key));
+    memcpy(pInfo->salt, pIv, sizeof(pInfo->salt));
+    // TLS 1.2 carries an explicit nonce in each record, any unique
+    // starting value will do.
+    memcpy(pInfo->iv, pSeq, sizeof(pInfo->iv));
+    memcpy(pInfo->rec_seq, pSeq, sizeof(pInfo->rec_seq));
+    return sizeof(*pInfo);
+}
+
+#endif // LS_HAS_KTLS
+
+
+int SslConnection::enableKtlsTx()
+{
+#ifdef LS_HAS_KTLS
+    union ktls_crypto_info crypto;
+    unsigned char achKeys[2 * (32 + 12)];
+    unsigned char achSeq[8];
+    const unsigned char *pKey;
+    const unsigned char *pIv;
+    int keyLen, ivLen, infoLen = 0;
+    int ret = LS_FAIL;
+
+    // TLS 1.2 only: a TLS 1.3 peer may send a KeyUpdate asking for one
+    // back, the SSL library would then rekey and answer through the BIO
+    // which no longer owns the record layer.
+    const SSL_CIPHER *pCipher = SSL_get_current_cipher(m_ssl);
+    if (!pCipher || wpending() > 0 || SSL_version(m_ssl) != TLS1_2_VERSION)
+        goto out;
+
+    switch (SSL_CIPHER_get_cipher_nid(pCipher))
+    {
+    case NID_aes_128_gcm:
+        keyLen = 16;
+        ivLen = 4;
+        break;
+    case NID_aes_256_gcm:
+        keyLen = 32;
+        ivLen = 4;
+        break;
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+    case NID_chacha20_poly1305:
+        keyLen = 32;
+        ivLen = 12;
+        break;
+#endif
+    default:
+        goto out;
+    }
+
+    {
+        // AEAD key block: client key, server key, client IV, server IV.
+        size_t len = SSL_get_key_block_len(m_ssl);
+        if (len != (size_t)(2 * (keyLen + ivLen))
+            || !SSL_generate_key_block(m_ssl, achKeys, len))
+            goto out;
+        pKey = achKeys + keyLen;
+        pIv = achKeys + 2 * keyLen + ivLen;
+    }
+
+    {
+        uint64_t seq = SSL_get_write_sequence(m_ssl);
+        for (int i = 7; i >= 0; --i, seq >>= 8)
+            achSeq[i] = seq & 0xff;
+    }
+
+    memset(&crypto, 0, sizeof(crypto));
+    crypto.info.version = TLS_1_2_VERSION;
+    if (keyLen == 16)
+    {
+        crypto.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+        infoLen = fillGcmInfo(&crypto.gcm128, pKey, pIv, achSeq);
+    }
+    else if (ivLen == 4)
+    {
+        crypto.info.cipher_type = TLS_CIPHER_AES_GCM_256;
+        infoLen = fillGcmInfo(&crypto.gcm256, pKey, pIv, achSeq);
+    }
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+    else
+    {
+        crypto.info.cipher_type = TLS_CIPHER_CHACHA20_POLY1305;
+        memcpy(crypto.chacha.key, pKey, sizeof(crypto.chacha.key));
+        memcpy(crypto.chacha.iv, pIv, sizeof(crypto.chacha.iv));
+        memcpy(crypto.chacha.rec_seq, achSeq, sizeof(crypto.chacha.rec_seq));
+        infoLen = sizeof(crypto.chacha);
+    }
+#endif
+
+    if (setsockopt(SSL_get_fd(m_ssl), IPPROTO_TCP, TCP_ULP, "tls",
+                   sizeof("tls")) == -1
+        || setsockopt(SSL_get_fd(m_ssl), SOL_TLS, TLS_TX, &crypto,
+                      infoLen) == -1)
+    {
+        DEBUG_MESSAGE("[SSL: %p] kTLS TX setup failed: %s\n", this,
+                      strerror(errno));
+    }
+    else
+    {
+        // Records are sealed by the kernel from now on, nothing may
+        // reach the socket through the SSL object anymore.
+        m_flag |= F_KTLS_TX;
+        m_bio.m_flag |= LS_FDBIO_WDISABLED;
+        setWriteBuffering(0);
+        ret = LS_OK;
+    }
+    OPENSSL_cleanse(&crypto, sizeof(crypto));
+
+out:
+    OPENSSL_cleanse(achKeys, sizeof(achKeys));
+    return ret;
+#else
+    return LS_FAIL;
+#endif
+}
+
+
+int SslConnection::ktlsWritev(const struct iovec *vect, int count)
+{
+    int ret = ::writev(SSL_get_fd(m_ssl), vect, count);
+    if (ret >= 0)
+        return ret;
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+    {
+        m_iWant = LAST_WRITE | WANT_WRITE;
+        return 0;
+    }
+    return LS_FAIL;
+}
+
+
+void SslConnection::ktlsCloseNotify()
+{
+#ifdef LS_HAS_KTLS
+    static const char s_achAlert[2] = { 1, 0 };  // warning, close_notify
+    char achCtrl[CMSG_SPACE(sizeof(unsigned char))];
+    struct iovec iov = { (void *)s_achAlert, sizeof(s_achAlert) };
+    struct msghdr msg;
+    struct cmsghdr *pCmsg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = achCtrl;
+    msg.msg_controllen = sizeof(achCtrl);
+    pCmsg = CMSG_FIRSTHDR(&msg);
+    pCmsg->cmsg_level = SOL_TLS;
+    pCmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+    pCmsg->cmsg_len = CMSG_LEN(sizeof(unsigned char));
+    *CMSG_DATA(pCmsg) = TLS_RECORD_TYPE_ALERT;
+    ::sendmsg(SSL_get_fd(m_ssl), &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+#endif
+}
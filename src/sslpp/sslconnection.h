@@ -39,6 +39,8 @@ public:
         F_ASYNC_CERT        = 4,
         F_ASYNC_PK          = 8,
         F_ASYNC_CERT_FAIL   = 16,
+        F_KTLS              = 32,
+        F_KTLS_TX           = 64,
     };
 
     char wantRead() const   {   return m_iWant & WANT_READ;     }
@@ -52,6 +54,7 @@ public:
     int  getFlag(int v) const   {   return m_flag & v;     }
     void setFlag(int f, int v)  {   m_flag = (m_flag & ~f) | (v ? f : 0);  }
     bool isWaitAsync() const    {   return m_flag & (F_ASYNC_CERT | F_ASYNC_PK);   }
+    bool isKtlsTx() const       {   return m_flag & F_KTLS_TX;  }
 
     SslConnection();
     ~SslConnection();
@@ -137,7 +140,19 @@ public:
     {   return (getFlag(F_ASYNC_CERT | F_ASYNC_CERT_FAIL) == F_ASYNC_CERT); }
     bool wantAsyncCtx(SSL_CTX *&pInput);
 
+    /**
+     * Hand the TX record layer over to the kernel (kTLS) once the
+     * handshake is done and nothing is left in the write buffer; after
+     * that write() and writev() go straight to the socket and sendfile()
+     * can be used on it.  Returns LS_FAIL when the cipher, the protocol
+     * or the kernel is not supported, the connection stays in user space.
+     */
+    int enableKtlsTx();
+
 private:
+    int  ktlsWritev(const struct iovec *vect, int count);
+    void ktlsCloseNotify();
+
     SSL    *m_ssl;
     SslClientSessCache *m_pSessCache;
     short   m_flag;
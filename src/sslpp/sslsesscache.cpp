@@ -20,6 +20,7 @@
 #include <log4cxx/logger.h>
 #include <shm/lsshmhash.h>
 #include <shm/lsshmhashobserver.h>
+#include <shm/lsshmstripedhash.h>
 // #include <shm/lsshmtypes.h>
 #include <util/datetime.h>
 #include <util/objpool.h>
@@ -37,6 +38,9 @@
 
 #define shmSslCache "SSLCache"
 #define shmSsl  "SSL"
+//every worker takes the store lock on each handshake, spread the sessions
+//over independently locked tables.
+#define SSL_SESS_STRIPES    16
 static int s_numNew = 0;
 
 
@@ -96,8 +100,9 @@ int SslSessCache::initShm(int uid, int gid)
     pShm->chperm(uid, gid, 0600);
     if ((pPool = pShm->getGlobalPool()) == NULL)
         return LS_FAIL;
-    if ((m_pSessStore = pPool->getNamedHash(shmSslCache, 10000,
-                        LsShmHash::hash32id, memcmp, LSSHM_FLAG_LRU | LSSHM_FLAG_TID)) != NULL)
+    if ((m_pSessStore = LsShmStripedHash::get(pPool, shmSslCache,
+                        SSL_SESS_STRIPES, 10000, LsShmHash::hash32id, memcmp,
+                        LSSHM_FLAG_LRU | LSSHM_FLAG_TID)) != NULL)
     {
         m_pSessStore->disableAutoLock(); // we will be responsible for the lock
         s_numNew = 0;
@@ -225,7 +230,9 @@ static void removeCb(SSL_CTX *pCtx, SSL_SESSION *pSess)
 #ifdef DEBUG_SHOW_MORE
     printId("Remove Session", (unsigned char *)id, (int)len);
 #endif
-    LsShmHash * pStore = cache.getSessStore();
+    LsShmHash *pStore = NULL;
+    if (cache.isReady())
+        pStore = cache.getSessStore(id, (int)len);
     if (pStore && cache.deleteSessionEx(pStore, (const char *)id, (int)len))
     {
         if (cache.getObserver() != NULL)
@@ -263,7 +270,7 @@ LsShmOffset_t SslSessCache::addSessionEx(LsShmHash *pHash, time_t lruTm,
     ls_strpair_t parms;
 
     if (NULL == pHash)
-        pHash = getSessStore();
+        pHash = getSessStore(pId, idLen);
 
     s_numNew++;
     // flush out expired data
@@ -293,7 +300,7 @@ int SslSessCache::deleteSession(const char * pId, int len)
 {
     int ret = 0;
     if (m_pSessStore)
-        ret = deleteSessionEx(m_pSessStore, pId, len);
+        ret = deleteSessionEx(getSessStore(pId, len), pId, len);
     if (0 == ret && m_pRemoteStore)
         ret = deleteSessionEx(m_pRemoteStore, pId, len);
     return ret;
@@ -315,6 +322,12 @@ void SslSessCache::unlock(LsShmHash *pHash)
 }
 
 
+LsShmHash *SslSessCache::getSessStore(const void *pId, int len) const
+{
+    return m_pSessStore->getStripeByKey(pId, len);
+}
+
+
 /**
  * getLockedSessionData() will attempt to get the session data from
  * the hash given the id and length.
@@ -325,10 +338,11 @@ void SslSessCache::unlock(LsShmHash *pHash)
 SslSessData_t *SslSessCache::getLockedSessionData(const unsigned char *id,
         int len, LsShmHash *&pHash)
 {
+    LsShmHash *pStore = getSessStore(id, len);
     pHash = NULL;
-    SslSessData_t *pObj = getLockedSessionDataEx(m_pSessStore, id, len);
+    SslSessData_t *pObj = getLockedSessionDataEx(pStore, id, len);
     if (pObj)
-        pHash = m_pSessStore;
+        pHash = pStore;
     else if (m_pRemoteStore && (pObj = getLockedSessionDataEx(m_pRemoteStore, id, len)))
         pHash = m_pRemoteStore;
     return pObj;
@@ -363,13 +377,7 @@ SslSessData_t *SslSessCache::getLockedSessionDataEx(LsShmHash *pHash,
  */
 int SslSessCache::sessionFlush()
 {
-    int num;
-
-    m_pSessStore->lock();
-    num = m_pSessStore->trim(DateTime::s_curTime - m_expireSec, NULL, NULL);
-    m_pSessStore->unlock();
-
-    return num;
+    return m_pSessStore->trim(DateTime::s_curTime - m_expireSec, NULL, NULL);
 }
 
 
@@ -379,19 +387,23 @@ int SslSessCache::sessionFlush()
 int SslSessCache::stat()
 {
     LsHashStat stat;
+    LsShmHash *pHash;
 
-    // lock
-    m_pSessStore->lock();
-    m_pSessStore->stat(&stat, checkStatElem, m_pSessStore);
     LS_DBG_L("NEWSESSION STATISTIC <%p> " , this);
-    LS_DBG_L("HASH STATISTIC NUM %3d DUP %3d EXPIRED %d IDX [%d %d %d]",
-             stat.num, stat.numDup, stat.numExpired, stat.numIdx,
-             stat.numIdxOccupied, stat.maxLink);
-    LS_DBG_L("HASH STATISTIC TOP %d %d %d %d %d [%d %d %d %d %d]",
-             stat.top[0], stat.top[1], stat.top[2], stat.top[3], stat.top[4],
-             stat.top[5], stat.top[6], stat.top[7], stat.top[8], stat.top[9]);
-    // unlock
-    m_pSessStore->unlock();
+    for (int i = 0; i < m_pSessStore->getStripes(); ++i)
+    {
+        pHash = m_pSessStore->getStripe(i);
+        pHash->lock();
+        pHash->stat(&stat, checkStatElem, pHash);
+        pHash->unlock();
+        LS_DBG_L("HASH STATISTIC [%s] NUM %3d DUP %3d EXPIRED %d IDX [%d %d %d]",
+                 pHash->name(), stat.num, stat.numDup, stat.numExpired,
+                 stat.numIdx, stat.numIdxOccupied, stat.maxLink);
+        LS_DBG_L("HASH STATISTIC TOP %d %d %d %d %d [%d %d %d %d %d]",
+                 stat.top[0], stat.top[1], stat.top[2], stat.top[3],
+                 stat.top[4], stat.top[5], stat.top[6], stat.top[7],
+                 stat.top[8], stat.top[9]);
+    }
     return 0;
 }
 
@@ -399,10 +411,17 @@ int SslSessCache::stat()
 uint32_t SslSessCache::getSessCnt() const
 {
     LsHashStat stat;
-    m_pSessStore->lock();
-    m_pSessStore->stat(&stat, checkStatElem, m_pSessStore);
-    m_pSessStore->unlock();
-    return stat.num;
+    LsShmHash *pHash;
+    uint32_t num = 0;
+    for (int i = 0; i < m_pSessStore->getStripes(); ++i)
+    {
+        pHash = m_pSessStore->getStripe(i);
+        pHash->lock();
+        pHash->stat(&stat, checkStatElem, pHash);
+        pHash->unlock();
+        num += stat.num;
+    }
+    return num;
 }
 
 
@@ -29,6 +29,7 @@
 #define LS_SSLSESSCACHE_DEFAULTSIZE 40*1024
 
 class LsShmHash;
+class LsShmStripedHash;
 
 class LsShmHashObserver;
 typedef struct SslSessData_s SslSessData_t;
@@ -59,7 +60,7 @@ public:
     int     addSession(time_t lruTm, const uint8_t *pId, int idLen,
                        unsigned char *pData, int iDataLen)
     {
-        return (addSessionEx(getSessStore(), lruTm, pId, idLen,
+        return (addSessionEx(getSessStore(pId, idLen), lruTm, pId, idLen,
                              pData, iDataLen) != 0);
     }
 
@@ -81,8 +82,8 @@ public:
     {   return m_pRemoteStore;          }
 
     void    unlock(LsShmHash *pHash);
-    LsShmHash *getSessStore() const
-    {   return m_pSessStore;    }
+    // The stripe of the local store holding the session id.
+    LsShmHash *getSessStore(const void *pId, int len) const;
 
     uint32_t    getSessCnt() const;
 
@@ -96,7 +97,7 @@ private:
 private:
     int32_t                 m_expireSec;
     int                     m_maxEntries;
-    LsShmHash              *m_pSessStore;
+    LsShmStripedHash       *m_pSessStore;
     LsShmHash              *m_pRemoteStore;
     LsShmHashObserver      *m_pObserver;
 
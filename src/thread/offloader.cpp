@@ -67,7 +67,11 @@ Offloader::Offloader()
 Offloader::~Offloader()
 {
     if (m_crew)
+    {
+        if (m_crew->isWorkStealing())
+            m_crew->logStats(get_log_id());
         delete m_crew;
+    }
     if (m_pFinishedQueue)
         ls_lfqueue_delete(m_pFinishedQueue);
 }
@@ -127,6 +131,10 @@ int Offloader::addJob(ls_offload *data)
 
 int Offloader::startProcessor(int workers)
 {
+    //bursts of short jobs (TLS private key operations), per worker deques
+    //avoid contending on a single queue.
+    if (workers > 1)
+        m_crew->enableWorkStealing(workers);
     return m_crew->startJobProcessor(workers, m_pFinishedQueue,
                                      (WorkCrewProcessFn)process_offload);
 }
@@ -194,3 +202,103 @@ int offloader_enqueue(struct Offloader * offload, ls_offload *task)
     return offload->addJob(task);
 }
 
+
+
+int offloader_cancel(ls_offload_t *task)
+{
+    if (!task)
+        return LS_FAIL;
+    ls_atomic_set(&task->is_canceled, 1);
+    return LS_OK;
+}
+
+
+struct fn_offload
+{
+    ls_offload_t        m_header;
+    offload_perform_fn  m_perform;
+    offload_result_cb   m_on_done;
+    void               *m_param;
+    int                 m_result;
+};
+
+
+static int fn_offload_perform(ls_offload *task)
+{
+    fn_offload *job = (fn_offload *)task;
+    job->m_result = job->m_perform(job->m_param);
+    return 0;
+}
+
+
+static void fn_offload_release(ls_offload *task)
+{
+    if (--task->ref_cnt <= 0)
+        delete (fn_offload *)task;
+}
+
+
+static void fn_offload_done(void *param)
+{
+    fn_offload *job = (fn_offload *)param;
+    if (job->m_on_done)
+        job->m_on_done(job->m_param, job->m_result);
+}
+
+
+static ls_offload_api s_fn_offload_api =
+{
+    fn_offload_perform,
+    fn_offload_release,
+    fn_offload_done
+};
+
+
+ls_offload_t *offloader_submit(struct Offloader *offload,
+                               offload_perform_fn perform,
+                               offload_result_cb on_done, void *param)
+{
+    int result;
+    if (offload)
+    {
+        fn_offload *job = new fn_offload();
+        job->m_header.api = &s_fn_offload_api;
+        job->m_header.param_task_done = job;
+        job->m_perform = perform;
+        job->m_on_done = on_done;
+        job->m_param = param;
+        job->m_result = 0;
+        //hold a reference so the task survives an enqueue failure.
+        job->m_header.ref_cnt = 1;
+        if (offload->addJob(&job->m_header) != -1)
+        {
+            fn_offload_release(&job->m_header);
+            return &job->m_header;
+        }
+        LS_DBG_L("[%s] failed to queue task %p, run inline.\n",
+                 offload->get_log_id(), job);
+        fn_offload_release(&job->m_header);
+    }
+    result = perform(param);
+    if (on_done)
+        on_done(param, result);
+    return NULL;
+}
+
+
+static Offloader *s_pSharedOffloader = NULL;
+
+
+int offloader_start_shared(int workers)
+{
+    if (s_pSharedOffloader)
+        return LS_OK;
+    s_pSharedOffloader = offloader_new2("OFFLOAD", workers, 1, workers, 1);
+    return s_pSharedOffloader ? LS_OK : LS_FAIL;
+}
+
+
+struct Offloader *offloader_get_shared()
+{
+    return s_pSharedOffloader;
+}
@@ -36,6 +36,12 @@
 #include <new>
 
 
+//slot of the crew worker running on the calling thread, for jobs added by
+//the jobs themselves.
+static __thread const WorkCrew *s_pTlsCrew = NULL;
+static __thread int s_iTlsSlot = -1;
+
+
 WorkCrew::WorkCrew(EventNotifier *en)
     : m_pProcess(NULL)
     , m_pFinishedQueue(NULL)
@@ -50,6 +56,11 @@ WorkCrew::WorkCrew(EventNotifier *en)
     , m_idleWorkers(0)
     , m_iRunningWorkers(0)
     , m_cleanUp()
+    , m_pDeques(NULL)
+    , m_iDeques(0)
+    , m_iNextDeque(0)
+    , m_iQueued(0)
+    , m_iStealWaiting(0)
 {
     init();
 }
@@ -70,6 +81,11 @@ WorkCrew::WorkCrew(int maxWorkers, WorkCrewProcessFn  processor,
     , m_idleWorkers(0)
     , m_iRunningWorkers(0)
     , m_cleanUp()
+    , m_pDeques(NULL)
+    , m_iDeques(0)
+    , m_iNextDeque(0)
+    , m_iQueued(0)
+    , m_iStealWaiting(0)
 {
     DPRINTF("WRKRW CNSTRCT %s\n", pStatus());
     init();
@@ -92,6 +108,11 @@ WorkCrew::WorkCrew(int32_t maxWorkers, WorkCrewProcessFn  processor,
     , m_idleWorkers(0)
     , m_iRunningWorkers(0)
     , m_cleanUp()
+    , m_pDeques(NULL)
+    , m_iDeques(0)
+    , m_iNextDeque(0)
+    , m_iQueued(0)
+    , m_iStealWaiting(0)
 {
     DPRINTF("WRKRW CNSTRCT %s\n", pStatus());
     init();
@@ -171,6 +192,8 @@ WorkCrew::~WorkCrew()
 
     m_cleanUp.release_objects();
     ls_mutex_unlock(&m_crewLock);
+    if (m_pDeques)
+        delete [] m_pDeques;
 
     int count = ls_atomic_value(&m_iRunningWorkers);
     if (count > 0)
@@ -280,6 +303,8 @@ int WorkCrew::startJobProcessor(int numWorkers,
     m_pProcess = processor;
     m_pFinishedQueue = pFinishedQueue;
     m_maxWorkers = numWorkers;
+    if (m_pDeques && m_maxWorkers > m_iDeques)
+        m_maxWorkers = m_iDeques;
     LS_DBG_H("WorkCrew::startJobProcessor(), Starting Processor.");
     return startProcessing();
 }
@@ -382,10 +407,13 @@ int WorkCrew::addJob(ls_lfnodei_t *item)
     {
         return LS_FAIL;
     }
+    if (m_pDeques)
+        ret = addStealJob(item);
+    else
 #ifdef LS_WORKCREW_LF
-    ret =  ls_lfqueue_put(m_pJobQueue, item);
+        ret =  ls_lfqueue_put(m_pJobQueue, item);
 #else
-    ret = m_pJobQueue->append(&item, 1);
+        ret = m_pJobQueue->append(&item, 1);
 #endif
     if (ls_atomic_value(&m_idleWorkers) >= ls_atomic_value(&m_minIdle)
         || ls_mutex_trylock(&m_addWorker) != 0 )
@@ -467,6 +495,8 @@ int32_t WorkCrew::maxWorkers(int32_t num)
     {
         return LS_FAIL;
     }
+    if (m_pDeques && num > m_iDeques)
+        num = m_iDeques;
 
     int32_t oldMaxWorkers = m_maxWorkers;
 
@@ -492,6 +522,12 @@ void WorkCrew::stopAllWorkers(int discard)
     ls_atomic_setint(&m_minIdle, 0);
     ls_atomic_setint(&m_maxIdle, 0);
     ls_mutex_unlock(&m_crewLock);
+    if (m_pDeques)
+    {
+        m_stealMutex.lock();
+        m_stealReady.broadcast();
+        m_stealMutex.unlock();
+    }
 }
 
 
@@ -514,18 +550,28 @@ void *WorkCrew::workerRoutine(CrewWorker * pWorker)
                 pWorker->getSlot(), m_nice, tidles);
     }
 
+    if (m_pDeques)
+    {
+        s_pTlsCrew = this;
+        s_iTlsSlot = pWorker->getSlot();
+    }
     while (pWorker->isWorking())
     {
         DPRINTF("WRKRTN slot %d running %s\n", pWorker->getSlot(), pStatus());
 
-        ls_lfnodei_t * job = getJob(true);
+        int64_t queuedUs = 0;
+        ls_lfnodei_t * job = m_pDeques
+                             ? getStealJob(pWorker->getSlot(), true, &queuedUs)
+                             : getJob(true);
         if (!job)
         {
             DPRINTF("WRKRTN poll job failed slot %d %s\n", pWorker->getSlot(), pStatus());
             int32_t idle = ls_atomic_fetch_add(&m_idleWorkers, 1);
             DPRINTF("WRKRTN IDLE slot %d %s\n", pWorker->getSlot(), pStatus());
             // timed get
-            job = getJob();
+            job = m_pDeques
+                  ? getStealJob(pWorker->getSlot(), false, &queuedUs)
+                  : getJob();
             idle = ls_atomic_sub_fetch(&m_idleWorkers, 1);
             assert(idle >= 0);
             DPRINTF("WRKRTN NOT IDLE slot %d %s\n", pWorker->getSlot(), pStatus());
@@ -534,7 +580,10 @@ void *WorkCrew::workerRoutine(CrewWorker * pWorker)
         if (job)
         {
             DPRINTF("WRKRTN processing job slot %d %s\n", pWorker->getSlot(), pStatus());
-            m_pProcess(job);
+            if (m_pDeques)
+                runJob(pWorker, job, queuedUs);
+            else
+                m_pProcess(job);
             if (ls_atomic_value(&m_pFinishedQueue))
                 putFinishedItem(job);
 
@@ -572,3 +621,142 @@ void WorkCrew::setInitCb(void (*routine)(void *), void * arg)
     m_initCb.arg = arg;
 }
 
+
+int WorkCrew::enableWorkStealing(int workers)
+{
+    if (m_pDeques || workers <= 0
+        || ls_atomic_value(&m_stateFutex) != TO_START)
+        return LS_FAIL;
+    m_pDeques = new WorkStealDeque[workers];
+    if (!m_pDeques)
+        return LS_FAIL;
+    m_iDeques = workers;
+    if (m_maxWorkers > m_iDeques)
+        m_maxWorkers = m_iDeques;
+    LS_DBG_H("WorkCrew::enableWorkStealing(), %d deques.", workers);
+    return LS_OK;
+}
+
+
+int WorkCrew::addStealJob(ls_lfnodei_t *item)
+{
+    int slot;
+    if (s_pTlsCrew == this && s_iTlsSlot >= 0 && s_iTlsSlot < m_iDeques)
+        slot = s_iTlsSlot;
+    else
+        slot = (uint32_t)ls_atomic_fetch_add(&m_iNextDeque, 1) % m_iDeques;
+
+    //count first, a worker that sees the count skips the wait and
+    //retries, so the job cannot be missed.
+    ls_atomic_fetch_add(&m_iQueued, 1);
+    if (m_pDeques[slot].pushBack(item, WorkStealDeque::nowUs()) != LS_OK)
+    {
+        ls_atomic_fetch_add(&m_iQueued, -1);
+        return LS_FAIL;
+    }
+    if (ls_atomic_value(&m_iStealWaiting) > 0)
+    {
+        m_stealMutex.lock();
+        m_stealReady.signal();
+        m_stealMutex.unlock();
+    }
+    return LS_OK;
+}
+
+
+ls_lfnodei_t *WorkCrew::stealJob(int slot, int64_t *pQueuedUs)
+{
+    ls_lfnodei_t *job;
+    int i;
+    for (i = 1; i < m_iDeques; ++i)
+    {
+        int victim = (slot + i) % m_iDeques;
+        if ((job = m_pDeques[victim].popFront(pQueuedUs)) != NULL)
+        {
+            ++m_pDeques[slot].getStats()->m_iSteals;
+            return job;
+        }
+    }
+    return NULL;
+}
+
+
+ls_lfnodei_t *WorkCrew::getStealJob(int slot, bool poll, int64_t *pQueuedUs)
+{
+    ls_lfnodei_t *job;
+    if (slot < 0 || slot >= m_iDeques)
+        return NULL;
+    job = m_pDeques[slot].popBack(pQueuedUs);
+    if (!job)
+        job = stealJob(slot, pQueuedUs);
+    if (!job && !poll)
+    {
+        m_stealMutex.lock();
+        ls_atomic_fetch_add(&m_iStealWaiting, 1);
+        if (ls_atomic_value(&m_iQueued) <= 0
+            && ls_atomic_value(&m_stateFutex) == RUNNING)
+            m_stealReady.wait(m_stealMutex.get(), 250);
+        ls_atomic_fetch_add(&m_iStealWaiting, -1);
+        m_stealMutex.unlock();
+
+        job = m_pDeques[slot].popBack(pQueuedUs);
+        if (!job)
+            job = stealJob(slot, pQueuedUs);
+    }
+    if (job)
+        ls_atomic_fetch_add(&m_iQueued, -1);
+    return job;
+}
+
+
+void WorkCrew::runJob(CrewWorker *pWorker, ls_lfnodei_t *job,
+                      int64_t queuedUs)
+{
+    int slot = pWorker->getSlot();
+    if (slot < 0 || slot >= m_iDeques)
+    {
+        m_pProcess(job);
+        return;
+    }
+    WorkCrewStats *pStats = m_pDeques[slot].getStats();
+    int64_t start = WorkStealDeque::nowUs();
+    int64_t wait = start - queuedUs;
+
+    m_pProcess(job);
+
+    ++pStats->m_iJobs;
+    pStats->m_iWaitUs += wait;
+    if (wait > pStats->m_iMaxWaitUs)
+        pStats->m_iMaxWaitUs = wait;
+    pStats->m_iRunUs += WorkStealDeque::nowUs() - start;
+}
+
+
+int WorkCrew::getWorkerStats(int slot, WorkCrewStats *pStats) const
+{
+    if (slot < 0 || slot >= m_iDeques)
+        return LS_FAIL;
+    *pStats = *m_pDeques[slot].getStats();
+    return LS_OK;
+}
+
+
+void WorkCrew::logStats(const char *pName) const
+{
+    WorkCrewStats stats;
+    int i;
+    for (i = 0; i < m_iDeques; ++i)
+    {
+        getWorkerStats(i, &stats);
+        if (!stats.m_iJobs && !stats.m_iMaxDepth)
+            continue;
+        LS_INFO("[%s] worker %d: jobs %lld, stolen %lld, avg wait %lldus, "
+                "max wait %lldus, avg run %lldus, depth %d, max depth %d.",
+                pName, i, (long long)stats.m_iJobs,
+                (long long)stats.m_iSteals,
+                stats.m_iJobs ? (long long)(stats.m_iWaitUs / stats.m_iJobs) : 0LL,
+                (long long)stats.m_iMaxWaitUs,
+                stats.m_iJobs ? (long long)(stats.m_iRunUs / stats.m_iJobs) : 0LL,
+                stats.m_iDepth, stats.m_iMaxDepth);
+    }
+}
@@ -20,6 +20,9 @@
 
 #include <lsdef.h>
 #include <thread/crewworker.h>
+#include <thread/pthreadcond.h>
+#include <thread/pthreadmutex.h>
+#include <thread/workstealdeque.h>
 #include <util/objarray.h>
 #include <util/gpointerlist.h>
 #include <lsr/ls_lock.h>
@@ -190,6 +193,28 @@ public:
 
     void dropPriorityBy(int n)  {   m_nice = n;     }
 
+    /** @enableWorkStealing
+     * @brief Switches to one job deque per worker, must be called before
+     * startProcessing().
+     * @details Jobs are spread round robin over the deques, jobs added by
+     * a worker go to its own deque. A worker runs its own jobs newest
+     * first and steals the oldest job of another worker when it runs dry.
+     * The number of workers is capped at the number of deques.
+     *
+     * @param[in] workers - The number of deques, the max workers.
+     * @return 0 if successful, else -1 if not.
+     */
+    int enableWorkStealing(int workers);
+    bool isWorkStealing() const {   return m_pDeques != NULL;   }
+
+    /** @getWorkerStats
+     * @brief Per worker latency and queue depth, work stealing mode only.
+     * @return 0 if successful, -1 if slot is out of range.
+     */
+    int getWorkerStats(int slot, WorkCrewStats *pStats) const;
+    int getStatSlots() const    {   return m_iDeques;   }
+    void logStats(const char *pName) const;
+
 private:
     class Callback
     {
@@ -229,6 +254,14 @@ private:
     TPointerList<Callback>      m_cleanUp;
     Callback                    m_initCb;
 
+    WorkStealDeque             *m_pDeques;
+    int32_t                     m_iDeques;
+    int32_t                     m_iNextDeque;
+    int32_t                     m_iQueued;
+    int32_t                     m_iStealWaiting;
+    PThreadMutex                m_stealMutex;
+    PThreadCond                 m_stealReady;
+
 
 #ifdef LS_WORKCREW_DEBUG
     const char * pStatus() {
@@ -258,6 +291,10 @@ private:
      * @internal This function attempts to get a job from the job queue.
      */
     ls_lfnodei_t *getJob(bool poll = false);
+    ls_lfnodei_t *getStealJob(int slot, bool poll, int64_t *pQueuedUs);
+    ls_lfnodei_t *stealJob(int slot, int64_t *pQueuedUs);
+    int addStealJob(ls_lfnodei_t *item);
+    void runJob(CrewWorker *pWorker, ls_lfnodei_t *job, int64_t queuedUs);
 
     /** @workerDied
      * @brief signals WorkCrew that a worker has died
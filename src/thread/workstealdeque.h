@@ -0,0 +1,177 @@
+/*****************************************************************************
+*    Open LiteSpeed is an open source HTTP server.                           *
+*    Copyright (C) 2013 - 2020  LiteSpeed Technologies, Inc.                 *
+*                                                                            *
+*    This program is free software: you can redistribute it and/or modify    *
+*    it under the terms of the GNU General Public License as published by    *
+*    the Free Software Foundation, either version 3 of the License, or       *
+*    (at your option) any later version.                                     *
+*                                                                            *
+*    This program is distributed in the hope that it will be useful,         *
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            *
+*    GNU General Public License for more details.                            *
+*                                                                            *
+*    You should have received a copy of the GNU General Public License       *
+*    along with this program. If not, see http://www.gnu.org/licenses/.      *
+*****************************************************************************/
+#ifndef WORKSTEALDEQUE_H
+#define WORKSTEALDEQUE_H
+
+#include <lsdef.h>
+#include <lsr/ls_lock.h>
+#include <lsr/ls_node.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * Per worker statistics of a work stealing WorkCrew, times in micro
+ * seconds. Counters are updated by the owner without locking, readers
+ * get a snapshot that may be slightly stale.
+ */
+struct WorkCrewStats
+{
+    int64_t     m_iJobs;        // jobs run by this worker
+    int64_t     m_iSteals;      // jobs taken from other workers
+    int64_t     m_iWaitUs;      // total time the jobs sat in a queue
+    int64_t     m_iMaxWaitUs;
+    int64_t     m_iRunUs;       // total time spent in the process function
+    int32_t     m_iDepth;       // jobs currently queued for this worker
+    int32_t     m_iMaxDepth;
+};
+
+
+/**
+ * Job deque owned by one worker. The owner pushes and pops at the back
+ * (LIFO, the most recent job is the most likely to be cache hot), other
+ * workers steal from the front (FIFO, the oldest job). Operations are
+ * short, a spin lock is enough to keep owner and thieves apart.
+ */
+class WorkStealDeque
+{
+    struct Entry
+    {
+        ls_lfnodei_t   *m_pJob;
+        int64_t         m_iQueuedUs;
+    };
+
+    ls_spinlock_t   m_lock;
+    Entry          *m_pRing;
+    uint32_t        m_iCapacity;    // power of 2
+    uint32_t        m_iHead;
+    uint32_t        m_iTail;
+
+    WorkCrewStats   m_stats;
+
+    int grow()
+    {
+        uint32_t cap = m_iCapacity ? m_iCapacity << 1 : 64;
+        Entry *pRing = (Entry *)malloc(sizeof(Entry) * cap);
+        uint32_t i, n = m_iTail - m_iHead;
+        if (!pRing)
+            return LS_FAIL;
+        for (i = 0; i < n; ++i)
+            pRing[i] = m_pRing[(m_iHead + i) & (m_iCapacity - 1)];
+        if (m_pRing)
+            free(m_pRing);
+        m_pRing = pRing;
+        m_iCapacity = cap;
+        m_iHead = 0;
+        m_iTail = n;
+        return LS_OK;
+    }
+
+    void updateDepth()
+    {
+        m_stats.m_iDepth = m_iTail - m_iHead;
+        if (m_stats.m_iDepth > m_stats.m_iMaxDepth)
+            m_stats.m_iMaxDepth = m_stats.m_iDepth;
+    }
+
+    LS_NO_COPY_ASSIGN(WorkStealDeque);
+public:
+    WorkStealDeque()
+        : m_pRing(NULL)
+        , m_iCapacity(0)
+        , m_iHead(0)
+        , m_iTail(0)
+    {
+        ls_spinlock_setup(&m_lock);
+        memset(&m_stats, 0, sizeof(m_stats));
+    }
+
+    ~WorkStealDeque()
+    {
+        if (m_pRing)
+            free(m_pRing);
+    }
+
+    static int64_t nowUs()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    }
+
+    int size() const            {   return m_iTail - m_iHead;   }
+
+    int pushBack(ls_lfnodei_t *pJob, int64_t queuedUs)
+    {
+        int ret = LS_OK;
+        ls_spinlock_lock(&m_lock);
+        if (m_iTail - m_iHead == m_iCapacity)
+            ret = grow();
+        if (ret == LS_OK)
+        {
+            Entry *pEntry = &m_pRing[m_iTail++ & (m_iCapacity - 1)];
+            pEntry->m_pJob = pJob;
+            pEntry->m_iQueuedUs = queuedUs;
+            updateDepth();
+        }
+        ls_spinlock_unlock(&m_lock);
+        return ret;
+    }
+
+    /** Owner side, most recent job first. */
+    ls_lfnodei_t *popBack(int64_t *pQueuedUs)
+    {
+        ls_lfnodei_t *pJob = NULL;
+        ls_spinlock_lock(&m_lock);
+        if (m_iTail != m_iHead)
+        {
+            Entry *pEntry = &m_pRing[--m_iTail & (m_iCapacity - 1)];
+            pJob = pEntry->m_pJob;
+            *pQueuedUs = pEntry->m_iQueuedUs;
+            updateDepth();
+        }
+        ls_spinlock_unlock(&m_lock);
+        return pJob;
+    }
+
+    /** Thief side, oldest job first. */
+    ls_lfnodei_t *popFront(int64_t *pQueuedUs)
+    {
+        ls_lfnodei_t *pJob = NULL;
+        if (m_iTail == m_iHead)
+            return NULL;
+        ls_spinlock_lock(&m_lock);
+        if (m_iTail != m_iHead)
+        {
+            Entry *pEntry = &m_pRing[m_iHead++ & (m_iCapacity - 1)];
+            pJob = pEntry->m_pJob;
+            *pQueuedUs = pEntry->m_iQueuedUs;
+            updateDepth();
+        }
+        ls_spinlock_unlock(&m_lock);
+        return pJob;
+    }
+
+    WorkCrewStats *getStats()               {   return &m_stats;    }
+    const WorkCrewStats *getStats() const   {   return &m_stats;    }
+};
+
+
+#endif //WORKSTEALDEQUE_H
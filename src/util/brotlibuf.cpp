@@ -39,6 +39,9 @@ BrotliBuf::BrotliBuf()
     , m_iAvailOut(0)
     , m_pNextIn(NULL)
     , m_pNextOut(NULL)
+#ifdef LS_BROTLI_SHARED_DICT
+    , m_pPreparedDict(NULL)
+#endif
 {
 }
 
@@ -48,6 +51,9 @@ BrotliBuf::BrotliBuf(int type, int level)
     , m_iAvailOut(0)
     , m_pNextIn(NULL)
     , m_pNextOut(NULL)
+#ifdef LS_BROTLI_SHARED_DICT
+    , m_pPreparedDict(NULL)
+#endif
 {
     init(type, level);
 }
@@ -63,10 +69,53 @@ int BrotliBuf::release()
         BrotliDecoderDestroyInstance(m_pDecoder);
     else
         BrotliEncoderDestroyInstance(m_pEncoder);
+    m_pEncoder = NULL;
+    releaseDictionary();
     return 0;
 }
 
 
+//The encoder only references the prepared dictionary, it goes after the
+//encoder instance using it.
+void BrotliBuf::releaseDictionary()
+{
+#ifdef LS_BROTLI_SHARED_DICT
+    if (m_pPreparedDict)
+    {
+        BrotliEncoderDestroyPreparedDictionary(m_pPreparedDict);
+        m_pPreparedDict = NULL;
+    }
+#endif
+}
+
+
+int BrotliBuf::setDictionary(const char *pDict, size_t len)
+{
+#ifdef LS_BROTLI_SHARED_DICT
+    if (m_iType == COMPRESSOR_DECOMPRESS)
+    {
+        if (!m_pDecoder)
+            return LS_FAIL;
+        return (BrotliDecoderAttachDictionary(m_pDecoder,
+                    BROTLI_SHARED_DICTIONARY_RAW, len,
+                    (const uint8_t *)pDict) == BROTLI_TRUE) ? LS_OK : LS_FAIL;
+    }
+    if (!m_pEncoder)
+        return LS_FAIL;
+    releaseDictionary();
+    m_pPreparedDict = BrotliEncoderPrepareDictionary(
+        BROTLI_SHARED_DICTIONARY_RAW, len, (const uint8_t *)pDict,
+        BROTLI_MAX_QUALITY, NULL, NULL, NULL);
+    if (!m_pPreparedDict)
+        return LS_FAIL;
+    return (BrotliEncoderAttachPreparedDictionary(m_pEncoder, m_pPreparedDict)
+            == BROTLI_TRUE) ? LS_OK : LS_FAIL;
+#else
+    return LS_FAIL;
+#endif
+}
+
+
 int BrotliBuf::init(int type, int level)
 {
     if (type == COMPRESSOR_DECOMPRESS)
@@ -192,6 +241,7 @@ int BrotliBuf::reset()
     {
         if (m_pEncoder != NULL)
             BrotliEncoderDestroyInstance(m_pEncoder);
+        releaseDictionary();
         m_pEncoder = BrotliEncoderCreateInstance(NULL, NULL, NULL);
         return (m_pEncoder ? LS_OK : LS_FAIL);
     }
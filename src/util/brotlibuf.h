@@ -27,6 +27,10 @@
 #include <brotli/encode.h>
 #include <brotli/decode.h>
 
+//brotli 1.1 and later can take a raw shared dictionary, needed for "dcb".
+#ifdef SHARED_BROTLI_MAX_COMPOUND_DICTS
+#define LS_BROTLI_SHARED_DICT
+#endif
 
 class VMemBuf;
 
@@ -40,6 +44,9 @@ class BrotliBuf : public Compressor
     size_t          m_iAvailOut;
     const uint8_t  *m_pNextIn;
     uint8_t        *m_pNextOut;
+#ifdef LS_BROTLI_SHARED_DICT
+    BrotliEncoderPreparedDictionary *m_pPreparedDict;
+#endif
     //uint32_t        m_crc;
 
     int process(BrotliEncoderOperation op);
@@ -47,6 +54,7 @@ class BrotliBuf : public Compressor
     int decompress(const char *pBuf, int len);
 
     int isStreamFinished();
+    void releaseDictionary();
 public:
     BrotliBuf();
     ~BrotliBuf();
@@ -69,6 +77,7 @@ public:
     int release();
 
     int resetCompressCache();
+    int setDictionary(const char *pDict, size_t len);
     const char *getLastError() const;
 
     LS_NO_COPY_ASSIGN(BrotliBuf);
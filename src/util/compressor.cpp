@@ -50,6 +50,12 @@ int Compressor::resetCompressCache()
 }
 
 
+int Compressor::setDictionary(const char *pDict, size_t len)
+{
+    return LS_FAIL;
+}
+
+
 int Compressor::processFile(int type, const char *pFileName,
                          const char *pCompressFileName)
 {
@@ -20,6 +20,7 @@
 
 #include <lsdef.h>
 #include <inttypes.h>
+#include <stddef.h>
 
 class VMemBuf;
 
@@ -60,6 +61,12 @@ public:
     virtual const char *getLastError() const = 0;
 
     virtual int resetCompressCache();
+    /**
+     * Uses raw bytes as a shared dictionary for the next stream, must be
+     * called after init() or reset() and before beginStream(). The buffer
+     * has to stay valid until the stream ends. LS_FAIL if not supported.
+     */
+    virtual int setDictionary(const char *pDict, size_t len);
     virtual int write(const char *pBuf, int len) = 0;
     virtual int processFile(int type, const char *pFileName,
                     const char *pCompressFileName);
@@ -1,40 +0,0 @@
-/*****************************************************************************
-*    Open LiteSpeed is an open source HTTP server.                           *
-*    Copyright (C) 2013 - 2020  LiteSpeed Technologies, Inc.                 *
-*                                                                            *
-*    This program is free software: you can redistribute it and/or modify    *
-*    it under the terms of the GNU General Public License as published by    *
-*    the Free Software Foundation, either version 3 of the License, or       *
-*    (at your option) any later version.                                     *
-*                                                                            *
-*    This program is distributed in the hope that it will be useful,         *
-*    but WITHOUT ANY WARRANTY; without even the implied warranty of          *
-*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            *
-*    GNU General Public License for more details.                            *
-*                                                                            *
-*    You should have received a copy of the GNU General Public License       *
-*    along with this program. If not, see http://www.gnu.org/licenses/.      *
-*****************************************************************************/
-#ifndef TIMERPROCESSOR_H
-#define TIMERPROCESSOR_H
-
-
-class TimerTask;
-class TaskSet;
-
-class TimerProcessor
-{
-    TaskSet *m_pSet;
-
-    TimerProcessor(const TimerProcessor &rhs);
-    void operator=(const TimerProcessor &rhs);
-public:
-    TimerProcessor();
-    virtual ~TimerProcessor();
-    void reset();
-    void add(TimerTask *pSet);
-    void remove(TimerTask *pSet);
-    virtual void onTimer(TimerTask *task) = 0;
-};
-
-#endif
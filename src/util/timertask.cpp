@@ -1,38 +0,0 @@
-/*****************************************************************************
-*    Open LiteSpeed is an open source HTTP server.                           *
-*    Copyright (C) 2013 - 2020  LiteSpeed Technologies, Inc.                 *
-*                                                                            *
-*    This program is free software: you can redistribute it and/or modify    *
-*    it under the terms of the GNU General Public License as published by    *
-*    the Free Software Foundation, either version 3 of the License, or       *
-*    (at your option) any later version.                                     *
-*                                                                            *
-*    This program is distributed in the hope that it will be useful,         *
-*    but WITHOUT ANY WARRANTY; without even the implied warranty of          *
-*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            *
-*    GNU General Public License for more details.                            *
-*                                                                            *
-*    You should have received a copy of the GNU General Public License       *
-*    along with this program. If not, see http://www.gnu.org/licenses/.      *
-*****************************************************************************/
-#include "timertask.h"
-
-TimerTask::TimerTask()
-    : m_iScheduled(0)
-    , m_iEvent(0)
-    , m_pTimer(0)
-    , m_pProcessor(0)
-{
-}
-TimerTask::~TimerTask()
-{
-}
-
-void TimerTask::reset()
-{
-    m_iScheduled     = 0;
-    m_iEvent         = 0;
-    m_pProcessor    = 0;
-}
-
-
@@ -0,0 +1,232 @@
+/*****************************************************************************
+*    Open LiteSpeed is an open source HTTP server.                           *
+*    Copyright (C) 2013 - 2020  LiteSpeed Technologies, Inc.                 *
+*                                                                            *
+*    This program is free software: you can redistribute it and/or modify    *
+*    it under the terms of the GNU General Public License as published by    *
+*    the Free Software Foundation, either version 3 of the License, or       *
+*    (at your option) any later version.                                     *
+*                                                                            *
+*    This program is distributed in the hope that it will be useful,         *
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            *
+*    GNU General Public License for more details.                            *
+*                                                                            *
+*    You should have received a copy of the GNU General Public License       *
+*    along with this program. If not, see http://www.gnu.org/licenses/.      *
+*****************************************************************************/
+#include "timingwheel.h"
+
+#include <time.h>
+
+
+#define TW_ROOT_MASK    (TW_ROOT_SIZE - 1)
+#define TW_LEVEL_MASK   (TW_LEVEL_SIZE - 1)
+#define TW_LEVEL_SHIFT(l)   (TW_ROOT_BITS + TW_LEVEL_BITS * (l))
+
+
+static inline void initSlot(DLinkedObj *pSlot)
+{
+    pSlot->setNext(pSlot);
+    pSlot->setPrev(pSlot);
+}
+
+
+static inline bool isSlotEmpty(const DLinkedObj *pSlot)
+{
+    return pSlot->next() == pSlot;
+}
+
+
+TimingWheel::TimingWheel()
+    : m_iCurrent(0)
+{
+    int i, l;
+    for (i = 0; i < TW_ROOT_SIZE; ++i)
+        initSlot(&m_root[i]);
+    for (l = 0; l < TW_LEVELS - 1; ++l)
+        for (i = 0; i < TW_LEVEL_SIZE; ++i)
+            initSlot(&m_levels[l][i]);
+}
+
+
+TimingWheel::~TimingWheel()
+{
+    DLinkedObj tmp;
+    int i, l;
+    for (i = 0; i < TW_ROOT_SIZE; ++i)
+    {
+        initSlot(&tmp);
+        detachAll(&m_root[i], &tmp);
+        while (!isSlotEmpty(&tmp))
+            tmp.next()->remove();
+    }
+    for (l = 0; l < TW_LEVELS - 1; ++l)
+        for (i = 0; i < TW_LEVEL_SIZE; ++i)
+        {
+            initSlot(&tmp);
+            detachAll(&m_levels[l][i], &tmp);
+            while (!isSlotEmpty(&tmp))
+                tmp.next()->remove();
+        }
+}
+
+
+bool TimingWheel::empty() const
+{
+    int i, l;
+    for (i = 0; i < TW_ROOT_SIZE; ++i)
+        if (!isSlotEmpty(&m_root[i]))
+            return false;
+    for (l = 0; l < TW_LEVELS - 1; ++l)
+        for (i = 0; i < TW_LEVEL_SIZE; ++i)
+            if (!isSlotEmpty(&m_levels[l][i]))
+                return false;
+    return true;
+}
+
+
+/**
+ * Moves the whole chain of pSlot to the empty list head pTo, pSlot is left
+ * empty. Entries stay linked so that they can still be cancelled.
+ */
+void TimingWheel::detachAll(DLinkedObj *pSlot, DLinkedObj *pTo)
+{
+    if (isSlotEmpty(pSlot))
+        return;
+    DLinkedObj *pFirst = pSlot->next();
+    DLinkedObj *pLast = pSlot->prev();
+    pTo->setNext(pFirst);
+    pFirst->setPrev(pTo);
+    pTo->setPrev(pLast);
+    pLast->setNext(pTo);
+    initSlot(pSlot);
+}
+
+
+void TimingWheel::place(TimingWheelEntry *pEntry)
+{
+    uint64_t base = m_iCurrent + 1;
+    uint64_t expire = pEntry->m_iExpire;
+    uint64_t delta;
+    DLinkedObj *pSlot;
+    int level;
+
+    if (expire < base)
+        expire = base;
+    delta = expire - base;
+    if (delta > TW_MAX_DELAY)
+    {
+        delta = TW_MAX_DELAY;
+        expire = base + delta;
+    }
+
+    if (delta < TW_ROOT_SIZE)
+        pSlot = &m_root[expire & TW_ROOT_MASK];
+    else
+    {
+        for (level = 0; level < TW_LEVELS - 2; ++level)
+            if (delta < (1ULL << TW_LEVEL_SHIFT(level + 1)))
+                break;
+        pSlot = &m_levels[level][(expire >> TW_LEVEL_SHIFT(level))
+                                 & TW_LEVEL_MASK];
+    }
+    pSlot->addPrev(pEntry);
+}
+
+
+void TimingWheel::arm(TimingWheelEntry *pEntry, uint64_t expireMs)
+{
+    pEntry->cancel();
+    pEntry->m_iExpire = expireMs;
+    place(pEntry);
+}
+
+
+/**
+ * Re-distributes the slot of an upper wheel that the current time has
+ * entered, returns the index of that slot so that the caller knows
+ * whether the next wheel wrapped as well.
+ */
+int TimingWheel::cascade(int level)
+{
+    DLinkedObj tmp;
+    int index = ((m_iCurrent + 1) >> TW_LEVEL_SHIFT(level)) & TW_LEVEL_MASK;
+
+    initSlot(&tmp);
+    detachAll(&m_levels[level][index], &tmp);
+    while (!isSlotEmpty(&tmp))
+    {
+        TimingWheelEntry *pEntry = static_cast<TimingWheelEntry *>(
+                                       tmp.next());
+        pEntry->remove();
+        place(pEntry);
+    }
+    return index;
+}
+
+
+uint64_t TimingWheel::nextExpire() const
+{
+    uint64_t tick = m_iCurrent + 1;
+    int index;
+    for (int i = 0; i < TW_ROOT_SIZE; ++i, ++tick)
+    {
+        index = tick & TW_ROOT_MASK;
+        // entries of the upper wheels are never due before they cascade
+        if (index == 0 || !isSlotEmpty(&m_root[index]))
+            break;
+    }
+    return tick;
+}
+
+
+uint64_t TimingWheel::now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+int TimingWheel::advance(uint64_t nowMs)
+{
+    DLinkedObj due;
+    uint64_t tick;
+    int count = 0;
+    int level;
+
+    while (m_iCurrent < nowMs)
+    {
+        tick = m_iCurrent + 1;
+        int index = tick & TW_ROOT_MASK;
+        if (index == 0)
+        {
+            for (level = 0; level < TW_LEVELS - 1; ++level)
+                if (cascade(level) != 0)
+                    break;
+        }
+
+        initSlot(&due);
+        detachAll(&m_root[index], &due);
+        // callbacks see the tick being run, re-arming for it lands in the
+        // next tick instead of this slot
+        m_iCurrent = tick;
+        while (!isSlotEmpty(&due))
+        {
+            TimingWheelEntry *pEntry = static_cast<TimingWheelEntry *>(
+                                           due.next());
+            pEntry->remove();
+            if (pEntry->m_iExpire > tick)
+            {
+                // clamped to TW_MAX_DELAY, not really due yet
+                place(pEntry);
+                continue;
+            }
+            ++count;
+            pEntry->onExpire();
+        }
+    }
+    return count;
+}
+
@@ -0,0 +1,107 @@
+/*****************************************************************************
+*    Open LiteSpeed is an open source HTTP server.                           *
+*    Copyright (C) 2013 - 2020  LiteSpeed Technologies, Inc.                 *
+*                                                                            *
+*    This program is free software: you can redistribute it and/or modify    *
+*    it under the terms of the GNU General Public License as published by    *
+*    the Free Software Foundation, either version 3 of the License, or       *
+*    (at your option) any later version.                                     *
+*                                                                            *
+*    This program is distributed in the hope that it will be useful,         *
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            *
+*    GNU General Public License for more details.                            *
+*                                                                            *
+*    You should have received a copy of the GNU General Public License       *
+*    along with this program. If not, see http://www.gnu.org/licenses/.      *
+*****************************************************************************/
+#ifndef TIMINGWHEEL_H
+#define TIMINGWHEEL_H
+
+
+#include <lsdef.h>
+#include <util/linkedobj.h>
+
+#include <stdint.h>
+
+#define TW_ROOT_BITS    8
+#define TW_LEVEL_BITS   6
+#define TW_LEVELS       4
+#define TW_ROOT_SIZE    (1 << TW_ROOT_BITS)
+#define TW_LEVEL_SIZE   (1 << TW_LEVEL_BITS)
+#define TW_MAX_DELAY    ((1ULL << (TW_ROOT_BITS + TW_LEVEL_BITS \
+                                   * (TW_LEVELS - 1))) - 1)
+
+class TimingWheel;
+
+class TimingWheelEntry : public DLinkedObj
+{
+    friend class TimingWheel;
+
+    uint64_t        m_iExpire;
+
+    LS_NO_COPY_ASSIGN(TimingWheelEntry);
+public:
+    TimingWheelEntry()
+        : m_iExpire(0)
+    {}
+    virtual ~TimingWheelEntry()     {   cancel();       }
+
+    virtual void onExpire() = 0;
+
+    bool isArmed() const            {   return next() != NULL;  }
+    uint64_t getExpire() const      {   return m_iExpire;       }
+    void cancel()
+    {
+        if (next())
+            remove();
+    }
+};
+
+
+/**
+ * Hierarchical timing wheel with 1 millisecond ticks. The root wheel has
+ * 256 slots, each of the 3 upper wheels has 64 slots covering 64 times the
+ * span of the one below, entries cascade down as the time advances.
+ * Arm and cancel are O(1); advance() only touches the slots that come due.
+ * Delays beyond TW_MAX_DELAY (about 18 hours) are clamped and the entry
+ * is re-queued until it is really due.
+ */
+class TimingWheel
+{
+    uint64_t        m_iCurrent;
+    DLinkedObj      m_root[TW_ROOT_SIZE];
+    DLinkedObj      m_levels[TW_LEVELS - 1][TW_LEVEL_SIZE];
+
+    void place(TimingWheelEntry *pEntry);
+    int  cascade(int level);
+    static void detachAll(DLinkedObj *pSlot, DLinkedObj *pTo);
+
+    LS_NO_COPY_ASSIGN(TimingWheel);
+public:
+    TimingWheel();
+    ~TimingWheel();
+
+    void init(uint64_t nowMs)       {   m_iCurrent = nowMs;     }
+    uint64_t getCurrent() const     {   return m_iCurrent;      }
+    bool empty() const;
+
+    /** An entry armed at or before getCurrent() runs on the next tick. */
+    void arm(TimingWheelEntry *pEntry, uint64_t expireMs);
+    void armAfter(TimingWheelEntry *pEntry, uint32_t delayMs)
+    {   arm(pEntry, m_iCurrent + delayMs);   }
+
+    /**
+     * Earliest tick that may run an entry. It is exact for the root wheel,
+     * otherwise it is the next tick an upper wheel cascades at.
+     */
+    uint64_t nextExpire() const;
+
+    /** Runs every entry due at or before nowMs, returns the number run. */
+    int advance(uint64_t nowMs);
+
+    /** Monotonic clock in milliseconds, not affected by time adjustments. */
+    static uint64_t now();
+};
+
+#endif // TIMINGWHEEL_H
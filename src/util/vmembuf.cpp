@@ -26,6 +26,7 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <lsr/ls_atomic.h>
+#include <lsr/ls_offload.h>
 #include <lsr/ls_strtool.h>
 
 #define _RELEASE_MMAP
@@ -38,17 +39,164 @@ int  VMemBuf::s_iCurAnonMapBlocks = 0;
 int  VMemBuf::s_iKeepOpened = 0;
 int  VMemBuf::s_iFdSpare = -1; //open( "/dev/null", O_RDWR );
 char VMemBuf::s_aTmpFileTemplate[256] = "/tmp/tmp-XXXXXX";
+int  VMemBuf::s_iAnonHugePages = VMBUF_HUGEPAGE_OFF;
+int  VMemBuf::s_iAsyncSwap = 1;
 BufList *s_pAnonPool = NULL;
 ls_spinlock_t   s_LockAnonPool;
 
+//Free lists of multi-block anonymous maps, 2, 4, 8 and 16 blocks, single
+//blocks go to s_pAnonPool.
+#define VMBUF_SIZE_CLASSES      4
+#define VMBUF_MAX_CLASS_BLOCKS  16
+#define VMBUF_HUGE_PAGE_SIZE    (2 * 1024 * 1024)
+static BufList *s_pClassPool[VMBUF_SIZE_CLASSES];
+
+static char    *s_pArena = NULL;
+static size_t   s_iArenaSize = 0;
+
+
+//A block carved from the arena, the memory is owned by the arena and is
+//never unmapped on its own.
+class ArenaBlockBuf : public BlockBuf
+{
+public:
+    ArenaBlockBuf(char *pBuf, size_t size)
+        : BlockBuf(pBuf, size)
+    {}
+    ~ArenaBlockBuf()    {}
+};
+
+
+static int isArenaBlock(const BlockBuf *pBuf)
+{
+    return ((pBuf->getBuf() >= s_pArena)
+            && (pBuf->getBuf() < s_pArena + s_iArenaSize));
+}
+
+
 void VMemBuf::initAnonPool()
 {
     ls_atomic_spin_lock(&s_LockAnonPool);
     s_pAnonPool = new BufList();
+    for (int i = 0; i < VMBUF_SIZE_CLASSES; ++i)
+        s_pClassPool[i] = new BufList();
     ls_atomic_spin_unlock(&s_LockAnonPool);
 }
 
 
+static char *mapHugePageArena(size_t size, int mode)
+{
+    char *pBuf = (char *)MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (mode == VMBUF_HUGEPAGE_EXPLICIT)
+    {
+        pBuf = (char *)mmap(NULL, size, PROT_READ | PROT_WRITE,
+                            MAP_ANON | MAP_PRIVATE | MAP_HUGETLB, -1, 0);
+        if (pBuf != MAP_FAILED)
+            return pBuf;
+        perror("mmap() with MAP_HUGETLB failed, fall back to transparent "
+               "hugepages");
+    }
+#endif
+    //over map by one hugepage to align the region, a private map so
+    //transparent hugepages apply to it.
+    pBuf = (char *)mmap(NULL, size + VMBUF_HUGE_PAGE_SIZE,
+                        PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+    if (pBuf == MAP_FAILED)
+        return pBuf;
+    char *pAligned = (char *)(((unsigned long)pBuf + VMBUF_HUGE_PAGE_SIZE - 1)
+                              & ~((unsigned long)VMBUF_HUGE_PAGE_SIZE - 1));
+    if (pAligned > pBuf)
+        munmap(pBuf, pAligned - pBuf);
+    munmap(pAligned + size, pBuf + VMBUF_HUGE_PAGE_SIZE - pAligned);
+#ifdef MADV_HUGEPAGE
+    madvise(pAligned, size, MADV_HUGEPAGE);
+#endif
+    return pAligned;
+}
+
+
+void VMemBuf::initAnonArena()
+{
+    if ((s_iAnonHugePages == VMBUF_HUGEPAGE_OFF) || (s_pArena != NULL))
+        return;
+    size_t size = (size_t)s_iMaxAnonMapBlocks * s_iBlockSize;
+    size = (size + VMBUF_HUGE_PAGE_SIZE - 1) / VMBUF_HUGE_PAGE_SIZE
+           * VMBUF_HUGE_PAGE_SIZE;
+    if (size == 0)
+        return;
+    char *pBuf = mapHugePageArena(size, s_iAnonHugePages);
+    if (pBuf == MAP_FAILED)
+    {
+        perror("Failed to map hugepage arena for anonymous memory buffers");
+        return;
+    }
+    //Fault the pages in now instead of on the first requests.
+    char *p;
+    for (p = pBuf; p < pBuf + size; p += 4096)
+        *p = 0;
+
+    ls_atomic_spin_lock(&s_LockAnonPool);
+    s_pArena = pBuf;
+    s_iArenaSize = size;
+    for (p = pBuf; p < pBuf + size; p += s_iBlockSize)
+        s_pAnonPool->push_back(new ArenaBlockBuf(p, s_iBlockSize));
+    ls_atomic_spin_unlock(&s_LockAnonPool);
+}
+
+
+//0 for a single block, 1 - VMBUF_SIZE_CLASSES for a power of two count of
+//blocks, -1 if the size is not cached.
+int VMemBuf::getSizeClass(size_t size)
+{
+    if (size % s_iBlockSize)
+        return LS_FAIL;
+    size_t blocks = size / s_iBlockSize;
+    int cls = 0;
+    while (blocks > 1)
+    {
+        if (blocks & 1)
+            return LS_FAIL;
+        blocks >>= 1;
+        ++cls;
+    }
+    return (cls <= VMBUF_SIZE_CLASSES) ? cls : LS_FAIL;
+}
+
+
+//Must be called with s_LockAnonPool held.
+void VMemBuf::freeAnonBlock(BlockBuf *pBuf, int reuse)
+{
+    int cls;
+    if (reuse && ((cls = getSizeClass(pBuf->getBlockSize())) != LS_FAIL))
+    {
+        if (cls == 0)
+        {
+            s_pAnonPool->push_back(pBuf);
+            return;
+        }
+        //keep each size class within 1/16 of the in-memory buffer budget.
+        BufList *pList = s_pClassPool[cls - 1];
+        if ((pList->size() << cls) < s_iMaxAnonMapBlocks / 16)
+        {
+            pList->push_back(pBuf);
+            return;
+        }
+    }
+    //An arena block is not unmapped by delete, a pinned one that may still
+    //be referenced by the kernel is just retired.
+    delete pBuf;
+}
+
+
+//File backed blocks converted to in-memory must not go to the pool, the
+//arena blocks among them can.
+int VMemBuf::canReuse(BlockBuf *pBuf) const
+{
+    return !m_iPinned && (!m_iNoRecycle || isArenaBlock(pBuf));
+}
+
+
 void VMemBuf::setMaxAnonMapSize(int sz)
 {
     ls_atomic_spin_lock(&s_LockAnonPool);
@@ -79,8 +227,142 @@ void VMemBuf::setTempFileTemplate(const char *pTemp)
 }
 
 
+//Writes of a swap file queued past this are done in place, it bounds the
+//memory held by a buffer when the disk cannot keep up.
+#define VMBUF_MAX_SWAP_PENDING  64
+
+//A swap file shared by a buffer and its pending block writes, the last one
+//to let go closes it.
+struct SwapFile
+{
+    int     m_iFd;
+    int     m_iRef;
+    int     m_iPending;
+};
+
+//The memory of a swap file block, kept until its content is on disk.
+struct SwapStaging
+{
+    char           *m_pBuf;
+    int             m_iRef;
+    int             m_iFailed;
+    //copied from while its write was in flight, the write of this one
+    //waits for it so the two cannot land out of order.
+    SwapStaging    *m_pPrev;
+};
+
+struct SwapWriteJob
+{
+    SwapFile       *m_pFile;
+    SwapStaging    *m_pStaging;
+    off_t           m_offset;
+    int             m_iSize;
+};
+
+
+static void releaseStaging(SwapStaging *pStaging)
+{
+    if (ls_atomic_sub_fetch(&pStaging->m_iRef, 1) == 0)
+    {
+        if (pStaging->m_pPrev)
+            releaseStaging(pStaging->m_pPrev);
+        free(pStaging->m_pBuf);
+        delete pStaging;
+    }
+}
+
+
+//1 while a queued write still holds it.
+static int isStagingWriting(SwapStaging *pStaging)
+{
+    return __atomic_load_n(&pStaging->m_iRef, __ATOMIC_ACQUIRE) > 1;
+}
+
+
+static SwapStaging *newStaging(size_t size)
+{
+    char *pBuf = (char *)malloc(size);
+    if (!pBuf)
+        return NULL;
+    SwapStaging *pStaging = new SwapStaging();
+    pStaging->m_pBuf = pBuf;
+    pStaging->m_iRef = 1;
+    pStaging->m_iFailed = 0;
+    pStaging->m_pPrev = NULL;
+    return pStaging;
+}
+
+
+static void releaseSwapFileRef(SwapFile *pFile)
+{
+    if (ls_atomic_sub_fetch(&pFile->m_iRef, 1) == 0)
+    {
+        ::close(pFile->m_iFd);
+        delete pFile;
+    }
+}
+
+
+//A block of a buffer with async swap, it holds staging memory until the
+//block is written out, then it is mapped from the swap file when needed.
+class SwapBlockBuf : public BlockBuf
+{
+public:
+    explicit SwapBlockBuf(SwapStaging *pStaging, size_t size)
+        : BlockBuf(pStaging->m_pBuf, size)
+        , m_pStaging(pStaging)
+        , m_iDirty(1)
+    {}
+    ~SwapBlockBuf()
+    {
+        if (m_pStaging)
+            releaseStaging(m_pStaging);
+        else if (getBuf())
+            munmap(getBuf(), getBlockSize());
+    }
+
+    //Drops the staging memory once the content is on disk, m_iFailed is
+    //only settled once the write has let go of it.
+    int dropStaging()
+    {
+        if (m_iDirty || isStagingWriting(m_pStaging)
+            || m_pStaging->m_iFailed)
+            return 0;
+        releaseStaging(m_pStaging);
+        m_pStaging = NULL;
+        setBlockBuf(NULL, getBlockSize());
+        return 1;
+    }
+
+    SwapStaging    *m_pStaging;
+    //changed since the last write was queued.
+    char            m_iDirty;
+};
+
+
+static int performSwapWrite(void *param)
+{
+    SwapWriteJob *pJob = (SwapWriteJob *)param;
+    if (pwrite(pJob->m_pFile->m_iFd, pJob->m_pStaging->m_pBuf, pJob->m_iSize,
+               pJob->m_offset) != pJob->m_iSize)
+    {
+        perror("Failed to write swap file block");
+        //keep it in memory for good.
+        pJob->m_pStaging->m_iFailed = 1;
+    }
+    ls_atomic_sub_fetch(&pJob->m_pFile->m_iPending, 1);
+    releaseStaging(pJob->m_pStaging);
+    releaseSwapFileRef(pJob->m_pFile);
+    delete pJob;
+    return 0;
+}
+
+
 VMemBuf::VMemBuf()
     : m_bufList(4)
+    , m_pSwapFile(NULL)
+    , m_iSwapReap(0)
+    , m_iAsyncSwap(0)
 {
     reset();
 }
@@ -101,20 +383,20 @@ void VMemBuf::releaseBlocks(bool locked)
     {
         ls_atomic_spin_lock(&s_LockAnonPool);
         s_iCurAnonMapBlocks -= m_iCurTotalSize / s_iBlockSize;
-        if (m_iNoRecycle)
-            m_bufList.release_objects();
-        else
-        {
-            s_pAnonPool->push_back(m_bufList);
-            m_bufList.clear();
-        }
+        BlockBuf **pBlock;
+        for (pBlock = m_bufList.begin(); pBlock < m_bufList.end(); ++pBlock)
+            freeAnonBlock(*pBlock, canReuse(*pBlock));
+        m_bufList.clear();
         ls_atomic_spin_unlock(&s_LockAnonPool);
     }
     else
         m_bufList.release_objects();
+    releaseSwapFile();
+    m_iSwapReap = 0;
     memset(&m_curWBlkPos, 0,
            (char *)(&m_pCurRPos + 1) - (char *)&m_curWBlkPos);
     m_iCurTotalSize = 0;
+    m_iPinned = 0;
     if (!locked) {
         ls_atomic_spin_unlock(&m_lock);
     }
@@ -143,18 +425,11 @@ void VMemBuf::recycle(BlockBuf *pBuf)
     ls_atomic_spin_lock(&s_LockAnonPool);
     if (m_iType == VMBUF_ANON_MAP)
     {
-        if (pBuf->getBlockSize() == s_iBlockSize)
-        {
-            if (m_iNoRecycle)
-                delete pBuf;
-            else
-                s_pAnonPool->push_back(pBuf);
-            --s_iCurAnonMapBlocks;
-            return;
-        }
         s_iCurAnonMapBlocks -= pBuf->getBlockSize() / s_iBlockSize;
+        freeAnonBlock(pBuf, canReuse(pBuf));
     }
-    delete pBuf;
+    else
+        delete pBuf;
     ls_atomic_spin_unlock(&s_LockAnonPool);
 }
 
@@ -172,6 +447,7 @@ void VMemBuf::rewindWOff(off_t rewind)
             {
                 m_curWBlkPos -= (*m_pCurWBlock)->getBlockSize();
                 m_pCurWBlock--;
+                markSwapDirty();
                 if (!(*m_pCurWBlock)->getBuf())
                 {
                     if ( remapBlock(*m_pCurWBlock, m_curWBlkPos - s_iBlockSize) == 0)
@@ -215,6 +491,11 @@ int VMemBuf::shrinkBuf(off_t size)
     */
     if (size < 0)
         size = 0;
+    if (m_iPinned)
+    {
+        releaseBlocks(false);
+        return 0;
+    }
     if ((m_iType == VMBUF_FILE_MAP) && (m_iFd != -1))
     {
         if (m_iCurTotalSize > size)
@@ -258,8 +539,188 @@ int VMemBuf::remapBlock(BlockBuf *pBlock, off_t pos)
 }
 
 
+//Takes the memory off a file backed block the reader or writer has moved
+//past, returns what to munmap() once m_lock is released.
+char *VMemBuf::detachFileBlock(BlockBuf *pBlock)
+{
+    char *pBuf = pBlock->getBuf();
+    if (m_iAsyncSwap && ((SwapBlockBuf *)pBlock)->m_pStaging)
+    {
+        //if it is not on disk yet, reapSwapBlocks() drops it later.
+        ((SwapBlockBuf *)pBlock)->dropStaging();
+        return NULL;
+    }
+    pBlock->setBlockBuf(NULL, pBlock->getBlockSize());
+    return pBuf;
+}
+
+
+void VMemBuf::releaseFileBlock(BlockBuf *pBlock)
+{
+    int size = pBlock->getBlockSize();
+    char *pBuf = detachFileBlock(pBlock);
+    if (pBuf)
+        munmap(pBuf, size);
+}
+
+
+BlockBuf *VMemBuf::newSwapBlock()
+{
+    SwapStaging *pStaging = newStaging(s_iBlockSize);
+    if (!pStaging)
+        return NULL;
+    return new SwapBlockBuf(pStaging, s_iBlockSize);
+}
+
+
+//Queues the write of a block the writer is leaving, the event loop never
+//waits on the disk for it.
+void VMemBuf::flushSwapBlock(BlockBuf *pBlock, off_t pos)
+{
+    SwapBlockBuf *pSwap = (SwapBlockBuf *)pBlock;
+    if (!pSwap->m_pStaging || !pSwap->m_iDirty)
+        return;
+    SwapStaging *pPrev = pSwap->m_pStaging->m_pPrev;
+    if (pPrev)
+    {
+        //stays dirty, flushSwapBlocks() comes back to it.
+        if (isStagingWriting(pPrev))
+            return;
+        pSwap->m_pStaging->m_pPrev = NULL;
+        releaseStaging(pPrev);
+    }
+    if (!m_pSwapFile)
+    {
+        int fd = dup(m_iFd);
+        if (fd == -1)
+        {
+            perror("dup() failed in flushSwapBlock");
+            return;
+        }
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        m_pSwapFile = new SwapFile();
+        m_pSwapFile->m_iFd = fd;
+        m_pSwapFile->m_iRef = 1;
+        m_pSwapFile->m_iPending = 0;
+    }
+    SwapWriteJob *pJob = new SwapWriteJob();
+    pJob->m_pFile = m_pSwapFile;
+    pJob->m_pStaging = pSwap->m_pStaging;
+    pJob->m_offset = pos;
+    pJob->m_iSize = s_iBlockSize;
+    ls_atomic_add_fetch(&m_pSwapFile->m_iRef, 1);
+    ls_atomic_add_fetch(&pSwap->m_pStaging->m_iRef, 1);
+    pSwap->m_iDirty = 0;
+
+    //without offload threads, or too far behind, it is written in place.
+    struct Offloader *pOffloader = NULL;
+    if (ls_atomic_add_fetch(&m_pSwapFile->m_iPending, 1)
+        <= VMBUF_MAX_SWAP_PENDING)
+        pOffloader = offloader_get_shared();
+    offloader_submit(pOffloader, performSwapWrite, NULL, pJob);
+}
+
+
+//Queues the writes of the dirty blocks up to the writer, including the
+//ones held back while an earlier write of the same block was in flight.
+void VMemBuf::flushSwapBlocks()
+{
+    int end = m_pCurWBlock - m_bufList.begin();
+    for (int i = m_iSwapReap; i <= end; ++i)
+        flushSwapBlock(m_bufList[i], (off_t)i * s_iBlockSize);
+}
+
+
+//Called whenever the writer enters a block. If a queued write may still
+//be reading the staging memory, the writer gets a copy instead.
+void VMemBuf::markSwapDirty()
+{
+    if (!m_iAsyncSwap || (m_iType != VMBUF_FILE_MAP) || !m_pCurWBlock)
+        return;
+    SwapBlockBuf *pSwap = (SwapBlockBuf *)*m_pCurWBlock;
+    pSwap->m_iDirty = 1;
+    SwapStaging *pOld = pSwap->m_pStaging;
+    if (!pOld || !isStagingWriting(pOld))
+        return;
+    SwapStaging *pStaging = newStaging(s_iBlockSize);
+    if (!pStaging)
+    {
+        //cannot copy, wait for the disk rather than tear the block.
+        while (isStagingWriting(pOld))
+            usleep(100);
+        return;
+    }
+    memmove(pStaging->m_pBuf, pOld->m_pBuf, s_iBlockSize);
+    //the reference of the block moves over to m_pPrev.
+    pStaging->m_pPrev = pOld;
+    pSwap->m_pStaging = pStaging;
+    pSwap->setBlockBuf(pStaging->m_pBuf, s_iBlockSize);
+    if ((m_pCurWPos >= pOld->m_pBuf)
+        && (m_pCurWPos <= pOld->m_pBuf + s_iBlockSize))
+        m_pCurWPos = pStaging->m_pBuf + (m_pCurWPos - pOld->m_pBuf);
+    if ((m_pCurRBlock == m_pCurWBlock) && (m_pCurRPos >= pOld->m_pBuf)
+        && (m_pCurRPos <= pOld->m_pBuf + s_iBlockSize))
+        m_pCurRPos = pStaging->m_pBuf + (m_pCurRPos - pOld->m_pBuf);
+}
+
+
+//Drops the staging memory of the blocks behind the writer that are on
+//disk, the reader maps them from the swap file when it gets there. Blocks
+//before m_iSwapReap hold none. Must be called with m_lock held.
+void VMemBuf::reapSwapBlocks()
+{
+    int end = m_pCurWBlock - m_bufList.begin();
+    int reap = end;
+    int i;
+    SwapBlockBuf *pBlock;
+    for (i = m_iSwapReap; i < end; ++i)
+    {
+        pBlock = (SwapBlockBuf *)m_bufList[i];
+        if (pBlock->m_pStaging
+            && ((m_bufList.begin() + i == m_pCurRBlock)
+                || !pBlock->dropStaging())
+            && (reap == end))
+            reap = i;
+    }
+    m_iSwapReap = reap;
+}
+
+
+void VMemBuf::releaseSwapFile()
+{
+    if (m_pSwapFile)
+    {
+        releaseSwapFileRef(m_pSwapFile);
+        m_pSwapFile = NULL;
+    }
+}
+
+
+int VMemBuf::flushSwapFile()
+{
+    if (!m_iAsyncSwap || (m_iType != VMBUF_FILE_MAP))
+        return 0;
+    //a queued write of older content must not land after ours.
+    while (m_pSwapFile && (ls_atomic_value(&m_pSwapFile->m_iPending) > 0))
+        usleep(100);
+    int i;
+    BlockBuf *pBlock;
+    for (i = 0; i < m_bufList.size(); ++i)
+    {
+        pBlock = m_bufList[i];
+        if (((SwapBlockBuf *)pBlock)->m_pStaging
+            && (pwrite(m_iFd, pBlock->getBuf(), s_iBlockSize,
+                       (off_t)i * s_iBlockSize) != (int)s_iBlockSize))
+            return LS_FAIL;
+    }
+    return 0;
+}
+
+
 int VMemBuf::reinit(off_t TargetSize)
 {
+    if (m_iPinned)
+        releaseBlocks(false);
     ls_atomic_spin_lock(&s_LockAnonPool);
     if (m_iType == VMBUF_ANON_MAP)
     {
@@ -305,9 +766,9 @@ int VMemBuf::reinit(off_t TargetSize)
             if ((m_pCurWBlock) &&
                 (m_pCurWBlock != m_bufList.begin()) &&
                 (m_pCurWBlock != m_pCurRBlock))
-                releaseBlock(*m_pCurWBlock);
+                releaseFileBlock(*m_pCurWBlock);
             if ((m_pCurRBlock) && (m_pCurRBlock != m_bufList.begin()))
-                releaseBlock(*m_pCurRBlock);
+                releaseFileBlock(*m_pCurRBlock);
         }
 #endif
 
@@ -324,6 +785,7 @@ int VMemBuf::reinit(off_t TargetSize)
         {
             m_curWBlkPos = m_curRBlkPos = (*m_pCurWBlock)->getBlockSize();
             m_pCurRPos = m_pCurWPos = (*m_pCurWBlock)->getBuf();
+            markSwapDirty();
         }
         else
         {
@@ -351,19 +813,29 @@ void VMemBuf::reset()
 BlockBuf *VMemBuf::getAnonMapBlock(size_t size)
 {
     BlockBuf *pBlock;
+    int blocks = (size + s_iBlockSize - 1) / s_iBlockSize;
+    if ((blocks > 1) && (blocks <= VMBUF_MAX_CLASS_BLOCKS))
+    {
+        //round up to a size class so the map can be cached.
+        int n = 2;
+        while (n < blocks)
+            n <<= 1;
+        blocks = n;
+    }
+    size = blocks * s_iBlockSize;
+    int cls = getSizeClass(size);
     ls_atomic_spin_lock(&s_LockAnonPool);
-    if (size == s_iBlockSize)
+    if (cls != LS_FAIL)
     {
-        if (!s_pAnonPool->empty())
+        BufList *pList = (cls == 0) ? s_pAnonPool : s_pClassPool[cls - 1];
+        if (!pList->empty())
         {
-            pBlock = s_pAnonPool->pop_back();
-            ++s_iCurAnonMapBlocks;
+            pBlock = pList->pop_back();
+            s_iCurAnonMapBlocks += blocks;
             ls_atomic_spin_unlock(&s_LockAnonPool);
             return pBlock;
         }
     }
-    int blocks = (size + s_iBlockSize - 1) / s_iBlockSize;
-    size = blocks * s_iBlockSize;
     char *pBuf = (char *) mmap(NULL, size, PROT_READ | PROT_WRITE,
                                MAP_ANON | MAP_SHARED, -1, 0);
     if (pBuf == MAP_FAILED)
@@ -577,6 +1049,13 @@ void VMemBuf::rewindReadWriteBuf()
 {
     if (m_bufList.empty())
         return ;
+    if (m_iPinned)
+    {
+        //the kernel may still be sending from these blocks, start over
+        //with fresh ones instead of writing over them.
+        releaseBlocks(false);
+        return;
+    }
 
 #ifdef _RELEASE_MMAP
     if (m_iType == VMBUF_FILE_MAP)
@@ -589,7 +1068,7 @@ void VMemBuf::rewindReadWriteBuf()
         if ((m_pCurRBlock) &&
             (m_pCurRBlock != m_bufList.begin()) &&
             (m_pCurRBlock != m_pCurWBlock))
-            releaseBlock(*m_pCurRBlock);
+            releaseFileBlock(*m_pCurRBlock);
     }
 #endif
     ls_atomic_spin_lock(&m_lock);
@@ -611,12 +1090,18 @@ void VMemBuf::rewindReadWriteBuf()
         m_curRBlkPos = m_curWBlkPos;
         m_pCurRPos = m_pCurWPos;
     }
+    markSwapDirty();
     ls_atomic_spin_unlock(&m_lock);
 }
 
 
 void VMemBuf::rewindWriteBuf()
 {
+    if (m_iPinned)
+    {
+        releaseBlocks(false);
+        return;
+    }
     ls_atomic_spin_lock(&m_lock);
     if (m_pCurRBlock)
     {
@@ -633,6 +1118,7 @@ void VMemBuf::rewindWriteBuf()
         m_curRBlkPos = m_curWBlkPos;
         m_pCurRPos = m_pCurWPos;
     }
+    markSwapDirty();
     ls_atomic_spin_unlock(&m_lock);
 
 }
@@ -654,7 +1140,7 @@ void VMemBuf::rewindReadBuf()
         if ((m_pCurRBlock) &&
             (m_pCurRBlock != m_bufList.begin()) &&
             (m_pCurRBlock != m_pCurWBlock))
-            releaseBlock(*m_pCurRBlock);
+            releaseFileBlock(*m_pCurRBlock);
     }
 #endif
     ls_atomic_spin_lock(&m_lock);
@@ -696,6 +1182,8 @@ int VMemBuf::mapNextWBlock()
 
         if (m_iType == VMBUF_FILE_MAP)
         {
+            if (m_iAsyncSwap)
+                flushSwapBlocks();
             if (!(*(m_pCurWBlock + 1))->getBuf())
             {
                 if (remapBlock(*(m_pCurWBlock + 1), m_curWBlkPos) == -1)
@@ -707,14 +1195,16 @@ int VMemBuf::mapNextWBlock()
 #ifdef _RELEASE_MMAP
         if (m_iType == VMBUF_FILE_MAP && m_pCurRBlock != m_pCurWBlock)
         {
-            pRelease = (*m_pCurWBlock)->getBuf();
             size = (*m_pCurWBlock)->getBlockSize();
-            (*m_pCurWBlock)->setBlockBuf(NULL, size);
+            pRelease = detachFileBlock(*m_pCurWBlock);
         }
 #endif
         ++m_pCurWBlock;
         m_curWBlkPos += (*m_pCurWBlock)->getBlockSize();
         m_pCurWPos = (*m_pCurWBlock)->getBuf();
+        markSwapDirty();
+        if (m_iAsyncSwap && (m_iType == VMBUF_FILE_MAP))
+            reapSwapBlocks();
         ls_atomic_spin_unlock(&m_lock);
 #ifdef _RELEASE_MMAP
         if (pRelease)
@@ -763,6 +1253,13 @@ int VMemBuf::grow()
         }
         break;
     case VMBUF_FILE_MAP:
+        if (m_iAsyncSwap)
+        {
+            //the file grows as the blocks are written out.
+            if ((pBlock = newSwapBlock()) == NULL)
+                return LS_FAIL;
+            break;
+        }
         if (ftruncate(m_iFd, m_iCurTotalSize + s_iBlockSize) == -1)
         {
             perror("Failed to increase temp file size with ftrancate()");
@@ -867,9 +1364,8 @@ int VMemBuf::mapNextRBlock()
 
         if (m_iType == VMBUF_FILE_MAP && m_pCurRBlock != m_pCurWBlock)
         {
-            pRelease = (*m_pCurRBlock)->getBuf();
             size = (*m_pCurRBlock)->getBlockSize();
-            (*m_pCurRBlock)->setBlockBuf(NULL, size);
+            pRelease = detachFileBlock(*m_pCurRBlock);
         }
         BlockBuf *pBuf = *(m_pCurRBlock + 1);
         if (pBuf->getBuf() == NULL)
@@ -991,6 +1487,7 @@ MMapVMemBuf::MMapVMemBuf(int TargetSize)
 {
     int type = VMBUF_ANON_MAP;
 
+    enableAsyncSwap(s_iAsyncSwap);
     if ((lowOnAnonMem()) || (TargetSize > 1024 * 1024) ||
         (TargetSize >=
          (long)((s_iMaxAnonMapBlocks - s_iCurAnonMapBlocks) * s_iBlockSize)))
@@ -1079,7 +1576,7 @@ void VMemBuf::releaseBlockBuf(off_t offset)
     pSrcBlock = m_bufList[blk];
     if (pSrcBlock->getBuf() && (pSrcBlock != *m_pCurRBlock)
         && (pSrcBlock != *m_pCurWBlock))
-        releaseBlock(pSrcBlock);
+        releaseFileBlock(pSrcBlock);
 }
 
 
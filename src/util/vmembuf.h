@@ -30,7 +30,12 @@
 #define VMBUF_ANON_MAP  1
 #define VMBUF_FILE_MAP  2
 
+#define VMBUF_HUGEPAGE_OFF          0
+#define VMBUF_HUGEPAGE_TRANSPARENT  1
+#define VMBUF_HUGEPAGE_EXPLICIT     2
+
 class BlockBuf;
+struct SwapFile;
 typedef TPointerList<BlockBuf> BufList;
 
 class VMemBuf
@@ -43,6 +48,8 @@ protected:
     static char     s_aTmpFileTemplate[256];
     static int      s_iMaxAnonMapBlocks;
     static int      s_iCurAnonMapBlocks;
+    static int      s_iAnonHugePages;
+    static int      s_iAsyncSwap;
 
 private:
     BufList         m_bufList;
@@ -53,6 +60,7 @@ private:
     short           m_iType;
     unsigned char   m_iAutoGrow;
     unsigned char   m_iNoRecycle;
+    unsigned char   m_iPinned;
     ls_spinlock_t   m_lock;
     off_t           m_curWBlkPos;
     BlockBuf      **m_pCurWBlock;
@@ -62,6 +70,10 @@ private:
     BlockBuf      **m_pCurRBlock;
     char           *m_pCurRPos;
 
+    SwapFile       *m_pSwapFile;
+    int             m_iSwapReap;
+    char            m_iAsyncSwap;
+
 
     VMemBuf(const VMemBuf &rhs);
     void operator=(const VMemBuf &rhs);
@@ -74,8 +86,21 @@ private:
     void reset();
     BlockBuf *getAnonMapBlock(size_t size);
     void recycle(BlockBuf *pBuf);
+    int  canReuse(BlockBuf *pBuf) const;
+
+    static int  getSizeClass(size_t size);
+    static void freeAnonBlock(BlockBuf *pBuf, int reuse);
 
     int  remapBlock(BlockBuf *pBlock, off_t pos);
+    char *detachFileBlock(BlockBuf *pBlock);
+    void releaseFileBlock(BlockBuf *pBlock);
+
+    BlockBuf *newSwapBlock();
+    void flushSwapBlock(BlockBuf *pBlock, off_t pos);
+    void flushSwapBlocks();
+    void markSwapDirty();
+    void reapSwapBlocks();
+    void releaseSwapFile();
 
 public:
     void deallocate();
@@ -84,6 +109,9 @@ public:
     static int lowOnAnonMem();
     static int  getMinMmapSize()  {   return s_iMinMmapSize;  }
     static void setMaxAnonMapSize(int sz);
+    static void setAnonHugePages(int mode)  {   s_iAnonHugePages = mode;    }
+    static int  getAnonHugePages()          {   return s_iAnonHugePages;    }
+    static void setAsyncSwap(int enable)    {   s_iAsyncSwap = enable;      }
     static void setTempFileTemplate(const char *pTemp);
     static char *mapTmpBlock(int fd, BlockBuf &buf, off_t  offset,
                              int write = 0);
@@ -116,6 +144,12 @@ public:
     off_t  getCurWOffset() const;
     int write(const char *pBuf, int size);
     bool isMmaped() const {   return m_iType >= VMBUF_ANON_MAP;  }
+    bool isAnonMapped() const {   return m_iType == VMBUF_ANON_MAP;  }
+
+    //Blocks that have been handed to the kernel by reference (MSG_ZEROCOPY)
+    //are never reused in place or returned to the pool, they get unmapped.
+    void pin()                      {   m_iPinned = 1;          }
+    bool isPinned() const           {   return m_iPinned;       }
     //int  seekRPos( size_t pos );
     //int  seekWPos( size_t pos );
     void rewindWriteBuf();
@@ -124,6 +158,13 @@ public:
     void rewindWOff(off_t rewind);
     int setROffset(off_t  offset);
     int getfd() const               {   return m_iFd;            }
+
+    //Swap file blocks are written behind by the offload threads, only
+    //set it on a buffer owned by the event loop, before it is used.
+    void enableAsyncSwap(int enable)    {   m_iAsyncSwap = enable;  }
+    //Writes the blocks still held in memory to the swap file in place,
+    //for a caller about to read the file through getfd().
+    int  flushSwapFile();
     off_t  getCurFileSize() const   {   return m_iCurTotalSize;  }
     off_t  getCurRBlkPos() const    {   return m_curRBlkPos;    }
     off_t  getCurWBlkPos() const    {   return m_curWBlkPos;    }
@@ -141,6 +182,9 @@ public:
 
     int convertFileBackedToInMemory();
     static void initAnonPool();
+    //Pre-faults the in-memory buffer budget of this process as one hugepage
+    //backed region and carves it into pool blocks, call it after fork.
+    static void initAnonArena();
     int eof(off_t offset);
     const char *acquireBlockBuf(off_t offset, int *size);
     void releaseBlockBuf(off_t offset);
@@ -155,6 +199,7 @@ public:
     MMapVMemBuf()
         : VMemBuf()
     {
+        enableAsyncSwap(s_iAsyncSwap);
         initBlank(VMBUF_ANON_MAP);
     }
     
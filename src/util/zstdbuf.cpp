@@ -0,0 +1,242 @@
+/*****************************************************************************
+*    Open LiteSpeed is an open source HTTP server.                           *
+*    Copyright (C) 2013 - 2020  LiteSpeed Technologies, Inc.                 *
+*                                                                            *
+*    This program is free software: you can redistribute it and/or modify    *
+*    it under the terms of the GNU General Public License as published by    *
+*    the Free Software Foundation, either version 3 of the License, or       *
+*    (at your option) any later version.                                     *
+*                                                                            *
+*    This program is distributed in the hope that it will be useful,         *
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            *
+*    GNU General Public License for more details.                            *
+*                                                                            *
+*    You should have received a copy of the GNU General Public License       *
+*    along with this program. If not, see http://www.gnu.org/licenses/.      *
+*****************************************************************************/
+#include <util/zstdbuf.h>
+
+#ifdef USE_ZSTD
+
+#include <util/vmembuf.h>
+
+#include <assert.h>
+#include <string.h>
+
+
+ZstdBuf::ZstdBuf()
+    : m_pCCtx(NULL)
+    , m_iLevel(3)
+    , m_iFrameDone(0)
+    , m_iLastError(0)
+{
+    memset(&m_out, 0, sizeof(m_out));
+}
+
+
+ZstdBuf::ZstdBuf(int type, int level)
+    : m_pCCtx(NULL)
+    , m_iLevel(3)
+    , m_iFrameDone(0)
+    , m_iLastError(0)
+{
+    memset(&m_out, 0, sizeof(m_out));
+    init(type, level);
+}
+
+
+ZstdBuf::~ZstdBuf()
+{
+    release();
+}
+
+
+int ZstdBuf::release()
+{
+    if (m_iType == COMPRESSOR_DECOMPRESS)
+        ZSTD_freeDCtx(m_pDCtx);
+    else
+        ZSTD_freeCCtx(m_pCCtx);
+    m_pCCtx = NULL;
+    return 0;
+}
+
+
+int ZstdBuf::init(int type, int level)
+{
+    release();
+    if (type == COMPRESSOR_DECOMPRESS)
+        m_iType = COMPRESSOR_DECOMPRESS;
+    else
+        m_iType = COMPRESSOR_COMPRESS;
+    if (m_iType == COMPRESSOR_COMPRESS)
+    {
+        m_iLevel = level;
+        m_pCCtx = ZSTD_createCCtx();
+        if (!m_pCCtx)
+            return LS_FAIL;
+        m_iLastError = ZSTD_CCtx_setParameter(m_pCCtx,
+                                              ZSTD_c_compressionLevel, level);
+        return (ZSTD_isError(m_iLastError) ? LS_FAIL : LS_OK);
+    }
+    else
+    {
+        m_pDCtx = ZSTD_createDCtx();
+        return (m_pDCtx ? LS_OK : LS_FAIL);
+    }
+}
+
+
+int ZstdBuf::reinit()
+{
+    m_iStreamStarted = 1;
+    return reset();
+}
+
+
+int ZstdBuf::beginStream()
+{
+    if (!m_pCompressCache)
+        return LS_FAIL;
+    size_t size;
+    m_out.dst = m_pCompressCache->getWriteBuffer(size);
+    m_out.size = size;
+    m_out.pos = 0;
+    if (!m_out.dst)
+        return LS_FAIL;
+    m_iFrameDone = 0;
+    m_iStreamStarted = 1;
+    return 0;
+}
+
+
+//Returns the bytes of input consumed, or LS_FAIL. A compress call returns
+//once the input is consumed and, for a flush or the end of the frame,
+//everything the context held has been written out.
+int ZstdBuf::process(const char *pBuf, int len, ZSTD_EndDirective op)
+{
+    if (!m_iStreamStarted)
+        return LS_FAIL;
+    ZSTD_inBuffer in = { pBuf, (size_t)len, 0 };
+    size_t ret;
+    size_t size;
+    size_t before;
+    while (true)
+    {
+        if (m_out.pos == m_out.size)
+        {
+            m_out.dst = m_pCompressCache->getWriteBuffer(size);
+            if (!m_out.dst)
+                return LS_FAIL;
+            m_out.size = size;
+            m_out.pos = 0;
+        }
+        before = m_out.pos;
+        if (m_iType == COMPRESSOR_COMPRESS)
+            ret = ZSTD_compressStream2(m_pCCtx, &m_out, &in, op);
+        else
+            ret = ZSTD_decompressStream(m_pDCtx, &m_out, &in);
+        if (ZSTD_isError(ret))
+        {
+            m_iLastError = ret;
+            return LS_FAIL;
+        }
+        m_pCompressCache->writeUsed(m_out.pos - before);
+        if (m_iType == COMPRESSOR_COMPRESS)
+        {
+            if ((op == ZSTD_e_continue) ? (in.pos == in.size) : (ret == 0))
+                break;
+        }
+        else
+        {
+            if (ret == 0)
+                m_iFrameDone = 1;
+            if ((in.pos == in.size) && (m_out.pos < m_out.size))
+                break;
+        }
+    }
+    return in.pos;
+}
+
+
+int ZstdBuf::flush()
+{
+    if (m_iType == COMPRESSOR_DECOMPRESS)
+        return 0;
+    return (process(NULL, 0, ZSTD_e_flush) == LS_FAIL) ? LS_FAIL : 0;
+}
+
+
+int ZstdBuf::endStream()
+{
+    int ret = 0;
+    if (m_iType == COMPRESSOR_COMPRESS)
+        ret = process(NULL, 0, ZSTD_e_end);
+    else if (!m_iFrameDone)
+        ret = LS_FAIL;
+    m_iStreamStarted = 0;
+    return (ret == LS_FAIL) ? LS_FAIL : 0;
+}
+
+
+int ZstdBuf::reset()
+{
+    //only drops the frame in progress, the level is kept.
+    m_iFrameDone = 0;
+    if (m_iType == COMPRESSOR_COMPRESS)
+    {
+        if (!m_pCCtx)
+            return LS_FAIL;
+        m_iLastError = ZSTD_CCtx_reset(m_pCCtx, ZSTD_reset_session_only);
+    }
+    else
+    {
+        if (!m_pDCtx)
+            return LS_FAIL;
+        m_iLastError = ZSTD_DCtx_reset(m_pDCtx, ZSTD_reset_session_only);
+    }
+    return (ZSTD_isError(m_iLastError) ? LS_FAIL : LS_OK);
+}
+
+
+//Referenced as a raw prefix, only good for the next frame; reset() drops it.
+int ZstdBuf::setDictionary(const char *pDict, size_t len)
+{
+    if (m_iType == COMPRESSOR_COMPRESS)
+    {
+        if (!m_pCCtx)
+            return LS_FAIL;
+        m_iLastError = ZSTD_CCtx_refPrefix(m_pCCtx, pDict, len);
+    }
+    else
+    {
+        if (!m_pDCtx)
+            return LS_FAIL;
+        m_iLastError = ZSTD_DCtx_refPrefix(m_pDCtx, pDict, len);
+    }
+    return (ZSTD_isError(m_iLastError) ? LS_FAIL : LS_OK);
+}
+
+
+int ZstdBuf::resetCompressCache()
+{
+    m_pCompressCache->rewindReadBuf();
+    m_pCompressCache->rewindWriteBuf();
+    size_t size;
+    m_out.dst = m_pCompressCache->getWriteBuffer(size);
+    m_out.size = size;
+    m_out.pos = 0;
+    return 0;
+}
+
+
+const char *ZstdBuf::getLastError() const
+{
+    if (!ZSTD_isError(m_iLastError))
+        return NULL;
+    return ZSTD_getErrorName(m_iLastError);
+}
+
+
+#endif // USE_ZSTD
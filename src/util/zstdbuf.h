@@ -15,31 +15,60 @@
 *    You should have received a copy of the GNU General Public License       *
 *    along with this program. If not, see http://www.gnu.org/licenses/.      *
 *****************************************************************************/
-#ifndef TIMER_H
-#define TIMER_H
+#ifndef ZSTDBUF_H
+#define ZSTDBUF_H
 
+#include <config.h>
 
+#ifdef USE_ZSTD
+#include <lsdef.h>
+#include <util/compressor.h>
 
-class TimerTask;
-class TimerImpl;
+#include <zstd.h>
 
-class Timer
+
+class VMemBuf;
+
+class ZstdBuf : public Compressor
 {
-    TimerImpl *m_pImpl;
+    union {
+        ZSTD_CCtx  *m_pCCtx;
+        ZSTD_DCtx  *m_pDCtx;
+    };
+    int             m_iLevel;
+    short           m_iFrameDone;
+    size_t          m_iLastError;
+    ZSTD_outBuffer  m_out;
+
+    int process(const char *pBuf, int len, ZSTD_EndDirective op);
 
-    Timer(const Timer &rhs);
-    void operator=(const Timer &rhs);
 public:
-    Timer();
-    ~Timer();
-    /** Schedules the specified task for execution after the specified delay.
-     *  @param task task to be scheduled.
-     *  @param delay delay in seconds before task is to be executed.
-     */
-    int  schedule(TimerTask *task, long delay);
-    void cancel(TimerTask *task);
-    void execute();
-    static int currentTime();
+    ZstdBuf();
+    ~ZstdBuf();
+
+    explicit ZstdBuf(int type, int level);
+
+    int getType() const {   return m_iType;   }
+
+    int init(int type, int level);
+    int reinit();
+    int beginStream();
+    int write(const char *pBuf, int len)
+    {   return process(pBuf, len, ZSTD_e_continue);  }
+    int shouldFlush()   {   return 0;   }
+    int flush();
+    int endStream();
+    int reset();
+
+    int release();
+
+    int resetCompressCache();
+    int setDictionary(const char *pDict, size_t len);
+    const char *getLastError() const;
+
+    LS_NO_COPY_ASSIGN(ZstdBuf);
 };
 
+#endif // USE_ZSTD
+
 #endif
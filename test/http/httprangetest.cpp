@@ -20,6 +20,7 @@
 #include <lsr/ls_xpool.h>
 #include <http/httprange.h>
 #include <http/httpstatuscode.h>
+#include <util/autostr.h>
 #include <string.h>
 #include "unittest-cpp/UnitTest++.h"
 
@@ -137,6 +138,32 @@ SUITE(YourSuitqqqqeName)
         int ret = range2->parse(pdfRange, pool);
         CHECK(ret == 0);
 
+        //prebuilt part headers add up to the multipart body length.
+        AutoStr2 mime("application/pdf");
+        range2->beginMultipart();
+        CHECK(range2->buildAllPartHeaders(mime.c_str(), pool) > 0);
+        CHECK(range2->hasAllPartHeaders());
+        off_t total = 0;
+        for (int i = 0; i <= range2->count(); ++i)
+        {
+            const char *pHeader = range2->getPrebuiltHeader(i, len);
+            CHECK(range2->getPartHeader(i, mime.c_str(), crs, 1000) == len);
+            CHECK(memcmp(crs, pHeader, len) == 0);
+            total += len;
+            if (i < range2->count())
+            {
+                CHECK(range2->getContentOffset(i, b, e) == 0);
+                total += e - b;
+            }
+        }
+        CHECK(total == range2->getMultipartBodyLen(&mime));
+        CHECK(range2->getCurRange() == 0);
+        range2->partSent(10);
+        CHECK(range2->getPartSent() == 10);
+        range2->nextPart();
+        CHECK(range2->getCurRange() == 1);
+        CHECK(range2->getPartSent() == 0);
+
         ls_xpool_delete(pool);
 
     }
@@ -0,0 +1,93 @@
+/*****************************************************************************
+*    Open LiteSpeed is an open source HTTP server.                           *
+*    Copyright (C) 2013 - 2020  LiteSpeed Technologies, Inc.                 *
+*                                                                            *
+*    This program is free software: you can redistribute it and/or modify    *
+*    it under the terms of the GNU General Public License as published by    *
+*    the Free Software Foundation, either version 3 of the License, or       *
+*    (at your option) any later version.                                     *
+*                                                                            *
+*    This program is distributed in the hope that it will be useful,         *
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            *
+*    GNU General Public License for more details.                            *
+*                                                                            *
+*    You should have received a copy of the GNU General Public License       *
+*    along with this program. If not, see http://www.gnu.org/licenses/.      *
+*****************************************************************************/
+#ifdef RUN_TEST
+
+#include <http/staticfileshmcache.h>
+#include <shm/lsshm.h>
+#include <util/datetime.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "unittest-cpp/UnitTest++.h"
+
+
+static const char *s_pPath = "/var/www/sfsc_test.html";
+
+
+TEST(StaticFileShmCacheTest)
+{
+    if (LsShm::getBaseDirCount() == 0)
+    {
+        mkdir("/dev/shm/ols", 0700);
+        LsShm::addBaseDir("/dev/shm/ols");
+    }
+    StaticFileShmCache &cache = StaticFileShmCache::getInstance();
+    CHECK(cache.init(1024 * 1024, getuid(), getgid()) == LS_OK);
+    if (!cache.isReady())
+        return;
+
+    char achBody[1000];
+    char achBuf[100];
+    int len = strlen(s_pPath);
+    long entries, bytes;
+    memset(achBody, 'a', sizeof(achBody));
+
+    LsShmOffset_t off1 = cache.publish(s_pPath, len, 1, 1000, 5, achBody);
+    CHECK(off1 != 0);
+    CHECK(cache.attach(s_pPath, len, 1, 1000, 5) == off1);
+    CHECK(cache.attach(s_pPath, len, 1, 1000, 6) == 0);
+    CHECK(cache.read(off1, 990, achBuf, 100) == 10);
+    CHECK(achBuf[0] == 'a');
+
+    //another worker replaces the body, the old block stays readable here
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        memset(achBody, 'b', sizeof(achBody));
+        LsShmOffset_t off = cache.publish(s_pPath, len, 1, 1000, 7, achBody);
+        cache.detach(off);
+        _exit(off != 0 ? 0 : 1);
+    }
+    int status = -1;
+    waitpid(pid, &status, 0);
+    CHECK(status == 0);
+    CHECK(cache.read(off1, 0, achBuf, 10) == 10);
+    CHECK(achBuf[0] == 'a');
+    CHECK(cache.attach(s_pPath, len, 1, 1000, 5) == 0);
+    LsShmOffset_t off2 = cache.attach(s_pPath, len, 1, 1000, 7);
+    CHECK(off2 != 0);
+    CHECK(cache.read(off2, 0, achBuf, 10) == 10);
+    CHECK(achBuf[0] == 'b');
+    cache.getStats(&entries, &bytes);
+    CHECK(entries >= 1);
+
+    cache.detach(off1);
+    cache.detach(off1);
+    cache.detach(off2);
+
+    time_t saved = DateTime::s_curTime;
+    DateTime::s_curTime = time(NULL) + 3600;
+    cache.onTimer();
+    DateTime::s_curTime = saved;
+    CHECK(cache.attach(s_pPath, len, 1, 1000, 7) == 0);
+}
+
+#endif
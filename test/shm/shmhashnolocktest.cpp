@@ -0,0 +1,355 @@
+/*****************************************************************************
+*    Open LiteSpeed is an open source HTTP server.                           *
+*    Copyright (C) 2013 - 2020  LiteSpeed Technologies, Inc.                 *
+*                                                                            *
+*    This program is free software: you can redistribute it and/or modify    *
+*    it under the terms of the GNU General Public License as published by    *
+*    the Free Software Foundation, either version 3 of the License, or       *
+*    (at your option) any later version.                                     *
+*                                                                            *
+*    This program is distributed in the hope that it will be useful,         *
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            *
+*    GNU General Public License for more details.                            *
+*                                                                            *
+*    You should have received a copy of the GNU General Public License       *
+*    along with this program. If not, see http://www.gnu.org/licenses/.      *
+*****************************************************************************/
+#ifdef RUN_TEST
+
+#include <http/staticfileshmcache.h>
+#include <shm/lsshmpool.h>
+#include <shm/lsshmhash.h>
+
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "unittest-cpp/UnitTest++.h"
+
+static const char *g_pNoLockDirName = "/tmp";
+static const char *g_pNoLockShmName = "SHMNOLOCKTEST";
+
+#define SZ_NOLOCKKEYS   100
+#define SZ_NOLOCKLOOPS  20000
+#define SZ_REHASHKEYS   5000
+#define SZ_SFCACHEFILES 2000
+
+
+TEST(shmHashFindNoLock_test)
+{
+    char achShmFileName[255];
+    char achLockFileName[255];
+    char achKey[32];
+    int i, len, valLen, valLen2, miss;
+    LsShmOffset_t offVal;
+    snprintf(achShmFileName, sizeof(achShmFileName), "%s/%s.shm",
+             g_pNoLockDirName, g_pNoLockShmName);
+    snprintf(achLockFileName, sizeof(achLockFileName), "%s/%s.lock",
+             g_pNoLockDirName, g_pNoLockShmName);
+    unlink(achShmFileName);
+    unlink(achLockFileName);
+
+    LsShm *pShm;
+    LsShmPool *pPool;
+    LsShmHash *pHash;
+    LsShmHash *pNumHash;
+
+    CHECK((pShm = LsShm::open(g_pNoLockShmName, 0, g_pNoLockDirName))
+          != NULL);
+    if (pShm == NULL)
+        return;
+    CHECK((pPool = pShm->getGlobalPool()) != NULL);
+    if (pPool == NULL)
+        return;
+    CHECK((pHash = pPool->getNamedHash("nolock", 10, LsShmHash::hashXXH32,
+                                       memcmp, LSSHM_FLAG_NONE)) != NULL);
+    CHECK((pNumHash = pPool->getNamedHash("nolocknum", 10, NULL, NULL,
+                                          LSSHM_FLAG_NONE)) != NULL);
+    if ((pHash == NULL) || (pNumHash == NULL))
+        return;
+
+    for (i = 0; i < SZ_NOLOCKKEYS; ++i)
+    {
+        len = snprintf(achKey, sizeof(achKey), "key%d", i);
+        CHECK(pHash->insert(achKey, len, &i, sizeof(i)) != 0);
+        CHECK(pNumHash->insert((const void *)(long)(i + 1), 0, &i,
+                               sizeof(i)) != 0);
+    }
+    for (i = 0; i < SZ_NOLOCKKEYS; ++i)
+    {
+        len = snprintf(achKey, sizeof(achKey), "key%d", i);
+        offVal = pHash->findNoLock(achKey, len, &valLen);
+        CHECK(offVal != 0);
+        CHECK(offVal == pHash->find(achKey, len, &valLen2));
+        CHECK(valLen == (int)sizeof(i));
+        CHECK(*(int *)pHash->offset2ptr(offVal) == i);
+        offVal = pNumHash->findNoLock((const void *)(long)(i + 1), 0,
+                                      &valLen);
+        CHECK(offVal != 0);
+        CHECK(*(int *)pNumHash->offset2ptr(offVal) == i);
+    }
+    CHECK(pHash->findNoLock("nokey", 5, &valLen) == 0);
+    CHECK(valLen == 0);
+    CHECK(pHash->remove("key0", 4) == 1);
+    CHECK(pHash->findNoLock("key0", 4, &valLen) == 0);
+
+    // a writer keeps growing and shrinking the table, including rehash,
+    // while the existing keys must stay visible to the lock free reader.
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        for (;;)
+        {
+            for (i = 0; i < 2000; ++i)
+            {
+                len = snprintf(achKey, sizeof(achKey), "tmp%d", i);
+                pHash->insert(achKey, len, &i, sizeof(i));
+            }
+            for (i = 0; i < 2000; ++i)
+            {
+                len = snprintf(achKey, sizeof(achKey), "tmp%d", i);
+                pHash->remove(achKey, len);
+            }
+        }
+    }
+    CHECK(pid > 0);
+    miss = 0;
+    for (i = 0; i < SZ_NOLOCKLOOPS; ++i)
+    {
+        len = snprintf(achKey, sizeof(achKey), "key%d",
+                       1 + i % (SZ_NOLOCKKEYS - 1));
+        if (pHash->findNoLock(achKey, len, &valLen) == 0)
+            ++miss;
+    }
+    CHECK(miss == 0);
+    if (pid > 0)
+    {
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+    }
+
+    pShm->deleteFile();
+    pShm->close();
+}
+
+
+// the value is rewritten with a different length and fill while being
+// copied out, a copy must never mix two versions.
+TEST(shmHashCopyNoLock_test)
+{
+    char achShmFileName[255];
+    char achLockFileName[255];
+    unsigned char achVal[1024];
+    unsigned char achBuf[1024];
+    struct iovec iov[2];
+    int i, n, len, torn;
+    snprintf(achShmFileName, sizeof(achShmFileName), "%s/%s.shm",
+             g_pNoLockDirName, g_pNoLockShmName);
+    snprintf(achLockFileName, sizeof(achLockFileName), "%s/%s.lock",
+             g_pNoLockDirName, g_pNoLockShmName);
+    unlink(achShmFileName);
+    unlink(achLockFileName);
+
+    LsShm *pShm;
+    LsShmPool *pPool;
+    LsShmHash *pHash;
+
+    CHECK((pShm = LsShm::open(g_pNoLockShmName, 0, g_pNoLockDirName))
+          != NULL);
+    if (pShm == NULL)
+        return;
+    CHECK((pPool = pShm->getGlobalPool()) != NULL);
+    if (pPool == NULL)
+        return;
+    CHECK((pHash = pPool->getNamedHash("copy", 10, LsShmHash::hashXXH32,
+                                       memcmp, LSSHM_FLAG_NONE)) != NULL);
+    if (pHash == NULL)
+        return;
+
+    iov[0].iov_base = achBuf;
+    iov[0].iov_len = 16;
+    iov[1].iov_base = achBuf + 16;
+    iov[1].iov_len = sizeof(achBuf) - 16;
+    CHECK(pHash->copyNoLock("hot", 3, iov, 2) == 0);
+    memset(achVal, 0, 64);
+    CHECK(pHash->insertIov("hot", 3, iov, 0) != 0);
+    CHECK(pHash->set("hot", 3, achVal, 64) != 0);
+    memset(achBuf, 0xff, sizeof(achBuf));
+    CHECK(pHash->copyNoLock("hot", 3, iov, 2) == 64);
+    CHECK(achBuf[0] == 0 && achBuf[15] == 0 && achBuf[16] == 0
+          && achBuf[63] == 0 && achBuf[64] == 0xff);
+    CHECK(pHash->insertIov("hot", 3, iov, 2) == 0);
+    iov[1].iov_len = 8;
+    CHECK(pHash->copyNoLock("hot", 3, iov, 2) == 64);
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        for (i = 0; ; ++i)
+        {
+            n = i & 0x7f;
+            memset(achVal, n, sizeof(achVal));
+            pHash->set("hot", 3, achVal, 64 + n * 7);
+        }
+    }
+    CHECK(pid > 0);
+    iov[1].iov_len = sizeof(achBuf) - 16;
+    while (pHash->copyNoLock("hot", 3, iov, 2) == 64)
+        usleep(1000);
+    torn = 0;
+    for (i = 0; i < SZ_NOLOCKLOOPS; ++i)
+    {
+        // gone for a moment while it is moved to a bigger element
+        if ((len = pHash->copyNoLock("hot", 3, iov, 2)) == 0)
+            continue;
+        n = achBuf[0];
+        if ((len != 64 + n * 7) || (achBuf[len - 1] != n)
+            || (achBuf[len / 2] != n))
+            ++torn;
+    }
+    CHECK(torn == 0);
+    if (pid > 0)
+    {
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+    }
+
+    pShm->deleteFile();
+    pShm->close();
+}
+
+
+TEST(shmHashIncrRehash_test)
+{
+    char achShmFileName[255];
+    char achLockFileName[255];
+    char achKey[32];
+    int i, len, valLen, n;
+    snprintf(achShmFileName, sizeof(achShmFileName), "%s/%s.shm",
+             g_pNoLockDirName, g_pNoLockShmName);
+    snprintf(achLockFileName, sizeof(achLockFileName), "%s/%s.lock",
+             g_pNoLockDirName, g_pNoLockShmName);
+    unlink(achShmFileName);
+    unlink(achLockFileName);
+
+    LsShm *pShm;
+    LsShmPool *pPool;
+    LsShmHash *pHash;
+    LsShmHash::iteroffset iterOff;
+
+    CHECK((pShm = LsShm::open(g_pNoLockShmName, 0, g_pNoLockDirName))
+          != NULL);
+    if (pShm == NULL)
+        return;
+    CHECK((pPool = pShm->getGlobalPool()) != NULL);
+    if (pPool == NULL)
+        return;
+    CHECK((pHash = pPool->getNamedHash("rehash", 10, LsShmHash::hashXXH32,
+                                       memcmp, LSSHM_FLAG_NONE)) != NULL);
+    if (pHash == NULL)
+        return;
+
+    // buckets move a few at a time, every key must stay reachable while
+    // the old and the new index are both in use.
+    pHash->disableAutoLock();
+    pHash->lock();
+    for (i = 0; i < SZ_REHASHKEYS; ++i)
+    {
+        len = snprintf(achKey, sizeof(achKey), "key%d", i);
+        CHECK(pHash->insert(achKey, len, &i, sizeof(i)) != 0);
+        if (i % 97 == 0)
+        {
+            for (n = 0; n <= i; ++n)
+            {
+                len = snprintf(achKey, sizeof(achKey), "key%d", n);
+                CHECK(pHash->find(achKey, len, &valLen) != 0);
+            }
+        }
+    }
+    CHECK(pHash->size() == SZ_REHASHKEYS);
+    n = 0;
+    for (iterOff = pHash->begin(); iterOff.m_iOffset != 0;
+         iterOff = pHash->next(iterOff))
+        ++n;
+    CHECK(n == SZ_REHASHKEYS);
+    for (i = 0; i < SZ_REHASHKEYS; i += 2)
+    {
+        len = snprintf(achKey, sizeof(achKey), "key%d", i);
+        CHECK(pHash->remove(achKey, len) == 1);
+    }
+    pHash->unlock();
+    pHash->enableAutoLock();
+    for (i = 0; i < SZ_REHASHKEYS; ++i)
+    {
+        len = snprintf(achKey, sizeof(achKey), "key%d", i);
+        CHECK((pHash->findNoLock(achKey, len, &valLen) != 0) == (i & 1));
+    }
+    CHECK(pHash->size() == SZ_REHASHKEYS / 2);
+
+    pShm->deleteFile();
+    pShm->close();
+}
+
+
+// StaticFileShmCache keeps its stats in the user part of the table header
+// reserved area, updating them must not disturb the sequence counters of
+// lock free readers, nor the other way around.
+TEST(shmHashReservedNoLock_test)
+{
+    char achPath[64];
+    char achBody[64];
+    int i, len, valLen, miss;
+    long entries, bytes;
+    unlink("/tmp/static_file.shm");
+    unlink("/tmp/static_file.lock");
+    if (LsShm::getBaseDirCount() == 0)
+        LsShm::addBaseDir(g_pNoLockDirName);
+
+    StaticFileShmCache &cache = StaticFileShmCache::getInstance();
+    CHECK(cache.init(64 * 1024 * 1024, getuid(), getgid()) == LS_OK);
+    if (!cache.isReady())
+        return;
+    LsShmHash *pStore = cache.getStore();
+    memset(achBody, 'x', sizeof(achBody));
+    len = snprintf(achPath, sizeof(achPath), "/sfcache/0");
+    cache.detach(cache.publish(achPath, len, 1, sizeof(achBody), 1000,
+                               achBody));
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        for (i = 1; i <= SZ_SFCACHEFILES; ++i)
+        {
+            len = snprintf(achPath, sizeof(achPath), "/sfcache/%d", i);
+            cache.detach(cache.publish(achPath, len, i + 1, sizeof(achBody),
+                                       1000, achBody));
+        }
+        _exit(0);
+    }
+    CHECK(pid > 0);
+    miss = 0;
+    for (i = 0; i < SZ_NOLOCKLOOPS; ++i)
+    {
+        if (pStore->findNoLock("/sfcache/0", 10, &valLen) == 0)
+            ++miss;
+    }
+    CHECK(miss == 0);
+    if (pid > 0)
+        waitpid(pid, NULL, 0);
+
+    for (i = 0; i <= SZ_SFCACHEFILES; ++i)
+    {
+        len = snprintf(achPath, sizeof(achPath), "/sfcache/%d", i);
+        CHECK(pStore->findNoLock(achPath, len, &valLen) != 0);
+    }
+    cache.getStats(&entries, &bytes);
+    CHECK(entries == SZ_SFCACHEFILES + 1);
+    CHECK(bytes > 0);
+    CHECK(bytes % (SZ_SFCACHEFILES + 1) == 0);
+    CHECK(bytes / (SZ_SFCACHEFILES + 1) < 4096);
+    pStore->getPool()->getShm()->deleteFile();
+}
+
+#endif
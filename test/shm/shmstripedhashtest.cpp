@@ -0,0 +1,111 @@
+/*****************************************************************************
+*    Open LiteSpeed is an open source HTTP server.                           *
+*    Copyright (C) 2013 - 2020  LiteSpeed Technologies, Inc.                 *
+*                                                                            *
+*    This program is free software: you can redistribute it and/or modify    *
+*    it under the terms of the GNU General Public License as published by    *
+*    the Free Software Foundation, either version 3 of the License, or       *
+*    (at your option) any later version.                                     *
+*                                                                            *
+*    This program is distributed in the hope that it will be useful,         *
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            *
+*    GNU General Public License for more details.                            *
+*                                                                            *
+*    You should have received a copy of the GNU General Public License       *
+*    along with this program. If not, see http://www.gnu.org/licenses/.      *
+*****************************************************************************/
+#ifdef RUN_TEST
+
+#include <shm/lsshmpool.h>
+#include <shm/lsshmstripedhash.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "unittest-cpp/UnitTest++.h"
+
+static const char *g_pStripeDirName = "/tmp";
+static const char *g_pStripeShmName = "SHMSTRIPETEST";
+
+#define SZ_STRIPES      4
+#define SZ_STRIPEKEYS   200
+
+
+TEST(shmStripedHash_test)
+{
+    char achShmFileName[255];
+    char achLockFileName[255];
+    char achKey[32];
+    int aCount[SZ_STRIPES];
+    int i, j, len, valLen;
+    snprintf(achShmFileName, sizeof(achShmFileName), "%s/%s.shm",
+             g_pStripeDirName, g_pStripeShmName);
+    snprintf(achLockFileName, sizeof(achLockFileName), "%s/%s.lock",
+             g_pStripeDirName, g_pStripeShmName);
+    unlink(achShmFileName);
+    unlink(achLockFileName);
+
+    LsShm *pShm;
+    LsShmPool *pPool;
+    LsShmStripedHash *pStriped;
+    LsShmHash *pHash;
+
+    CHECK((pShm = LsShm::open(g_pStripeShmName, 0, g_pStripeDirName))
+          != NULL);
+    if (pShm == NULL)
+        return;
+    CHECK((pPool = pShm->getGlobalPool()) != NULL);
+    if (pPool == NULL)
+        return;
+    CHECK(LsShmStripedHash::get(pPool, "stripe", 0, 100,
+                                LsShmHash::hashXXH32, memcmp,
+                                LSSHM_FLAG_LRU) == NULL);
+    CHECK((pStriped = LsShmStripedHash::get(pPool, "stripe", SZ_STRIPES, 100,
+                                            LsShmHash::hashXXH32, memcmp,
+                                            LSSHM_FLAG_LRU)) != NULL);
+    if (pStriped == NULL)
+        return;
+    CHECK(pStriped->getStripes() == SZ_STRIPES);
+    CHECK(strcmp(pStriped->getStripe(1)->name(), "stripe.01") == 0);
+
+    for (i = 0; i < SZ_STRIPEKEYS; ++i)
+    {
+        len = snprintf(achKey, sizeof(achKey), "key%d", i);
+        pHash = pStriped->getStripeByKey(achKey, len);
+        CHECK(pHash->insert(achKey, len, &i, sizeof(i)) != 0);
+    }
+    CHECK(pStriped->size() == SZ_STRIPEKEYS);
+
+    memset(aCount, 0, sizeof(aCount));
+    for (i = 0; i < SZ_STRIPEKEYS; ++i)
+    {
+        len = snprintf(achKey, sizeof(achKey), "key%d", i);
+        pHash = pStriped->getStripeByKey(achKey, len);
+        CHECK(pHash->find(achKey, len, &valLen) != 0);
+        for (j = 0; j < SZ_STRIPES; ++j)
+        {
+            if (pStriped->getStripe(j) == pHash)
+                ++aCount[j];
+            else
+                CHECK(pStriped->getStripe(j)->find(achKey, len, &valLen)
+                      == 0);
+        }
+    }
+    for (j = 0; j < SZ_STRIPES; ++j)
+    {
+        CHECK(aCount[j] > 0);
+        CHECK((int)pStriped->getStripe(j)->size() == aCount[j]);
+    }
+
+    CHECK(pStriped->trim(time(NULL) - 3600, NULL, NULL) == 0);
+    CHECK(pStriped->trim(time(NULL) + 3600, NULL, NULL) == SZ_STRIPEKEYS);
+    CHECK(pStriped->size() == 0);
+
+    pStriped->close();
+    pShm->deleteFile();
+    pShm->close();
+}
+
+#endif
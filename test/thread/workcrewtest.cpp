@@ -273,6 +273,73 @@ TEST(THREAD_WORKCREW_TEST_MULTI)
     ls_lfqueue_delete(pFinishedQueue);
     printf("End work crew test multi\n");
 }
+
+
+static void *workCrewStealTest(ls_lfnodei_t *item)
+{
+    workcrewtest_t *wct = (workcrewtest_t *)((char *)item - offsetof(
+                workcrewtest_t, m_node));
+    usleep(random() % 2000);
+    wct->m_val += 3;
+    return NULL;
+}
+
+
+TEST(THREAD_WORKCREW_STEAL_TEST)
+{
+    printf("Start work crew stealing test\n");
+    int i;
+    int total = 300;
+    WorkCrewStats stats;
+    long jobs = 0;
+    ls_lfqueue_t *pFinishedQueue = ls_lfqueue_new();
+    WorkCrew *wc = new WorkCrew(8, workCrewStealTest, pFinishedQueue, 0,
+                                4, 8);
+
+    CHECK(0 == wc->enableWorkStealing(4));
+    CHECK(wc->isWorkStealing());
+    CHECK(-1 == wc->enableWorkStealing(4));
+    CHECK(4 == wc->maxWorkers());
+    CHECK(4 == wc->getStatSlots());
+
+    CHECK(wc->startProcessing() == 0);
+    for (i = 0; i < total; ++i)
+    {
+        workcrewtest_t *wct = (workcrewtest_t *)ls_palloc(sizeof(workcrewtest_t));
+        wct->m_node.next = NULL;
+        wct->m_oval = i;
+        wct->m_val = i;
+        CHECK(wc->addJob((ls_lfnodei_t *)((char *)wct + offsetof(workcrewtest_t,
+                            m_node))) == 0);
+    }
+
+    for (i = 0; i < total; ++i)
+    {
+        ls_lfnodei_t *pNode = NULL;
+        workcrewtest_t *wct = NULL;
+        while ((pNode = ls_lfqueue_get(pFinishedQueue)) == NULL)
+            usleep(100);
+        wct = (workcrewtest_t *)((char *)pNode - offsetof(workcrewtest_t, m_node));
+        CHECK(wct->m_oval == wct->m_val - 3);
+        ls_pfree(wct);
+    }
+
+    for (i = 0; i < wc->getStatSlots(); ++i)
+    {
+        CHECK(0 == wc->getWorkerStats(i, &stats));
+        CHECK(0 == stats.m_iDepth);
+        CHECK(stats.m_iMaxDepth > 0);
+        jobs += stats.m_iJobs;
+    }
+    CHECK(total == jobs);
+    CHECK(-1 == wc->getWorkerStats(4, &stats));
+
+    wc->stopProcessing();
+    CHECK(0 == wc->size());
+    delete wc;
+    ls_lfqueue_delete(pFinishedQueue);
+    printf("End work crew stealing test\n");
+}
 #endif
 
 #endif
@@ -0,0 +1,157 @@
+/*****************************************************************************
+*    Open LiteSpeed is an open source HTTP server.                           *
+*    Copyright (C) 2013 - 2020  LiteSpeed Technologies, Inc.                 *
+*                                                                            *
+*    This program is free software: you can redistribute it and/or modify    *
+*    it under the terms of the GNU General Public License as published by    *
+*    the Free Software Foundation, either version 3 of the License, or       *
+*    (at your option) any later version.                                     *
+*                                                                            *
+*    This program is distributed in the hope that it will be useful,         *
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            *
+*    GNU General Public License for more details.                            *
+*                                                                            *
+*    You should have received a copy of the GNU General Public License       *
+*    along with this program. If not, see http://www.gnu.org/licenses/.      *
+*****************************************************************************/
+#ifdef RUN_TEST
+
+#include <util/timingwheel.h>
+#include "unittest-cpp/UnitTest++.h"
+
+
+class TestEntry : public TimingWheelEntry
+{
+public:
+    TestEntry()
+        : m_iFired(0)
+        , m_iFiredAt(0)
+        , m_iRearm(0)
+        , m_pWheel(NULL)
+    {}
+
+    virtual void onExpire()
+    {
+        ++m_iFired;
+        m_iFiredAt = m_pWheel->getCurrent();
+        if (m_iRearm)
+            m_pWheel->armAfter(this, m_iRearm);
+    }
+
+    int          m_iFired;
+    uint64_t     m_iFiredAt;
+    uint32_t     m_iRearm;
+    TimingWheel *m_pWheel;
+};
+
+
+SUITE(TimingWheelTest)
+{
+    TEST(testExpireOrder)
+    {
+        TimingWheel wheel;
+        TestEntry e[5];
+        uint32_t delays[5] = { 0, 5, 255, 256, 70000 };
+        int i;
+
+        wheel.init(1000);
+        for (i = 0; i < 5; ++i)
+        {
+            e[i].m_pWheel = &wheel;
+            wheel.armAfter(&e[i], delays[i]);
+            CHECK(e[i].isArmed());
+        }
+        CHECK(!wheel.empty());
+
+        // nothing runs for the current tick, a 0 delay means the next one
+        CHECK(0 == wheel.advance(1000));
+        CHECK(1 == wheel.advance(1001));
+        CHECK(1 == e[0].m_iFired);
+        CHECK(!e[0].isArmed());
+
+        CHECK(0 == wheel.advance(1004));
+        CHECK(1 == wheel.advance(1005));
+        CHECK(1005 == e[1].m_iFiredAt);
+
+        CHECK(2 == wheel.advance(1256));
+        CHECK(1255 == e[2].m_iFiredAt);
+        CHECK(1256 == e[3].m_iFiredAt);
+
+        CHECK(0 == wheel.advance(70999));
+        CHECK(1 == wheel.advance(71000));
+        CHECK(71000 == e[4].m_iFiredAt);
+        CHECK(wheel.empty());
+    }
+
+    TEST(testCancelAndRearm)
+    {
+        TimingWheel wheel;
+        TestEntry e1, e2;
+
+        wheel.init(0);
+        e1.m_pWheel = e2.m_pWheel = &wheel;
+        wheel.armAfter(&e1, 100);
+        wheel.armAfter(&e2, 100);
+        e1.cancel();
+        CHECK(!e1.isArmed());
+
+        // re-arming moves the entry instead of queuing it twice
+        wheel.armAfter(&e2, 50);
+        wheel.armAfter(&e2, 20000);
+        CHECK(0 == wheel.advance(19999));
+        CHECK(1 == wheel.advance(20000));
+        CHECK(0 == e1.m_iFired);
+        CHECK(1 == e2.m_iFired);
+
+        e2.m_iRearm = 1000;
+        wheel.armAfter(&e2, 0);
+        CHECK(4 == wheel.advance(23001));
+        CHECK(23001 == e2.m_iFiredAt);
+        CHECK(e2.isArmed());
+        e2.cancel();
+        CHECK(wheel.empty());
+    }
+
+    TEST(testLongDelay)
+    {
+        TimingWheel wheel;
+        TestEntry e;
+
+        wheel.init(5);
+        e.m_pWheel = &wheel;
+        wheel.arm(&e, 5 + TW_MAX_DELAY + 3000);
+        CHECK(0 == wheel.advance(5 + TW_MAX_DELAY + 2999));
+        CHECK(e.isArmed());
+        CHECK(1 == wheel.advance(5 + TW_MAX_DELAY + 3000));
+        CHECK(5 + TW_MAX_DELAY + 3000 == e.m_iFiredAt);
+    }
+
+    TEST(testNextExpire)
+    {
+        TimingWheel wheel;
+        TestEntry e1, e2;
+
+        wheel.init(1000);
+        e1.m_pWheel = e2.m_pWheel = &wheel;
+        // nothing armed, the next root wrap bounds the wait
+        CHECK(1024 == wheel.nextExpire());
+
+        wheel.armAfter(&e1, 7);
+        CHECK(1007 == wheel.nextExpire());
+        wheel.armAfter(&e2, 3);
+        CHECK(1003 == wheel.nextExpire());
+        e2.cancel();
+        CHECK(1007 == wheel.nextExpire());
+        CHECK(1 == wheel.advance(1007));
+
+        // an upper wheel entry is reported at its cascade tick at the latest
+        wheel.armAfter(&e1, 5000);
+        CHECK(1024 == wheel.nextExpire());
+        CHECK(0 == wheel.advance(1024));
+        CHECK(wheel.nextExpire() <= 6007);
+        CHECK(wheel.nextExpire() > 1024);
+    }
+}
+
+#endif
@@ -18,6 +18,10 @@
 #ifdef RUN_TEST
 
 #include "vmembuftest.h"
+#include <edio/multiplexer.h>
+#include <edio/multiplexerfactory.h>
+#include <lsr/ls_atomic.h>
+#include <lsr/ls_offload.h>
 #include <util/blockbuf.h>
 #include <util/vmembuf.h>
 
@@ -25,10 +29,31 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
 #include "unittest-cpp/UnitTest++.h"
 
 
 
+//Holds the single shared offload worker until the flag is set, or marks
+//that every job queued before it has run.
+static int s_iOffloadFlag = 0;
+
+static int holdOffloader(void *param)
+{
+    while (!ls_atomic_value((int *)param))
+        usleep(1000);
+    return 0;
+}
+
+
+static int markOffloader(void *param)
+{
+    ls_atomic_setint((int *)param, 1);
+    return 0;
+}
+
+
 SUITE(VMemBufTest)
 {
 
@@ -262,6 +287,203 @@ SUITE(VMemBufTest)
 //
 //    }
     }
+
+    TEST(testPinnedAnon)
+    {
+        VMemBuf *pVmemBuf = new VMemBuf();
+        char *pBuf;
+        size_t size;
+        CHECK(pVmemBuf->set(VMBUF_ANON_MAP, pVmemBuf->getBlockSize()) == 0);
+        CHECK(pVmemBuf->isAnonMapped());
+        pBuf = pVmemBuf->getWriteBuffer(size);
+        CHECK(pBuf != NULL);
+        memset(pBuf, 'a', 1024);
+        pVmemBuf->writeUsed(1024);
+        pBuf = pVmemBuf->getReadBuffer(size);
+        CHECK(size == 1024);
+        pVmemBuf->readUsed(size);
+
+        pVmemBuf->pin();
+        CHECK(pVmemBuf->isPinned());
+        pVmemBuf->rewindReadWriteBuf();
+        CHECK(!pVmemBuf->isPinned());
+        CHECK(pVmemBuf->getCurFileSize() == 0);
+        CHECK(pVmemBuf->getCurWBlkPos() == 0);
+        CHECK(true == pVmemBuf->empty());
+
+        pBuf = pVmemBuf->getWriteBuffer(size);
+        CHECK(pBuf != NULL);
+        CHECK(size == (size_t)pVmemBuf->getBlockSize());
+        pVmemBuf->writeUsed(100);
+        pBuf = pVmemBuf->getReadBuffer(size);
+        CHECK(size == 100);
+        pVmemBuf->readUsed(size);
+
+        pVmemBuf->pin();
+        pVmemBuf->rewindWriteBuf();
+        CHECK(!pVmemBuf->isPinned());
+        CHECK(pVmemBuf->getCurFileSize() == 0);
+        delete pVmemBuf;
+    }
+
+    TEST(testAnonSizeClass)
+    {
+        int blockSize = VMemBuf::getBlockSize();
+        VMemBuf *pVmemBuf = new VMemBuf();
+        char *pBuf;
+        char *pOld;
+        size_t size;
+
+        //3 blocks round up to the 4 block size class.
+        CHECK(pVmemBuf->set(VMBUF_ANON_MAP, blockSize * 3) == 0);
+        pOld = pVmemBuf->getWriteBuffer(size);
+        CHECK(pOld != NULL);
+        CHECK(size == (size_t)blockSize * 4);
+        CHECK(pVmemBuf->getCurFileSize() == blockSize * 4);
+        pVmemBuf->deallocate();
+
+        //the map is kept in the free list and handed out again.
+        CHECK(pVmemBuf->set(VMBUF_ANON_MAP, blockSize * 4) == 0);
+        pBuf = pVmemBuf->getWriteBuffer(size);
+        CHECK(pBuf == pOld);
+        CHECK(size == (size_t)blockSize * 4);
+        pVmemBuf->deallocate();
+
+        //a pinned one is not.
+        CHECK(pVmemBuf->set(VMBUF_ANON_MAP, blockSize * 4) == 0);
+        pOld = pVmemBuf->getWriteBuffer(size);
+        pVmemBuf->pin();
+        pVmemBuf->deallocate();
+        CHECK(pVmemBuf->set(VMBUF_ANON_MAP, blockSize * 4) == 0);
+        pBuf = pVmemBuf->getWriteBuffer(size);
+        CHECK(pBuf != NULL);
+        CHECK(size == (size_t)blockSize * 4);
+        delete pVmemBuf;
+    }
+
+    TEST(testAsyncSwap)
+    {
+        int blockSize = VMemBuf::getBlockSize();
+        int total = blockSize * 5 + 100;
+        char *pData = (char *)malloc(total);
+        char *pRead = (char *)malloc(total);
+        int i;
+        for (i = 0; i < total; ++i)
+            pData[i] = 'a' + i % 23;
+
+        VMemBuf::setAsyncSwap(1);
+        MMapVMemBuf *pVmemBuf = new MMapVMemBuf(2 * 1024 * 1024);
+        CHECK(pVmemBuf->isMmaped() && !pVmemBuf->isAnonMapped());
+        CHECK(pVmemBuf->write(pData, total) == total);
+
+        //blocks behind the writer come back from the swap file.
+        char *pBuf;
+        size_t size;
+        int len = 0;
+        while ((pBuf = pVmemBuf->getReadBuffer(size)) && (size > 0))
+        {
+            memmove(pRead + len, pBuf, size);
+            len += size;
+            pVmemBuf->readUsed(size);
+        }
+        CHECK(len == total);
+        CHECK(memcmp(pData, pRead, total) == 0);
+
+        CHECK(pVmemBuf->copyToBuf(pRead, 0, total) == total);
+        CHECK(memcmp(pData, pRead, total) == 0);
+
+        CHECK(pVmemBuf->flushSwapFile() == 0);
+        CHECK(pread(pVmemBuf->getfd(), pRead, total, 0) == total);
+        CHECK(memcmp(pData, pRead, total) == 0);
+
+        pVmemBuf->rewindReadBuf();
+        pBuf = pVmemBuf->getReadBuffer(size);
+        CHECK(pBuf != NULL);
+        CHECK(memcmp(pBuf, pData, size) == 0);
+        delete pVmemBuf;
+        free(pData);
+        free(pRead);
+    }
+
+    TEST(testAsyncSwapRewriteQueued)
+    {
+        if (!MultiplexerFactory::getMultiplexer())
+        {
+            Multiplexer *pMultiplexer = MultiplexerFactory::getNew(
+                MultiplexerFactory::getType("poll"));
+            CHECK(pMultiplexer != NULL);
+            pMultiplexer->init(1024);
+            MultiplexerFactory::setMultiplexer(pMultiplexer);
+        }
+        CHECK(offloader_start_shared(1) == 0);
+        struct Offloader *pOffloader = offloader_get_shared();
+        CHECK(pOffloader != NULL);
+
+        int blockSize = VMemBuf::getBlockSize();
+        int total = blockSize * 4 + 100;
+        char *pOld = (char *)malloc(total);
+        char *pNew = (char *)malloc(total);
+        char *pRead = (char *)malloc(total);
+        int i;
+        for (i = 0; i < total; ++i)
+        {
+            pOld[i] = 'a' + i % 23;
+            pNew[i] = 'A' + i % 19;
+        }
+
+        VMemBuf::setAsyncSwap(1);
+        MMapVMemBuf *pVmemBuf = new MMapVMemBuf(2 * 1024 * 1024);
+        CHECK(pVmemBuf->isMmaped() && !pVmemBuf->isAnonMapped());
+
+        //the write of the first block stays queued behind the held worker.
+        s_iOffloadFlag = 0;
+        offloader_submit(pOffloader, holdOffloader, NULL, &s_iOffloadFlag);
+        CHECK(pVmemBuf->write(pOld, blockSize + 100) == blockSize + 100);
+
+        //rewrite it while the queued write still points at it.
+        pVmemBuf->rewindReadWriteBuf();
+        CHECK(pVmemBuf->write(pNew, blockSize + 100) == blockSize + 100);
+
+        int done = 0;
+        ls_atomic_setint(&s_iOffloadFlag, 1);
+        offloader_submit(pOffloader, markOffloader, NULL, &done);
+        while (!ls_atomic_value(&done))
+            usleep(1000);
+        //the queued write went out with what it was queued with, the
+        //rewrite was not torn into it.
+        CHECK(pread(pVmemBuf->getfd(), pRead, blockSize, 0) == blockSize);
+        CHECK(memcmp(pOld, pRead, blockSize) == 0);
+
+        //moving on queues the held back write of the first block, the
+        //blocks behind the writer are then read back from the swap file.
+        CHECK(pVmemBuf->write(pNew + blockSize + 100, total - blockSize - 100)
+              == total - blockSize - 100);
+        done = 0;
+        offloader_submit(pOffloader, markOffloader, NULL, &done);
+        while (!ls_atomic_value(&done))
+            usleep(1000);
+
+        char *pBuf;
+        size_t size;
+        int len = 0;
+        while ((pBuf = pVmemBuf->getReadBuffer(size)) && (size > 0))
+        {
+            memmove(pRead + len, pBuf, size);
+            len += size;
+            pVmemBuf->readUsed(size);
+        }
+        CHECK(len == total);
+        CHECK(memcmp(pNew, pRead, total) == 0);
+
+        CHECK(pVmemBuf->flushSwapFile() == 0);
+        CHECK(pread(pVmemBuf->getfd(), pRead, total, 0) == total);
+        CHECK(memcmp(pNew, pRead, total) == 0);
+        delete pVmemBuf;
+        VMemBuf::setAsyncSwap(0);
+        free(pOld);
+        free(pNew);
+        free(pRead);
+    }
 }
 
 #endif
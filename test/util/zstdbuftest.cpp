@@ -0,0 +1,171 @@
+/*****************************************************************************
+*    Open LiteSpeed is an open source HTTP server.                           *
+*    Copyright (C) 2013 - 2020  LiteSpeed Technologies, Inc.                 *
+*                                                                            *
+*    This program is free software: you can redistribute it and/or modify    *
+*    it under the terms of the GNU General Public License as published by    *
+*    the Free Software Foundation, either version 3 of the License, or       *
+*    (at your option) any later version.                                     *
+*                                                                            *
+*    This program is distributed in the hope that it will be useful,         *
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            *
+*    GNU General Public License for more details.                            *
+*                                                                            *
+*    You should have received a copy of the GNU General Public License       *
+*    along with this program. If not, see http://www.gnu.org/licenses/.      *
+*****************************************************************************/
+#ifdef RUN_TEST
+
+#ifdef USE_ZSTD
+
+#include <util/zstdbuf.h>
+#include <util/vmembuf.h>
+#include "unittest-cpp/UnitTest++.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+static int feedBuf(VMemBuf *pSrc, ZstdBuf *pZstd)
+{
+    size_t size;
+    char *pBuf;
+    pSrc->rewindReadBuf();
+    while (((pBuf = pSrc->getReadBuffer(size)) != NULL) && (size > 0))
+    {
+        if (pZstd->write(pBuf, size) != (int)size)
+            return LS_FAIL;
+        pSrc->readUsed(size);
+    }
+    return 0;
+}
+
+
+static int sameContent(VMemBuf *pBuf, const char *pExpect, int len)
+{
+    size_t size;
+    char *p;
+    int offset = 0;
+    pBuf->rewindReadBuf();
+    while (((p = pBuf->getReadBuffer(size)) != NULL) && (size > 0))
+    {
+        if ((offset + (int)size > len) || memcmp(p, pExpect + offset, size))
+            return 0;
+        offset += size;
+        pBuf->readUsed(size);
+    }
+    return offset == len;
+}
+
+
+TEST(ZstdBufTest_testZstdRoundTrip)
+{
+    VMemBuf zsFile;
+    VMemBuf plainFile;
+    ZstdBuf zsBuf;
+    ZstdBuf unzsBuf;
+    CHECK(0 == zsFile.set("zstdbuftest.zst", -1));
+    CHECK(0 == plainFile.set("zstdbuftest.out", -1));
+    CHECK(0 == zsBuf.init(ZstdBuf::COMPRESSOR_COMPRESS, 3));
+    CHECK(0 == unzsBuf.init(ZstdBuf::COMPRESSOR_DECOMPRESS, 0));
+
+    int len = 20000 * 4;
+    char *pOrg = (char *)malloc(len);
+    for (int i = 0; i < len; i += 4)
+    {
+        int num = (i % 1024 < 512) ? i : rand();
+        memmove(pOrg + i, &num, 4);
+    }
+
+    zsBuf.setCompressCache(&zsFile);
+    CHECK(0 == zsBuf.beginStream());
+    for (int i = 0; i < len; i += 4)
+        CHECK(4 == zsBuf.write(pOrg + i, 4));
+    CHECK(0 == zsBuf.flush());
+    CHECK(0 == zsBuf.endStream());
+    CHECK(zsFile.getCurWOffset() > 0);
+    CHECK(zsFile.getCurWOffset() < len);
+
+    unzsBuf.setCompressCache(&plainFile);
+    CHECK(0 == unzsBuf.beginStream());
+    CHECK(0 == feedBuf(&zsFile, &unzsBuf));
+    CHECK(0 == unzsBuf.endStream());
+    CHECK(sameContent(&plainFile, pOrg, len));
+
+    //the level survives a reset, a second frame compresses the same way.
+    off_t firstSize = zsFile.getCurWOffset();
+    CHECK(0 == zsBuf.reset());
+    zsFile.rewindReadWriteBuf();
+    CHECK(0 == zsBuf.beginStream());
+    CHECK(len == zsBuf.write(pOrg, len));
+    CHECK(0 == zsBuf.endStream());
+    CHECK(zsFile.getCurWOffset() <= firstSize);
+
+    //a truncated frame is reported at the end of the stream.
+    CHECK(0 == unzsBuf.reset());
+    plainFile.rewindReadWriteBuf();
+    CHECK(0 == unzsBuf.beginStream());
+    CHECK(10 == unzsBuf.write(pOrg, 10) || unzsBuf.getLastError() != NULL);
+    CHECK(LS_FAIL == unzsBuf.endStream());
+
+    free(pOrg);
+    zsFile.close();
+    plainFile.close();
+    unlink("zstdbuftest.zst");
+    unlink("zstdbuftest.out");
+}
+
+
+TEST(ZstdBufTest_testZstdDictionary)
+{
+    VMemBuf zsFile;
+    VMemBuf plainFile;
+    ZstdBuf zsBuf;
+    ZstdBuf unzsBuf;
+    CHECK(0 == zsFile.set("zstdbuftest.dict.zst", -1));
+    CHECK(0 == plainFile.set("zstdbuftest.dict.out", -1));
+    CHECK(0 == zsBuf.init(ZstdBuf::COMPRESSOR_COMPRESS, 3));
+    CHECK(0 == unzsBuf.init(ZstdBuf::COMPRESSOR_DECOMPRESS, 0));
+
+    //a new version of a file differs from the old one in a few places.
+    int len = 16384;
+    char *pDict = (char *)malloc(len);
+    char *pOrg = (char *)malloc(len);
+    for (int i = 0; i < len; ++i)
+        pDict[i] = (char)rand();
+    memmove(pOrg, pDict, len);
+    for (int i = 0; i < len; i += 4096)
+        pOrg[i] ^= 0x5a;
+
+    zsBuf.setCompressCache(&zsFile);
+    CHECK(0 == zsBuf.setDictionary(pDict, len));
+    CHECK(0 == zsBuf.beginStream());
+    CHECK(len == zsBuf.write(pOrg, len));
+    CHECK(0 == zsBuf.endStream());
+    CHECK(zsFile.getCurWOffset() > 0);
+    CHECK(zsFile.getCurWOffset() < len / 16);
+
+    unzsBuf.setCompressCache(&plainFile);
+    CHECK(0 == unzsBuf.setDictionary(pDict, len));
+    CHECK(0 == unzsBuf.beginStream());
+    CHECK(0 == feedBuf(&zsFile, &unzsBuf));
+    CHECK(0 == unzsBuf.endStream());
+    CHECK(sameContent(&plainFile, pOrg, len));
+
+    //the dictionary is only good for one frame.
+    CHECK(0 == unzsBuf.reset());
+    plainFile.rewindReadWriteBuf();
+    CHECK(0 == unzsBuf.beginStream());
+    CHECK(LS_FAIL == feedBuf(&zsFile, &unzsBuf));
+
+    free(pDict);
+    free(pOrg);
+    zsFile.close();
+    plainFile.close();
+    unlink("zstdbuftest.dict.zst");
+    unlink("zstdbuftest.dict.out");
+}
+
+#endif
+#endif